@@ -0,0 +1,238 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Host microbenchmark of the software frame filter
+ *
+ * Checks the verdicts of a few known frames, then measures the cost of
+ * frame_filter_match() per frame for filters of growing size, which the
+ * serial-radio pays in the radio RX path for every received frame.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "frame_filter.h"
+
+#define NUM_FRAMES 4096
+#define ROUNDS     64
+
+#define PAN_ID     0xabcd
+#define SHORT_ADDR 0x0001
+#define EXT_ADDR   0x00124b0001020304ULL
+#define MAC_ADDR   0x00124b00a1b2c3d4ULL
+
+struct frame {
+	uint8_t psdu[127];
+	uint8_t len;
+};
+
+static void put_le(uint8_t *p, uint64_t v, size_t len)
+{
+	while (len--) {
+		*p++ = v;
+		v >>= 8;
+	}
+}
+
+/* 2006 data frame with PAN ID compression and a 20-byte payload */
+static void build_frame(struct frame *fr, uint16_t pan, uint8_t dst_mode,
+			uint64_t dst, uint8_t src_mode, uint64_t src)
+{
+	uint16_t fcf = 0x0001 | 0x0040 | (dst_mode << 10) | (1 << 12) |
+		       (src_mode << 14);
+	size_t dst_len = dst_mode == FRAME_FILTER_ADDR_EXT ? 8 : 2;
+	size_t src_len = src_mode == FRAME_FILTER_ADDR_EXT ? 8 : 2;
+	uint8_t *p = fr->psdu;
+
+	put_le(p, fcf, 2);
+	p[2] = 0x42;
+	put_le(&p[3], pan, 2);
+	put_le(&p[5], dst, dst_len);
+	put_le(&p[5 + dst_len], src, src_len);
+	fr->len = 5 + dst_len + src_len + 20 + 2;
+}
+
+static uint64_t now(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static int check(const struct frame_filter *f, const struct frame *fr,
+		 bool expected, const char *what)
+{
+	if (frame_filter_match(f, fr->psdu, fr->len) != expected) {
+		fprintf(stderr, "wrong verdict: %s\n", what);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int check_verdicts(void)
+{
+	struct frame_filter f;
+	struct frame fr;
+	int err = 0;
+
+	frame_filter_clear(&f);
+	frame_filter_set_pan_id(&f, PAN_ID);
+	frame_filter_set_short_addr(&f, SHORT_ADDR);
+	frame_filter_set_ext_addr(&f, EXT_ADDR);
+
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_SHORT, 0xffff,
+		    FRAME_FILTER_ADDR_SHORT, 7);
+	err |= check(&f, &fr, true, "broadcast");
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_EXT, EXT_ADDR,
+		    FRAME_FILTER_ADDR_EXT, 7);
+	err |= check(&f, &fr, true, "to extended address");
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_SHORT, 2,
+		    FRAME_FILTER_ADDR_SHORT, 7);
+	err |= check(&f, &fr, false, "to other short address");
+	build_frame(&fr, 0x1234, FRAME_FILTER_ADDR_SHORT, SHORT_ADDR,
+		    FRAME_FILTER_ADDR_SHORT, 7);
+	err |= check(&f, &fr, false, "other PAN");
+	fr.len = 5;
+	err |= check(&f, &fr, false, "truncated");
+
+	frame_filter_add_src(&f, true, FRAME_FILTER_ADDR_SHORT, 7);
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_SHORT, SHORT_ADDR,
+		    FRAME_FILTER_ADDR_SHORT, 7);
+	err |= check(&f, &fr, false, "denied source");
+	frame_filter_add_src(&f, false, FRAME_FILTER_ADDR_SHORT, 8);
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_SHORT, SHORT_ADDR,
+		    FRAME_FILTER_ADDR_SHORT, 8);
+	err |= check(&f, &fr, true, "allowed source");
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_SHORT, SHORT_ADDR,
+		    FRAME_FILTER_ADDR_SHORT, 9);
+	err |= check(&f, &fr, false, "source not allowed");
+
+	/* Without an extended address, the radio acknowledges its MAC */
+	frame_filter_clear(&f);
+	frame_filter_set_mac_addr(&f, MAC_ADDR);
+	frame_filter_set_short_addr(&f, SHORT_ADDR);
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_EXT, MAC_ADDR,
+		    FRAME_FILTER_ADDR_SHORT, 7);
+	err |= check(&f, &fr, true, "short address set, frame to MAC");
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_EXT, EXT_ADDR,
+		    FRAME_FILTER_ADDR_SHORT, 7);
+	err |= check(&f, &fr, false, "short address set, frame to other "
+				     "extended address");
+	frame_filter_set_ext_addr(&f, EXT_ADDR);
+	build_frame(&fr, PAN_ID, FRAME_FILTER_ADDR_EXT, MAC_ADDR,
+		    FRAME_FILTER_ADDR_SHORT, 7);
+	err |= check(&f, &fr, false, "extended address set, frame to MAC");
+	frame_filter_set_ext_addr(&f, 0);
+	err |= check(&f, &fr, true, "extended address unset, frame to MAC");
+
+	frame_filter_clear(&f);
+	frame_filter_set_types(&f, 1 << 0);
+	err |= check(&f, &fr, false, "data frame, beacons only");
+
+	return err;
+}
+
+/* Mix of broadcasts, frames to us, to others and from other PANs */
+static void build_frames(struct frame *frames)
+{
+	for (int i = 0; i < NUM_FRAMES; i++) {
+		uint64_t src = rand() % 16;
+
+		switch (rand() % 4) {
+		case 0:
+			build_frame(&frames[i], PAN_ID, FRAME_FILTER_ADDR_SHORT,
+				    0xffff, FRAME_FILTER_ADDR_SHORT, src);
+			break;
+		case 1:
+			build_frame(&frames[i], PAN_ID, FRAME_FILTER_ADDR_EXT,
+				    EXT_ADDR, FRAME_FILTER_ADDR_EXT,
+				    EXT_ADDR + src);
+			break;
+		case 2:
+			build_frame(&frames[i], PAN_ID, FRAME_FILTER_ADDR_SHORT,
+				    0x100 + src, FRAME_FILTER_ADDR_SHORT, src);
+			break;
+		default:
+			build_frame(&frames[i], 0x1234, FRAME_FILTER_ADDR_SHORT,
+				    SHORT_ADDR, FRAME_FILTER_ADDR_SHORT, src);
+			break;
+		}
+	}
+}
+
+static void bench(const char *name, const struct frame_filter *f,
+		  const struct frame *frames)
+{
+	uint64_t best = UINT64_MAX;
+	size_t passed = 0;
+
+	for (int r = 0; r < ROUNDS; r++) {
+		uint64_t start = now(), t;
+
+		passed = 0;
+		for (int i = 0; i < NUM_FRAMES; i++) {
+			passed += frame_filter_match(f, frames[i].psdu,
+						     frames[i].len);
+		}
+
+		t = now() - start;
+		best = t < best ? t : best;
+	}
+
+	printf("%-24s %10.1f %8.1f%%\n", name, (double)best / NUM_FRAMES,
+	       100.0 * passed / NUM_FRAMES);
+}
+
+int main(void)
+{
+	struct frame *frames = malloc(NUM_FRAMES * sizeof(*frames));
+	struct frame_filter f;
+
+	if (!frames || check_verdicts()) {
+		return 1;
+	}
+
+	srand(1);
+	build_frames(frames);
+
+#ifdef HAVE_TSC
+	printf("%-24s %10s %9s\n", "filter", "cyc/frame", "passed");
+#else
+	printf("%-24s %10s %9s\n", "filter", "ns/frame", "passed");
+#endif
+
+	frame_filter_clear(&f);
+	bench("none", &f, frames);
+
+	frame_filter_set_pan_id(&f, PAN_ID);
+	bench("PAN ID", &f, frames);
+
+	frame_filter_set_short_addr(&f, SHORT_ADDR);
+	frame_filter_set_ext_addr(&f, EXT_ADDR);
+	bench("PAN ID, addresses", &f, frames);
+
+	for (int i = 0; i < FRAME_FILTER_SRC_MAX; i++) {
+		frame_filter_add_src(&f, true, FRAME_FILTER_ADDR_SHORT, 16 + i);
+	}
+	bench("+ full deny list", &f, frames);
+
+	free(frames);
+
+	return 0;
+}
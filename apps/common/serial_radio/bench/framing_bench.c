@@ -0,0 +1,435 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Host microbenchmark of SLIP against COBS with CRC-16
+ *
+ * Round trips frames through both framings to check the COBS encoder
+ * and decoder across segment, window and chunk boundaries, then
+ * compares their encode and decode cost, their bytes on the wire and
+ * the resulting goodput at common line rates, and how many frames a
+ * single flipped bit lets through corrupted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "cobs.h"
+#include "slip.h"
+
+#define FRAME_SIZE  128
+#define STREAM_SIZE (2 * 1024 * 1024)
+#define ROUNDS      8
+
+/* Feed the stream in UART-sized chunks, like the firmware does */
+#define CHUNK 64
+
+struct sink {
+	/* Decoded frames keep their CRC in the storage */
+	uint8_t buf[FRAME_SIZE + COBS_CRC_LEN];
+	size_t frames;
+	uint32_t sum;
+	/* Expected frame, to count corrupted ones */
+	const uint8_t *expect;
+	size_t expect_len;
+	size_t corrupted;
+};
+
+static uint8_t *sink_alloc(void *user_data, size_t *size)
+{
+	struct sink *s = user_data;
+
+	*size = sizeof(s->buf);
+	return s->buf;
+}
+
+static void sink_frame(void *user_data, size_t len)
+{
+	struct sink *s = user_data;
+
+	s->frames++;
+	s->sum = s->sum * 31 + (uint32_t)len + (len ? s->buf[0] + s->buf[len - 1] : 0);
+
+	if (s->expect && (len != s->expect_len ||
+			  memcmp(s->buf, s->expect, len))) {
+		s->corrupted++;
+	}
+}
+
+static void sink_discard(void *user_data)
+{
+	(void)user_data;
+}
+
+static const struct slip_decoder_cb sink_cb = {
+	.alloc = sink_alloc,
+	.frame = sink_frame,
+	.discard = sink_discard,
+};
+
+static uint64_t now(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Input generation */
+
+enum pattern {
+	PATTERN_RANDOM,
+	PATTERN_SLIP_WORST,
+	PATTERN_NO_ZEROS,
+};
+
+static const char *const pattern_names[] = {
+	[PATTERN_RANDOM] = "random",
+	[PATTERN_SLIP_WORST] = "all escapes",
+	[PATTERN_NO_ZEROS] = "no zeros",
+};
+
+static void build_frames(uint8_t *out, size_t size, enum pattern pattern)
+{
+	size_t i;
+
+	srand(1);
+
+	for (i = 0; i < size; i++) {
+		switch (pattern) {
+		case PATTERN_SLIP_WORST:
+			out[i] = (i & 1) ? SLIP_ESC : SLIP_END;
+			break;
+		case PATTERN_NO_ZEROS:
+			out[i] = 1 + rand() % 255;
+			break;
+		default:
+			out[i] = rand();
+			break;
+		}
+	}
+}
+
+/* Encoders, writing into CHUNK sized windows like into the TX ring */
+
+static size_t slip_encode_frames(const uint8_t *data, size_t len,
+				 size_t frame_len, uint8_t *out)
+{
+	struct slip_encoder enc;
+	size_t off, n = 0;
+
+	for (off = 0; off + frame_len <= len; off += frame_len) {
+		slip_encoder_start(&enc, data + off, frame_len);
+
+		while (!slip_encoder_done(&enc)) {
+			n += slip_encode(&enc, out + n, CHUNK);
+		}
+	}
+
+	return n;
+}
+
+static size_t cobs_encode_frames(const uint8_t *data, size_t len,
+				 size_t frame_len, uint8_t *out)
+{
+	static struct cobs_encoder enc;
+	size_t off, n = 0;
+
+	for (off = 0; off + frame_len <= len; off += frame_len) {
+		cobs_encoder_start(&enc, data + off, frame_len);
+
+		while (!cobs_encoder_done(&enc)) {
+			n += cobs_encode(&enc, out + n, CHUNK);
+		}
+	}
+
+	return n;
+}
+
+static void slip_decode_stream(const uint8_t *data, size_t len,
+			       struct sink *s)
+{
+	struct slip_decoder dec;
+	size_t off;
+
+	slip_decoder_init(&dec, &sink_cb, s);
+
+	for (off = 0; off < len; off += CHUNK) {
+		slip_decode(&dec, data + off, len - off < CHUNK ? len - off : CHUNK);
+	}
+}
+
+static void cobs_decode_stream(const uint8_t *data, size_t len,
+			       struct sink *s)
+{
+	struct cobs_decoder dec;
+	size_t off;
+
+	cobs_decoder_init(&dec, &sink_cb, s);
+
+	for (off = 0; off < len; off += CHUNK) {
+		cobs_decode(&dec, data + off, len - off < CHUNK ? len - off : CHUNK);
+	}
+}
+
+/**
+ * Random frames, split into two segments and encoded into random
+ * windows, decoded in random chunks
+ */
+static int check_round_trip(void)
+{
+	static uint8_t frame[FRAME_SIZE];
+	static uint8_t wire[2 * FRAME_SIZE];
+	struct cobs_encoder enc;
+	struct cobs_decoder dec;
+	struct sink s;
+	int i;
+
+	memset(&s, 0, sizeof(s));
+	cobs_decoder_init(&dec, &sink_cb, &s);
+	srand(2);
+
+	for (i = 0; i < 200000; i++) {
+		size_t len = rand() % FRAME_SIZE;
+		size_t split = len ? rand() % (len + 1) : 0;
+		size_t n = 0, off;
+		int zeros = rand() % 4;
+		size_t k;
+
+		for (k = 0; k < len; k++) {
+			frame[k] = (zeros && rand() % (4 * zeros) == 0) ? 0 :
+				   rand();
+		}
+
+		cobs_encoder_begin(&enc);
+		cobs_encoder_next(&enc, frame, split, 0);
+		while (!cobs_encoder_done(&enc)) {
+			n += cobs_encode(&enc, wire + n, 1 + rand() % 16);
+		}
+		cobs_encoder_next(&enc, frame + split, len - split, 1);
+		while (!cobs_encoder_done(&enc)) {
+			n += cobs_encode(&enc, wire + n, 1 + rand() % 300);
+		}
+
+		if (n > COBS_ENCODED_MAX(len)) {
+			fprintf(stderr, "COBS frame of %zu bytes encoded to %zu\n",
+				len, n);
+			return 1;
+		}
+
+		s.expect = frame;
+		s.expect_len = len;
+		for (off = 0; off < n; ) {
+			size_t chunk = 1 + rand() % 32;
+
+			if (chunk > n - off) {
+				chunk = n - off;
+			}
+			cobs_decode(&dec, wire + off, chunk);
+			off += chunk;
+		}
+
+		if (s.frames != (size_t)i + 1 || s.corrupted) {
+			fprintf(stderr, "COBS round trip failed at frame %d "
+				"(%zu bytes)\n", i, len);
+			return 1;
+		}
+	}
+
+	printf("COBS round trip: %d frames ok\n\n", i);
+
+	return 0;
+}
+
+static int bench_speed(uint8_t *frames, uint8_t *wire)
+{
+	static const size_t frame_lens[] = { 16, 127 };
+	size_t len = STREAM_SIZE;
+	size_t f;
+	int p;
+
+#ifdef HAVE_TSC
+	printf("%-12s %5s %9s %9s %9s %9s %8s %8s\n", "input", "frame",
+	       "slip enc", "slip dec", "cobs enc", "cobs dec", "slip",
+	       "cobs");
+	printf("%-12s %5s %9s %9s %9s %9s %8s %8s\n", "", "",
+	       "B/cyc", "B/cyc", "B/cyc", "B/cyc", "wire/B", "wire/B");
+#else
+	printf("%-12s %5s %9s %9s %9s %9s %8s %8s\n", "input", "frame",
+	       "slip enc", "slip dec", "cobs enc", "cobs dec", "slip",
+	       "cobs");
+	printf("%-12s %5s %9s %9s %9s %9s %8s %8s\n", "", "",
+	       "B/ns", "B/ns", "B/ns", "B/ns", "wire/B", "wire/B");
+#endif
+
+	for (p = PATTERN_RANDOM; p <= PATTERN_NO_ZEROS; p++) {
+		build_frames(frames, len, p);
+
+		for (f = 0; f < sizeof(frame_lens) / sizeof(frame_lens[0]); f++) {
+			size_t fl = frame_lens[f];
+			size_t payload = len / fl * fl;
+			uint64_t t[4] = { UINT64_MAX, UINT64_MAX, UINT64_MAX,
+					  UINT64_MAX };
+			size_t slip_len = 0, cobs_len = 0;
+			struct sink ss, cs;
+			int r;
+
+			for (r = 0; r < ROUNDS; r++) {
+				uint64_t start, d;
+
+				start = now();
+				slip_len = slip_encode_frames(frames, len, fl, wire);
+				d = now() - start;
+				t[0] = d < t[0] ? d : t[0];
+
+				memset(&ss, 0, sizeof(ss));
+				start = now();
+				slip_decode_stream(wire, slip_len, &ss);
+				d = now() - start;
+				t[1] = d < t[1] ? d : t[1];
+
+				start = now();
+				cobs_len = cobs_encode_frames(frames, len, fl, wire);
+				d = now() - start;
+				t[2] = d < t[2] ? d : t[2];
+
+				memset(&cs, 0, sizeof(cs));
+				start = now();
+				cobs_decode_stream(wire, cobs_len, &cs);
+				d = now() - start;
+				t[3] = d < t[3] ? d : t[3];
+			}
+
+			if (ss.frames != len / fl || cs.frames != ss.frames ||
+			    cs.sum != ss.sum) {
+				fprintf(stderr, "mismatch on %s/%zu: %zu vs %zu "
+					"frames\n", pattern_names[p], fl,
+					ss.frames, cs.frames);
+				return 1;
+			}
+
+			printf("%-12s %5zu %9.3f %9.3f %9.3f %9.3f %8.3f %8.3f\n",
+			       pattern_names[p], fl,
+			       (double)payload / t[0], (double)payload / t[1],
+			       (double)payload / t[2], (double)payload / t[3],
+			       (double)slip_len / payload,
+			       (double)cobs_len / payload);
+		}
+	}
+
+	return 0;
+}
+
+/* Payload bytes per second of 127 byte frames, 10 bits per character */
+static void print_goodput(uint8_t *frames, uint8_t *wire)
+{
+	static const unsigned int bauds[] = { 115200, 1000000 };
+	size_t len = 127 * 4096;
+	int p;
+	size_t b;
+
+	printf("\n%-12s %9s %12s %12s\n", "input", "baud", "slip kB/s",
+	       "cobs kB/s");
+
+	for (p = PATTERN_RANDOM; p <= PATTERN_NO_ZEROS; p++) {
+		size_t slip_len, cobs_len;
+
+		build_frames(frames, len, p);
+		slip_len = slip_encode_frames(frames, len, 127, wire);
+		cobs_len = cobs_encode_frames(frames, len, 127, wire);
+
+		for (b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+			double chars = bauds[b] / 10.0;
+
+			printf("%-12s %9u %12.2f %12.2f\n", pattern_names[p],
+			       bauds[b], chars * len / slip_len / 1000,
+			       chars * len / cobs_len / 1000);
+		}
+	}
+}
+
+/**
+ * Flip one random bit in each encoded frame and count the frames that
+ * are delivered with wrong content
+ */
+static void bench_corruption(void)
+{
+	static uint8_t frame[64];
+	static uint8_t wire[2 * sizeof(frame) + 8];
+	const int count = 100000;
+	struct slip_decoder sdec;
+	struct cobs_decoder cdec;
+	struct cobs_encoder cenc;
+	struct slip_encoder senc;
+	struct sink ss, cs;
+	int i;
+
+	memset(&ss, 0, sizeof(ss));
+	memset(&cs, 0, sizeof(cs));
+	slip_decoder_init(&sdec, &sink_cb, &ss);
+	cobs_decoder_init(&cdec, &sink_cb, &cs);
+	srand(3);
+
+	for (i = 0; i < count; i++) {
+		size_t n, k;
+
+		for (k = 0; k < sizeof(frame); k++) {
+			frame[k] = rand();
+		}
+
+		ss.expect = cs.expect = frame;
+		ss.expect_len = cs.expect_len = sizeof(frame);
+
+		slip_encoder_start(&senc, frame, sizeof(frame));
+		n = slip_encode(&senc, wire, sizeof(wire));
+		wire[rand() % n] ^= 1 << (rand() % 8);
+		slip_decode(&sdec, wire, n);
+
+		cobs_encoder_start(&cenc, frame, sizeof(frame));
+		n = cobs_encode(&cenc, wire, sizeof(wire));
+		wire[rand() % n] ^= 1 << (rand() % 8);
+		cobs_decode(&cdec, wire, n);
+	}
+
+	printf("\n%d frames of %zu bytes, one bit flipped in each:\n", count,
+	       sizeof(frame));
+	printf("  slip  %6zu delivered, %6zu of them corrupted\n", ss.frames,
+	       ss.corrupted);
+	printf("  cobs  %6zu delivered, %6zu of them corrupted, %u CRC "
+	       "errors\n", cs.frames, cs.corrupted, cdec.crc_errors);
+}
+
+int main(void)
+{
+	uint8_t *frames = malloc(STREAM_SIZE);
+	uint8_t *wire = malloc(3 * STREAM_SIZE);
+
+	if (!frames || !wire) {
+		return 1;
+	}
+
+	if (check_round_trip() || bench_speed(frames, wire)) {
+		return 1;
+	}
+
+	print_goodput(frames, wire);
+	bench_corruption();
+
+	free(wire);
+	free(frames);
+
+	return 0;
+}
@@ -0,0 +1,490 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Host microbenchmark of the SLIP decoder
+ *
+ * Compares slip_decode() against the per-byte state machine that the
+ * serial-radio used before, which appended one byte at a time and
+ * checked allocation and tailroom for every byte. Both decoders write
+ * into the same kind of fixed-size frame buffers.
+ *
+ * The encoder section compares slip_encode(), writing into the windows
+ * of a TX ring as large as the firmware's, against the old whole-frame
+ * encode into a staging buffer that the UART drained directly. As in
+ * the firmware, a window is all contiguous space of a drained ring, or
+ * CHUNK bytes at a time while the UART is behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "slip.h"
+
+#define FRAME_SIZE   128
+#define STREAM_SIZE  (4 * 1024 * 1024)
+#define ROUNDS       8
+
+struct sink {
+	uint8_t buf[FRAME_SIZE];
+	int allocated;
+	size_t frames;
+	uint32_t sum;
+};
+
+static void sink_frame(struct sink *s, const uint8_t *data, size_t len)
+{
+	s->frames++;
+	s->sum = s->sum * 31 + (uint32_t)len + data[0] + data[len - 1];
+}
+
+/* Per-byte state machine, as previously found in slip_process_byte() */
+
+static uint8_t legacy_state = STATE_OK;
+static size_t legacy_len;
+
+static int legacy_process_byte(struct sink *s, unsigned char c)
+{
+	switch (legacy_state) {
+	case STATE_GARBAGE:
+		if (c == SLIP_END) {
+			legacy_state = STATE_OK;
+		}
+		return 0;
+
+	case STATE_ESC:
+		if (c == SLIP_ESC_END) {
+			c = SLIP_END;
+		} else if (c == SLIP_ESC_ESC) {
+			c = SLIP_ESC;
+		} else {
+			legacy_state = STATE_GARBAGE;
+			return 0;
+		}
+		legacy_state = STATE_OK;
+		break;
+
+	case STATE_OK:
+		if (c == SLIP_ESC) {
+			legacy_state = STATE_ESC;
+			return 0;
+		} else if (c == SLIP_END) {
+			return 1;
+		}
+		break;
+	}
+
+	if (!s->allocated) {
+		s->allocated = 1;
+		legacy_len = 0;
+	}
+
+	if (legacy_len == sizeof(s->buf)) {
+		s->allocated = 0;
+		return 0;
+	}
+
+	s->buf[legacy_len++] = c;
+
+	return 0;
+}
+
+static void legacy_decode(struct sink *s, const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (legacy_process_byte(s, data[i]) && s->allocated) {
+			sink_frame(s, s->buf, legacy_len);
+			s->allocated = 0;
+		}
+	}
+}
+
+/* Chunk decoder */
+
+static uint8_t *chunk_alloc(void *user_data, size_t *size)
+{
+	struct sink *s = user_data;
+
+	*size = sizeof(s->buf);
+	return s->buf;
+}
+
+static void chunk_frame(void *user_data, size_t len)
+{
+	struct sink *s = user_data;
+
+	sink_frame(s, s->buf, len);
+}
+
+static void chunk_discard(void *user_data)
+{
+	(void)user_data;
+}
+
+static const struct slip_decoder_cb chunk_cb = {
+	.alloc = chunk_alloc,
+	.frame = chunk_frame,
+	.discard = chunk_discard,
+};
+
+/* Whole-frame encoder, as previously found in slip_buffer() */
+
+static size_t legacy_encode(uint8_t *sbuf, const uint8_t *data, size_t len)
+{
+	uint8_t *sbuf_orig = sbuf;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		uint8_t byte = data[i];
+
+		switch (byte) {
+		case SLIP_END:
+			*sbuf++ = SLIP_ESC;
+			*sbuf++ = SLIP_ESC_END;
+			break;
+		case SLIP_ESC:
+			*sbuf++ = SLIP_ESC;
+			*sbuf++ = SLIP_ESC_ESC;
+			break;
+		default:
+			*sbuf++ = byte;
+		}
+	}
+
+	*sbuf++ = SLIP_END;
+
+	return sbuf - sbuf_orig;
+}
+
+/* Input generation */
+
+enum pattern {
+	PATTERN_RANDOM,
+	PATTERN_PLAIN,
+	PATTERN_ESCAPES,
+};
+
+static const char *const pattern_names[] = {
+	[PATTERN_RANDOM] = "random",
+	[PATTERN_PLAIN] = "no escapes",
+	[PATTERN_ESCAPES] = "all escapes",
+};
+
+static size_t build_stream(uint8_t *out, size_t size, enum pattern pattern,
+			   size_t frame_len)
+{
+	size_t n = 0;
+	size_t i;
+
+	srand(1);
+
+	while (n + 2 * frame_len + 1 <= size) {
+		for (i = 0; i < frame_len; i++) {
+			uint8_t c;
+
+			switch (pattern) {
+			case PATTERN_PLAIN:
+				c = rand() % SLIP_END;
+				break;
+			case PATTERN_ESCAPES:
+				c = (i & 1) ? SLIP_ESC : SLIP_END;
+				break;
+			default:
+				c = rand();
+				break;
+			}
+
+			if (c == SLIP_END) {
+				out[n++] = SLIP_ESC;
+				out[n++] = SLIP_ESC_END;
+			} else if (c == SLIP_ESC) {
+				out[n++] = SLIP_ESC;
+				out[n++] = SLIP_ESC_ESC;
+			} else {
+				out[n++] = c;
+			}
+		}
+
+		out[n++] = SLIP_END;
+	}
+
+	return n;
+}
+
+static uint64_t now(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Feed the stream in UART-sized chunks, like the firmware does */
+#define CHUNK 64
+
+static uint64_t run_legacy(const uint8_t *data, size_t len, struct sink *s)
+{
+	uint64_t start = now();
+	size_t off;
+
+	for (off = 0; off < len; off += CHUNK) {
+		legacy_decode(s, data + off, len - off < CHUNK ? len - off : CHUNK);
+	}
+
+	return now() - start;
+}
+
+static uint64_t run_chunk(const uint8_t *data, size_t len, struct sink *s)
+{
+	struct slip_decoder dec;
+	uint64_t start;
+	size_t off;
+
+	slip_decoder_init(&dec, &chunk_cb, s);
+
+	start = now();
+	for (off = 0; off < len; off += CHUNK) {
+		slip_decode(&dec, data + off, len - off < CHUNK ? len - off : CHUNK);
+	}
+
+	return now() - start;
+}
+
+static void build_frames(uint8_t *out, size_t size, enum pattern pattern)
+{
+	size_t i;
+
+	srand(1);
+
+	for (i = 0; i < size; i++) {
+		switch (pattern) {
+		case PATTERN_PLAIN:
+			out[i] = rand() % SLIP_END;
+			break;
+		case PATTERN_ESCAPES:
+			out[i] = (i & 1) ? SLIP_ESC : SLIP_END;
+			break;
+		default:
+			out[i] = rand();
+			break;
+		}
+	}
+}
+
+/* Size of the firmware's TX ring, CONFIG_WPAN_SERIAL_UART_TX_RING_SIZE */
+#define TX_RING_SIZE 256
+
+/*
+ * Encode frame_len sized frames from data. Timed runs leave the output
+ * where the UART would pick it up, with out NULL; otherwise all of it is
+ * collected in out for the round trip check.
+ */
+static uint64_t run_legacy_encode(const uint8_t *data, size_t len,
+				  size_t frame_len, uint8_t *out, size_t *out_len)
+{
+	static uint8_t staging[1 + 2 * FRAME_SIZE];
+	uint64_t start = now();
+	size_t off, n = 0;
+
+	for (off = 0; off + frame_len <= len; off += frame_len) {
+		size_t enc = legacy_encode(staging, data + off, frame_len);
+
+		/* The UART drained the staging buffer */
+		if (out) {
+			memcpy(out + n, staging, enc);
+		}
+		n += enc;
+	}
+
+	*out_len = n;
+
+	return now() - start;
+}
+
+static uint64_t run_stream_encode(const uint8_t *data, size_t len,
+				  size_t frame_len, size_t window,
+				  uint8_t *out, size_t *out_len)
+{
+	static uint8_t ring[TX_RING_SIZE];
+	struct slip_encoder enc;
+	uint64_t start = now();
+	size_t off, n = 0;
+	size_t head = 0;
+
+	for (off = 0; off + frame_len <= len; off += frame_len) {
+		slip_encoder_start(&enc, data + off, frame_len);
+
+		while (!slip_encoder_done(&enc)) {
+			size_t w;
+
+			if (out) {
+				n += slip_encode(&enc, out + n, CHUNK);
+				continue;
+			}
+
+			/* Up to window bytes of contiguous ring space */
+			w = TX_RING_SIZE - head;
+			if (w > window) {
+				w = window;
+			}
+
+			w = slip_encode(&enc, ring + head, w);
+			head = (head + w) % TX_RING_SIZE;
+			n += w;
+		}
+	}
+
+	*out_len = n;
+
+	return now() - start;
+}
+
+static int bench_encode(uint8_t *frames, uint8_t *encoded)
+{
+	static const size_t frame_lens[] = { 16, 127 };
+	size_t len = STREAM_SIZE / 2;
+	size_t f;
+	int p;
+
+#ifdef HAVE_TSC
+	printf("\n%-12s %6s %14s %14s %8s %14s %8s\n", "input", "frame",
+	       "staged B/cyc", "idle B/cyc", "speedup", "busy B/cyc",
+	       "speedup");
+#else
+	printf("\n%-12s %6s %14s %14s %8s %14s %8s\n", "input", "frame",
+	       "staged B/ns", "idle B/ns", "speedup", "busy B/ns", "speedup");
+#endif
+
+	for (p = PATTERN_RANDOM; p <= PATTERN_ESCAPES; p++) {
+		build_frames(frames, len, p);
+
+		for (f = 0; f < sizeof(frame_lens) / sizeof(frame_lens[0]); f++) {
+			uint64_t legacy = UINT64_MAX, stream = UINT64_MAX;
+			uint64_t busy = UINT64_MAX;
+			size_t legacy_len, stream_len;
+			uint32_t legacy_sum = 0;
+			struct sink cs;
+			int r;
+
+			for (r = 0; r < ROUNDS; r++) {
+				uint64_t t;
+
+				t = run_legacy_encode(frames, len, frame_lens[f],
+						      NULL, &legacy_len);
+				legacy = t < legacy ? t : legacy;
+
+				t = run_stream_encode(frames, len, frame_lens[f],
+						      TX_RING_SIZE, NULL,
+						      &stream_len);
+				stream = t < stream ? t : stream;
+
+				t = run_stream_encode(frames, len, frame_lens[f],
+						      CHUNK, NULL, &stream_len);
+				busy = t < busy ? t : busy;
+			}
+
+			/* Round trip the streamed output through the decoder */
+			run_legacy_encode(frames, len, frame_lens[f],
+					  encoded, &legacy_len);
+			run_stream_encode(frames, len, frame_lens[f], CHUNK,
+					  encoded, &stream_len);
+			memset(&cs, 0, sizeof(cs));
+			run_chunk(encoded, stream_len, &cs);
+			legacy_sum = cs.sum;
+
+			if (legacy_len != stream_len ||
+			    cs.frames != len / frame_lens[f]) {
+				fprintf(stderr, "encoder mismatch on %s/%zu\n",
+					pattern_names[p], frame_lens[f]);
+				return 1;
+			}
+
+			printf("%-12s %6zu %14.3f %14.3f %7.2fx %14.3f %7.2fx "
+			       "(sum %08x)\n", pattern_names[p], frame_lens[f],
+			       (double)len / legacy, (double)len / stream,
+			       (double)legacy / stream, (double)len / busy,
+			       (double)legacy / busy, legacy_sum);
+		}
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	static const size_t frame_lens[] = { 16, 127 };
+	uint8_t *stream = malloc(STREAM_SIZE);
+	size_t f;
+	int p;
+
+	if (!stream) {
+		return 1;
+	}
+
+#ifdef HAVE_TSC
+	printf("%-12s %6s %14s %14s %8s\n", "input", "frame",
+	       "legacy B/cyc", "chunk B/cyc", "speedup");
+#else
+	printf("%-12s %6s %14s %14s %8s\n", "input", "frame",
+	       "legacy B/ns", "chunk B/ns", "speedup");
+#endif
+
+	for (p = PATTERN_RANDOM; p <= PATTERN_ESCAPES; p++) {
+		for (f = 0; f < sizeof(frame_lens) / sizeof(frame_lens[0]); f++) {
+			size_t len = build_stream(stream, STREAM_SIZE, p,
+						  frame_lens[f]);
+			uint64_t legacy = UINT64_MAX, chunk = UINT64_MAX;
+			struct sink ls, cs;
+			int r;
+
+			for (r = 0; r < ROUNDS; r++) {
+				uint64_t t;
+
+				memset(&ls, 0, sizeof(ls));
+				memset(&cs, 0, sizeof(cs));
+				legacy_state = STATE_OK;
+
+				t = run_legacy(stream, len, &ls);
+				legacy = t < legacy ? t : legacy;
+
+				t = run_chunk(stream, len, &cs);
+				chunk = t < chunk ? t : chunk;
+			}
+
+			if (ls.frames != cs.frames || ls.sum != cs.sum) {
+				fprintf(stderr, "decoder mismatch on %s/%zu: "
+					"%zu vs %zu frames\n", pattern_names[p],
+					frame_lens[f], ls.frames, cs.frames);
+				return 1;
+			}
+
+			printf("%-12s %6zu %14.3f %14.3f %7.2fx\n",
+			       pattern_names[p], frame_lens[f],
+			       (double)len / legacy, (double)len / chunk,
+			       (double)legacy / chunk);
+		}
+	}
+
+	if (bench_encode(stream, malloc(2 * STREAM_SIZE + 1))) {
+		return 1;
+	}
+
+	free(stream);
+
+	return 0;
+}
@@ -0,0 +1,964 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Sustained load test of a border-router bridge against a fake radio
+ *
+ * Starts the bridge given on the command line on a pseudo terminal, with
+ * {pty} replaced by its path, and plays the serial-radio on the other
+ * end: "?M", "?C" credits, "!S" and "!B" reports, and the replies to the
+ * bridge's setup requests. The node has the configured address
+ * PREFIX::1234, which the bridge resolves with a neighbor solicitation.
+ * Every UDP datagram the bridge sends to it is echoed back from the node,
+ * with addresses and ports swapped. Like a Zephyr node, the fake node reassembles fragmented
+ * datagrams in a cache of --node-reass entries that time out after five
+ * seconds, and fragments its echoes. --loss drops a share of the bridge's
+ * frames as if their ACKs never came.
+ *
+ * UDP packets are then sent to the fake node through the bridge's TUN
+ * device with a fixed number in flight, and the echoes that come back
+ * through the bridge are counted. The packet rate, the round trip time
+ * and the CPU time the bridge process used per packet are reported, e.g.
+ *
+ *   ./bridge_load -- ./wpan-bridged -d {pty} -i wpanload0 -p fd00:1::
+ *   ./bridge_load -- python3 py/wpan-bridge.py -d {pty} \
+ *           -i wpanload0 -p fd00:1::
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_filter.h"
+#include "lowpan.h"
+#include "neighbor.h"
+#include "slip.h"
+
+#define SERIAL_MSG_MAX  2048
+#define SERIAL_OUT_SIZE 65536
+
+/* As CONFIG_WPAN_SERIAL_SLIP_RX_BUF_COUNT and CONFIG_WPAN_SERIAL_AGG_MAX */
+#define CREDIT_WINDOW 6
+#define AGG_MAX       8
+
+#define META_LEN 10
+
+#define IPPROTO_UDP_NH 17
+
+/* 802.15.4 frame without its FCS, and a header with extended addresses */
+#define PSDU_MAX (127 - 2)
+#define MHR_LEN  21
+
+/* Contiki MAC_TX_* status of reports, and the radio's transmissions */
+#define MAC_TX_OK       0
+#define MAC_TX_NOACK    2
+#define MAC_TX_ATTEMPTS 4
+
+/* As CONFIG_NET_L2_IEEE802154_REASSEMBLY_TIMEOUT */
+#define NODE_REASS_TIMEOUT_MS 5000
+
+/**
+ * Extended address of the fake radio and of the node it echoes for, and
+ * the node's interface identifier, configured instead of derived from
+ * its address, so the bridge must learn the node's address
+ */
+#define RADIO_MAC 0x00124b0000000001ULL
+#define NODE_MAC  0x00124b0000000002ULL
+#define NODE_IID  0x1234
+
+#define IPPROTO_ICMPV6_NH   58
+#define ND_NEIGHBOR_SOLICIT 135
+
+#define TICK_MS 100
+
+/* Payload of the load packets */
+struct probe {
+	uint32_t seq;
+	uint64_t sent_ns;
+} __attribute__((packed));
+
+static struct {
+	double duration;
+	size_t size;
+	unsigned int window;
+	const char *prefix;
+	/* The prefix is 6LoWPAN context 0, as with the bridge's --context */
+	bool context;
+	/* As the node's CONFIG_NET_L2_IEEE802154_FRAGMENT_REASS_CACHE_SIZE */
+	unsigned int node_reass;
+	/* Frames from the bridge lost, in percent */
+	int loss;
+	bool bridge_output;
+} opts = {
+	.duration = 10.0,
+	.size = 32,
+	.window = 16,
+	.prefix = "fd00:1::",
+	.node_reass = 1,
+};
+
+static int epfd;
+static int pty_fd;
+static int udp_fd;
+static int timer_fd;
+
+/* Fake radio */
+
+static struct slip_decoder slip_dec;
+static uint8_t serial_msg[SERIAL_MSG_MAX];
+
+static struct {
+	uint8_t buf[SERIAL_OUT_SIZE];
+	size_t head;
+	size_t tail;
+} out;
+
+static struct {
+	bool enabled;
+	uint16_t freed;
+	bool update;
+} credits;
+
+static struct lowpan_context contexts[LOWPAN_CONTEXTS];
+
+/* Reassembly of the node, and whether the bridge sends IPHC */
+static struct lowpan_reass node_reass;
+static bool bridge_iphc;
+static uint16_t node_tag;
+
+/* Address of the node */
+static uint8_t node_addr[16];
+
+static bool aggregate;
+static bool metadata;
+static uint8_t node_seq;
+
+/* Echoes of a "!B" batch, sent in one container once aggregation is on */
+static struct {
+	uint8_t count;
+	size_t len;
+	uint8_t buf[SERIAL_MSG_MAX];
+} container;
+
+/* Load */
+
+static struct {
+	uint64_t sent;
+	uint64_t received;
+	uint64_t rtt_sum_ns;
+	uint64_t rtt_max_ns;
+	uint32_t next_seq;
+	uint64_t progress_ns;
+} load;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void put_be16(uint16_t v, uint8_t *p)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static void put_be64(uint64_t v, uint8_t *p)
+{
+	for (int i = 7; i >= 0; i--) {
+		p[i] = v;
+		v >>= 8;
+	}
+}
+
+static void put_le(uint64_t v, uint8_t *p, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		p[i] = v;
+		v >>= 8;
+	}
+}
+
+static void pty_flush(void)
+{
+	while (out.head < out.tail) {
+		ssize_t n = write(pty_fd, &out.buf[out.head],
+				  out.tail - out.head);
+
+		if (n <= 0) {
+			break;
+		}
+		out.head += n;
+	}
+
+	if (out.head == out.tail) {
+		out.head = 0;
+		out.tail = 0;
+	}
+}
+
+/* SLIP encode a message from the radio, with the simulated LQI byte */
+static void radio_send(const uint8_t *msg, size_t len, bool lqi)
+{
+	static const uint8_t zero;
+	struct slip_encoder enc;
+
+	if (sizeof(out.buf) - out.tail < 2 * (len + 1) + 1) {
+		memmove(out.buf, &out.buf[out.head], out.tail - out.head);
+		out.tail -= out.head;
+		out.head = 0;
+	}
+
+	if (sizeof(out.buf) - out.tail < 2 * (len + 1) + 1) {
+		/* The bridge stopped reading */
+		return;
+	}
+
+	slip_encoder_begin(&enc);
+	slip_encoder_next(&enc, msg, len, !lqi);
+	out.tail += slip_encode(&enc, &out.buf[out.tail],
+				sizeof(out.buf) - out.tail);
+	if (lqi) {
+		slip_encoder_next(&enc, &zero, 1, 1);
+		out.tail += slip_encode(&enc, &out.buf[out.tail],
+					sizeof(out.buf) - out.tail);
+	}
+}
+
+static void radio_reply(const uint8_t *msg, size_t len)
+{
+	radio_send(msg, len, true);
+}
+
+static void container_begin(void)
+{
+	container.buf[0] = '!';
+	container.buf[1] = metadata ? 'Y' : 'F';
+	container.len = 3;
+	container.count = 0;
+}
+
+static void container_end(void)
+{
+	if (container.count) {
+		container.buf[2] = container.count;
+		radio_send(container.buf, container.len, false);
+	}
+	container.count = 0;
+}
+
+/* A frame to the bridge as "!X" with metadata, a raw frame or contained */
+static void radio_emit(const uint8_t *f, size_t flen)
+{
+	uint8_t msg[2 + META_LEN + PSDU_MAX] = { '!', 'X', 200, (uint8_t)-60 };
+
+	if (aggregate) {
+		/* As many frames as the firmware puts into a container */
+		if (container.count == AGG_MAX ||
+		    container.len + 1 + META_LEN + flen > sizeof(container.buf)) {
+			container_end();
+			container_begin();
+		}
+
+		container.buf[container.len++] = flen;
+		if (metadata) {
+			memcpy(&container.buf[container.len], &msg[2],
+			       META_LEN);
+			container.len += META_LEN;
+		}
+		memcpy(&container.buf[container.len], f, flen);
+		container.len += flen;
+		container.count++;
+		return;
+	}
+
+	if (metadata) {
+		put_be64(now_ns(), &msg[4]);
+		memcpy(&msg[2 + META_LEN], f, flen);
+		radio_send(msg, 2 + META_LEN + flen, false);
+	} else {
+		radio_send(f, flen, false);
+	}
+}
+
+/* Data, PAN ID compression, 2006, extended addresses, back to the sender */
+static void node_mhr(uint8_t *f, const struct frame_mhr *h)
+{
+	put_le(0xdc41, f, 2);
+	f[2] = node_seq++;
+	put_le(h->dst_pan, &f[3], 2);
+	put_le(h->src, &f[5], 8);
+	put_le(NODE_MAC, &f[13], 8);
+}
+
+/**
+ * Send a packet from the node to the sender of @p h, compressed if the
+ * bridge compresses, and fragmented if it must be
+ */
+static void node_send(const struct frame_mhr *h, const uint8_t *ip6,
+		      size_t len)
+{
+	struct lowpan_ll src = { NODE_MAC, FRAME_FILTER_ADDR_EXT };
+	struct lowpan_ll dst = { h->src, h->src_mode };
+	uint8_t f[PSDU_MAX], hdr[LOWPAN_IPHC_MAX];
+	size_t hdr_n, hdr_len = 0, n;
+	struct lowpan_frag fr;
+
+	if (bridge_iphc) {
+		hdr_n = lowpan_compress(contexts, &src, &dst, ip6, len, hdr,
+					&hdr_len);
+	} else {
+		hdr[0] = LOWPAN_DISPATCH_IPV6;
+		hdr_n = 1;
+	}
+
+	if (MHR_LEN + hdr_n + len - hdr_len <= PSDU_MAX) {
+		node_mhr(f, h);
+		memcpy(&f[MHR_LEN], hdr, hdr_n);
+		memcpy(&f[MHR_LEN + hdr_n], &ip6[hdr_len], len - hdr_len);
+		radio_emit(f, MHR_LEN + hdr_n + len - hdr_len);
+		return;
+	}
+
+	lowpan_frag_start(&fr, ip6, len, hdr, hdr_n, hdr_len, node_tag++);
+	while ((n = lowpan_frag_next(&fr, &f[MHR_LEN], PSDU_MAX - MHR_LEN))) {
+		node_mhr(f, h);
+		radio_emit(f, MHR_LEN + n);
+	}
+}
+
+/**
+ * Answer a neighbor solicitation for the node's address, and echo a UDP
+ * datagram to it back with addresses and ports swapped, which keeps the
+ * UDP checksum valid
+ */
+static void node_reply(const struct frame_mhr *h, const uint8_t *ip6,
+		       size_t len)
+{
+	static uint8_t reply[1280];
+	struct lowpan_ll ll = { NODE_MAC, FRAME_FILTER_ADDR_EXT };
+
+	if (len >= LOWPAN_IPV6_HDR_LEN + 24 && ip6[6] == IPPROTO_ICMPV6_NH &&
+	    ip6[40] == ND_NEIGHBOR_SOLICIT && !memcmp(&ip6[48], node_addr, 16)) {
+		node_send(h, reply,
+			  neighbor_advertise(reply, node_addr, &ip6[8], &ll));
+		return;
+	}
+
+	if (len < LOWPAN_IPV6_HDR_LEN + LOWPAN_UDP_HDR_LEN ||
+	    ip6[6] != IPPROTO_UDP_NH || memcmp(&ip6[24], node_addr, 16)) {
+		return;
+	}
+
+	memcpy(reply, ip6, len);
+	memcpy(&reply[8], &ip6[24], 16);
+	memcpy(&reply[24], &ip6[8], 16);
+	memcpy(&reply[40], &ip6[42], 2);
+	memcpy(&reply[42], &ip6[40], 2);
+
+	node_send(h, reply, len);
+}
+
+/* A frame from the bridge reaches the node, unicast or broadcast */
+static void node_receive(const uint8_t *psdu, size_t len)
+{
+	static uint8_t ip6[1280];
+	const uint8_t *payload;
+	size_t payload_len, consumed;
+	struct lowpan_ll src, dst;
+	struct frame_mhr h;
+	uint8_t *dgram;
+	int n;
+
+	if (!frame_mhr_parse(psdu, len, &h) || h.type != 1 ||
+	    h.src_mode != FRAME_FILTER_ADDR_EXT || len == h.hdr_len ||
+	    (h.dst_mode == FRAME_FILTER_ADDR_EXT ? h.dst != NODE_MAC :
+	     h.dst != FRAME_FILTER_BROADCAST)) {
+		return;
+	}
+
+	payload = &psdu[h.hdr_len];
+	payload_len = len - h.hdr_len;
+	src.addr = h.src;
+	src.mode = h.src_mode;
+	dst.addr = h.dst;
+	dst.mode = h.dst_mode;
+
+	switch (payload[0] & LOWPAN_DISPATCH_FRAG_MASK) {
+	case LOWPAN_DISPATCH_FRAG1:
+		bridge_iphc = payload_len > LOWPAN_FRAG1_HDR_LEN &&
+			      payload[LOWPAN_FRAG1_HDR_LEN] !=
+			      LOWPAN_DISPATCH_IPV6;
+		/* fallthrough */
+	case LOWPAN_DISPATCH_FRAGN:
+		n = lowpan_reass_add(&node_reass, contexts, &src, &dst, payload,
+				     payload_len, now_ns() / 1000000, &dgram);
+		if (n > 0) {
+			node_reply(&h, dgram, n);
+		}
+		return;
+	}
+
+	bridge_iphc = payload[0] != LOWPAN_DISPATCH_IPV6;
+	if (bridge_iphc) {
+		n = lowpan_decompress(contexts, &src, &dst, payload,
+				      payload_len, 0, ip6, &consumed);
+		if (n < 0) {
+			return;
+		}
+		memcpy(&ip6[n], &payload[consumed], payload_len - consumed);
+		node_reply(&h, ip6, n + payload_len - consumed);
+	} else {
+		node_reply(&h, &payload[1], payload_len - 1);
+	}
+}
+
+/* Report status of a frame, which is lost at the configured rate */
+static bool radio_transmit(const uint8_t *psdu, size_t len)
+{
+	if (opts.loss && rand() % 100 < opts.loss) {
+		return false;
+	}
+
+	node_receive(psdu, len);
+	return true;
+}
+
+static void radio_batch(const uint8_t *p, size_t len)
+{
+	uint8_t report[2 + 1 + 3 * AGG_MAX] = { '!', 'B' };
+	size_t off = 1;
+	uint8_t i, count = len ? p[0] : 0;
+
+	if (!count || count > AGG_MAX) {
+		return;
+	}
+
+	/* Echoes follow the report, as the nodes answer after the ACKs */
+	report[2] = count;
+	container_begin();
+	for (i = 0; i < count && off + 2 <= len; i++) {
+		bool ok = radio_transmit(&p[off + 2], p[off + 1]);
+
+		report[3 + 3 * i] = p[off];
+		report[4 + 3 * i] = ok ? MAC_TX_OK : MAC_TX_NOACK;
+		report[5 + 3 * i] = ok ? 1 : MAC_TX_ATTEMPTS;
+		off += 2 + p[off + 1];
+	}
+	radio_reply(report, 3 + 3 * count);
+	container_end();
+}
+
+static void radio_message(const uint8_t *msg, size_t len)
+{
+	uint8_t reply[2 + 16 + 2] = { '!', msg[1] };
+
+	if (len < 2) {
+		return;
+	}
+
+	if (msg[0] == '?' && msg[1] == 'M') {
+		reply[1] = 'M';
+		put_be64(RADIO_MAC, &reply[2]);
+		radio_reply(reply, 10);
+	} else if (msg[0] == '?' && msg[1] == 'C') {
+		credits.enabled = true;
+		credits.freed = 0;
+		credits.update = true;
+		/* Counted from here on, including this request */
+		msg = NULL;
+	} else if (msg[0] == '?' && msg[1] == 'L') {
+		reply[1] = 'L';
+		reply[2] = 11;
+		reply[3] = 16;
+		for (int i = 0; i < 16; i++) {
+			reply[4 + i] = (uint8_t)(-90 + (i * 7) % 13);
+		}
+		radio_reply(reply, 20);
+	} else if (msg[0] == '!' && msg[1] == 'S' && len >= 4) {
+		bool ok;
+
+		container_begin();
+		ok = radio_transmit(&msg[4 + 3 * msg[3]], len - 4 - 3 * msg[3]);
+		reply[1] = 'R';
+		reply[2] = msg[2];
+		reply[3] = ok ? MAC_TX_OK : MAC_TX_NOACK;
+		reply[4] = ok ? 1 : MAC_TX_ATTEMPTS;
+		radio_reply(reply, 5);
+		container_end();
+	} else if (msg[0] == '!' && msg[1] == 'B') {
+		radio_batch(&msg[2], len - 2);
+	} else if (msg[0] == '!' && msg[1] == 'A' && len >= 3) {
+		aggregate = msg[2];
+		reply[2] = aggregate;
+		reply[3] = AGG_MAX;
+		radio_reply(reply, 4);
+	} else if (msg[0] == '!' && msg[1] == 'E' && len >= 3) {
+		metadata = msg[2];
+		reply[2] = metadata;
+		reply[3] = 3;
+		put_be64(now_ns(), &reply[4]);
+		radio_reply(reply, 12);
+	} else if (msg[0] == '!' && msg[1] == 'J' && len >= 3) {
+		reply[2] = msg[2];
+		reply[3] = 0;
+		reply[4] = 1;
+		radio_reply(reply, 5);
+	}
+
+	if (credits.enabled) {
+		credits.freed++;
+		credits.update = true;
+	}
+}
+
+static uint8_t *slip_alloc(void *user_data, size_t *size)
+{
+	(void)user_data;
+
+	*size = sizeof(serial_msg);
+	return serial_msg;
+}
+
+static void slip_frame(void *user_data, size_t len)
+{
+	(void)user_data;
+
+	radio_message(serial_msg, len);
+}
+
+static void slip_discard(void *user_data)
+{
+	(void)user_data;
+}
+
+static const struct slip_decoder_cb slip_cb = {
+	.alloc = slip_alloc,
+	.frame = slip_frame,
+	.discard = slip_discard,
+};
+
+static void pty_read(void)
+{
+	static uint8_t chunk[4096];
+	ssize_t n = read(pty_fd, chunk, sizeof(chunk));
+
+	if (n <= 0) {
+		return;
+	}
+
+	slip_decode(&slip_dec, chunk, n);
+
+	/* One update per chunk, as the firmware coalesces them */
+	if (credits.update) {
+		uint8_t msg[6] = { '!', 'C', CREDIT_WINDOW, 0 };
+
+		put_be16(credits.freed, &msg[4]);
+		radio_reply(msg, sizeof(msg));
+		credits.update = false;
+	}
+
+	pty_flush();
+}
+
+/* Load */
+
+static void load_send(void)
+{
+	static uint8_t payload[1280];
+	struct probe *pr = (struct probe *)payload;
+
+	while (load.sent - load.received < opts.window) {
+		pr->seq = load.next_seq++;
+		pr->sent_ns = now_ns();
+		if (send(udp_fd, payload, opts.size, 0) < 0) {
+			break;
+		}
+		load.sent++;
+	}
+}
+
+static void load_receive(void)
+{
+	static uint8_t payload[1280];
+	struct probe *pr = (struct probe *)payload;
+	ssize_t n;
+
+	while ((n = recv(udp_fd, payload, sizeof(payload), 0)) > 0) {
+		uint64_t rtt;
+
+		if ((size_t)n < sizeof(*pr)) {
+			continue;
+		}
+
+		rtt = now_ns() - pr->sent_ns;
+		load.received++;
+		load.rtt_sum_ns += rtt;
+		if (rtt > load.rtt_max_ns) {
+			load.rtt_max_ns = rtt;
+		}
+		load.progress_ns = now_ns();
+	}
+}
+
+/* User and system time of a process in clock ticks */
+static uint64_t proc_cpu_ticks(pid_t pid)
+{
+	char path[64], buf[1024];
+	unsigned long utime, stime;
+	char *p;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	f = fopen(path, "r");
+	if (!f) {
+		return 0;
+	}
+
+	p = fgets(buf, sizeof(buf), f) ? strrchr(buf, ')') : NULL;
+	fclose(f);
+
+	/* Fields 14 and 15, counted from the state after the name */
+	if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+			 "%lu %lu", &utime, &stime) != 2) {
+		return 0;
+	}
+
+	return utime + stime;
+}
+
+static int pty_create(char *path, size_t size)
+{
+	struct termios tio;
+	int fd, slave;
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 ||
+	    ptsname_r(fd, path, size) != 0) {
+		perror("pty");
+		return -1;
+	}
+
+	/* Raw before the bridge opens it, so nothing is echoed meanwhile */
+	slave = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (slave < 0 || tcgetattr(slave, &tio) < 0) {
+		perror(path);
+		return -1;
+	}
+
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	/* Kept open, the master reports a hangup while no slave is */
+	return fd;
+}
+
+static pid_t bridge_start(char **argv, const char *pty)
+{
+	pid_t pid;
+	int i;
+
+	for (i = 0; argv[i]; i++) {
+		if (!strcmp(argv[i], "{pty}")) {
+			argv[i] = (char *)pty;
+		}
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		if (!opts.bridge_output) {
+			int null = open("/dev/null", O_WRONLY);
+
+			dup2(null, STDOUT_FILENO);
+		}
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+
+	return pid;
+}
+
+static int udp_open(void)
+{
+	struct sockaddr_in6 local = { .sin6_family = AF_INET6 };
+	struct sockaddr_in6 addr = {
+		.sin6_family = AF_INET6,
+		.sin6_port = htons(7),
+	};
+	int fd;
+
+	if (inet_pton(AF_INET6, opts.prefix, &addr.sin6_addr) != 1) {
+		fprintf(stderr, "Invalid prefix %s\n", opts.prefix);
+		return -1;
+	}
+
+	if (opts.context) {
+		contexts[0].valid = true;
+		memcpy(contexts[0].prefix, addr.sin6_addr.s6_addr, 8);
+	}
+
+	/* From the bridge's own address, whatever else the host has */
+	local.sin6_addr = addr.sin6_addr;
+	local.sin6_addr.s6_addr[15] = 1;
+
+	put_be64(NODE_IID, &addr.sin6_addr.s6_addr[8]);
+	memcpy(node_addr, addr.sin6_addr.s6_addr, 16);
+
+	fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("udp");
+		return -1;
+	}
+
+	/* Fails until the bridge has set up its TUN device */
+	if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+	    connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void epoll_add(int fd)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+
+	epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void report(const char *name, double elapsed, uint64_t ticks)
+{
+	double cpu_s = (double)ticks / sysconf(_SC_CLK_TCK);
+
+	printf("%s: %.1f s, %zu B UDP payload, %u in flight\n", name, elapsed,
+	       opts.size, opts.window);
+	printf("  echoed   %llu packets (%.1f packets/s each way)\n",
+	       (unsigned long long)load.received, load.received / elapsed);
+	printf("  missing  %llu packets, lost or still in flight\n",
+	       (unsigned long long)(load.sent - load.received));
+	if (load.received) {
+		printf("  RTT      avg %.2f ms, max %.2f ms\n",
+		       load.rtt_sum_ns / 1e6 / load.received,
+		       load.rtt_max_ns / 1e6);
+		printf("  bridge   CPU %.1f %%, %.1f us per packet each way\n",
+		       100.0 * cpu_s / elapsed,
+		       1e6 * cpu_s / (2.0 * load.received));
+	}
+	if (node_reass.complete || node_reass.dropped) {
+		printf("  node     %u reassembled, %u timed out, %u fragments "
+		       "dropped\n", node_reass.complete, node_reass.timeouts,
+		       node_reass.dropped);
+	}
+}
+
+static int run(pid_t pid, const char *name)
+{
+	struct itimerspec tick = {
+		.it_interval = { 0, TICK_MS * 1000000L },
+		.it_value = { 0, TICK_MS * 1000000L },
+	};
+	struct epoll_event events[4];
+	uint64_t start = 0, deadline = 0, ticks = 0;
+	uint64_t wait_until = now_ns() + 10000000000ULL;
+	int n, i;
+
+	timerfd_settime(timer_fd, 0, &tick, NULL);
+
+	while (true) {
+		n = epoll_wait(epfd, events, 4, -1);
+		for (i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+			uint64_t expired;
+
+			if (fd == pty_fd) {
+				pty_read();
+			} else if (fd == udp_fd) {
+				load_receive();
+			} else if (fd == timer_fd &&
+				   read(timer_fd, &expired, sizeof(expired)) > 0) {
+				if (waitpid(pid, NULL, WNOHANG) == pid) {
+					fprintf(stderr, "%s exited\n", name);
+					return -1;
+				}
+
+				if (!start) {
+					/* Probe until the bridge is up */
+					if (now_ns() > wait_until) {
+						fprintf(stderr, "No echo through %s\n",
+							name);
+						return -1;
+					}
+					load.sent = load.received;
+					continue;
+				}
+
+				/* Echoes lost on the way free their slots */
+				if (now_ns() - load.progress_ns > 1000000000ULL) {
+					load.sent = load.received;
+					load.progress_ns = now_ns();
+				}
+			}
+		}
+
+		if (!start && load.received) {
+			/* The first echo made it, measure from here */
+			memset(&load, 0, sizeof(load));
+			load.progress_ns = start = now_ns();
+			deadline = start + (uint64_t)(opts.duration * 1e9);
+			ticks = proc_cpu_ticks(pid);
+		}
+
+		if (start && now_ns() >= deadline) {
+			break;
+		}
+
+		load_send();
+		pty_flush();
+	}
+
+	report(name, (now_ns() - start) / 1e9, proc_cpu_ticks(pid) - ticks);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] -- BRIDGE ARGS... ({pty} is replaced)\n"
+		"  -t, --duration S   measured time (%.0f s)\n"
+		"  -s, --size BYTES   UDP payload (%zu)\n"
+		"  -w, --window N     packets in flight (%u)\n"
+		"  -p, --prefix P     prefix the bridge is given (%s)\n"
+		"  -x, --context      the prefix is 6LoWPAN context 0\n"
+		"  -r, --node-reass N datagrams the node reassembles at once (%u)\n"
+		"  -l, --loss PERCENT frames from the bridge lost (%d)\n"
+		"  -o, --output       keep the bridge's output\n",
+		prog, opts.duration, opts.size, opts.window, opts.prefix,
+		opts.node_reass, opts.loss);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option longopts[] = {
+		{ "duration", required_argument, NULL, 't' },
+		{ "size", required_argument, NULL, 's' },
+		{ "window", required_argument, NULL, 'w' },
+		{ "prefix", required_argument, NULL, 'p' },
+		{ "context", no_argument, NULL, 'x' },
+		{ "node-reass", required_argument, NULL, 'r' },
+		{ "loss", required_argument, NULL, 'l' },
+		{ "output", no_argument, NULL, 'o' },
+		{ 0 },
+	};
+	char pty[64];
+	pid_t pid;
+	int c, ret;
+
+	while ((c = getopt_long(argc, argv, "+t:s:w:p:xr:l:o", longopts,
+				NULL)) != -1) {
+		switch (c) {
+		case 't':
+			opts.duration = atof(optarg);
+			break;
+		case 's':
+			opts.size = atoi(optarg);
+			break;
+		case 'w':
+			opts.window = atoi(optarg);
+			break;
+		case 'p':
+			opts.prefix = optarg;
+			break;
+		case 'x':
+			opts.context = true;
+			break;
+		case 'r':
+			opts.node_reass = atoi(optarg);
+			break;
+		case 'l':
+			opts.loss = atoi(optarg);
+			break;
+		case 'o':
+			opts.bridge_output = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc || opts.size < sizeof(struct probe) ||
+	    opts.size > 1280 - LOWPAN_IPV6_HDR_LEN - LOWPAN_UDP_HDR_LEN ||
+	    !opts.node_reass || opts.node_reass > LOWPAN_REASS_MAX ||
+	    opts.loss < 0 || opts.loss >= 100) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	pty_fd = pty_create(pty, sizeof(pty));
+	if (pty_fd < 0) {
+		return 1;
+	}
+
+	slip_decoder_init(&slip_dec, &slip_cb, NULL);
+	lowpan_reass_init(&node_reass, opts.node_reass, NODE_REASS_TIMEOUT_MS);
+	srand(1);
+
+	pid = bridge_start(&argv[optind], pty);
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+
+	/* The TUN device takes a moment, and the route with it */
+	for (c = 0; c < 100 && (udp_fd = udp_open()) < 0; c++) {
+		usleep(100000);
+	}
+
+	if (udp_fd < 0) {
+		fprintf(stderr, "No address %s1 to send from\n", opts.prefix);
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (udp_fd < 0 || epfd < 0 || timer_fd < 0) {
+		kill(pid, SIGTERM);
+		return 1;
+	}
+
+	epoll_add(pty_fd);
+	epoll_add(udp_fd);
+	epoll_add(timer_fd);
+
+	ret = run(pid, argv[optind]);
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	return ret < 0;
+}
@@ -0,0 +1,805 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "frame_filter.h"
+#include "lowpan.h"
+
+/* First IPHC byte */
+#define IPHC_TF_SHIFT  3
+#define IPHC_NH        0x04
+#define IPHC_HLIM_MASK 0x03
+
+/* Second IPHC byte */
+#define IPHC_CID       0x80
+#define IPHC_SAC       0x40
+#define IPHC_SAM_SHIFT 4
+#define IPHC_M         0x08
+#define IPHC_DAC       0x04
+#define IPHC_DAM_SHIFT 0
+
+/* Traffic class and flow label: all inline, flow label, class, elided */
+#define TF_ALL    0
+#define TF_FL     1
+#define TF_TC     2
+#define TF_ELIDED 3
+
+/* Address modes, stateless and stateful alike */
+#define AM_FULL 0
+#define AM_64   1
+#define AM_16   2
+#define AM_LL   3
+
+/* UDP next header compression: 11110CPP */
+#define NHC_UDP      0xf0
+#define NHC_UDP_MASK 0xf8
+#define NHC_UDP_C    0x04
+
+#define IPPROTO_UDP_NH 17
+
+static const uint8_t prefix_ll[8] = { 0xfe, 0x80 };
+
+/* Interface identifier of a 16-bit address, without its last two bytes */
+static const uint8_t iid_16[6] = { 0x00, 0x00, 0x00, 0xff, 0xfe, 0x00 };
+
+static const uint8_t hlim_values[4] = { 0, 1, 64, 255 };
+
+static uint16_t get_be16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static void put_be16(uint16_t v, uint8_t *p)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static bool is_zero(const uint8_t *p, size_t len)
+{
+	while (len--) {
+		if (*p++) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Interface identifier derived from a MAC address, RFC 6282 section 3.2.2 */
+static bool ll_iid(const struct lowpan_ll *ll, uint8_t *iid)
+{
+	uint64_t v;
+	int i;
+
+	if (!ll) {
+		return false;
+	}
+
+	if (ll->mode == FRAME_FILTER_ADDR_EXT) {
+		/* EUI-64 with the universal/local bit flipped */
+		v = ll->addr ^ (2ULL << 56);
+		for (i = 7; i >= 0; i--) {
+			iid[i] = v;
+			v >>= 8;
+		}
+		return true;
+	}
+
+	if (ll->mode == FRAME_FILTER_ADDR_SHORT) {
+		memcpy(iid, iid_16, sizeof(iid_16));
+		put_be16(ll->addr, &iid[6]);
+		return true;
+	}
+
+	return false;
+}
+
+static int context_find(const struct lowpan_context *ctx, const uint8_t *addr)
+{
+	int i;
+
+	for (i = 0; ctx && i < LOWPAN_CONTEXTS; i++) {
+		if (ctx[i].valid && !memcmp(ctx[i].prefix, addr, 8)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* Inline bytes of an address whose prefix is elided, and their mode */
+static uint8_t iid_compress(const uint8_t *addr, const struct lowpan_ll *ll,
+			    uint8_t *out, size_t *len)
+{
+	uint8_t iid[8];
+
+	if (ll_iid(ll, iid) && !memcmp(&addr[8], iid, 8)) {
+		*len = 0;
+		return AM_LL;
+	}
+
+	if (!memcmp(&addr[8], iid_16, sizeof(iid_16))) {
+		memcpy(out, &addr[14], 2);
+		*len = 2;
+		return AM_16;
+	}
+
+	memcpy(out, &addr[8], 8);
+	*len = 8;
+	return AM_64;
+}
+
+/**
+ * Compress a unicast address against the link-local prefix or a context.
+ * Sets @p cid to the context used, -1 for a stateless mode.
+ */
+static uint8_t unicast_compress(const struct lowpan_context *ctx,
+				const uint8_t *addr, const struct lowpan_ll *ll,
+				int *cid, uint8_t *out, size_t *len)
+{
+	*cid = -1;
+
+	if (!memcmp(addr, prefix_ll, 8)) {
+		return iid_compress(addr, ll, out, len);
+	}
+
+	*cid = context_find(ctx, addr);
+	if (*cid >= 0) {
+		return iid_compress(addr, ll, out, len);
+	}
+
+	memcpy(out, addr, 16);
+	*len = 16;
+	return AM_FULL;
+}
+
+/* ff02::00XX, ffXX::00XX:XXXX and ffXX::00XX:XXXX:XXXX, stateless */
+static uint8_t multicast_compress(const uint8_t *addr, uint8_t *out,
+				  size_t *len)
+{
+	if (addr[1] == 0x02 && is_zero(&addr[2], 13)) {
+		out[0] = addr[15];
+		*len = 1;
+		return AM_LL;
+	}
+
+	if (is_zero(&addr[2], 11)) {
+		out[0] = addr[1];
+		memcpy(&out[1], &addr[13], 3);
+		*len = 4;
+		return AM_16;
+	}
+
+	if (is_zero(&addr[2], 9)) {
+		out[0] = addr[1];
+		memcpy(&out[1], &addr[11], 5);
+		*len = 6;
+		return AM_64;
+	}
+
+	memcpy(out, addr, 16);
+	*len = 16;
+	return AM_FULL;
+}
+
+/* Ports in 4, 8 or 16 bits, then the checksum */
+static size_t udp_compress(const uint8_t *udp, uint8_t *out)
+{
+	uint16_t sport = get_be16(&udp[0]);
+	uint16_t dport = get_be16(&udp[2]);
+	size_t off = 1;
+
+	if ((sport >> 4) == 0xf0b && (dport >> 4) == 0xf0b) {
+		out[0] = NHC_UDP | 3;
+		out[off++] = ((sport & 0xf) << 4) | (dport & 0xf);
+	} else if ((sport >> 8) == 0xf0) {
+		out[0] = NHC_UDP | 2;
+		out[off++] = sport;
+		put_be16(dport, &out[off]);
+		off += 2;
+	} else if ((dport >> 8) == 0xf0) {
+		out[0] = NHC_UDP | 1;
+		put_be16(sport, &out[off]);
+		off += 2;
+		out[off++] = dport;
+	} else {
+		out[0] = NHC_UDP;
+		memcpy(&out[off], udp, 4);
+		off += 4;
+	}
+
+	/* Carried inline like Zephyr does, eliding it needs an upper layer */
+	memcpy(&out[off], &udp[6], 2);
+
+	return off + 2;
+}
+
+size_t lowpan_compress(const struct lowpan_context *ctx,
+		       const struct lowpan_ll *src, const struct lowpan_ll *dst,
+		       const uint8_t *ip6, size_t len, uint8_t *out,
+		       size_t *hdr_len)
+{
+	uint8_t tc, ecn, dscp, sam, dam, hlim;
+	uint8_t saddr[16], daddr[16];
+	size_t slen, dlen, off = 2;
+	int scid, dcid = -1;
+	uint32_t fl;
+	bool nhc;
+
+	if (len < LOWPAN_IPV6_HDR_LEN || (ip6[0] >> 4) != 6) {
+		return 0;
+	}
+
+	out[0] = LOWPAN_DISPATCH_IPHC;
+	out[1] = 0;
+
+	/* Compressed before anything is written, they decide the CID byte */
+	if (is_zero(&ip6[8], 16)) {
+		scid = -1;
+		sam = AM_FULL;
+		slen = 0;
+		out[1] |= IPHC_SAC;
+	} else {
+		sam = unicast_compress(ctx, &ip6[8], src, &scid, saddr, &slen);
+	}
+
+	if (ip6[24] == 0xff) {
+		dam = multicast_compress(&ip6[24], daddr, &dlen);
+		out[1] |= IPHC_M;
+	} else {
+		dam = unicast_compress(ctx, &ip6[24], dst, &dcid, daddr, &dlen);
+	}
+
+	if (scid >= 0) {
+		out[1] |= IPHC_SAC;
+	}
+	if (dcid >= 0) {
+		out[1] |= IPHC_DAC;
+	}
+	out[1] |= (sam << IPHC_SAM_SHIFT) | (dam << IPHC_DAM_SHIFT);
+
+	if (scid > 0 || dcid > 0) {
+		out[1] |= IPHC_CID;
+		out[off++] = ((scid > 0 ? scid : 0) << 4) | (dcid > 0 ? dcid : 0);
+	}
+
+	/* The traffic class is DSCP and ECN, inline it is ECN and DSCP */
+	tc = (ip6[0] << 4) | (ip6[1] >> 4);
+	ecn = tc & 3;
+	dscp = tc >> 2;
+	fl = ((uint32_t)(ip6[1] & 0x0f) << 16) | (ip6[2] << 8) | ip6[3];
+
+	if (!tc && !fl) {
+		out[0] |= TF_ELIDED << IPHC_TF_SHIFT;
+	} else if (!fl) {
+		out[0] |= TF_TC << IPHC_TF_SHIFT;
+		out[off++] = (ecn << 6) | dscp;
+	} else if (!dscp) {
+		out[0] |= TF_FL << IPHC_TF_SHIFT;
+		out[off++] = (ecn << 6) | (fl >> 16);
+		out[off++] = fl >> 8;
+		out[off++] = fl;
+	} else {
+		out[off++] = (ecn << 6) | dscp;
+		out[off++] = fl >> 16;
+		out[off++] = fl >> 8;
+		out[off++] = fl;
+	}
+
+	nhc = ip6[6] == IPPROTO_UDP_NH &&
+	      len >= LOWPAN_IPV6_HDR_LEN + LOWPAN_UDP_HDR_LEN;
+	if (nhc) {
+		out[0] |= IPHC_NH;
+	} else {
+		out[off++] = ip6[6];
+	}
+
+	hlim = ip6[7];
+	if (hlim == 1 || hlim == 64 || hlim == 255) {
+		out[0] |= hlim == 1 ? 1 : hlim == 64 ? 2 : 3;
+	} else {
+		out[off++] = hlim;
+	}
+
+	memcpy(&out[off], saddr, slen);
+	off += slen;
+	memcpy(&out[off], daddr, dlen);
+	off += dlen;
+
+	*hdr_len = LOWPAN_IPV6_HDR_LEN;
+	if (nhc) {
+		off += udp_compress(&ip6[LOWPAN_IPV6_HDR_LEN], &out[off]);
+		*hdr_len += LOWPAN_UDP_HDR_LEN;
+	}
+
+	return off;
+}
+
+static int iid_decompress(uint8_t mode, const struct lowpan_ll *ll,
+			  const uint8_t *in, size_t left, uint8_t *addr,
+			  size_t *off)
+{
+	switch (mode) {
+	case AM_64:
+		if (left < 8) {
+			return -1;
+		}
+		memcpy(&addr[8], in, 8);
+		*off += 8;
+		return 0;
+	case AM_16:
+		if (left < 2) {
+			return -1;
+		}
+		memcpy(&addr[8], iid_16, sizeof(iid_16));
+		memcpy(&addr[14], in, 2);
+		*off += 2;
+		return 0;
+	default:
+		return ll_iid(ll, &addr[8]) ? 0 : -1;
+	}
+}
+
+/* Address with a stateless or context based prefix, RFC 6282 3.1.1 */
+static int unicast_decompress(const struct lowpan_context *ctx, bool stateful,
+			      uint8_t cid, uint8_t mode,
+			      const struct lowpan_ll *ll, const uint8_t *in,
+			      size_t left, uint8_t *addr, size_t *off)
+{
+	if (mode == AM_FULL) {
+		if (left < 16) {
+			return -1;
+		}
+		memcpy(addr, in, 16);
+		*off += 16;
+		return 0;
+	}
+
+	if (!stateful) {
+		memcpy(addr, prefix_ll, 8);
+	} else if (ctx && ctx[cid].valid) {
+		memcpy(addr, ctx[cid].prefix, 8);
+	} else {
+		return -1;
+	}
+
+	return iid_decompress(mode, ll, in, left, addr, off);
+}
+
+static int multicast_decompress(uint8_t mode, const uint8_t *in, size_t left,
+				uint8_t *addr, size_t *off)
+{
+	static const uint8_t inline_len[4] = { 16, 6, 4, 1 };
+	size_t n = inline_len[mode];
+
+	if (left < n) {
+		return -1;
+	}
+
+	memset(addr, 0, 16);
+	addr[0] = 0xff;
+	if (mode == AM_FULL) {
+		memcpy(addr, in, 16);
+	} else if (mode == AM_LL) {
+		addr[1] = 0x02;
+		addr[15] = in[0];
+	} else {
+		addr[1] = in[0];
+		memcpy(&addr[16 - (n - 1)], &in[1], n - 1);
+	}
+
+	*off += n;
+	return 0;
+}
+
+static int udp_decompress(const uint8_t *in, size_t len, size_t *off,
+			  uint8_t *udp)
+{
+	uint8_t nhc;
+	size_t need;
+
+	if (*off >= len || (in[*off] & NHC_UDP_MASK) != NHC_UDP) {
+		/* Extension header compression is not supported */
+		return -1;
+	}
+
+	nhc = in[(*off)++];
+	need = ((nhc & 3) == 3 ? 1 : (nhc & 3) ? 3 : 4) +
+	       (nhc & NHC_UDP_C ? 0 : 2);
+	if (len - *off < need) {
+		return -1;
+	}
+
+	in += *off;
+	switch (nhc & 3) {
+	case 3:
+		put_be16(0xf0b0 | (in[0] >> 4), &udp[0]);
+		put_be16(0xf0b0 | (in[0] & 0xf), &udp[2]);
+		in += 1;
+		break;
+	case 2:
+		put_be16(0xf000 | in[0], &udp[0]);
+		memcpy(&udp[2], &in[1], 2);
+		in += 3;
+		break;
+	case 1:
+		memcpy(&udp[0], &in[0], 2);
+		put_be16(0xf000 | in[2], &udp[2]);
+		in += 3;
+		break;
+	default:
+		memcpy(udp, in, 4);
+		in += 4;
+		break;
+	}
+
+	if (nhc & NHC_UDP_C) {
+		memset(&udp[6], 0, 2);
+	} else {
+		memcpy(&udp[6], in, 2);
+	}
+
+	*off += need;
+	return 0;
+}
+
+int lowpan_decompress(const struct lowpan_context *ctx,
+		      const struct lowpan_ll *src, const struct lowpan_ll *dst,
+		      const uint8_t *in, size_t len, size_t datagram_len,
+		      uint8_t *ip6, size_t *consumed)
+{
+	uint8_t tf, sam, dam, scid = 0, dcid = 0;
+	size_t off = 2, hdr = LOWPAN_IPV6_HDR_LEN, total;
+	uint8_t ecn = 0, dscp = 0;
+	uint32_t fl = 0;
+	bool nhc;
+
+	if (len < 2 || (in[0] & LOWPAN_DISPATCH_IPHC_MASK) !=
+			       LOWPAN_DISPATCH_IPHC) {
+		return -1;
+	}
+
+	if (in[1] & IPHC_CID) {
+		if (off >= len) {
+			return -1;
+		}
+		scid = in[off] >> 4;
+		dcid = in[off] & 0xf;
+		off++;
+	}
+
+	tf = (in[0] >> IPHC_TF_SHIFT) & 3;
+	if (len - off < (size_t)(tf == TF_ALL ? 4 : tf == TF_FL ? 3 :
+				  tf == TF_TC ? 1 : 0)) {
+		return -1;
+	}
+
+	switch (tf) {
+	case TF_ALL:
+		ecn = in[off] >> 6;
+		dscp = in[off] & 0x3f;
+		fl = ((uint32_t)(in[off + 1] & 0x0f) << 16) |
+		     (in[off + 2] << 8) | in[off + 3];
+		off += 4;
+		break;
+	case TF_FL:
+		ecn = in[off] >> 6;
+		fl = ((uint32_t)(in[off] & 0x0f) << 16) |
+		     (in[off + 1] << 8) | in[off + 2];
+		off += 3;
+		break;
+	case TF_TC:
+		ecn = in[off] >> 6;
+		dscp = in[off] & 0x3f;
+		off += 1;
+		break;
+	}
+
+	ip6[0] = 0x60 | (dscp >> 2);
+	ip6[1] = ((dscp & 3) << 6) | (ecn << 4) | (fl >> 16);
+	ip6[2] = fl >> 8;
+	ip6[3] = fl;
+
+	nhc = in[0] & IPHC_NH;
+	if (nhc) {
+		ip6[6] = IPPROTO_UDP_NH;
+	} else {
+		if (off >= len) {
+			return -1;
+		}
+		ip6[6] = in[off++];
+	}
+
+	if (in[0] & IPHC_HLIM_MASK) {
+		ip6[7] = hlim_values[in[0] & IPHC_HLIM_MASK];
+	} else {
+		if (off >= len) {
+			return -1;
+		}
+		ip6[7] = in[off++];
+	}
+
+	sam = (in[1] >> IPHC_SAM_SHIFT) & 3;
+	if ((in[1] & IPHC_SAC) && sam == AM_FULL) {
+		/* The unspecified address */
+		memset(&ip6[8], 0, 16);
+	} else if (unicast_decompress(ctx, in[1] & IPHC_SAC, scid, sam, src,
+				      &in[off], len - off, &ip6[8], &off) < 0) {
+		return -1;
+	}
+
+	dam = (in[1] >> IPHC_DAM_SHIFT) & 3;
+	if (in[1] & IPHC_M) {
+		/* Unicast-prefix based multicast addresses are not supported */
+		if ((in[1] & IPHC_DAC) ||
+		    multicast_decompress(dam, &in[off], len - off, &ip6[24],
+					 &off) < 0) {
+			return -1;
+		}
+	} else if (((in[1] & IPHC_DAC) && dam == AM_FULL) ||
+		   unicast_decompress(ctx, in[1] & IPHC_DAC, dcid, dam, dst,
+				      &in[off], len - off, &ip6[24], &off) < 0) {
+		return -1;
+	}
+
+	if (nhc) {
+		if (udp_decompress(in, len, &off, &ip6[LOWPAN_IPV6_HDR_LEN]) < 0) {
+			return -1;
+		}
+		hdr += LOWPAN_UDP_HDR_LEN;
+	}
+
+	total = datagram_len ? datagram_len : hdr + (len - off);
+	if (total < hdr || total - LOWPAN_IPV6_HDR_LEN > 0xffff) {
+		return -1;
+	}
+
+	put_be16(total - LOWPAN_IPV6_HDR_LEN, &ip6[4]);
+	if (nhc) {
+		put_be16(total - LOWPAN_IPV6_HDR_LEN,
+			 &ip6[LOWPAN_IPV6_HDR_LEN + 4]);
+	}
+
+	*consumed = off;
+	return hdr;
+}
+
+void lowpan_frag_start(struct lowpan_frag *fr, const uint8_t *ip6, size_t len,
+		       const uint8_t *hdr, size_t hdr_n, size_t hdr_len,
+		       uint16_t tag)
+{
+	fr->ip6 = ip6;
+	fr->len = len;
+	memcpy(fr->hdr, hdr, hdr_n);
+	fr->hdr_n = hdr_n;
+	fr->hdr_len = hdr_len;
+	fr->tag = tag;
+	fr->offset = 0;
+}
+
+/* All but the last fragment end at a multiple of 8 bytes of the datagram */
+size_t lowpan_frag_next(struct lowpan_frag *fr, uint8_t *out, size_t room)
+{
+	size_t hdr = fr->offset ? LOWPAN_FRAGN_HDR_LEN : LOWPAN_FRAG1_HDR_LEN;
+	size_t start = fr->offset ? fr->offset : fr->hdr_len;
+	size_t n;
+
+	if (fr->offset >= fr->len ||
+	    room < hdr + (fr->offset ? 0 : fr->hdr_n) + 8) {
+		return 0;
+	}
+
+	out[0] = (fr->offset ? LOWPAN_DISPATCH_FRAGN : LOWPAN_DISPATCH_FRAG1) |
+		 ((fr->len >> 8) & 0x07);
+	out[1] = fr->len;
+	put_be16(fr->tag, &out[2]);
+
+	if (fr->offset) {
+		out[4] = fr->offset / 8;
+	} else {
+		memcpy(&out[hdr], fr->hdr, fr->hdr_n);
+		hdr += fr->hdr_n;
+	}
+
+	n = room - hdr;
+	if (start + n >= fr->len) {
+		n = fr->len - start;
+	} else {
+		n = ((start + n) & ~(size_t)7) - start;
+	}
+
+	memcpy(&out[hdr], &fr->ip6[start], n);
+	fr->offset = start + n;
+
+	return hdr + n;
+}
+
+void lowpan_reass_init(struct lowpan_reass *r, size_t slots,
+		       uint32_t timeout_ms)
+{
+	memset(r, 0, sizeof(*r));
+	r->slots = slots < LOWPAN_REASS_MAX ? slots : LOWPAN_REASS_MAX;
+	r->timeout_ms = timeout_ms;
+}
+
+size_t lowpan_reass_expire(struct lowpan_reass *r, uint64_t now)
+{
+	size_t used = 0;
+
+	for (size_t i = 0; i < r->slots; i++) {
+		if (r->e[i].used && r->e[i].expires <= now) {
+			r->e[i].used = false;
+			r->timeouts++;
+		}
+		used += r->e[i].used;
+	}
+
+	return used;
+}
+
+static struct lowpan_reass_entry *reass_find(struct lowpan_reass *r,
+					     const struct lowpan_ll *src,
+					     uint16_t tag, uint16_t size,
+					     uint64_t now)
+{
+	struct lowpan_reass_entry *free_entry = NULL;
+
+	lowpan_reass_expire(r, now);
+
+	for (size_t i = 0; i < r->slots; i++) {
+		struct lowpan_reass_entry *e = &r->e[i];
+
+		if (!e->used) {
+			free_entry = free_entry ? free_entry : e;
+		} else if (e->tag == tag && e->size == size &&
+			   e->src.addr == src->addr &&
+			   e->src.mode == src->mode) {
+			return e;
+		}
+	}
+
+	if (free_entry) {
+		free_entry->used = true;
+		free_entry->src = *src;
+		free_entry->tag = tag;
+		free_entry->size = size;
+		free_entry->expires = now + r->timeout_ms;
+		memset(free_entry->units, 0, sizeof(free_entry->units));
+	}
+
+	return free_entry;
+}
+
+/* Mark the units of [start, end), false if they are not all new */
+static bool reass_mark(struct lowpan_reass_entry *e, size_t start, size_t end)
+{
+	bool fresh = true;
+
+	for (size_t u = start / 8; u < (end + 7) / 8; u++) {
+		fresh &= !(e->units[u / 8] & (1 << (u % 8)));
+		e->units[u / 8] |= 1 << (u % 8);
+	}
+
+	return fresh;
+}
+
+static bool reass_complete(const struct lowpan_reass_entry *e)
+{
+	for (size_t u = 0; u < (e->size + 7u) / 8; u++) {
+		if (!(e->units[u / 8] & (1 << (u % 8)))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int lowpan_reass_add(struct lowpan_reass *r, const struct lowpan_context *ctx,
+		     const struct lowpan_ll *src, const struct lowpan_ll *dst,
+		     const uint8_t *frag, size_t len, uint64_t now,
+		     uint8_t **ip6)
+{
+	bool first = (frag[0] & LOWPAN_DISPATCH_FRAG_MASK) ==
+		     LOWPAN_DISPATCH_FRAG1;
+	size_t hdr = first ? LOWPAN_FRAG1_HDR_LEN : LOWPAN_FRAGN_HDR_LEN;
+	uint8_t headers[LOWPAN_IPV6_HDR_LEN + LOWPAN_UDP_HDR_LEN];
+	struct lowpan_reass_entry *e;
+	size_t start, end, consumed = 0;
+	uint16_t size, tag;
+	int n = 0;
+
+	if (len <= hdr) {
+		r->dropped++;
+		return -1;
+	}
+
+	size = ((frag[0] & 0x07) << 8) | frag[1];
+	tag = get_be16(&frag[2]);
+	frag += hdr;
+	len -= hdr;
+
+	if (size < LOWPAN_IPV6_HDR_LEN || size > LOWPAN_REASS_SIZE_MAX) {
+		r->dropped++;
+		return -1;
+	}
+
+	if (first && frag[0] == LOWPAN_DISPATCH_IPV6) {
+		consumed = 1;
+	} else if (first) {
+		n = lowpan_decompress(ctx, src, dst, frag, len, size, headers,
+				      &consumed);
+	}
+
+	start = first ? 0 : (size_t)frag[-1] * 8;
+	end = first ? n + len - consumed : start + len;
+
+	/* Only the last fragment may end between two units */
+	if (n < 0 || end > size || (end % 8 && end != size)) {
+		r->dropped++;
+		return -1;
+	}
+
+	e = reass_find(r, src, tag, size, now);
+	if (!e) {
+		r->dropped++;
+		return -1;
+	}
+
+	if (!reass_mark(e, start, end)) {
+		/* A repeated fragment, e.g. after a lost ACK */
+		return 0;
+	}
+
+	if (first) {
+		memcpy(e->buf, headers, n);
+		memcpy(&e->buf[n], &frag[consumed], len - consumed);
+	} else {
+		memcpy(&e->buf[start], frag, len);
+	}
+
+	if (!reass_complete(e)) {
+		return 0;
+	}
+
+	e->used = false;
+	r->complete++;
+	lowpan_udp_checksum(e->buf, e->size);
+	*ip6 = e->buf;
+
+	return e->size;
+}
+
+void lowpan_udp_checksum(uint8_t *ip6, size_t len)
+{
+	uint8_t *udp = &ip6[LOWPAN_IPV6_HDR_LEN];
+	uint32_t sum;
+	size_t i;
+
+	if (len < LOWPAN_IPV6_HDR_LEN + LOWPAN_UDP_HDR_LEN ||
+	    ip6[6] != IPPROTO_UDP_NH || udp[6] || udp[7]) {
+		return;
+	}
+
+	/* Pseudo header: addresses, upper-layer length and next header */
+	sum = (len - LOWPAN_IPV6_HDR_LEN) + IPPROTO_UDP_NH;
+	for (i = 8; i < LOWPAN_IPV6_HDR_LEN; i += 2) {
+		sum += get_be16(&ip6[i]);
+	}
+
+	for (i = 0; i + 1 < len - LOWPAN_IPV6_HDR_LEN; i += 2) {
+		sum += get_be16(&udp[i]);
+	}
+	if ((len - LOWPAN_IPV6_HDR_LEN) & 1) {
+		sum += udp[i] << 8;
+	}
+
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+
+	sum = ~sum & 0xffff;
+	put_be16(sum ? sum : 0xffff, &udp[6]);
+}
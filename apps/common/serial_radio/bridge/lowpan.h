@@ -0,0 +1,210 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief 6LoWPAN IPHC header compression (RFC 6282) and fragmentation
+ *        (RFC 4944) for the bridge
+ *
+ * Compresses the IPv6 header and a following UDP header (NHC) of packets
+ * to the radio, and decompresses those of received frames. Addresses are
+ * elided against the link-local prefix or a context and the MAC addresses
+ * of the frame. Fields are laid out as Zephyr's 6LoWPAN layer does, so
+ * that the nodes' compressor and the bridge's produce the same bytes:
+ * the UDP checksum is always carried inline, and extension headers are
+ * left uncompressed.
+ *
+ * Datagrams that do not fit into a frame are sent as a FRAG1 fragment
+ * with the compressed headers, followed by FRAGN fragments. Received
+ * fragments are reassembled in a cache of a fixed number of datagrams.
+ */
+
+#ifndef SERIAL_RADIO_BRIDGE_LOWPAN_H_
+#define SERIAL_RADIO_BRIDGE_LOWPAN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Dispatch of an uncompressed IPv6 header and of IPHC */
+#define LOWPAN_DISPATCH_IPV6      0x41
+#define LOWPAN_DISPATCH_IPHC      0x60
+#define LOWPAN_DISPATCH_IPHC_MASK 0xe0
+
+#define LOWPAN_CONTEXTS 16
+
+/* Largest compressed header: IPHC, CID, TF, HLIM, addresses and NHC UDP */
+#define LOWPAN_IPHC_MAX 48
+
+#define LOWPAN_IPV6_HDR_LEN 40
+#define LOWPAN_UDP_HDR_LEN  8
+
+/* Fragment headers: dispatch and datagram size, tag, and FRAGN offset */
+#define LOWPAN_DISPATCH_FRAG1     0xc0
+#define LOWPAN_DISPATCH_FRAGN     0xe0
+#define LOWPAN_DISPATCH_FRAG_MASK 0xf8
+#define LOWPAN_FRAG1_HDR_LEN      4
+#define LOWPAN_FRAGN_HDR_LEN      5
+
+/* Datagrams being reassembled at once, and their largest size */
+#define LOWPAN_REASS_MAX      8
+#define LOWPAN_REASS_SIZE_MAX 1280
+
+/* Link-layer address of a frame, modes as in struct frame_mhr */
+struct lowpan_ll {
+	/* Extended addresses in host order, short ones in the low bits */
+	uint64_t addr;
+	uint8_t mode;
+};
+
+/* Prefix of a compression context, only /64 contexts are supported */
+struct lowpan_context {
+	bool valid;
+	uint8_t prefix[8];
+};
+
+/* A datagram being sent in fragments */
+struct lowpan_frag {
+	const uint8_t *ip6;
+	size_t len;
+	/* Compressed headers or the uncompressed dispatch, for FRAG1 */
+	uint8_t hdr[LOWPAN_IPHC_MAX];
+	size_t hdr_n;
+	/* Bytes of the datagram they replace */
+	size_t hdr_len;
+	uint16_t tag;
+	/* Bytes of the datagram sent so far */
+	size_t offset;
+};
+
+struct lowpan_reass_entry {
+	bool used;
+	struct lowpan_ll src;
+	uint16_t tag;
+	uint16_t size;
+	uint64_t expires;
+	/* Received 8-byte units of the datagram */
+	uint8_t units[LOWPAN_REASS_SIZE_MAX / 8 / 8];
+	uint8_t buf[LOWPAN_REASS_SIZE_MAX];
+};
+
+/**
+ * Reassembly cache, keyed on the source address, the tag and the size of
+ * the datagram like in RFC 4944 section 5.3. Its memory is bounded by
+ * the number of entries, and an entry is dropped once its timeout passed.
+ */
+struct lowpan_reass {
+	/* Entries in use at most, up to LOWPAN_REASS_MAX */
+	size_t slots;
+	uint32_t timeout_ms;
+	struct lowpan_reass_entry e[LOWPAN_REASS_MAX];
+
+	/** Datagrams reassembled */
+	uint32_t complete;
+	/** Datagrams dropped incomplete when their timeout passed */
+	uint32_t timeouts;
+	/** Fragments dropped: no free entry, too large or malformed */
+	uint32_t dropped;
+};
+
+/**
+ * @brief Compress the headers of an IPv6 packet
+ *
+ * @param ctx     LOWPAN_CONTEXTS contexts, or NULL for none
+ * @param src     Source address of the frame
+ * @param dst     Destination address of the frame
+ * @param ip6     IPv6 packet
+ * @param len     Length of @p ip6
+ * @param out     At least LOWPAN_IPHC_MAX bytes for the compressed headers
+ * @param hdr_len Bytes of @p ip6 replaced by them, the payload follows
+ *
+ * @return Bytes written to @p out, 0 if @p ip6 is not an IPv6 packet
+ */
+size_t lowpan_compress(const struct lowpan_context *ctx,
+		       const struct lowpan_ll *src, const struct lowpan_ll *dst,
+		       const uint8_t *ip6, size_t len, uint8_t *out,
+		       size_t *hdr_len);
+
+/**
+ * @brief Decompress IPHC headers
+ *
+ * Writes the IPv6 header, and the UDP header if it was compressed. The
+ * payload of the datagram follows the compressed headers in @p in. An
+ * elided UDP checksum is left 0, see lowpan_udp_checksum().
+ *
+ * @param datagram_len Size of the uncompressed datagram, or 0 if it ends
+ *                     with @p in
+ * @param ip6          At least LOWPAN_IPV6_HDR_LEN + LOWPAN_UDP_HDR_LEN
+ *                     bytes
+ * @param consumed     Bytes of @p in that held the compressed headers
+ *
+ * @return Bytes written to @p ip6, negative if the headers are malformed
+ *         or use a context or a compression that is not supported
+ */
+int lowpan_decompress(const struct lowpan_context *ctx,
+		      const struct lowpan_ll *src, const struct lowpan_ll *dst,
+		      const uint8_t *in, size_t len, size_t datagram_len,
+		      uint8_t *ip6, size_t *consumed);
+
+/**
+ * @brief Start sending a datagram in fragments
+ *
+ * @param hdr     Headers as compressed by lowpan_compress(), or just
+ *                LOWPAN_DISPATCH_IPV6
+ * @param hdr_len Bytes of @p ip6 they replace
+ */
+void lowpan_frag_start(struct lowpan_frag *fr, const uint8_t *ip6, size_t len,
+		       const uint8_t *hdr, size_t hdr_n, size_t hdr_len,
+		       uint16_t tag);
+
+/**
+ * @brief Write the next fragment
+ *
+ * @param room Space for the fragment in the frame
+ *
+ * @return Bytes written to @p out, 0 once all fragments are written
+ */
+size_t lowpan_frag_next(struct lowpan_frag *fr, uint8_t *out, size_t room);
+
+void lowpan_reass_init(struct lowpan_reass *r, size_t slots,
+		       uint32_t timeout_ms);
+
+/**
+ * @brief Add a received FRAG1 or FRAGN fragment
+ *
+ * @param now  Time in milliseconds, for the timeout
+ * @param ip6  Set to the datagram once it is complete, valid until the
+ *             next call
+ *
+ * @return Size of the complete datagram, 0 if fragments are missing,
+ *         negative if the fragment was dropped
+ */
+int lowpan_reass_add(struct lowpan_reass *r, const struct lowpan_context *ctx,
+		     const struct lowpan_ll *src, const struct lowpan_ll *dst,
+		     const uint8_t *frag, size_t len, uint64_t now,
+		     uint8_t **ip6);
+
+/**
+ * @brief Drop the datagrams whose timeout passed
+ *
+ * @return Entries still in use
+ */
+size_t lowpan_reass_expire(struct lowpan_reass *r, uint64_t now);
+
+/**
+ * @brief Fill in a UDP checksum that is 0, which IPv6 does not allow
+ *
+ * @param ip6 Complete IPv6 packet with its payload
+ */
+void lowpan_udp_checksum(uint8_t *ip6, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_RADIO_BRIDGE_LOWPAN_H_ */
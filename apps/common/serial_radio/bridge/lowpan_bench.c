@@ -0,0 +1,329 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Golden packets and payload gain of the bridge's IPHC compression
+ *
+ * Compresses and decompresses packets whose compressed form is known,
+ * laid out by the rules of RFC 6282 in the order Zephyr's 6LoWPAN layer
+ * uses, then reports the UDP payload that fits in one frame with IPHC
+ * instead of an uncompressed IPv6 header, and the cost per packet.
+ * Datagrams up to the IPv6 minimum MTU are also fragmented and reassembled
+ * again, in order and out of order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_filter.h"
+#include "lowpan.h"
+
+#define ROUNDS     64
+#define ITERATIONS 4096
+
+/* 802.15.4 frame without its FCS, and a header with extended addresses */
+#define PSDU_MAX    (127 - 2)
+#define MHR_EXT_LEN 21
+
+#define NODE_1 0x00124b0000000001ULL
+#define NODE_2 0x00124b0000000002ULL
+
+/* Context 0 of the vectors that use one */
+static const struct lowpan_context contexts[LOWPAN_CONTEXTS] = {
+	{ .valid = true, .prefix = { 0xfd, 0x00, 0x00, 0x01 } },
+};
+
+struct vector {
+	const char *name;
+	struct lowpan_ll src;
+	struct lowpan_ll dst;
+	bool context;
+	/* Receive only, the bridge never compresses this way */
+	bool decompress_only;
+	const char *ip6;
+	const char *lowpan;
+};
+
+static const struct vector vectors[] = {
+	{
+		"link-local UDP, 4-bit ports",
+		{ NODE_2, FRAME_FILTER_ADDR_EXT },
+		{ NODE_1, FRAME_FILTER_ADDR_EXT },
+		false, false,
+		"60000000000a1140fe8000000000000002124b0000000002"
+		"fe8000000000000002124b0000000001f0b1f0b2000a1ee36869",
+		"7e33f3121ee36869",
+	},
+	{
+		"global UDP",
+		{ NODE_2, FRAME_FILTER_ADDR_EXT },
+		{ NODE_1, FRAME_FILTER_ADDR_EXT },
+		false, false,
+		"60000000000c1140fd000001000000000000000000000001"
+		"fd0000010000000002124b000000000116331633000cc778636f6170",
+		"7e00fd000001000000000000000000000001"
+		"fd0000010000000002124b0000000001f016331633c778636f6170",
+	},
+	{
+		"global UDP, context 0",
+		{ NODE_2, FRAME_FILTER_ADDR_EXT },
+		{ NODE_1, FRAME_FILTER_ADDR_EXT },
+		true, false,
+		"60000000000c1140fd000001000000000000000000000001"
+		"fd0000010000000002124b000000000116331633000cc778636f6170",
+		"7e570000000000000001f016331633c778636f6170",
+	},
+	{
+		"all-nodes ICMPv6",
+		{ NODE_1, FRAME_FILTER_ADDR_EXT },
+		{ FRAME_FILTER_BROADCAST, FRAME_FILTER_ADDR_SHORT },
+		false, false,
+		"60000000000c3afffe8000000000000002124b0000000001"
+		"ff0200000000000000000000000000018000441b1234000170696e67",
+		"7b3b3a018000441b1234000170696e67",
+	},
+	{
+		"traffic class, flow label",
+		{ NODE_2, FRAME_FILTER_ADDR_EXT },
+		{ NODE_1, FRAME_FILTER_ADDR_EXT },
+		false, false,
+		"6b8123450009111efe80000000000000000000fffe001234"
+		"fe800000000000000000000000000001f01212340009775e78",
+		"64212e0123451e12340000000000000001f2121234775e78",
+	},
+	{
+		"short source address",
+		{ 0x0001, FRAME_FILTER_ADDR_SHORT },
+		{ NODE_1, FRAME_FILTER_ADDR_EXT },
+		false, false,
+		"6000000000083a40fe80000000000000000000fffe000001"
+		"fe8000000000000002124b00000000018100237212340001",
+		"7a333a8100237212340001",
+	},
+	{
+		"elided UDP checksum",
+		{ NODE_2, FRAME_FILTER_ADDR_EXT },
+		{ NODE_1, FRAME_FILTER_ADDR_EXT },
+		false, true,
+		"60000000000a1140fe8000000000000002124b0000000002"
+		"fe8000000000000002124b0000000001f0b1f0b2000a1ee36869",
+		"7e33f7126869",
+	},
+};
+
+static size_t from_hex(const char *hex, uint8_t *out)
+{
+	size_t n = 0;
+
+	for (; hex[0] && hex[1]; hex += 2) {
+		char byte[3] = { hex[0], hex[1] };
+
+		out[n++] = strtoul(byte, NULL, 16);
+	}
+
+	return n;
+}
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t compress(const struct vector *v, const uint8_t *ip6, size_t len,
+		       uint8_t *out)
+{
+	size_t hdr_len, n;
+
+	n = lowpan_compress(v->context ? contexts : NULL, &v->src, &v->dst, ip6,
+			    len, out, &hdr_len);
+	memcpy(&out[n], &ip6[hdr_len], len - hdr_len);
+
+	return n + len - hdr_len;
+}
+
+static int decompress(const struct vector *v, const uint8_t *in, size_t len,
+		      uint8_t *ip6)
+{
+	size_t consumed;
+	int n;
+
+	n = lowpan_decompress(v->context ? contexts : NULL, &v->src, &v->dst,
+			      in, len, 0, ip6, &consumed);
+	if (n < 0) {
+		return -1;
+	}
+
+	memcpy(&ip6[n], &in[consumed], len - consumed);
+	lowpan_udp_checksum(ip6, n + len - consumed);
+
+	return n + len - consumed;
+}
+
+static int check_vectors(void)
+{
+	uint8_t ip6[1280], lowpan[1280], out[1280];
+	size_t ip6_len, lowpan_len, n;
+	int err = 0;
+
+	for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		const struct vector *v = &vectors[i];
+
+		ip6_len = from_hex(v->ip6, ip6);
+		lowpan_len = from_hex(v->lowpan, lowpan);
+
+		if (!v->decompress_only) {
+			n = compress(v, ip6, ip6_len, out);
+			if (n != lowpan_len || memcmp(out, lowpan, n)) {
+				fprintf(stderr, "wrong compression: %s\n",
+					v->name);
+				err = 1;
+			}
+		}
+
+		if (decompress(v, lowpan, lowpan_len, out) != (int)ip6_len ||
+		    memcmp(out, ip6, ip6_len)) {
+			fprintf(stderr, "wrong decompression: %s\n", v->name);
+			err = 1;
+		}
+	}
+
+	return err;
+}
+
+/* Fragments a UDP datagram of the "global UDP" vector, grown to len */
+static int check_fragments(size_t len, bool reverse)
+{
+	const struct vector *v = &vectors[1];
+	static uint8_t frags[LOWPAN_REASS_SIZE_MAX / 8][PSDU_MAX];
+	size_t frag_len[LOWPAN_REASS_SIZE_MAX / 8];
+	uint8_t ip6[LOWPAN_REASS_SIZE_MAX], hdr[LOWPAN_IPHC_MAX], *out = NULL;
+	struct lowpan_reass reass;
+	struct lowpan_frag fr;
+	size_t hdr_len, hdr_n, n = 0;
+	int ret = 0;
+
+	from_hex(v->ip6, ip6);
+	for (size_t i = LOWPAN_IPV6_HDR_LEN + LOWPAN_UDP_HDR_LEN; i < len; i++) {
+		ip6[i] = i;
+	}
+	ip6[4] = (len - LOWPAN_IPV6_HDR_LEN) >> 8;
+	ip6[5] = len - LOWPAN_IPV6_HDR_LEN;
+	ip6[44] = ip6[4];
+	ip6[45] = ip6[5];
+	ip6[46] = ip6[47] = 0;
+	lowpan_udp_checksum(ip6, len);
+
+	hdr_n = lowpan_compress(NULL, &v->src, &v->dst, ip6, len, hdr, &hdr_len);
+	lowpan_frag_start(&fr, ip6, len, hdr, hdr_n, hdr_len, 0x1234);
+	while ((frag_len[n] = lowpan_frag_next(&fr, frags[n],
+					       PSDU_MAX - MHR_EXT_LEN))) {
+		n++;
+	}
+
+	lowpan_reass_init(&reass, 1, 1000);
+	for (size_t i = 0; i < n; i++) {
+		size_t f = reverse ? n - 1 - i : i;
+
+		ret = lowpan_reass_add(&reass, NULL, &v->src, &v->dst, frags[f],
+				       frag_len[f], 0, &out);
+		if (ret && (ret < 0 || i != n - 1)) {
+			break;
+		}
+	}
+
+	if (ret != (int)len || memcmp(out, ip6, len)) {
+		fprintf(stderr, "wrong reassembly: %zu bytes%s\n", len,
+			reverse ? ", reversed" : "");
+		return 1;
+	}
+
+	return 0;
+}
+
+/* UDP payload of one frame with extended addresses, as the bridge sends */
+static void report_gain(const struct vector *v)
+{
+	uint8_t ip6[1280], out[LOWPAN_IPHC_MAX];
+	size_t room = PSDU_MAX - MHR_EXT_LEN;
+	size_t len = from_hex(v->ip6, ip6);
+	size_t hdr_len, n, plain, iphc;
+
+	n = lowpan_compress(v->context ? contexts : NULL, &v->src, &v->dst, ip6,
+			    len, out, &hdr_len);
+
+	plain = room - 1 - LOWPAN_IPV6_HDR_LEN - LOWPAN_UDP_HDR_LEN;
+	iphc = room - n;
+	printf("%-28s %9zu %9zu %8zu %+8.0f%%\n", v->name, 1 + hdr_len, n,
+	       iphc, 100.0 * ((double)iphc - plain) / plain);
+}
+
+static void bench(const struct vector *v)
+{
+	uint8_t ip6[1280], lowpan[1280], out[1280];
+	size_t len = from_hex(v->ip6, ip6), n = 0;
+	uint64_t best_c = UINT64_MAX, best_d = UINT64_MAX;
+
+	for (int r = 0; r < ROUNDS; r++) {
+		uint64_t start = now(), t;
+
+		for (int i = 0; i < ITERATIONS; i++) {
+			n = compress(v, ip6, len, lowpan);
+		}
+
+		t = now() - start;
+		best_c = t < best_c ? t : best_c;
+
+		start = now();
+		for (int i = 0; i < ITERATIONS; i++) {
+			decompress(v, lowpan, n, out);
+		}
+
+		t = now() - start;
+		best_d = t < best_d ? t : best_d;
+	}
+
+	printf("%-28s %10.1f %10.1f\n", v->name, (double)best_c / ITERATIONS,
+	       (double)best_d / ITERATIONS);
+}
+
+int main(void)
+{
+	size_t i;
+
+	if (check_vectors()) {
+		return 1;
+	}
+
+	for (i = 200; i <= LOWPAN_REASS_SIZE_MAX; i++) {
+		if (check_fragments(i, false) || check_fragments(i, true)) {
+			return 1;
+		}
+	}
+
+	printf("%zu golden packets passed\n", sizeof(vectors) / sizeof(vectors[0]));
+	printf("200 to %u byte datagrams reassembled\n\n",
+	       LOWPAN_REASS_SIZE_MAX);
+
+	printf("UDP payload per frame: %zu bytes with dispatch 0x41\n",
+	       (size_t)(PSDU_MAX - MHR_EXT_LEN - 1 - LOWPAN_IPV6_HDR_LEN -
+			LOWPAN_UDP_HDR_LEN));
+	printf("%-28s %9s %9s %8s %9s\n", "packet", "hdr 0x41", "hdr IPHC",
+	       "payload", "gain");
+	for (i = 0; i < 3; i++) {
+		report_gain(&vectors[i]);
+	}
+
+	printf("\n%-28s %10s %10s\n", "packet", "ns/comp", "ns/decomp");
+	for (i = 0; i < 3; i++) {
+		bench(&vectors[i]);
+	}
+
+	return 0;
+}
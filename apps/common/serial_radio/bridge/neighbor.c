@@ -0,0 +1,369 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "frame_filter.h"
+#include "neighbor.h"
+
+#define IPV6_HDR_LEN 40
+
+#define IPPROTO_ICMPV6_NH 58
+#define ND_HOP_LIMIT      255
+
+/* ICMPv6 neighbor discovery types, and where their options start */
+#define ND_ROUTER_SOLICIT   133
+#define ND_ROUTER_ADVERT    134
+#define ND_NEIGHBOR_SOLICIT 135
+#define ND_NEIGHBOR_ADVERT  136
+
+#define ND_RS_OPT_OFFSET 8
+#define ND_RA_OPT_OFFSET 16
+#define ND_NS_OPT_OFFSET 24
+
+/* Source and target link-layer address options */
+#define ND_OPT_SLLAO 1
+#define ND_OPT_TLLAO 2
+
+/* Solicited and override flags of an advertisement */
+#define ND_NA_SOLICITED 0x40
+#define ND_NA_OVERRIDE  0x20
+
+static uint16_t get_be16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static void put_be16(uint16_t v, uint8_t *p)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static uint64_t get_be64(const uint8_t *p)
+{
+	uint64_t v = 0;
+
+	for (int i = 0; i < 8; i++) {
+		v = (v << 8) | p[i];
+	}
+
+	return v;
+}
+
+static void put_be64(uint64_t v, uint8_t *p)
+{
+	for (int i = 7; i >= 0; i--) {
+		p[i] = v;
+		v >>= 8;
+	}
+}
+
+/* Both halves mixed, addresses of one prefix differ in the low bits only */
+static size_t slot_of(const uint8_t *ip6)
+{
+	uint64_t h = get_be64(ip6) * 0x9e3779b97f4a7c15ULL ^ get_be64(&ip6[8]);
+
+	h *= 0xbf58476d1ce4e5b9ULL;
+	return (h >> 32) & (NEIGHBOR_SLOTS - 1);
+}
+
+void neighbor_init(struct neighbor_table *t, uint32_t timeout_ms)
+{
+	memset(t, 0, sizeof(*t));
+	t->timeout_ms = timeout_ms;
+}
+
+static struct neighbor *lookup(struct neighbor_table *t, const uint8_t *ip6)
+{
+	size_t i = slot_of(ip6);
+
+	while (t->e[i].state != NEIGHBOR_FREE) {
+		if (!memcmp(t->e[i].ip6, ip6, 16)) {
+			return &t->e[i];
+		}
+		i = (i + 1) & (NEIGHBOR_SLOTS - 1);
+	}
+
+	return NULL;
+}
+
+struct neighbor *neighbor_find(struct neighbor_table *t, const uint8_t *ip6,
+			       uint64_t now)
+{
+	struct neighbor *n = lookup(t, ip6);
+
+	if (n && n->state == NEIGHBOR_REACHABLE && n->expires <= now) {
+		neighbor_remove(t, n);
+		t->expired++;
+		return NULL;
+	}
+
+	return n;
+}
+
+/* Entries that follow it move back, so no probe sequence is cut short */
+void neighbor_remove(struct neighbor_table *t, struct neighbor *n)
+{
+	size_t i = n - t->e, j = i, k;
+
+	t->incomplete -= n->state == NEIGHBOR_INCOMPLETE;
+	n->state = NEIGHBOR_FREE;
+	t->count--;
+
+	while (true) {
+		j = (j + 1) & (NEIGHBOR_SLOTS - 1);
+		if (t->e[j].state == NEIGHBOR_FREE) {
+			return;
+		}
+
+		/* Stays if its home slot lies cyclically in (i, j] */
+		k = slot_of(t->e[j].ip6);
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+			continue;
+		}
+
+		t->e[i] = t->e[j];
+		t->e[j].state = NEIGHBOR_FREE;
+		i = j;
+	}
+}
+
+struct neighbor *neighbor_add(struct neighbor_table *t, const uint8_t *ip6,
+			      uint64_t now)
+{
+	struct neighbor *n = lookup(t, ip6), *oldest = NULL;
+	size_t i;
+
+	if (n) {
+		return n;
+	}
+
+	if (t->count == NEIGHBOR_MAX) {
+		for (i = 0; i < NEIGHBOR_SLOTS; i++) {
+			if (t->e[i].state == NEIGHBOR_REACHABLE &&
+			    (!oldest || t->e[i].expires < oldest->expires)) {
+				oldest = &t->e[i];
+			}
+		}
+
+		/* All incomplete, solicitations are bounded by the caller */
+		if (!oldest) {
+			return NULL;
+		}
+
+		neighbor_remove(t, oldest);
+		t->evicted++;
+	}
+
+	for (i = slot_of(ip6); t->e[i].state != NEIGHBOR_FREE;
+	     i = (i + 1) & (NEIGHBOR_SLOTS - 1)) {
+	}
+
+	n = &t->e[i];
+	memcpy(n->ip6, ip6, 16);
+	n->state = NEIGHBOR_INCOMPLETE;
+	n->probes = 0;
+	n->ll.addr = 0;
+	n->ll.mode = FRAME_FILTER_ADDR_NONE;
+	n->expires = now;
+	t->count++;
+	t->incomplete++;
+
+	return n;
+}
+
+static bool is_unicast(const uint8_t *ip6)
+{
+	static const uint8_t unspecified[16];
+
+	return ip6[0] != 0xff && memcmp(ip6, unspecified, 16);
+}
+
+void neighbor_learn(struct neighbor_table *t, const uint8_t *ip6,
+		    const struct lowpan_ll *ll, uint64_t now)
+{
+	struct neighbor *n;
+
+	if (!is_unicast(ip6) || ll->mode == FRAME_FILTER_ADDR_NONE ||
+	    (ll->mode == FRAME_FILTER_ADDR_SHORT &&
+	     ll->addr == FRAME_FILTER_BROADCAST)) {
+		return;
+	}
+
+	n = lookup(t, ip6);
+	if (!n || n->state != NEIGHBOR_REACHABLE) {
+		n = n ? n : neighbor_add(t, ip6, now);
+		if (!n) {
+			return;
+		}
+		t->incomplete--;
+		t->learned++;
+	}
+
+	n->state = NEIGHBOR_REACHABLE;
+	n->ll = *ll;
+	n->expires = now + t->timeout_ms;
+}
+
+/* 802.15.4 link-layer address option: 16 bytes if extended, 8 if short */
+static bool ll_option_parse(const uint8_t *o, size_t len,
+			    struct lowpan_ll *ll)
+{
+	if (len == 16) {
+		ll->addr = get_be64(&o[2]);
+		ll->mode = FRAME_FILTER_ADDR_EXT;
+		return true;
+	}
+
+	if (len == 8) {
+		ll->addr = get_be16(&o[2]);
+		ll->mode = FRAME_FILTER_ADDR_SHORT;
+		return true;
+	}
+
+	return false;
+}
+
+static size_t ll_option_put(uint8_t *o, uint8_t type,
+			    const struct lowpan_ll *ll)
+{
+	size_t len = ll->mode == FRAME_FILTER_ADDR_EXT ? 16 : 8;
+
+	memset(o, 0, len);
+	o[0] = type;
+	o[1] = len / 8;
+	if (ll->mode == FRAME_FILTER_ADDR_EXT) {
+		put_be64(ll->addr, &o[2]);
+	} else {
+		put_be16(ll->addr, &o[2]);
+	}
+
+	return len;
+}
+
+void neighbor_learn_packet(struct neighbor_table *t,
+			   const struct lowpan_ll *src, const uint8_t *ip6,
+			   size_t len, uint64_t now)
+{
+	const uint8_t *icmp = &ip6[IPV6_HDR_LEN], *addr = &ip6[8];
+	size_t icmp_len, off, opt_len;
+	uint8_t want = ND_OPT_SLLAO;
+	struct lowpan_ll ll;
+
+	if (len < IPV6_HDR_LEN || (ip6[0] >> 4) != 6) {
+		return;
+	}
+
+	neighbor_learn(t, &ip6[8], src, now);
+
+	/* Neighbor discovery comes from the link only, see RFC 4861 */
+	if (len < IPV6_HDR_LEN + 4 || ip6[6] != IPPROTO_ICMPV6_NH ||
+	    ip6[7] != ND_HOP_LIMIT) {
+		return;
+	}
+
+	icmp_len = len - IPV6_HDR_LEN;
+	switch (icmp[0]) {
+	case ND_ROUTER_SOLICIT:
+		off = ND_RS_OPT_OFFSET;
+		break;
+	case ND_ROUTER_ADVERT:
+		off = ND_RA_OPT_OFFSET;
+		break;
+	case ND_NEIGHBOR_SOLICIT:
+		off = ND_NS_OPT_OFFSET;
+		break;
+	case ND_NEIGHBOR_ADVERT:
+		off = ND_NS_OPT_OFFSET;
+		want = ND_OPT_TLLAO;
+		addr = &icmp[8];
+		break;
+	default:
+		return;
+	}
+
+	for (; off + 2 <= icmp_len; off += opt_len) {
+		opt_len = icmp[off + 1] * 8;
+		if (!opt_len || off + opt_len > icmp_len) {
+			return;
+		}
+
+		if (icmp[off] == want &&
+		    ll_option_parse(&icmp[off], opt_len, &ll)) {
+			neighbor_learn(t, addr, &ll, now);
+			return;
+		}
+	}
+}
+
+/* ICMPv6 header and pseudo header of a packet to the link */
+static size_t icmp_finish(uint8_t *ip6, const uint8_t *src,
+			  const uint8_t *dst, size_t icmp_len)
+{
+	uint8_t *icmp = &ip6[IPV6_HDR_LEN];
+	uint32_t sum;
+	size_t i;
+
+	memset(ip6, 0, 8);
+	ip6[0] = 0x60;
+	put_be16(icmp_len, &ip6[4]);
+	ip6[6] = IPPROTO_ICMPV6_NH;
+	ip6[7] = ND_HOP_LIMIT;
+	memcpy(&ip6[8], src, 16);
+	memcpy(&ip6[24], dst, 16);
+
+	icmp[2] = icmp[3] = 0;
+	sum = icmp_len + IPPROTO_ICMPV6_NH;
+	for (i = 8; i < IPV6_HDR_LEN; i += 2) {
+		sum += get_be16(&ip6[i]);
+	}
+
+	/* Options are multiples of 8 bytes, the length is even */
+	for (i = 0; i < icmp_len; i += 2) {
+		sum += get_be16(&icmp[i]);
+	}
+
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+
+	put_be16(~sum, &icmp[2]);
+
+	return IPV6_HDR_LEN + icmp_len;
+}
+
+size_t neighbor_solicit(uint8_t *ip6, const uint8_t *src,
+			const uint8_t *target, const struct lowpan_ll *ll)
+{
+	uint8_t dst[16] = { 0xff, 0x02, [11] = 0x01, [12] = 0xff };
+	uint8_t *icmp = &ip6[IPV6_HDR_LEN];
+
+	memcpy(&dst[13], &target[13], 3);
+
+	memset(icmp, 0, ND_NS_OPT_OFFSET);
+	icmp[0] = ND_NEIGHBOR_SOLICIT;
+	memcpy(&icmp[8], target, 16);
+
+	return icmp_finish(ip6, src, dst,
+			   ND_NS_OPT_OFFSET +
+			   ll_option_put(&icmp[ND_NS_OPT_OFFSET], ND_OPT_SLLAO,
+					 ll));
+}
+
+size_t neighbor_advertise(uint8_t *ip6, const uint8_t *target,
+			  const uint8_t *dst, const struct lowpan_ll *ll)
+{
+	uint8_t *icmp = &ip6[IPV6_HDR_LEN];
+
+	memset(icmp, 0, ND_NS_OPT_OFFSET);
+	icmp[0] = ND_NEIGHBOR_ADVERT;
+	icmp[4] = ND_NA_SOLICITED | ND_NA_OVERRIDE;
+	memcpy(&icmp[8], target, 16);
+
+	return icmp_finish(ip6, target, dst,
+			   ND_NS_OPT_OFFSET +
+			   ll_option_put(&icmp[ND_NS_OPT_OFFSET], ND_OPT_TLLAO,
+					 ll));
+}
@@ -0,0 +1,148 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Neighbor table of the bridge: IPv6 to link-layer addresses
+ *
+ * Nodes may use any interface identifier, e.g. configured addresses like
+ * fd01::1234, so their MAC addresses are learned instead of derived: from
+ * the source addresses of the frames they send, and from the link-layer
+ * address options of their neighbor discovery messages (RFC 4861, with
+ * the 802.15.4 options of RFC 4944 section 8). Addresses nothing was
+ * learned for are resolved with neighbor solicitations.
+ *
+ * The table is hashed on the IPv6 address with linear probing, so lookups
+ * take constant time. Entries not refreshed within the timeout age out.
+ */
+
+#ifndef SERIAL_RADIO_BRIDGE_NEIGHBOR_H_
+#define SERIAL_RADIO_BRIDGE_NEIGHBOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lowpan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Neighbors at most, and slots of the table, twice as many */
+#define NEIGHBOR_MAX   256
+#define NEIGHBOR_SLOTS (2 * NEIGHBOR_MAX)
+
+/* Solicitations per address, as MAX_MULTICAST_SOLICIT and RETRANS_TIMER */
+#define NEIGHBOR_SOLICIT_MAX 3
+#define NEIGHBOR_RETRANS_MS  1000
+
+/* Neighbor solicitation with a link-layer address option of 16 bytes */
+#define NEIGHBOR_NS_LEN (40 + 24 + 16)
+
+enum neighbor_state {
+	NEIGHBOR_FREE,
+	/* Solicited, the link-layer address is not known yet */
+	NEIGHBOR_INCOMPLETE,
+	NEIGHBOR_REACHABLE,
+};
+
+struct neighbor {
+	uint8_t ip6[16];
+	uint8_t state;
+	/* Solicitations sent while incomplete */
+	uint8_t probes;
+	struct lowpan_ll ll;
+	/* Aged out once reachable, solicited again once incomplete */
+	uint64_t expires;
+};
+
+struct neighbor_table {
+	uint32_t timeout_ms;
+	size_t count;
+	/* Entries being solicited */
+	size_t incomplete;
+	struct neighbor e[NEIGHBOR_SLOTS];
+
+	/** Addresses learned that were not in the table */
+	uint32_t learned;
+	/** Entries aged out */
+	uint32_t expired;
+	/** Entries replaced by a new address while the table was full */
+	uint32_t evicted;
+};
+
+void neighbor_init(struct neighbor_table *t, uint32_t timeout_ms);
+
+/**
+ * @brief Look up an IPv6 address
+ *
+ * Entries move when others are added or removed, so the pointer is only
+ * valid until then.
+ *
+ * @return The entry, incomplete or reachable, or NULL if there is none or
+ *         it aged out
+ */
+struct neighbor *neighbor_find(struct neighbor_table *t, const uint8_t *ip6,
+			       uint64_t now);
+
+/**
+ * @brief Add an incomplete entry for an address to be solicited
+ *
+ * The oldest entry is replaced if the table is full.
+ */
+struct neighbor *neighbor_add(struct neighbor_table *t, const uint8_t *ip6,
+			      uint64_t now);
+
+void neighbor_remove(struct neighbor_table *t, struct neighbor *n);
+
+/**
+ * @brief Learn the link-layer address of an IPv6 address
+ *
+ * Unspecified and multicast addresses are ignored.
+ */
+void neighbor_learn(struct neighbor_table *t, const uint8_t *ip6,
+		    const struct lowpan_ll *ll, uint64_t now);
+
+/**
+ * @brief Learn from a packet received from @p src
+ *
+ * Its source address maps to @p src, and the link-layer address options
+ * of router and neighbor solicitations and advertisements are learned
+ * for their source or target address.
+ */
+void neighbor_learn_packet(struct neighbor_table *t,
+			   const struct lowpan_ll *src, const uint8_t *ip6,
+			   size_t len, uint64_t now);
+
+/**
+ * @brief Build a neighbor solicitation to the solicited-node address of
+ *        @p target
+ *
+ * @param ip6 NEIGHBOR_NS_LEN bytes for the packet
+ * @param src Source address
+ * @param ll  Link-layer address of the sender, for its option
+ *
+ * @return Length of the packet
+ */
+size_t neighbor_solicit(uint8_t *ip6, const uint8_t *src,
+			const uint8_t *target, const struct lowpan_ll *ll);
+
+/**
+ * @brief Build a solicited neighbor advertisement of @p target
+ *
+ * @param ip6 NEIGHBOR_NS_LEN bytes for the packet
+ * @param dst Source address of the solicitation
+ * @param ll  Link-layer address of @p target
+ *
+ * @return Length of the packet
+ */
+size_t neighbor_advertise(uint8_t *ip6, const uint8_t *target,
+			  const uint8_t *dst, const struct lowpan_ll *ll);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_RADIO_BRIDGE_NEIGHBOR_H_ */
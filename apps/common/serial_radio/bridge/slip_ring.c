@@ -0,0 +1,135 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "slip_ring.h"
+
+static uint8_t *ring_alloc(void *user_data, size_t *size)
+{
+	struct slip_ring *r = user_data;
+
+	*size = r->frame_max;
+	return &r->arena[r->head];
+}
+
+static void ring_frame(void *user_data, size_t len)
+{
+	struct slip_ring *r = user_data;
+
+	r->frames[r->count].offset = r->dec.buf - r->arena;
+	r->frames[r->count].len = len;
+	r->count++;
+	r->head = r->dec.buf - r->arena + len;
+}
+
+static void ring_discard(void *user_data)
+{
+	(void)user_data;
+}
+
+static const struct slip_decoder_cb ring_cb = {
+	.alloc = ring_alloc,
+	.frame = ring_frame,
+	.discard = ring_discard,
+};
+
+struct slip_ring *slip_ring_new(size_t chunk, size_t frame_max)
+{
+	struct slip_ring *r = calloc(1, sizeof(*r));
+
+	if (!r) {
+		return NULL;
+	}
+
+	/*
+	 * A read completes the frame carried over and decodes at most chunk
+	 * bytes behind it, and a frame completes every 2 bytes at most
+	 */
+	r->chunk = chunk;
+	r->frame_max = frame_max;
+	r->arena_size = chunk + 2 * frame_max;
+	r->in = malloc(chunk);
+	r->arena = malloc(r->arena_size);
+	r->frames = calloc(chunk / 2 + 1, sizeof(*r->frames));
+	if (!r->in || !r->arena || !r->frames) {
+		slip_ring_free(r);
+		return NULL;
+	}
+
+	slip_decoder_init(&r->dec, &ring_cb, r);
+
+	return r;
+}
+
+void slip_ring_free(struct slip_ring *r)
+{
+	if (!r) {
+		return;
+	}
+
+	free(r->in);
+	free(r->arena);
+	free(r->frames);
+	free(r);
+}
+
+/* Frames of the last read are released, a partial one moves to the front */
+static void ring_rewind(struct slip_ring *r)
+{
+	r->count = 0;
+	r->head = 0;
+
+	if (r->dec.buf && r->dec.buf != r->arena) {
+		memmove(r->arena, r->dec.buf, r->dec.len);
+		r->dec.buf = r->arena;
+	}
+}
+
+size_t slip_ring_feed(struct slip_ring *r, const uint8_t *data, size_t len)
+{
+	ring_rewind(r);
+	slip_decode(&r->dec, data, len < r->chunk ? len : r->chunk);
+
+	return r->count;
+}
+
+ssize_t slip_ring_read(struct slip_ring *r, int fd)
+{
+	ssize_t n;
+
+	ring_rewind(r);
+
+	n = read(fd, r->in, r->chunk);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+	}
+
+	if (n == 0) {
+		return -EPIPE;
+	}
+
+	slip_decode(&r->dec, r->in, n);
+
+	return r->count;
+}
+
+uint32_t slip_ring_dropped(const struct slip_ring *r)
+{
+	return r->dec.dropped;
+}
+
+uint8_t *slip_ring_arena(struct slip_ring *r, size_t *size)
+{
+	*size = r->arena_size;
+	return r->arena;
+}
+
+const struct slip_ring_frame *slip_ring_frames(const struct slip_ring *r)
+{
+	return r->frames;
+}
@@ -0,0 +1,105 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief SLIP receive buffer for host tools, around the firmware's decoder
+ *
+ * Bytes read from the serial port are decoded incrementally with
+ * slip_decode() into one preallocated arena, and the frames completed by
+ * a read are reported as offsets into it, so a caller can use them in
+ * place. A frame that is still incomplete moves to the front of the arena
+ * on the next read, which is the only copy besides the decoding.
+ *
+ * Built as a shared library for py/slip_ring.py, which hands the frames
+ * to Python as memoryviews of the arena.
+ */
+
+#ifndef SERIAL_RADIO_BRIDGE_SLIP_RING_H_
+#define SERIAL_RADIO_BRIDGE_SLIP_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "slip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct slip_ring_frame {
+	uint32_t offset;
+	uint32_t len;
+};
+
+struct slip_ring {
+	struct slip_decoder dec;
+
+	/* Bytes read at once, and the largest frame */
+	size_t chunk;
+	size_t frame_max;
+
+	uint8_t *in;
+	uint8_t *arena;
+	size_t arena_size;
+	/* Where the next frame is decoded to */
+	size_t head;
+
+	/* Frames completed by the last read, at most chunk / 2 */
+	struct slip_ring_frame *frames;
+	size_t count;
+};
+
+/**
+ * @brief Allocate a receive buffer
+ *
+ * @param chunk     Bytes read from the file descriptor at once
+ * @param frame_max Largest frame, longer ones are dropped
+ *
+ * @return The buffer, NULL if out of memory
+ */
+struct slip_ring *slip_ring_new(size_t chunk, size_t frame_max);
+
+void slip_ring_free(struct slip_ring *r);
+
+/**
+ * @brief Read once from @p fd and decode what was read
+ *
+ * The frames of an earlier read are no longer valid.
+ *
+ * @return Frames completed, 0 if none or nothing could be read, negative
+ *         errno on a read error other than EAGAIN and EINTR, and -EPIPE at
+ *         the end of the input
+ */
+ssize_t slip_ring_read(struct slip_ring *r, int fd);
+
+/**
+ * @brief Decode bytes that were read elsewhere
+ *
+ * @p len must not exceed the chunk size.
+ *
+ * @return Frames completed
+ */
+size_t slip_ring_feed(struct slip_ring *r, const uint8_t *data, size_t len);
+
+/** Bytes dropped because of framing errors or frames that were too long */
+uint32_t slip_ring_dropped(const struct slip_ring *r);
+
+/**
+ * @brief Arena the frames are decoded into, for callers without the layout
+ *        of struct slip_ring
+ *
+ * @param size Set to the size of the arena
+ */
+uint8_t *slip_ring_arena(struct slip_ring *r, size_t *size);
+
+/** Frames of the last read, see slip_ring_read() for their number */
+const struct slip_ring_frame *slip_ring_frames(const struct slip_ring *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_RADIO_BRIDGE_SLIP_RING_H_ */
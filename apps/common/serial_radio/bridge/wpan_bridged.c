@@ -0,0 +1,1742 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Native border-router bridge between a serial-radio and a TUN device
+ *
+ * Replaces py/wpan-bridge.py. IPv6 packets read from the TUN device are
+ * sent to the radio in "!S" and "!B" messages, and frames received by the
+ * radio are written to the TUN device. A single thread waits on the
+ * serial port, the TUN device and signals with epoll. All buffers are
+ * allocated up front: messages are decoded in place by the SLIP decoder
+ * of the firmware and encoded straight into the serial output buffer.
+ *
+ * The serial-radio's "!C" credits are followed, and the TUN device is only
+ * read while a message can be sent, so a busy radio pushes back into the
+ * kernel's TUN queue instead of into the bridge.
+ *
+ * IPv6 headers are compressed with IPHC, see lowpan.h. Received frames
+ * may carry either IPHC or an uncompressed header.
+ *
+ * Packets too large for a frame are sent as a train of fragments. A node
+ * reassembles only so many datagrams at once, and keeps one whose
+ * fragments went missing until its reassembly timeout, so trains to a
+ * node are held back until it has room for them.
+ *
+ * Frames are addressed by a neighbor table, see neighbor.h, which learns
+ * the nodes' MAC addresses from the frames they send and their neighbor
+ * discovery messages. Packets to addresses not known yet are held back
+ * while they are solicited.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_filter.h"
+#include "lowpan.h"
+#include "neighbor.h"
+#include "slip.h"
+
+/* Largest message from the serial-radio, a "!Y" container */
+#define SERIAL_MSG_MAX  2048
+#define SERIAL_OUT_SIZE 65536
+#define SERIAL_READ_MAX 4096
+
+/* Messages held back while the serial-radio has no credit left */
+#define MSGQ_SIZE 16384
+
+#define TUN_MTU 1280
+
+/* 802.15.4 frame without its FCS, which the radio appends */
+#define PSDU_MAX (127 - 2)
+
+/**
+ * Frames per "!B" batch and bytes per message, which must not exceed
+ * CONFIG_WPAN_SERIAL_TX_BATCH_MAX and CONFIG_WPAN_SERIAL_SLIP_RX_BUF_SIZE
+ */
+#define BATCH_MAX       8
+#define BATCH_BYTES_MAX 512
+
+/* Destinations whose ACKs carry the frame pending bit */
+#define PENDING_MAX 16
+
+/**
+ * Fragment trains in flight, packets held back until their destination is
+ * resolved or has room, and at most those to an address being solicited
+ */
+#define TRAINS_MAX          16
+#define HELD_MAX            16
+#define HELD_UNRESOLVED_MAX 4
+
+/* Neighbors not heard from for this long are solicited again */
+#define NEIGHBOR_TIMEOUT_MS (10 * 60 * 1000)
+
+/**
+ * Reassembly timeout of the bridge, and that of the nodes, as
+ * CONFIG_NET_L2_IEEE802154_REASSEMBLY_TIMEOUT
+ */
+#define REASS_TIMEOUT_MS      5000
+#define NODE_REASS_TIMEOUT_MS 5000
+
+/* Period of the reassembly, fragment train and solicitation timeouts */
+#define TIMER_MS 100
+
+/* Radio frame metadata of "!X" frames and "!Y" containers */
+#define META_LEN 10
+
+/* Energy detection scan: ms per channel, and the level of unscanned channels */
+#define ED_SCAN_MS 50
+#define ED_NONE    127
+
+/* Frame control field of frames to the radio's neighbours */
+#define FCF_TYPE_DATA    0x0001
+#define FCF_PAN_ID_COMP  0x0040
+#define FCF_DST_MODE(m)  ((m) << 10)
+#define FCF_VERSION_2006 0x1000
+#define FCF_SRC_MODE(m)  ((m) << 14)
+
+#define FRAME_TYPE_DATA 1
+
+#define IPV6_HDR_LEN LOWPAN_IPV6_HDR_LEN
+
+/* Contiki MAC_TX_* status of "!R" reports */
+#define MAC_TX_OK 0
+
+static struct {
+	const char *device;
+	int baud;
+	const char *ifname;
+	const char *prefix;
+	uint16_t pan_id;
+	/* -1 keeps the radio's channel, 0 picks the quietest one */
+	int channel;
+	/* Use the prefix as context 0, the nodes must know it as well */
+	bool context;
+	/* Send uncompressed IPv6 headers (dispatch 0x41) */
+	bool uncompressed;
+	/**
+	 * Datagrams a node reassembles at once, as its
+	 * CONFIG_NET_L2_IEEE802154_FRAGMENT_REASS_CACHE_SIZE, 0 to not wait
+	 */
+	int node_reass;
+	bool verbose;
+} opts = {
+	.device = "/dev/ttyACM2",
+	.baud = 115200,
+	.ifname = "tun0",
+	.prefix = "48:1516:2342::",
+	.pan_id = 0xabcd,
+	.channel = -1,
+	.node_reass = 1,
+};
+
+static struct {
+	uint64_t radio_frames;
+	uint64_t tun_written;
+	uint64_t tun_read;
+	uint64_t radio_sent;
+	uint64_t tx_ok;
+	uint64_t tx_failed;
+	uint64_t dropped;
+	uint64_t unsupported;
+	uint64_t tun_errors;
+	uint64_t msgq_full;
+	uint64_t batches;
+	uint64_t trains;
+	uint64_t fragments;
+	uint64_t held;
+	uint64_t solicits;
+	uint64_t unresolved;
+} stats;
+
+static int epfd;
+static int serial_fd;
+static int tun_fd;
+static int sig_fd;
+static int timer_fd;
+
+static bool running = true;
+
+/* 6LoWPAN contexts, context 0 is the prefix with --context */
+static struct lowpan_context contexts[LOWPAN_CONTEXTS];
+
+/* Radio MAC address in host order, 0 until the "!M" reply */
+static uint64_t radio_mac;
+static uint8_t seq;
+
+/* Credit based flow control, window 0 until the first "!C" update */
+static struct {
+	uint8_t window;
+	uint16_t freed;
+	/* Messages sent since and including "?C" */
+	uint16_t sent;
+} credits;
+
+/**
+ * Encoded bytes waiting for the serial port. Written from head, filled
+ * at tail, moved to the front when the tail runs out of room.
+ */
+static struct {
+	uint8_t buf[SERIAL_OUT_SIZE];
+	size_t head;
+	size_t tail;
+	bool waiting;
+} out;
+
+/* Messages held back for credits, each behind its 16-bit length */
+static struct {
+	uint8_t buf[MSGQ_SIZE];
+	size_t head;
+	size_t tail;
+	unsigned int count;
+} msgq;
+
+/* The TUN device is polled, see tun_gate() */
+static bool tun_reading;
+
+/* Frames of the batch being built from TUN packets */
+static struct {
+	uint8_t count;
+	size_t bytes;
+	uint8_t seq[BATCH_MAX];
+	uint8_t len[BATCH_MAX];
+	uint8_t psdu[BATCH_MAX][PSDU_MAX];
+} batch;
+
+/**
+ * Destinations of the frames in flight, by sequence number, and the
+ * number of frames in flight per destination. The radio sets the frame
+ * pending bit in ACKs to these ("!J"), so that polling nodes stay awake.
+ */
+static struct {
+	uint64_t addr;
+	uint8_t mode;
+	bool valid;
+} inflight[256];
+
+static struct {
+	uint64_t addr;
+	uint8_t mode;
+	unsigned int count;
+} pending[PENDING_MAX];
+
+/**
+ * Fragment trains by destination, until their fragments are reported. A
+ * train of which a fragment failed occupies the node's reassembly cache
+ * until the node's timeout passed.
+ */
+static struct {
+	uint64_t addr;
+	uint8_t frames;
+	bool used;
+	bool failed;
+	uint64_t expires;
+} trains[TRAINS_MAX];
+
+/* Train of each frame in flight plus 1, by sequence number, 0 for none */
+static uint8_t frame_train[256];
+
+/* Packets whose destination is not resolved or has no room yet, in order */
+static struct {
+	unsigned int count;
+	uint16_t len[HELD_MAX];
+	uint8_t pkt[HELD_MAX][TUN_MTU];
+} held;
+
+static uint16_t frag_tag;
+static struct lowpan_reass reass;
+static bool timer_armed;
+
+static struct neighbor_table neighbors;
+
+/* Address of the bridge on the TUN device, prefix::1 */
+static uint8_t bridge_addr[16];
+
+static struct slip_decoder slip_dec;
+static uint8_t serial_msg[SERIAL_MSG_MAX];
+
+#define vlog(...)                          \
+	do {                               \
+		if (opts.verbose) {        \
+			printf(__VA_ARGS__); \
+		}                          \
+	} while (0)
+
+static void put_be16(uint16_t v, uint8_t *p)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static uint16_t get_be16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static void put_be64(uint64_t v, uint8_t *p)
+{
+	for (int i = 7; i >= 0; i--) {
+		p[i] = v;
+		v >>= 8;
+	}
+}
+
+static uint64_t get_be64(const uint8_t *p)
+{
+	uint64_t v = 0;
+
+	for (int i = 0; i < 8; i++) {
+		v = (v << 8) | p[i];
+	}
+
+	return v;
+}
+
+static void put_le(uint64_t v, uint8_t *p, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		p[i] = v;
+		v >>= 8;
+	}
+}
+
+/* For the log, valid until the next call */
+static const char *addr_str(const uint8_t *ip6)
+{
+	static char str[INET6_ADDRSTRLEN];
+
+	return inet_ntop(AF_INET6, ip6, str, sizeof(str));
+}
+
+static void epoll_set(int fd, uint32_t events)
+{
+	struct epoll_event ev = { .events = events, .data.fd = fd };
+
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+		perror("epoll_ctl");
+	}
+}
+
+/* Serial output */
+
+static void serial_flush(void)
+{
+	while (out.head < out.tail) {
+		ssize_t n = write(serial_fd, &out.buf[out.head],
+				  out.tail - out.head);
+
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EINTR) {
+				perror("serial write");
+				running = false;
+			}
+			break;
+		}
+
+		out.head += n;
+	}
+
+	if (out.head == out.tail) {
+		out.head = 0;
+		out.tail = 0;
+	}
+
+	if (out.waiting != (out.head < out.tail)) {
+		out.waiting = out.head < out.tail;
+		epoll_set(serial_fd, EPOLLIN | (out.waiting ? EPOLLOUT : 0));
+	}
+}
+
+/* Room for @p size more bytes, moving the waiting ones to the front */
+static bool out_reserve(size_t size)
+{
+	if (sizeof(out.buf) - out.tail >= size) {
+		return true;
+	}
+
+	memmove(out.buf, &out.buf[out.head], out.tail - out.head);
+	out.tail -= out.head;
+	out.head = 0;
+
+	return sizeof(out.buf) - out.tail >= size;
+}
+
+/* SLIP encode a message behind the waiting bytes, false if full */
+static bool out_put(const uint8_t *msg, size_t len)
+{
+	struct slip_encoder enc;
+
+	/* Every byte escaped, plus SLIP_END */
+	if (!out_reserve(2 * len + 1)) {
+		return false;
+	}
+
+	slip_encoder_start(&enc, msg, len);
+	out.tail += slip_encode(&enc, &out.buf[out.tail],
+				sizeof(out.buf) - out.tail);
+
+	return true;
+}
+
+static bool credit_left(void)
+{
+	return !credits.window ||
+	       (uint16_t)(credits.sent - credits.freed) < credits.window;
+}
+
+/* Send held back messages as far as the credits allow */
+static void msgq_flush(void)
+{
+	while (msgq.count && credit_left()) {
+		size_t len = get_be16(&msgq.buf[msgq.head]);
+
+		if (!out_put(&msgq.buf[msgq.head + 2], len)) {
+			break;
+		}
+
+		msgq.head += 2 + len;
+		msgq.count--;
+		credits.sent++;
+	}
+
+	if (!msgq.count) {
+		msgq.head = 0;
+		msgq.tail = 0;
+	}
+
+	serial_flush();
+}
+
+/* Send a message, or hold it back while no credit is left */
+static void send_message(const uint8_t *msg, size_t len)
+{
+	if (sizeof(msgq.buf) - msgq.tail < 2 + len) {
+		memmove(msgq.buf, &msgq.buf[msgq.head], msgq.tail - msgq.head);
+		msgq.tail -= msgq.head;
+		msgq.head = 0;
+	}
+
+	if (sizeof(msgq.buf) - msgq.tail < 2 + len) {
+		stats.msgq_full++;
+		return;
+	}
+
+	put_be16(len, &msgq.buf[msgq.tail]);
+	memcpy(&msgq.buf[msgq.tail + 2], msg, len);
+	msgq.tail += 2 + len;
+	msgq.count++;
+
+	msgq_flush();
+}
+
+/**
+ * Read the TUN device only once the radio's address is known, nothing is
+ * held back for credits or a node's room, and a full batch fits into the
+ * output buffer
+ */
+static void tun_gate(void)
+{
+	bool want = radio_mac && !msgq.count && held.count < HELD_MAX &&
+		    sizeof(out.buf) - (out.tail - out.head) >=
+		    2 * BATCH_BYTES_MAX + 1;
+
+	if (want != tun_reading) {
+		tun_reading = want;
+		epoll_set(tun_fd, want ? EPOLLIN : 0);
+	}
+}
+
+/* Frame pending bit */
+
+static void pending_send(char op, uint8_t mode, uint64_t addr)
+{
+	uint8_t msg[4 + 8] = { '!', 'J', op, mode };
+
+	if (mode == FRAME_FILTER_ADDR_EXT) {
+		put_be64(addr, &msg[4]);
+		send_message(msg, 4 + 8);
+	} else {
+		put_be16(addr, &msg[4]);
+		send_message(msg, 4 + 2);
+	}
+}
+
+static void release_pending(uint8_t s)
+{
+	int i;
+
+	if (!inflight[s].valid) {
+		return;
+	}
+
+	inflight[s].valid = false;
+
+	for (i = 0; i < PENDING_MAX; i++) {
+		if (pending[i].count && pending[i].addr == inflight[s].addr &&
+		    pending[i].mode == inflight[s].mode) {
+			if (!--pending[i].count) {
+				pending_send('R', pending[i].mode,
+					     pending[i].addr);
+			}
+			return;
+		}
+	}
+}
+
+/* Set the frame pending bit for @p addr until its frame is reported */
+static void track_pending(uint8_t s, uint8_t mode, uint64_t addr)
+{
+	int free_slot = -1;
+	int i;
+
+	/* A report for a reused seq is lost, release its destination */
+	release_pending(s);
+
+	for (i = 0; i < PENDING_MAX; i++) {
+		if (pending[i].count && pending[i].addr == addr &&
+		    pending[i].mode == mode) {
+			break;
+		}
+		if (!pending[i].count && free_slot < 0) {
+			free_slot = i;
+		}
+	}
+
+	if (i == PENDING_MAX) {
+		if (free_slot < 0) {
+			/* Table full, the frame goes without the bit */
+			return;
+		}
+
+		i = free_slot;
+		pending[i].addr = addr;
+		pending[i].mode = mode;
+		pending_send('P', mode, addr);
+	}
+
+	pending[i].count++;
+	inflight[s].addr = addr;
+	inflight[s].mode = mode;
+	inflight[s].valid = true;
+}
+
+/* Fragment trains */
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Tick while datagrams are reassembled, a node waits out a failed train or
+ * an address is solicited
+ */
+static void timer_update(void)
+{
+	struct itimerspec its = { 0 };
+	bool want = neighbors.incomplete > 0;
+	size_t i;
+
+	for (i = 0; i < reass.slots && !want; i++) {
+		want = reass.e[i].used;
+	}
+
+	for (i = 0; i < TRAINS_MAX && !want; i++) {
+		want = trains[i].used && trains[i].failed && !trains[i].frames;
+	}
+
+	if (want == timer_armed) {
+		return;
+	}
+
+	if (want) {
+		its.it_interval.tv_nsec = TIMER_MS * 1000000L;
+		its.it_value = its.it_interval;
+	}
+
+	timerfd_settime(timer_fd, 0, &its, NULL);
+	timer_armed = want;
+}
+
+/* A train to @p addr can start, broadcast ones reach every node's cache */
+static bool train_room(uint64_t addr)
+{
+	int used = 0, total = 0, i;
+
+	if (!opts.node_reass) {
+		return true;
+	}
+
+	for (i = 0; i < TRAINS_MAX; i++) {
+		if (!trains[i].used) {
+			continue;
+		}
+
+		total++;
+		if (trains[i].addr == addr || addr == FRAME_FILTER_BROADCAST ||
+		    trains[i].addr == FRAME_FILTER_BROADCAST) {
+			used++;
+		}
+	}
+
+	return used < opts.node_reass && total < TRAINS_MAX;
+}
+
+static int train_start(uint64_t addr)
+{
+	int i;
+
+	for (i = 0; i < TRAINS_MAX; i++) {
+		if (!trains[i].used) {
+			trains[i].used = true;
+			trains[i].addr = addr;
+			trains[i].frames = 0;
+			trains[i].failed = false;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* A fragment was reported, or its report was lost */
+static void train_report(uint8_t s, bool ok)
+{
+	int t = frame_train[s] - 1;
+
+	if (t < 0) {
+		return;
+	}
+
+	frame_train[s] = 0;
+	trains[t].failed |= !ok;
+	if (--trains[t].frames) {
+		return;
+	}
+
+	if (trains[t].failed) {
+		/* The node drops the incomplete datagram after its timeout */
+		trains[t].expires = now_ms() + NODE_REASS_TIMEOUT_MS;
+	} else {
+		trains[t].used = false;
+	}
+}
+
+/* Radio to TUN */
+
+/* A packet from a node, whose addresses are learned on the way */
+static void tun_write(const struct lowpan_ll *src, const uint8_t *ip6,
+		      size_t len)
+{
+	neighbor_learn_packet(&neighbors, src, ip6, len, now_ms());
+
+	if (write(tun_fd, ip6, len) < 0) {
+		stats.tun_errors++;
+		return;
+	}
+
+	stats.tun_written++;
+}
+
+static void handle_radio_frame(const uint8_t *psdu, size_t len,
+			       const uint8_t *meta)
+{
+	static uint8_t ip6[TUN_MTU];
+	struct lowpan_ll src, dst;
+	uint8_t *dgram;
+	struct frame_mhr h;
+	const uint8_t *payload;
+	size_t payload_len, consumed;
+	int n;
+
+	stats.radio_frames++;
+
+	if (meta) {
+		vlog("  Link: lqi=%u rssi=%d dBm\n", meta[0], (int8_t)meta[1]);
+	}
+
+	if (!frame_mhr_parse(psdu, len, &h) || h.type != FRAME_TYPE_DATA ||
+	    (psdu[0] & FRAME_FCF_SECURITY)) {
+		stats.unsupported++;
+		return;
+	}
+
+	payload = psdu + h.hdr_len;
+	payload_len = len - h.hdr_len;
+
+	src.addr = h.src;
+	src.mode = h.src_mode;
+	dst.addr = h.dst;
+	dst.mode = h.dst_mode;
+
+	if (payload_len &&
+	    ((payload[0] & LOWPAN_DISPATCH_FRAG_MASK) == LOWPAN_DISPATCH_FRAG1 ||
+	     (payload[0] & LOWPAN_DISPATCH_FRAG_MASK) == LOWPAN_DISPATCH_FRAGN)) {
+		n = lowpan_reass_add(&reass, contexts, &src, &dst, payload,
+				     payload_len, now_ms(), &dgram);
+		if (n > 0) {
+			tun_write(&src, dgram, n);
+			vlog("<- Radio: %016llx len=%d, reassembled\n",
+			     (unsigned long long)h.src, n);
+		}
+		return;
+	}
+
+	if (payload_len > IPV6_HDR_LEN && payload[0] == LOWPAN_DISPATCH_IPV6 &&
+	    (payload[1] >> 4) == 6) {
+		tun_write(&src, payload + 1, payload_len - 1);
+		vlog("<- Radio: %016llx len=%zu\n", (unsigned long long)h.src,
+		     payload_len - 1);
+		return;
+	}
+
+	if (payload_len &&
+	    (payload[0] & LOWPAN_DISPATCH_IPHC_MASK) == LOWPAN_DISPATCH_IPHC) {
+		n = lowpan_decompress(contexts, &src, &dst, payload,
+				      payload_len, 0, ip6, &consumed);
+		if (n >= 0) {
+			memcpy(&ip6[n], &payload[consumed],
+			       payload_len - consumed);
+			n += payload_len - consumed;
+			lowpan_udp_checksum(ip6, n);
+			tun_write(&src, ip6, n);
+			vlog("<- Radio: %016llx len=%d, IPHC %zu bytes\n",
+			     (unsigned long long)h.src, n, consumed);
+			return;
+		}
+	}
+
+	/* Unknown dispatches and contexts */
+	stats.unsupported++;
+	vlog("  Unsupported dispatch 0x%02x from %016llx\n",
+	     payload_len ? payload[0] : 0, (unsigned long long)h.src);
+}
+
+/* "!F", "!Y": count, then length, "!Y" metadata and frame per frame */
+static void handle_container(const uint8_t *p, size_t len, bool meta)
+{
+	size_t off = 1;
+	uint8_t i;
+
+	for (i = 0; len && i < p[0] && off < len; i++) {
+		uint8_t frame_len = p[off++];
+		const uint8_t *info = NULL;
+
+		if (meta) {
+			info = &p[off];
+			off += META_LEN;
+		}
+
+		if (off + frame_len > len) {
+			break;
+		}
+
+		handle_radio_frame(&p[off], frame_len, info);
+		off += frame_len;
+	}
+}
+
+static void handle_report(uint8_t s, uint8_t status, uint8_t num_tx)
+{
+	release_pending(s);
+	train_report(s, status == MAC_TX_OK);
+
+	if (status == MAC_TX_OK) {
+		stats.tx_ok++;
+		vlog("  TX success: seq=%u num_tx=%u\n", s, num_tx);
+	} else {
+		stats.tx_failed++;
+		vlog("  TX error: seq=%u status=%u num_tx=%u\n", s, status,
+		     num_tx);
+	}
+}
+
+/* Switch to the channel with the least energy of a "!L" scan */
+static void select_channel(const uint8_t *p, size_t len)
+{
+	uint8_t msg[3] = { '!', 'C' };
+	int best = -1;
+	int8_t level, best_level = 0;
+	uint8_t i;
+
+	for (i = 0; i < p[1] && 2 + (size_t)i < len; i++) {
+		level = p[2 + i];
+		/* Ties go to the highest channel, 26 overlaps the fewest Wi-Fi channels */
+		if (level != ED_NONE && (best < 0 || level <= best_level)) {
+			best = p[0] + i;
+			best_level = level;
+		}
+	}
+
+	if (best < 0) {
+		printf("Radio cannot scan for energy, keeping its channel\n");
+		return;
+	}
+
+	msg[2] = best;
+	send_message(msg, sizeof(msg));
+	printf("-> Switching to channel %d (%d dBm)\n", best, best_level);
+}
+
+static void handle_message(const uint8_t *msg, size_t len)
+{
+	const uint8_t *p;
+	size_t plen;
+	uint8_t i;
+
+	if (len < 2 || msg[0] == '?') {
+		return;
+	}
+
+	if (msg[0] != '!') {
+		handle_radio_frame(msg, len, NULL);
+		return;
+	}
+
+	p = msg + 2;
+	plen = len - 2;
+
+	switch (msg[1]) {
+	case 'M':
+		if (plen >= 8) {
+			radio_mac = get_be64(p);
+			printf("Radio MAC: %016llx\n",
+			       (unsigned long long)radio_mac);
+		}
+		break;
+	case 'R':
+		if (plen >= 3) {
+			handle_report(p[0], p[1], p[2]);
+		}
+		break;
+	case 'B':
+		for (i = 0; plen && i < p[0] && 1 + 3 * (size_t)(i + 1) <= plen; i++) {
+			handle_report(p[1 + 3 * i], p[2 + 3 * i], p[3 + 3 * i]);
+		}
+		break;
+	case 'C':
+		if (plen >= 4) {
+			credits.window = p[0];
+			credits.freed = get_be16(&p[2]);
+			msgq_flush();
+		}
+		break;
+	case 'A':
+		if (plen >= 2) {
+			printf("Radio frame aggregation: mode=%u max=%u\n",
+			       p[0], p[1]);
+		}
+		break;
+	case 'E':
+		if (plen >= 2) {
+			printf("Radio frame metadata: mode=%u fields=0x%02x\n",
+			       p[0], p[1]);
+		}
+		break;
+	case 'J':
+		if (plen >= 3 && p[0] == 'A') {
+			printf("Radio frame pending bit: status=%u hw=%u\n",
+			       p[1], p[2]);
+		}
+		break;
+	case 'L':
+		if (plen >= 2) {
+			select_channel(p, plen);
+		}
+		break;
+	case 'X':
+		if (plen >= META_LEN) {
+			handle_radio_frame(p + META_LEN, plen - META_LEN, p);
+		}
+		break;
+	case 'F':
+	case 'Y':
+		handle_container(p, plen, msg[1] == 'Y');
+		break;
+	default:
+		break;
+	}
+}
+
+static uint8_t *slip_alloc(void *user_data, size_t *size)
+{
+	(void)user_data;
+
+	*size = sizeof(serial_msg);
+	return serial_msg;
+}
+
+static void slip_frame(void *user_data, size_t len)
+{
+	(void)user_data;
+
+	/* Handled in place, the buffer is reused for the next message */
+	handle_message(serial_msg, len);
+}
+
+static void slip_discard(void *user_data)
+{
+	(void)user_data;
+}
+
+static const struct slip_decoder_cb slip_cb = {
+	.alloc = slip_alloc,
+	.frame = slip_frame,
+	.discard = slip_discard,
+};
+
+static void serial_read(void)
+{
+	static uint8_t chunk[SERIAL_READ_MAX];
+	ssize_t n;
+
+	n = read(serial_fd, chunk, sizeof(chunk));
+	if (n < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			perror("serial read");
+			running = false;
+		}
+		return;
+	}
+
+	if (!n) {
+		fprintf(stderr, "Serial port closed\n");
+		running = false;
+		return;
+	}
+
+	slip_decode(&slip_dec, chunk, n);
+}
+
+/* TUN to radio */
+
+/* MAC header of a data frame from the radio to a neighbour */
+static size_t mhr_build(uint8_t *f, uint8_t s, uint8_t mode, uint64_t dst)
+{
+	uint16_t fcf = FCF_TYPE_DATA | FCF_PAN_ID_COMP | FCF_VERSION_2006 |
+		       FCF_DST_MODE(mode) | FCF_SRC_MODE(FRAME_FILTER_ADDR_EXT);
+	size_t dst_len = mode == FRAME_FILTER_ADDR_EXT ? 8 : 2;
+	size_t off = 0;
+
+	/* The radio awaits the ACK and retransmits without one */
+	if (dst != FRAME_FILTER_BROADCAST) {
+		fcf |= FRAME_FCF_ACK_REQUEST;
+	}
+
+	put_le(fcf, &f[off], 2);
+	off += 2;
+	f[off++] = s;
+	put_le(opts.pan_id, &f[off], 2);
+	off += 2;
+	put_le(dst, &f[off], dst_len);
+	off += dst_len;
+	put_le(radio_mac, &f[off], 8);
+	off += 8;
+
+	return off;
+}
+
+/* IPHC headers, or the dispatch of an uncompressed header */
+static size_t hdr_build(uint8_t *out, const uint8_t *ip6, size_t len,
+			uint8_t mode, uint64_t dst, size_t *hdr_len)
+{
+	struct lowpan_ll src_ll = { radio_mac, FRAME_FILTER_ADDR_EXT };
+	struct lowpan_ll dst_ll = { dst, mode };
+
+	if (opts.uncompressed) {
+		out[0] = LOWPAN_DISPATCH_IPV6;
+		*hdr_len = 0;
+		return 1;
+	}
+
+	return lowpan_compress(contexts, &src_ll, &dst_ll, ip6, len, out,
+			       hdr_len);
+}
+
+/* "!S" for a single frame, "!B" for several */
+static void batch_send(void)
+{
+	static uint8_t msg[BATCH_BYTES_MAX];
+	size_t off;
+	uint8_t i;
+
+	if (!batch.count) {
+		return;
+	}
+
+	if (batch.count == 1) {
+		msg[0] = '!';
+		msg[1] = 'S';
+		msg[2] = batch.seq[0];
+		/* No attributes */
+		msg[3] = 0;
+		memcpy(&msg[4], batch.psdu[0], batch.len[0]);
+		off = 4 + batch.len[0];
+	} else {
+		msg[0] = '!';
+		msg[1] = 'B';
+		msg[2] = batch.count;
+		off = 3;
+		for (i = 0; i < batch.count; i++) {
+			msg[off++] = batch.seq[i];
+			msg[off++] = batch.len[i];
+			memcpy(&msg[off], batch.psdu[i], batch.len[i]);
+			off += batch.len[i];
+		}
+		stats.batches++;
+	}
+
+	send_message(msg, off);
+	stats.radio_sent += batch.count;
+
+	vlog("-> Radio: %u frames\n", batch.count);
+
+	batch.count = 0;
+	batch.bytes = 0;
+}
+
+/* Add the frame built in the next batch slot, send the batch once full */
+static void batch_commit(size_t flen, uint8_t mode, uint64_t dst, int train)
+{
+	/* A report for a reused seq is lost */
+	train_report(seq, false);
+
+	if (train >= 0) {
+		frame_train[seq] = train + 1;
+		trains[train].frames++;
+	}
+
+	if (mode == FRAME_FILTER_ADDR_EXT ||
+	    (mode == FRAME_FILTER_ADDR_SHORT && dst != FRAME_FILTER_BROADCAST)) {
+		track_pending(seq, mode, dst);
+	}
+
+	batch.seq[batch.count] = seq++;
+	batch.len[batch.count] = flen;
+	batch.count++;
+	batch.bytes += 2 + flen;
+
+	if (batch.count == BATCH_MAX ||
+	    3 + batch.bytes + 2 + PSDU_MAX > BATCH_BYTES_MAX) {
+		batch_send();
+	}
+}
+
+/* FRAG1 with the compressed headers, then FRAGN fragments */
+static void train_send(const uint8_t *ip6, size_t len, uint8_t mode,
+		       uint64_t dst)
+{
+	int train = opts.node_reass ? train_start(dst) : -1;
+	uint8_t hdr[LOWPAN_IPHC_MAX];
+	struct lowpan_frag fr;
+	size_t hdr_n, hdr_len, off, n;
+	unsigned int count = 0;
+
+	hdr_n = hdr_build(hdr, ip6, len, mode, dst, &hdr_len);
+	lowpan_frag_start(&fr, ip6, len, hdr, hdr_n, hdr_len, frag_tag++);
+
+	while (true) {
+		uint8_t *f = batch.psdu[batch.count];
+
+		off = mhr_build(f, seq, mode, dst);
+		n = lowpan_frag_next(&fr, &f[off], PSDU_MAX - off);
+		if (!n) {
+			break;
+		}
+
+		batch_commit(off + n, mode, dst, train);
+		count++;
+	}
+
+	stats.trains++;
+	stats.fragments += count;
+	vlog("-> Radio: %zu bytes to %016llx in %u fragments, tag %u\n", len,
+	     (unsigned long long)dst, count, (uint16_t)(frag_tag - 1));
+}
+
+/* One frame or a train of fragments, false if the node has no room yet */
+static bool packet_send(const uint8_t *ip6, size_t len, uint8_t mode,
+			uint64_t dst)
+{
+	uint8_t *f = batch.psdu[batch.count];
+	size_t off, n, hdr_len;
+
+	off = mhr_build(f, seq, mode, dst);
+	n = hdr_build(&f[off], ip6, len, mode, dst, &hdr_len);
+	if (off + n + len - hdr_len <= PSDU_MAX) {
+		memcpy(&f[off + n], &ip6[hdr_len], len - hdr_len);
+		batch_commit(off + n + len - hdr_len, mode, dst, -1);
+		return true;
+	}
+
+	if (!train_room(dst)) {
+		return false;
+	}
+
+	train_send(ip6, len, mode, dst);
+	return true;
+}
+
+/* Broadcast a neighbor solicitation, from the link-local address if asked */
+static void solicit(struct neighbor *nb, uint64_t now)
+{
+	struct lowpan_ll ll = { radio_mac, FRAME_FILTER_ADDR_EXT };
+	uint8_t ns[NEIGHBOR_NS_LEN], src[16] = { 0xfe, 0x80 };
+	size_t len;
+
+	if (nb->ip6[0] == 0xfe && (nb->ip6[1] & 0xc0) == 0x80) {
+		put_be64(radio_mac ^ (2ULL << 56), &src[8]);
+	} else {
+		memcpy(src, bridge_addr, 16);
+	}
+
+	len = neighbor_solicit(ns, src, nb->ip6, &ll);
+	packet_send(ns, len, FRAME_FILTER_ADDR_SHORT, FRAME_FILTER_BROADCAST);
+
+	nb->probes++;
+	nb->expires = now + NEIGHBOR_RETRANS_MS;
+	stats.solicits++;
+
+	vlog("-> Radio: who has %s?\n", addr_str(nb->ip6));
+}
+
+/**
+ * Destination of a packet: the broadcast address for multicast, else the
+ * neighbor's link-layer address. An unknown address is solicited.
+ *
+ * @return 1 if resolved, 0 while solicited, negative if the table is full
+ */
+static int dst_resolve(const uint8_t *ip6_dst, uint8_t *mode, uint64_t *addr)
+{
+	uint64_t now = now_ms();
+	struct neighbor *nb;
+
+	if (ip6_dst[0] == 0xff) {
+		*mode = FRAME_FILTER_ADDR_SHORT;
+		*addr = FRAME_FILTER_BROADCAST;
+		return 1;
+	}
+
+	nb = neighbor_find(&neighbors, ip6_dst, now);
+	if (nb && nb->state == NEIGHBOR_REACHABLE) {
+		*mode = nb->ll.mode;
+		*addr = nb->ll.addr;
+		return 1;
+	}
+
+	if (nb) {
+		return 0;
+	}
+
+	nb = neighbor_add(&neighbors, ip6_dst, now);
+	if (!nb) {
+		return -1;
+	}
+
+	solicit(nb, now);
+	return 0;
+}
+
+/* Held packets to @p ip6_dst among the first @p end */
+static unsigned int held_count(const uint8_t *ip6_dst, unsigned int end)
+{
+	unsigned int i, count = 0;
+
+	for (i = 0; i < end; i++) {
+		count += !memcmp(&held.pkt[i][24], ip6_dst, 16);
+	}
+
+	return count;
+}
+
+static void held_remove(unsigned int i)
+{
+	held.count--;
+	memmove(&held.len[i], &held.len[i + 1],
+		(held.count - i) * sizeof(held.len[0]));
+	memmove(held.pkt[i], held.pkt[i + 1],
+		(held.count - i) * sizeof(held.pkt[0]));
+}
+
+/* The address did not answer its solicitations */
+static void held_drop(const uint8_t *ip6_dst)
+{
+	unsigned int i = 0;
+
+	while (i < held.count) {
+		if (memcmp(&held.pkt[i][24], ip6_dst, 16)) {
+			i++;
+			continue;
+		}
+
+		held_remove(i);
+		stats.unresolved++;
+	}
+}
+
+/**
+ * Send the held packets whose destination is resolved and has room by
+ * now, in order per destination
+ */
+static void held_flush(void)
+{
+	unsigned int i = 0;
+	uint8_t mode;
+	uint64_t dst;
+	int ret;
+
+	while (i < held.count) {
+		const uint8_t *ip6_dst = &held.pkt[i][24];
+
+		if (held_count(ip6_dst, i)) {
+			i++;
+			continue;
+		}
+
+		ret = dst_resolve(ip6_dst, &mode, &dst);
+		if (ret < 0) {
+			held_remove(i);
+			stats.unresolved++;
+			continue;
+		}
+
+		if (!ret || !packet_send(held.pkt[i], held.len[i], mode, dst)) {
+			i++;
+			continue;
+		}
+
+		held_remove(i);
+	}
+
+	batch_send();
+}
+
+/**
+ * Add a TUN packet to the batch, as one frame or a train of fragments, or
+ * hold it back behind earlier ones to its destination
+ */
+static void tun_packet(const uint8_t *ip6, size_t len)
+{
+	unsigned int queued;
+	uint8_t mode;
+	uint64_t dst;
+	int ret;
+
+	if (len < IPV6_HDR_LEN || (ip6[0] >> 4) != 6) {
+		stats.unsupported++;
+		return;
+	}
+
+	queued = held_count(&ip6[24], held.count);
+	ret = dst_resolve(&ip6[24], &mode, &dst);
+	if (ret < 0 || (!ret && queued >= HELD_UNRESOLVED_MAX)) {
+		stats.unresolved++;
+		return;
+	}
+
+	if (ret && !queued && packet_send(ip6, len, mode, dst)) {
+		return;
+	}
+
+	/* tun_gate() stops reading before the table is full */
+	if (held.count == HELD_MAX) {
+		stats.dropped++;
+		return;
+	}
+
+	held.len[held.count] = len;
+	memcpy(held.pkt[held.count], ip6, len);
+	held.count++;
+	stats.held++;
+	vlog("  Holding %zu bytes until %s\n", len,
+	     ret ? "the node has room" : "the node is resolved");
+}
+
+/* Drain the TUN device into batches while the serial-radio takes them */
+static void tun_read(void)
+{
+	static uint8_t pkt[TUN_MTU];
+	ssize_t n;
+
+	while (tun_reading) {
+		n = read(tun_fd, pkt, sizeof(pkt));
+		if (n <= 0) {
+			if (n < 0 && errno != EAGAIN && errno != EINTR) {
+				perror("tun read");
+			}
+			break;
+		}
+
+		stats.tun_read++;
+		tun_packet(pkt, n);
+		tun_gate();
+	}
+
+	batch_send();
+	tun_gate();
+}
+
+/* Timeouts */
+
+static void handle_timer(void)
+{
+	uint64_t expirations, now = now_ms();
+	struct neighbor *nb;
+	size_t n;
+	int i;
+
+	if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+		return;
+	}
+
+	lowpan_reass_expire(&reass, now);
+
+	for (i = 0; i < TRAINS_MAX; i++) {
+		if (trains[i].used && trains[i].failed && !trains[i].frames &&
+		    trains[i].expires <= now) {
+			trains[i].used = false;
+		}
+	}
+
+	/* Removing an entry may move the next one into its slot */
+	for (n = 0; n < NEIGHBOR_SLOTS && neighbors.incomplete; n++) {
+		nb = &neighbors.e[n];
+		if (nb->state != NEIGHBOR_INCOMPLETE || nb->expires > now) {
+			continue;
+		}
+
+		if (nb->probes < NEIGHBOR_SOLICIT_MAX) {
+			solicit(nb, now);
+			continue;
+		}
+
+		vlog("  No answer from %s\n", addr_str(nb->ip6));
+		held_drop(nb->ip6);
+		neighbor_remove(&neighbors, nb);
+		n--;
+	}
+
+	batch_send();
+}
+
+/* Setup */
+
+static speed_t baud_speed(int baud)
+{
+	switch (baud) {
+	case 115200:
+		return B115200;
+	case 230400:
+		return B230400;
+	case 460800:
+		return B460800;
+	case 921600:
+		return B921600;
+	case 1000000:
+		return B1000000;
+	default:
+		return 0;
+	}
+}
+
+static int serial_open(const char *device, int baud)
+{
+	struct termios tio;
+	speed_t speed = baud_speed(baud);
+	int fd;
+
+	if (!speed) {
+		fprintf(stderr, "Unsupported baud rate %d\n", baud);
+		return -1;
+	}
+
+	fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		perror(device);
+		return -1;
+	}
+
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tio.c_cflag |= CLOCAL | CREAD;
+		cfsetspeed(&tio, speed);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	return fd;
+}
+
+/* As in <linux/ipv6.h>, which clashes with <netinet/in.h> */
+struct in6_ifreq {
+	struct in6_addr ifr6_addr;
+	uint32_t ifr6_prefixlen;
+	int ifr6_ifindex;
+};
+
+/* Create the TUN device, bring it up and add prefix::1/64 */
+static int tun_open(const char *ifname, const char *prefix)
+{
+	struct in6_ifreq ifr6 = { .ifr6_prefixlen = 64 };
+	struct ifreq ifr = { 0 };
+	int fd, sock;
+
+	if (inet_pton(AF_INET6, prefix, &ifr6.ifr6_addr) != 1) {
+		fprintf(stderr, "Invalid prefix %s\n", prefix);
+		return -1;
+	}
+
+	memset(&ifr6.ifr6_addr.s6_addr[8], 0, 8);
+	ifr6.ifr6_addr.s6_addr[15] = 1;
+
+	fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		perror("/dev/net/tun");
+		return -1;
+	}
+
+	ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+		perror("TUNSETIFF");
+		close(fd);
+		return -1;
+	}
+
+	sock = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		perror("socket");
+		close(fd);
+		return -1;
+	}
+
+	ifr.ifr_mtu = TUN_MTU;
+	if (ioctl(sock, SIOCSIFMTU, &ifr) < 0) {
+		perror("SIOCSIFMTU");
+	}
+
+	if (ioctl(sock, SIOCGIFFLAGS, &ifr) < 0) {
+		perror(ifname);
+		goto err;
+	}
+
+	ifr.ifr_flags |= IFF_UP;
+	if (ioctl(sock, SIOCSIFFLAGS, &ifr) < 0 ||
+	    ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
+		perror(ifname);
+		goto err;
+	}
+
+	ifr6.ifr6_ifindex = ifr.ifr_ifindex;
+	if (ioctl(sock, SIOCSIFADDR, &ifr6) < 0 && errno != EEXIST) {
+		perror("SIOCSIFADDR");
+		goto err;
+	}
+
+	close(sock);
+
+	return fd;
+
+err:
+	close(sock);
+	close(fd);
+	return -1;
+}
+
+static int epoll_add(int fd, uint32_t events)
+{
+	struct epoll_event ev = { .events = events, .data.fd = fd };
+
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void print_stats(void)
+{
+	printf("radio: %llu frames received, %llu written to %s, "
+	       "%llu unsupported\n",
+	       (unsigned long long)stats.radio_frames,
+	       (unsigned long long)stats.tun_written, opts.ifname,
+	       (unsigned long long)stats.unsupported);
+	printf("%s: %llu packets read, %llu frames sent in %llu batches, "
+	       "%llu dropped\n", opts.ifname,
+	       (unsigned long long)stats.tun_read,
+	       (unsigned long long)stats.radio_sent,
+	       (unsigned long long)stats.batches,
+	       (unsigned long long)stats.dropped);
+	printf("fragments: %llu packets sent in %llu fragments, %llu held "
+	       "for a node; %u reassembled, %u timed out, %u dropped\n",
+	       (unsigned long long)stats.trains,
+	       (unsigned long long)stats.fragments,
+	       (unsigned long long)stats.held, reass.complete, reass.timeouts,
+	       reass.dropped);
+	printf("neighbors: %zu known, %u learned, %u aged out, %u evicted; "
+	       "%llu solicitations, %llu packets unresolved\n",
+	       neighbors.count, neighbors.learned, neighbors.expired,
+	       neighbors.evicted, (unsigned long long)stats.solicits,
+	       (unsigned long long)stats.unresolved);
+	printf("reports: %llu ok, %llu failed; %llu TUN write errors, "
+	       "%llu messages dropped\n",
+	       (unsigned long long)stats.tx_ok,
+	       (unsigned long long)stats.tx_failed,
+	       (unsigned long long)stats.tun_errors,
+	       (unsigned long long)stats.msgq_full);
+	fflush(stdout);
+}
+
+static void handle_signal(void)
+{
+	struct signalfd_siginfo si;
+
+	if (read(sig_fd, &si, sizeof(si)) != sizeof(si)) {
+		return;
+	}
+
+	if (si.ssi_signo == SIGUSR1) {
+		print_stats();
+	} else {
+		running = false;
+	}
+}
+
+/* Credits, then the MAC address, the channel and the frame options */
+static void radio_setup(void)
+{
+	static const uint8_t credit_req[] = { '?', 'C' };
+	uint8_t msg[4];
+
+	/* The firmware counts released messages from this request on */
+	out_put(credit_req, sizeof(credit_req));
+	credits.sent = 1;
+
+	send_message((const uint8_t *)"?M", 2);
+
+	if (opts.channel == 0) {
+		msg[0] = '?';
+		msg[1] = 'L';
+		put_be16(ED_SCAN_MS, &msg[2]);
+		send_message(msg, 4);
+		printf("-> Scanning channels...\n");
+	} else if (opts.channel > 0) {
+		msg[0] = '!';
+		msg[1] = 'C';
+		msg[2] = opts.channel;
+		send_message(msg, 3);
+	}
+
+	/* Containers while backlogged, metadata and the frame pending bit */
+	send_message((const uint8_t *)"!A\x01", 3);
+	send_message((const uint8_t *)"!E\x01", 3);
+	send_message((const uint8_t *)"!JA\x01", 4);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -d, --device PATH    serial port of the serial-radio (%s)\n"
+		"  -b, --baud RATE      serial rate (%d)\n"
+		"  -i, --ifname NAME    TUN device (%s)\n"
+		"  -p, --prefix PREFIX  /64 prefix, the bridge takes ::1 (%s)\n"
+		"  -P, --pan ID         PAN ID of sent frames (0x%04x)\n"
+		"  -c, --channel CHAN   radio channel, 'auto' for the quietest\n"
+		"  -x, --context        compress the prefix as 6LoWPAN context 0\n"
+		"  -u, --uncompressed   send uncompressed IPv6 headers\n"
+		"  -r, --node-reass N   datagrams a node reassembles at once (%d),\n"
+		"                       0 to send fragments without waiting\n"
+		"  -v, --verbose        log every packet\n",
+		prog, opts.device, opts.baud, opts.ifname, opts.prefix,
+		opts.pan_id, opts.node_reass);
+}
+
+static int parse_args(int argc, char **argv)
+{
+	static const struct option longopts[] = {
+		{ "device", required_argument, NULL, 'd' },
+		{ "baud", required_argument, NULL, 'b' },
+		{ "ifname", required_argument, NULL, 'i' },
+		{ "prefix", required_argument, NULL, 'p' },
+		{ "pan", required_argument, NULL, 'P' },
+		{ "channel", required_argument, NULL, 'c' },
+		{ "context", no_argument, NULL, 'x' },
+		{ "uncompressed", no_argument, NULL, 'u' },
+		{ "node-reass", required_argument, NULL, 'r' },
+		{ "verbose", no_argument, NULL, 'v' },
+		{ "help", no_argument, NULL, 'h' },
+		{ 0 },
+	};
+	int c;
+
+	while ((c = getopt_long(argc, argv, "d:b:i:p:P:c:xur:vh", longopts,
+				NULL)) != -1) {
+		switch (c) {
+		case 'd':
+			opts.device = optarg;
+			break;
+		case 'b':
+			opts.baud = atoi(optarg);
+			break;
+		case 'i':
+			opts.ifname = optarg;
+			break;
+		case 'p':
+			opts.prefix = optarg;
+			break;
+		case 'P':
+			opts.pan_id = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			opts.channel = strcmp(optarg, "auto") ? atoi(optarg) : 0;
+			if (opts.channel < 0 || opts.channel > 26) {
+				fprintf(stderr, "Invalid channel %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'x':
+			opts.context = true;
+			break;
+		case 'u':
+			opts.uncompressed = true;
+			break;
+		case 'r':
+			opts.node_reass = atoi(optarg);
+			if (opts.node_reass < 0) {
+				fprintf(stderr, "Invalid cache size %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'v':
+			opts.verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (inet_pton(AF_INET6, opts.prefix, bridge_addr) != 1) {
+		fprintf(stderr, "Invalid prefix %s\n", opts.prefix);
+		return -1;
+	}
+
+	if (opts.context) {
+		contexts[0].valid = true;
+		memcpy(contexts[0].prefix, bridge_addr, 8);
+	}
+
+	memset(&bridge_addr[8], 0, 8);
+	bridge_addr[15] = 1;
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct epoll_event events[5];
+	sigset_t mask;
+	int n, i;
+
+	if (parse_args(argc, argv) < 0) {
+		return 1;
+	}
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	serial_fd = serial_open(opts.device, opts.baud);
+	tun_fd = tun_open(opts.ifname, opts.prefix);
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (sig_fd < 0 || timer_fd < 0 || serial_fd < 0 || tun_fd < 0 ||
+	    epfd < 0) {
+		return 1;
+	}
+
+	printf("Bridging %s to %s with prefix %s/64\n", opts.device,
+	       opts.ifname, opts.prefix);
+
+	slip_decoder_init(&slip_dec, &slip_cb, NULL);
+	lowpan_reass_init(&reass, LOWPAN_REASS_MAX, REASS_TIMEOUT_MS);
+	neighbor_init(&neighbors, NEIGHBOR_TIMEOUT_MS);
+
+	if (epoll_add(sig_fd, EPOLLIN) < 0 || epoll_add(serial_fd, EPOLLIN) < 0 ||
+	    epoll_add(tun_fd, 0) < 0 || epoll_add(timer_fd, EPOLLIN) < 0) {
+		perror("epoll_ctl");
+		return 1;
+	}
+
+	radio_setup();
+
+	while (running) {
+		n = epoll_wait(epfd, events, sizeof(events) / sizeof(events[0]),
+			       -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == sig_fd) {
+				handle_signal();
+			} else if (fd == serial_fd) {
+				if (events[i].events & EPOLLOUT) {
+					serial_flush();
+					msgq_flush();
+				}
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+					serial_read();
+				}
+			} else if (fd == tun_fd) {
+				tun_read();
+			} else if (fd == timer_fd) {
+				handle_timer();
+			}
+		}
+
+		/* Nodes may have room for held packets by now */
+		if (held.count) {
+			held_flush();
+		}
+
+		timer_update();
+		tun_gate();
+	}
+
+	print_stats();
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Chunk based COBS framing with CRC-16 for the serial-radio protocol
+ *
+ * Alternative to SLIP on the serial link. Each frame is followed by a
+ * CRC-16/CCITT-FALSE (big-endian), encoded with Consistent Overhead Byte
+ * Stuffing and terminated by a 0x00 delimiter. Encoding adds one byte
+ * per 254 and three per frame whatever the content, where SLIP may
+ * double a frame, and frames that fail the CRC are dropped instead of
+ * being passed on. A 0x00 inside a frame always ends it, so the decoder
+ * is back in sync at the next frame after any corruption.
+ *
+ * Like the SLIP decoder, this does not depend on Zephyr, and frame
+ * storage is provided through the same callbacks.
+ */
+
+#ifndef SERIAL_RADIO_COBS_H_
+#define SERIAL_RADIO_COBS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "slip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COBS_DELIM     0x00
+#define COBS_BLOCK_MAX 254
+#define COBS_CRC_LEN   2
+#define COBS_CRC_INIT  0xffff
+
+/* Encoded size of a frame of @p len bytes in the worst case */
+#define COBS_ENCODED_MAX(len) \
+	((len) + COBS_CRC_LEN + ((len) + COBS_CRC_LEN) / COBS_BLOCK_MAX + 2)
+
+struct cobs_decoder {
+	const struct slip_decoder_cb *cb;
+	void *user_data;
+
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+
+	/* Bytes left in the current block, 0 at a code byte */
+	uint8_t left;
+	/* A zero follows the current block unless the frame ends */
+	uint8_t zero;
+	/* Discarding up to the next delimiter */
+	uint8_t garbage;
+
+	/** Bytes discarded because of framing errors or missing storage */
+	uint32_t dropped;
+	/** Frames discarded because their CRC did not match */
+	uint32_t crc_errors;
+};
+
+/**
+ * @brief Streaming COBS encoder
+ *
+ * Like the SLIP encoder, encodes a frame of one or more segments into as
+ * many output windows as needed. A block is staged in the encoder only
+ * if it spans segments or output windows, all others are copied straight
+ * from the frame.
+ */
+struct cobs_encoder {
+	const uint8_t *data;
+	size_t len;
+
+	uint16_t crc;
+	uint8_t crc_bytes[COBS_CRC_LEN];
+	/* enum cobs_enc_state */
+	uint8_t state;
+	/* The current segment is the last one */
+	uint8_t last;
+
+	/* Staged block: code byte, then its data */
+	uint8_t block[1 + COBS_BLOCK_MAX];
+	uint8_t fill;
+	/* Bytes of the staged block to write and written, once closed */
+	uint16_t emit_len;
+	uint16_t emit;
+};
+
+/** @brief CRC-16/CCITT-FALSE, start with COBS_CRC_INIT */
+uint16_t cobs_crc16(uint16_t crc, const uint8_t *data, size_t len);
+
+void cobs_decoder_init(struct cobs_decoder *dec,
+		       const struct slip_decoder_cb *cb, void *user_data);
+
+/**
+ * @brief Drop any partial frame and wait for the next delimiter
+ *
+ * Used after input bytes have been lost, e.g. on a UART overrun.
+ */
+void cobs_decoder_reset(struct cobs_decoder *dec);
+
+/**
+ * @brief Decode a span of received bytes
+ *
+ * Frames are passed to the frame() callback without their CRC.
+ *
+ * @return Number of frames completed within @p data
+ */
+size_t cobs_decode(struct cobs_decoder *dec, const uint8_t *data, size_t len);
+
+void cobs_encoder_start(struct cobs_encoder *enc, const uint8_t *data,
+			size_t len);
+
+/** @brief Begin a frame that is made of several segments */
+void cobs_encoder_begin(struct cobs_encoder *enc);
+
+/**
+ * @brief Continue the frame with the next segment
+ *
+ * The CRC and the delimiter follow the segment with @p last set.
+ */
+void cobs_encoder_next(struct cobs_encoder *enc, const uint8_t *data,
+		       size_t len, int last);
+
+/**
+ * @brief Encode the next part of the frame into @p dst
+ *
+ * @return Number of bytes written, at most @p size
+ */
+size_t cobs_encode(struct cobs_encoder *enc, uint8_t *dst, size_t size);
+
+/**
+ * @brief The frame is complete, or the encoder waits for the next segment
+ */
+int cobs_encoder_done(const struct cobs_encoder *enc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_RADIO_COBS_H_ */
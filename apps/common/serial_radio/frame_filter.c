@@ -0,0 +1,266 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "frame_filter.h"
+
+/* Frame control field */
+#define FCF_PAN_ID_COMP   0x0040
+#define FCF_SEQ_SUPPRESS  0x0100
+#define FCF_DST_MODE(fcf) (((fcf) >> 10) & 3)
+#define FCF_VERSION(fcf)  (((fcf) >> 12) & 3)
+#define FCF_SRC_MODE(fcf) (((fcf) >> 14) & 3)
+
+#define FRAME_VERSION_2015 2
+
+/* Frame types from multipurpose on have no regular addressing fields */
+#define FRAME_TYPE_MULTIPURPOSE 5
+
+static uint64_t get_le(const uint8_t *p, size_t len)
+{
+	uint64_t v = 0;
+
+	while (len--) {
+		v = (v << 8) | p[len];
+	}
+
+	return v;
+}
+
+static size_t addr_len(uint8_t mode)
+{
+	return mode == FRAME_FILTER_ADDR_EXT ? 8 :
+	       mode == FRAME_FILTER_ADDR_SHORT ? 2 : 0;
+}
+
+/**
+ * PAN ID fields present, by frame version. 802.15.4-2015 frames use
+ * table 7-2 of the standard, older ones omit the source PAN ID only
+ * if PAN ID compression is set.
+ */
+static void mhr_pan_ids(struct frame_mhr *h, uint16_t fcf)
+{
+	bool comp = fcf & FCF_PAN_ID_COMP;
+
+	if (FCF_VERSION(fcf) < FRAME_VERSION_2015) {
+		h->has_dst_pan = h->dst_mode != FRAME_FILTER_ADDR_NONE;
+		h->has_src_pan = h->src_mode != FRAME_FILTER_ADDR_NONE && !comp;
+	} else if (h->dst_mode == FRAME_FILTER_ADDR_NONE &&
+		   h->src_mode == FRAME_FILTER_ADDR_NONE) {
+		h->has_dst_pan = comp;
+	} else if (h->src_mode == FRAME_FILTER_ADDR_NONE) {
+		h->has_dst_pan = !comp;
+	} else if (h->dst_mode == FRAME_FILTER_ADDR_NONE) {
+		h->has_src_pan = !comp;
+	} else if (h->dst_mode == FRAME_FILTER_ADDR_EXT &&
+		   h->src_mode == FRAME_FILTER_ADDR_EXT) {
+		h->has_dst_pan = !comp;
+	} else {
+		h->has_dst_pan = true;
+		h->has_src_pan = !comp;
+	}
+}
+
+bool frame_mhr_parse(const uint8_t *p, size_t len, struct frame_mhr *h)
+{
+	const uint8_t *start = p;
+	const uint8_t *end = p + len;
+	uint16_t fcf;
+
+	memset(h, 0, sizeof(*h));
+
+	if (len < 2) {
+		return false;
+	}
+
+	fcf = get_le(p, 2);
+	h->type = fcf & FRAME_FCF_TYPE_MASK;
+	p += 2;
+
+	/* Matched by type only */
+	if (h->type >= FRAME_TYPE_MULTIPURPOSE) {
+		return true;
+	}
+
+	h->ack_request = fcf & FRAME_FCF_ACK_REQUEST;
+
+	if (!(FCF_VERSION(fcf) == FRAME_VERSION_2015 &&
+	      (fcf & FCF_SEQ_SUPPRESS))) {
+		if (p == end) {
+			return false;
+		}
+
+		h->has_seq = true;
+		h->seq = *p++;
+	}
+
+	h->dst_mode = FCF_DST_MODE(fcf);
+	h->src_mode = FCF_SRC_MODE(fcf);
+	if (h->dst_mode == 1 || h->src_mode == 1) {
+		/* Reserved addressing mode */
+		return false;
+	}
+
+	mhr_pan_ids(h, fcf);
+
+	if (end - p < (ptrdiff_t)((h->has_dst_pan + h->has_src_pan) * 2 +
+				  addr_len(h->dst_mode) +
+				  addr_len(h->src_mode))) {
+		return false;
+	}
+
+	if (h->has_dst_pan) {
+		h->dst_pan = get_le(p, 2);
+		p += 2;
+	}
+
+	h->dst = get_le(p, addr_len(h->dst_mode));
+	p += addr_len(h->dst_mode);
+
+	if (h->has_src_pan) {
+		h->src_pan = get_le(p, 2);
+		p += 2;
+	}
+
+	h->src = get_le(p, addr_len(h->src_mode));
+	p += addr_len(h->src_mode);
+
+	h->hdr_len = p - start;
+
+	return true;
+}
+
+static bool src_listed(const struct frame_filter_src *list, uint8_t num,
+		       const struct frame_mhr *h)
+{
+	for (uint8_t i = 0; i < num; i++) {
+		if (list[i].mode == h->src_mode && list[i].addr == h->src) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void frame_filter_update(struct frame_filter *f)
+{
+	f->active = f->pan_id != FRAME_FILTER_BROADCAST ||
+		    f->short_addr != FRAME_FILTER_BROADCAST ||
+		    f->ext_addr != 0 ||
+		    f->type_mask != FRAME_FILTER_TYPES_ALL ||
+		    f->num_allow || f->num_deny;
+}
+
+void frame_filter_clear(struct frame_filter *f)
+{
+	memset(f, 0, sizeof(*f));
+	f->pan_id = FRAME_FILTER_BROADCAST;
+	f->short_addr = FRAME_FILTER_BROADCAST;
+	f->type_mask = FRAME_FILTER_TYPES_ALL;
+}
+
+void frame_filter_set_mac_addr(struct frame_filter *f, uint64_t mac_addr)
+{
+	f->mac_addr = mac_addr;
+}
+
+void frame_filter_set_pan_id(struct frame_filter *f, uint16_t pan_id)
+{
+	f->pan_id = pan_id;
+	frame_filter_update(f);
+}
+
+void frame_filter_set_short_addr(struct frame_filter *f, uint16_t short_addr)
+{
+	f->short_addr = short_addr;
+	frame_filter_update(f);
+}
+
+void frame_filter_set_ext_addr(struct frame_filter *f, uint64_t ext_addr)
+{
+	f->ext_addr = ext_addr;
+	frame_filter_update(f);
+}
+
+void frame_filter_set_types(struct frame_filter *f, uint8_t mask)
+{
+	f->type_mask = mask;
+	frame_filter_update(f);
+}
+
+int frame_filter_add_src(struct frame_filter *f, bool deny, uint8_t mode,
+			 uint64_t addr)
+{
+	struct frame_filter_src *list = deny ? f->deny : f->allow;
+	uint8_t *num = deny ? &f->num_deny : &f->num_allow;
+
+	if (mode != FRAME_FILTER_ADDR_SHORT && mode != FRAME_FILTER_ADDR_EXT) {
+		return -EINVAL;
+	}
+
+	if (*num >= FRAME_FILTER_SRC_MAX) {
+		return -ENOMEM;
+	}
+
+	list[*num].mode = mode;
+	list[*num].addr = mode == FRAME_FILTER_ADDR_SHORT ?
+			  (addr & 0xffff) : addr;
+	(*num)++;
+	frame_filter_update(f);
+
+	return 0;
+}
+
+bool frame_filter_match(const struct frame_filter *f, const uint8_t *psdu,
+			size_t len)
+{
+	struct frame_mhr h;
+
+	if (!f->active) {
+		return true;
+	}
+
+	if (!frame_mhr_parse(psdu, len, &h)) {
+		return false;
+	}
+
+	if (!(f->type_mask & (1U << h.type))) {
+		return false;
+	}
+
+	if (f->pan_id != FRAME_FILTER_BROADCAST) {
+		uint16_t pan = h.has_dst_pan ? h.dst_pan : h.src_pan;
+
+		if ((h.has_dst_pan || h.has_src_pan) &&
+		    pan != FRAME_FILTER_BROADCAST && pan != f->pan_id) {
+			return false;
+		}
+	}
+
+	if (f->short_addr != FRAME_FILTER_BROADCAST || f->ext_addr != 0) {
+		if (h.dst_mode == FRAME_FILTER_ADDR_SHORT &&
+		    h.dst != FRAME_FILTER_BROADCAST &&
+		    (f->short_addr == FRAME_FILTER_BROADCAST ||
+		     h.dst != f->short_addr)) {
+			return false;
+		}
+
+		if (h.dst_mode == FRAME_FILTER_ADDR_EXT &&
+		    h.dst != (f->ext_addr ? f->ext_addr : f->mac_addr)) {
+			return false;
+		}
+	}
+
+	if (f->num_deny && src_listed(f->deny, f->num_deny, &h)) {
+		return false;
+	}
+
+	if (f->num_allow && !src_listed(f->allow, f->num_allow, &h)) {
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,170 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Software filter for received 802.15.4 frames
+ *
+ * Matches frames by type, destination PAN ID and address, and source
+ * allow and deny lists, on the MAC header alone. Like the SLIP decoder
+ * it does not depend on Zephyr, so that it can be benchmarked on a
+ * Linux host.
+ */
+
+#ifndef SERIAL_RADIO_FRAME_FILTER_H_
+#define SERIAL_RADIO_FRAME_FILTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_WPAN_SERIAL_FILTER_SRC_MAX)
+#define FRAME_FILTER_SRC_MAX CONFIG_WPAN_SERIAL_FILTER_SRC_MAX
+#else
+#define FRAME_FILTER_SRC_MAX 8
+#endif
+
+/* Addressing modes, as in the frame control field */
+#define FRAME_FILTER_ADDR_NONE  0
+#define FRAME_FILTER_ADDR_SHORT 2
+#define FRAME_FILTER_ADDR_EXT   3
+
+/* Frame control field */
+#define FRAME_FCF_TYPE_MASK   0x0007
+#define FRAME_FCF_SECURITY    0x0008
+#define FRAME_FCF_PENDING     0x0010
+#define FRAME_FCF_ACK_REQUEST 0x0020
+
+#define FRAME_TYPE_ACK 2
+
+/* Broadcast PAN ID and short address */
+#define FRAME_FILTER_BROADCAST 0xffff
+
+#define FRAME_FILTER_TYPES_ALL 0xff
+
+/* Addressing fields of a MAC header */
+struct frame_mhr {
+	uint8_t type;
+	bool ack_request;
+	bool has_seq;
+	uint8_t seq;
+	uint8_t dst_mode;
+	uint8_t src_mode;
+	bool has_dst_pan;
+	bool has_src_pan;
+	uint16_t dst_pan;
+	uint16_t src_pan;
+	/* Extended addresses in host order, short ones in the low bits */
+	uint64_t dst;
+	uint64_t src;
+	/* Up to the auxiliary security header or the payload */
+	uint8_t hdr_len;
+};
+
+struct frame_filter_src {
+	/* Extended addresses in host order, short ones in the low bits */
+	uint64_t addr;
+	uint8_t mode;
+};
+
+struct frame_filter {
+	/* Any of the criteria below is set */
+	bool active;
+
+	/* FRAME_FILTER_BROADCAST if not filtered by */
+	uint16_t pan_id;
+	uint16_t short_addr;
+	/* 0 if not filtered by */
+	uint64_t ext_addr;
+	/* The radio's own extended address, matched while ext_addr is 0 */
+	uint64_t mac_addr;
+
+	/* Bit n accepts frame type n */
+	uint8_t type_mask;
+
+	uint8_t num_allow;
+	uint8_t num_deny;
+	struct frame_filter_src allow[FRAME_FILTER_SRC_MAX];
+	struct frame_filter_src deny[FRAME_FILTER_SRC_MAX];
+};
+
+/**
+ * @brief Parse the addressing fields of a MAC header
+ *
+ * Multipurpose, fragment and extended frames are only parsed up to
+ * their type, and their header length is left at 0.
+ *
+ * @return false if the header is truncated or malformed
+ */
+bool frame_mhr_parse(const uint8_t *psdu, size_t len, struct frame_mhr *h);
+
+/** @brief Accept all frames, and forget the MAC address */
+void frame_filter_clear(struct frame_filter *f);
+
+/**
+ * @brief Set the radio's own extended address
+ *
+ * While no extended address is set, address filtering accepts frames to
+ * this one instead, as the radio acknowledges them. It does not enable
+ * filtering by itself.
+ */
+void frame_filter_set_mac_addr(struct frame_filter *f, uint64_t mac_addr);
+
+/**
+ * @brief Accept frames of @p pan_id and the broadcast PAN only
+ *
+ * The destination PAN ID is checked, or the source PAN ID of frames
+ * without a destination. FRAME_FILTER_BROADCAST accepts all PANs.
+ */
+void frame_filter_set_pan_id(struct frame_filter *f, uint16_t pan_id);
+
+/**
+ * @brief Accept frames to these addresses and broadcasts only
+ *
+ * Once either is set, frames with a destination address are accepted
+ * if it is the broadcast address or one of these. Frames without a
+ * destination address, e.g. beacons, pass. FRAME_FILTER_BROADCAST and 0
+ * respectively unset an address; without an extended address, the MAC
+ * address is accepted.
+ */
+void frame_filter_set_short_addr(struct frame_filter *f, uint16_t short_addr);
+void frame_filter_set_ext_addr(struct frame_filter *f, uint64_t ext_addr);
+
+/** @brief Accept the frame types whose bit is set in @p mask */
+void frame_filter_set_types(struct frame_filter *f, uint8_t mask);
+
+/**
+ * @brief Add a source address to the allow or the deny list
+ *
+ * Frames from a denied source are rejected. Once the allow list holds
+ * an entry, only frames from its sources are accepted, so frames
+ * without a source address are rejected as well.
+ *
+ * @return 0, -EINVAL for an invalid @p mode or -ENOMEM if the list is
+ *         full
+ */
+int frame_filter_add_src(struct frame_filter *f, bool deny, uint8_t mode,
+			 uint64_t addr);
+
+/**
+ * @brief Match a received frame
+ *
+ * @param psdu Frame starting with the frame control field, with or
+ *             without FCS
+ *
+ * @return true if the frame passes. Frames whose MAC header is
+ *         truncated or malformed only pass an inactive filter.
+ */
+bool frame_filter_match(const struct frame_filter *f, const uint8_t *psdu,
+			size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_RADIO_FRAME_FILTER_H_ */
@@ -0,0 +1,2944 @@
+/*
+ * Copyright (c) 2016-2019 Intel Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Core of the 802.15.4 "serial-radio" protocol
+ *
+ * Implementation of the 802.15.4 "serial-radio" protocol compatible with
+ * popular Contiki-based native border routers, shared by all transports
+ * to the host.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(serial_radio, LOG_LEVEL_INF);
+
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/random/random.h>
+#include <zephyr/sys/ring_buffer.h>
+#if defined(CONFIG_WPAN_SERIAL_RX_ISR_TIMING)
+#include <zephyr/timing/timing.h>
+#endif
+
+#include <zephyr/net/buf.h>
+#include <net_private.h>
+#include <zephyr/net/ieee802154_radio.h>
+
+#include "cobs.h"
+#include "frame_filter.h"
+#include "serial_radio.h"
+#include "slip.h"
+
+#if defined(CONFIG_NET_TC_THREAD_COOPERATIVE)
+#define THREAD_PRIORITY K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1)
+#else
+#define THREAD_PRIORITY K_PRIO_PREEMPT(8)
+#endif
+
+#define ANALYZE_UART_BOTTLENECK 0
+
+#if ANALYZE_UART_BOTTLENECK
+static atomic_t packets_received = ATOMIC_INIT(0);
+static atomic_t packets_sent = ATOMIC_INIT(0);
+#endif
+
+struct serial_radio_stats serial_radio_stats;
+
+/* Transport to the host, set by serial_radio_start() */
+static const struct serial_radio_transport *transport;
+
+/* RX queue */
+static struct k_fifo rx_queue;
+static K_THREAD_STACK_DEFINE(rx_stack, 1024);
+static struct k_thread rx_thread_data;
+
+#if defined(CONFIG_UART_INTERRUPT_DRIVEN)
+/**
+ * Raw bytes from the UART interrupt on their way to rx_decode_thread.
+ * The interrupt handler is the only producer and the thread the only
+ * consumer, so the ring needs no locking. The handler only copies
+ * bytes; SLIP framing and buffer allocation happen in the thread.
+ */
+RING_BUF_DECLARE(rx_ring, CONFIG_WPAN_SERIAL_RX_RING_SIZE);
+static K_SEM_DEFINE(rx_ring_sem, 0, 1);
+static K_THREAD_STACK_DEFINE(rx_decode_stack, 1024);
+static struct k_thread rx_decode_thread_data;
+
+/**
+ * Running byte counters of rx_ring. Once the ring has overflowed, the
+ * handler drops everything until the thread has decoded the bytes in
+ * front of the gap at rx_gap_at and resynchronized.
+ */
+static uint32_t rx_put_total;
+static uint32_t rx_get_total;
+static uint32_t rx_gap_at;
+static atomic_t rx_gap;
+
+#if defined(CONFIG_WPAN_SERIAL_RX_ISR_TIMING)
+/* Time spent moving received bytes in the interrupt handler */
+static uint64_t rx_isr_cycles;
+#endif
+#endif /* CONFIG_UART_INTERRUPT_DRIVEN */
+
+/**
+ * TX queues, one per priority class. tx_thread only sends a radio frame
+ * while no control reply is waiting, so "!R" reports and credit updates
+ * never sit behind a burst of received frames.
+ */
+enum tx_class {
+	/* Control replies and credit updates, never dropped */
+	TX_CLASS_CTRL,
+	/* Radio frames, dropped beyond CONFIG_WPAN_SERIAL_TX_DATA_DEPTH */
+	TX_CLASS_DATA,
+	TX_CLASS_COUNT,
+};
+
+static struct k_fifo tx_queue[TX_CLASS_COUNT];
+static struct k_poll_event tx_events[TX_CLASS_COUNT];
+static K_THREAD_STACK_DEFINE(tx_stack, 1024);
+static struct k_thread tx_thread_data;
+
+/* Queueing delay per class, read by the host with "?Q" */
+static struct {
+	atomic_t dropped;
+	atomic_t delay_count;
+	atomic_t delay_sum_us;
+	atomic_t delay_max_us;
+} tx_class_stats[TX_CLASS_COUNT];
+
+/**
+ * Enqueue and reception times of the queued radio frames. net_pkts have
+ * no room for them, and the data queue never holds more than its depth,
+ * so a ring of that size runs in step with it.
+ */
+static struct {
+	uint32_t queued;
+	uint32_t rx;
+} tx_data_times[CONFIG_WPAN_SERIAL_TX_DATA_DEPTH];
+static uint8_t tx_data_head;
+static uint8_t tx_data_tail;
+
+/**
+ * Encoded bytes on their way to the host. The transport is the
+ * only consumer. Producers hold tx_ring_lock: tx_thread for each message
+ * it takes from a queue, and the radio RX thread for a cut-through frame.
+ */
+RING_BUF_DECLARE(tx_ring, CONFIG_WPAN_SERIAL_UART_TX_RING_SIZE);
+static K_SEM_DEFINE(tx_space_sem, 0, 1);
+static K_MUTEX_DEFINE(tx_ring_lock);
+
+/**
+ * Cut-through forwarding, switched with "!T": a radio frame that arrives
+ * while nothing is queued or being encoded is encoded into tx_ring
+ * right in the radio RX thread, which is cooperative on most radio
+ * drivers, instead of waiting for tx_thread to be scheduled.
+ */
+static atomic_t tx_cut_through =
+	ATOMIC_INIT(IS_ENABLED(CONFIG_WPAN_SERIAL_CUT_THROUGH));
+
+/* Paths of the messages in tx_ring */
+enum tx_path {
+	/* Radio frames through the data queue and tx_thread */
+	TX_PATH_QUEUED,
+	/* Radio frames encoded in the radio RX thread */
+	TX_PATH_CUT_THROUGH,
+	TX_PATH_COUNT,
+	/* Control replies, not part of the latency histogram */
+	TX_PATH_CTRL = TX_PATH_COUNT,
+};
+
+/**
+ * "?H" latency histogram per path, from radio reception to the last
+ * byte handed to the transport. Bucket 0 counts frames below 128 us,
+ * bucket n those below 128 << n us, the last one all slower frames.
+ */
+#define TX_HIST_BUCKETS 12
+#define TX_HIST_LEN     (TX_PATH_COUNT * TX_HIST_BUCKETS * sizeof(uint32_t))
+
+static atomic_t tx_latency_hist[TX_PATH_COUNT][TX_HIST_BUCKETS];
+
+/* Running byte counters of tx_ring, used to tell when a frame has left */
+static uint32_t tx_put_total;
+static uint32_t tx_get_total;
+
+/* End position of frames that are still (partly) in tx_ring */
+#define TX_MARK_COUNT 8
+
+static struct {
+	uint32_t end;
+	uint32_t start;
+	uint8_t path;
+} tx_marks[TX_MARK_COUNT];
+static atomic_t tx_mark_head;
+static atomic_t tx_mark_tail;
+
+/* "!D" link counters */
+#define LINK_STATS_LEN (19 * sizeof(uint32_t))
+
+/**
+ * Control replies ("!M", "!R", ...) come from their own small pool, so
+ * they never compete with radio frames for net_pkts. The "!H"
+ * histogram, the "!D" counters or a "!B" report are the largest one.
+ */
+#define CTRL_MSG_SIZE MAX(MAX(3 + LINK_STATS_LEN, 4 + TX_HIST_LEN), \
+			  4 + 3 * CONFIG_WPAN_SERIAL_TX_BATCH_MAX)
+
+/* Until a fallback that found no free control message tries again */
+#define CTRL_RETRY_MS 10
+
+struct ctrl_msg {
+	void *fifo_reserved;
+	/* Switch the line to this rate once the message has left, or 0 */
+	uint32_t baud;
+	/* Cycle count when it was queued */
+	uint32_t queued;
+	uint8_t len;
+	/* Encode messages after this one in this framing, or LINK_FRAMING_KEEP */
+	uint8_t framing;
+	/* Fall back: switch before the message is sent instead of after it */
+	bool revert;
+	uint8_t data[CTRL_MSG_SIZE];
+} __aligned(4);
+
+static struct ctrl_msg ctrl_msgs[CONFIG_WPAN_SERIAL_CTRL_MSG_COUNT];
+static struct k_mem_slab ctrl_slab;
+
+/**
+ * Radio frames are coalesced into "!F" containers while the link is
+ * backlogged, once the host has enabled it with "!A".
+ */
+static atomic_t tx_aggregate;
+static uint8_t agg_buf[CONFIG_WPAN_SERIAL_AGG_BUF_SIZE];
+
+/**
+ * Radio frames carry their reception metadata once the host has enabled
+ * it with "!E": LQI, RSSI in dBm (-128 if unknown) and the RX timestamp
+ * in ns of the radio clock (be64, 0 without CONFIG_NET_PKT_TIMESTAMP).
+ * Such frames are sent as "!X" and "!Y" instead of raw frames and "!F"
+ * containers, so frames queued before the switch are still told apart.
+ */
+#define RADIO_META_LEN 10
+
+#define META_FLAG_LQI       BIT(0)
+#define META_FLAG_RSSI      BIT(1)
+#define META_FLAG_TIMESTAMP BIT(2)
+
+static atomic_t tx_metadata;
+
+/**
+ * Capture mode, switched with "!P" together with promiscuous reception.
+ * All radio frames are then sent in "!K" containers, whose frames carry
+ * a compact header instead of the "!E" metadata: channel, LQI, RSSI and
+ * the low 32 bits of the RX timestamp in us. The container is used for
+ * single frames as well, so a sniffer needs to parse one format only.
+ */
+#define CAPTURE_INFO_LEN 7
+
+#define PROMISC_FLAG_PROMISCUOUS BIT(0)
+#define PROMISC_FLAG_RX_ON_IDLE  BIT(1)
+#define PROMISC_FLAG_CAPTURE     BIT(2)
+
+static atomic_t tx_capture;
+static uint8_t radio_channel;
+
+/**
+ * Frame filter, configured by the host with "!G". PAN ID and
+ * destination addresses are also handed to the radio if it filters in
+ * hardware, which then rejects frames before they take a buffer. The
+ * software match runs for every frame regardless, so all radios behave
+ * alike and the frame type and source lists are applied as well.
+ */
+static struct frame_filter rx_filter;
+static struct k_spinlock rx_filter_lock;
+/* Extended address handed to the radio, which may keep the pointer */
+static uint8_t rx_filter_ext_addr[8];
+
+/* Status of "!G" replies */
+enum filter_status {
+	FILTER_OK = 0,
+	FILTER_INVALID = 1,
+	FILTER_FULL = 2,
+};
+
+/* Radio TX engine, decoupled from rx_thread */
+struct radio_tx_batch {
+	uint8_t count;
+	uint8_t remaining;
+	/* seq, status, num_tx per frame, as in "!R" */
+	uint8_t report[3 * CONFIG_WPAN_SERIAL_TX_BATCH_MAX];
+};
+
+/**
+ * Frames are copied out of their SLIP message into MTU-sized slab
+ * blocks, so that the message and its credit are released right away
+ * instead of after the frame has been on air.
+ */
+struct radio_tx_req {
+	void *fifo_reserved;
+	uint8_t psdu[IEEE802154_MAX_PHY_PACKET_SIZE];
+	uint8_t len;
+	uint8_t seq;
+	/* Set for frames of a "!B" batch, reported together */
+	struct radio_tx_batch *batch;
+	uint8_t idx;
+};
+
+K_MEM_SLAB_DEFINE_STATIC(radio_tx_batch_slab, sizeof(struct radio_tx_batch),
+			 2, 4);
+
+K_MEM_SLAB_DEFINE_STATIC(radio_tx_slab, sizeof(struct radio_tx_req),
+			 CONFIG_WPAN_SERIAL_TX_WINDOW, 4);
+static K_FIFO_DEFINE(radio_tx_queue);
+static K_THREAD_STACK_DEFINE(radio_tx_stack, 1024);
+static struct k_thread radio_tx_thread_data;
+/* The only net_pkt used for transmission */
+static struct net_pkt *radio_tx_pkt;
+/**
+ * Fragment handed to the radio with it, set up on the PSDU of each frame
+ * in turn. It does not come from a pool and is never unreferenced.
+ */
+static struct net_buf radio_tx_frame = {
+	.flags = NET_BUF_EXTERNAL_DATA,
+};
+static enum ieee802154_tx_mode radio_tx_mode = IEEE802154_TX_MODE_DIRECT;
+
+/**
+ * Held while a frame is on air, including its retries, and while the
+ * radio is scanning, so that neither happens on a channel the other has
+ * switched to.
+ */
+static K_MUTEX_DEFINE(radio_lock);
+
+/**
+ * "?L" energy detection scan of the 2.4 GHz O-QPSK channels. Energy is
+ * reported in dBm, ED_SCAN_NONE for channels that could not be scanned.
+ */
+#define ED_SCAN_FIRST_CHANNEL 11
+#define ED_SCAN_CHANNELS      16
+#define ED_SCAN_DEFAULT_MS    10
+#define ED_SCAN_NONE          INT8_MAX
+
+static K_SEM_DEFINE(ed_scan_sem, 0, 1);
+static int16_t ed_scan_max;
+
+/**
+ * Acknowledgments. The radio acknowledges frames to its own addresses
+ * itself, within the 192 us turnaround the host cannot meet across the
+ * serial link, and awaits the ACKs of host frames. The frame pending
+ * bit of its ACKs follows the pending table the host keeps with "!J".
+ * "?J" reports the counters below.
+ */
+static struct {
+	/* Frames to us with AR set, acknowledged by the radio */
+	atomic_t rx_acked;
+	/* ... with the frame pending bit set in the ACK */
+	atomic_t rx_pending;
+	/* ... repeating the source and sequence number of the last one */
+	atomic_t rx_retries;
+	/* Attempts of host frames with AR set */
+	atomic_t tx_ack_requested;
+	atomic_t tx_acked;
+	atomic_t tx_noack;
+	/* Attempts beyond the first, of all host frames */
+	atomic_t tx_retries;
+	/* ACKs with the frame pending bit set */
+	atomic_t tx_pending;
+	/* From the start of an attempt to its ACK */
+	atomic_t ack_wait_count;
+	atomic_t ack_wait_sum_us;
+	atomic_t ack_wait_max_us;
+} ack_stats;
+
+#define ACK_STATS_LEN (11 * sizeof(uint32_t))
+
+/* Capabilities in "!J" stats replies */
+#define ACK_FLAG_RX_AUTO_ACK BIT(0)
+#define ACK_FLAG_TX_ACK_WAIT BIT(1)
+
+/* Sources whose last acknowledged sequence number is kept */
+#define ACK_RX_SOURCES 8
+
+static struct {
+	uint64_t addr;
+	uint8_t mode;
+	uint8_t seq;
+} ack_rx_last[ACK_RX_SOURCES];
+static uint8_t ack_rx_next;
+
+/* Extended address the radio acknowledges, the MAC address unless "!G" */
+static uint64_t ack_ext_addr;
+
+/* Start of the current attempt, 0 while no ACK is awaited */
+static uint32_t ack_tx_start;
+
+/* Status codes of "!R" reports, as defined by Contiki's MAC layer */
+enum mac_tx_status {
+	MAC_TX_OK = 0,
+	MAC_TX_COLLISION = 1,
+	MAC_TX_NOACK = 2,
+	MAC_TX_DEFERRED = 3,
+	MAC_TX_ERR = 4,
+	MAC_TX_ERR_FATAL = 5,
+};
+
+/* 802.15.4 unit backoff period (20 symbols at 16 us) */
+#define UNIT_BACKOFF_US 320
+#define MAC_MIN_BE      3
+#define MAC_MAX_BE      5
+
+/* ieee802.15.4 device */
+static struct ieee802154_radio_api *radio_api;
+static const struct device *const ieee802154_dev =
+	DEVICE_DT_GET(DT_CHOSEN(zephyr_ieee802154));
+uint8_t mac_addr[8]; /* in little endian */
+
+/* Reported to the host in "!C" */
+#define CREDIT_FLAG_RTS_CTS BIT(0)
+
+/**
+ * Framing of the host link, SLIP until the host switches with "?V".
+ * COBS frames carry a CRC-16, so that corrupted messages are dropped
+ * instead of being acted upon.
+ */
+enum link_framing {
+	LINK_FRAMING_SLIP = 0,
+	LINK_FRAMING_COBS = 1,
+	LINK_FRAMING_COUNT,
+	/* In ctrl_msg: no switch after the message */
+	LINK_FRAMING_KEEP = 0xff,
+};
+
+/* Decoders of host messages, only the one of rx_framing is fed */
+static struct slip_decoder slip_dec;
+static struct cobs_decoder cobs_dec;
+
+/**
+ * Framing of received bytes. rx_thread sets rx_framing_next when it
+ * accepts a switch, the decoding context takes it over at its next
+ * chunk: the host waits for the reply before using the new framing.
+ */
+static atomic_t rx_framing_next;
+static uint8_t rx_framing;
+
+/* Framing of tx_ring, only changed with tx_ring_lock held */
+static uint8_t tx_framing;
+
+/* Encoders of tx_ring, used with tx_ring_lock held */
+static struct {
+	struct slip_encoder slip;
+	struct cobs_encoder cobs;
+} tx_enc;
+
+static void slip_rx_buf_destroy(struct net_buf *buf);
+
+NET_BUF_POOL_DEFINE(slip_rx_pool, CONFIG_WPAN_SERIAL_SLIP_RX_BUF_COUNT,
+		    CONFIG_WPAN_SERIAL_SLIP_RX_BUF_SIZE, 0, slip_rx_buf_destroy);
+
+static struct net_buf *buf_curr;
+
+/**
+ * Credit based flow control. Every host message occupies one
+ * slip_rx_pool buffer until it has been processed, so the host may
+ * have at most CONFIG_WPAN_SERIAL_SLIP_RX_BUF_COUNT messages in flight.
+ * Once enabled with "?C", the number of released messages is reported
+ * in "!C" updates whenever it changes.
+ */
+static struct {
+	atomic_t enabled;
+	/* Messages released since the last "?C" */
+	atomic_t freed;
+	/* credit_marker is queued in the control queue */
+	atomic_t queued;
+} host_credits;
+
+/* Placeholder in the control queue, "!C" is built when it is dequeued */
+static struct {
+	void *fifo_reserved;
+	uint32_t queued;
+} credit_marker;
+
+/* General helpers */
+
+static void credit_update(void)
+{
+	if (atomic_get(&host_credits.enabled) &&
+	    atomic_cas(&host_credits.queued, 0, 1)) {
+		credit_marker.queued = k_cycle_get_32();
+		k_fifo_put(&tx_queue[TX_CLASS_CTRL], &credit_marker);
+	}
+}
+
+static void tx_delay_record(enum tx_class tc, uint32_t queued)
+{
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - queued);
+
+	atomic_inc(&tx_class_stats[tc].delay_count);
+	atomic_add(&tx_class_stats[tc].delay_sum_us, us);
+
+	/* tx_thread is the only writer */
+	if (us > atomic_get(&tx_class_stats[tc].delay_max_us)) {
+		atomic_set(&tx_class_stats[tc].delay_max_us, us);
+	}
+}
+
+static void slip_rx_buf_destroy(struct net_buf *buf)
+{
+	net_buf_destroy(buf);
+
+	atomic_inc(&host_credits.freed);
+	credit_update();
+}
+
+static uint8_t *slip_alloc(void *user_data, size_t *size)
+{
+	ARG_UNUSED(user_data);
+
+	/**
+	 * One contiguous buffer, large enough for a "!B" batch. Messages
+	 * never need a net_pkt, frames are copied to radio_tx_slab.
+	 */
+	buf_curr = net_buf_alloc(&slip_rx_pool, K_NO_WAIT);
+	if (!buf_curr) {
+		LOG_ERR("No more buffers");
+		atomic_inc(&serial_radio_stats.rx_no_buf);
+		return NULL;
+	}
+
+	*size = net_buf_tailroom(buf_curr);
+
+	return net_buf_tail(buf_curr);
+}
+
+static void slip_frame(void *user_data, size_t len)
+{
+	sys_slist_t *done = user_data;
+
+	net_buf_add(buf_curr, len);
+
+	LOG_DBG("from SERIAL: Full packet %p, len %u", buf_curr, len);
+
+	atomic_inc(&serial_radio_stats.rx_frames);
+
+	/* Handed over to rx_thread once the whole chunk is decoded */
+	sys_slist_append(done, &buf_curr->node);
+	buf_curr = NULL;
+}
+
+static void slip_discard(void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	LOG_ERR("Discard partial packet %p", buf_curr);
+
+	net_buf_unref(buf_curr);
+	buf_curr = NULL;
+}
+
+static const struct slip_decoder_cb slip_cb = {
+	.alloc = slip_alloc,
+	.frame = slip_frame,
+	.discard = slip_discard,
+};
+
+static sys_slist_t slip_done;
+
+void serial_radio_rx(const uint8_t *data, size_t len)
+{
+	uint8_t framing = atomic_get(&rx_framing_next);
+	size_t frames;
+
+	if (framing != rx_framing) {
+		/**
+		 * A partial frame of the old framing holds buf_curr. The
+		 * new decoder waits for a delimiter, which the host sends
+		 * first after a switch.
+		 */
+		serial_radio_rx_reset();
+		rx_framing = framing;
+	}
+
+	if (rx_framing == LINK_FRAMING_COBS) {
+		frames = cobs_decode(&cobs_dec, data, len);
+	} else {
+		frames = slip_decode(&slip_dec, data, len);
+	}
+
+	if (frames) {
+		k_fifo_put_slist(&rx_queue, &slip_done);
+	}
+}
+
+void serial_radio_rx_reset(void)
+{
+	/* Partial frame in front of the gap is unusable */
+	if (rx_framing == LINK_FRAMING_COBS) {
+		cobs_decoder_reset(&cobs_dec);
+	} else {
+		slip_decoder_reset(&slip_dec);
+	}
+}
+
+static void tx_mark_push(uint32_t end, uint32_t start, enum tx_path path)
+{
+	atomic_val_t head = atomic_get(&tx_mark_head);
+
+	if (head - atomic_get(&tx_mark_tail) == TX_MARK_COUNT) {
+		/* Not tracked, the ring holds more frames than marks */
+		return;
+	}
+
+	tx_marks[head % TX_MARK_COUNT].end = end;
+	tx_marks[head % TX_MARK_COUNT].start = start;
+	tx_marks[head % TX_MARK_COUNT].path = path;
+	atomic_set(&tx_mark_head, head + 1);
+}
+
+static void tx_marks_complete(void)
+{
+	atomic_val_t tail = atomic_get(&tx_mark_tail);
+
+	while (tail != atomic_get(&tx_mark_head) &&
+	       (int32_t)(tx_get_total - tx_marks[tail % TX_MARK_COUNT].end) >= 0) {
+		uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() -
+						  tx_marks[tail % TX_MARK_COUNT].start);
+		uint8_t path = tx_marks[tail % TX_MARK_COUNT].path;
+
+		if (path < TX_PATH_COUNT) {
+			int bucket = us < 128 ? 0 : 31 - __builtin_clz(us) - 6;
+
+			atomic_inc(&tx_latency_hist[path]
+					[MIN(bucket, TX_HIST_BUCKETS - 1)]);
+		}
+
+		atomic_inc(&serial_radio_stats.tx_latency_count);
+		atomic_add(&serial_radio_stats.tx_latency_sum_us, us);
+		if (us > atomic_get(&serial_radio_stats.tx_latency_max_us)) {
+			atomic_set(&serial_radio_stats.tx_latency_max_us, us);
+		}
+
+#if ANALYZE_UART_BOTTLENECK
+		LOG_DBG("TX complete for packet after %u us", us);
+#endif
+		tail++;
+	}
+
+	atomic_set(&tx_mark_tail, tail);
+}
+
+uint32_t serial_radio_tx_claim(uint8_t **data)
+{
+	return ring_buf_get_claim(&tx_ring, data, UINT32_MAX);
+}
+
+/* Release bytes that the transport has taken from tx_ring */
+void serial_radio_tx_consumed(uint32_t len)
+{
+	ring_buf_get_finish(&tx_ring, len);
+	tx_get_total += len;
+
+	tx_marks_complete();
+	k_sem_give(&tx_space_sem);
+}
+
+#if defined(CONFIG_UART_INTERRUPT_DRIVEN)
+static void rx_ring_update_max(void)
+{
+	uint32_t fill = ring_buf_size_get(&rx_ring);
+
+	/* The interrupt handler is the only writer */
+	if (fill > atomic_get(&serial_radio_stats.rx_ring_max)) {
+		atomic_set(&serial_radio_stats.rx_ring_max, fill);
+	}
+}
+
+/* Move the UART FIFO into rx_ring, nothing else in interrupt context */
+static void rx_ring_fill(const struct device *dev)
+{
+	uint8_t *window;
+	uint32_t size;
+	int len;
+
+	while (true) {
+		size = atomic_get(&rx_gap) ? 0 :
+		       ring_buf_put_claim(&rx_ring, &window, UINT32_MAX);
+		if (!size) {
+			uint8_t scratch[16];
+
+			/* Full, the FIFO still has to be emptied */
+			len = uart_fifo_read(dev, scratch, sizeof(scratch));
+			if (len <= 0) {
+				break;
+			}
+
+			if (!atomic_get(&rx_gap)) {
+				rx_gap_at = rx_put_total;
+				atomic_set(&rx_gap, 1);
+				atomic_inc(&serial_radio_stats.rx_ring_overruns);
+			}
+
+			atomic_add(&serial_radio_stats.rx_bytes, len);
+			atomic_add(&serial_radio_stats.rx_dropped_bytes, len);
+			continue;
+		}
+
+		len = uart_fifo_read(dev, window, size);
+		ring_buf_put_finish(&rx_ring, MAX(len, 0));
+		if (len <= 0) {
+			break;
+		}
+
+		rx_put_total += len;
+		atomic_add(&serial_radio_stats.rx_bytes, len);
+	}
+
+	rx_ring_update_max();
+	k_sem_give(&rx_ring_sem);
+}
+
+/**
+ * Decode the bytes of rx_ring
+ */
+static void rx_decode_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	LOG_INF("SLIP decoder thread started");
+
+	while (true) {
+		uint8_t *data;
+		uint32_t len;
+		bool gap;
+
+		k_sem_take(&rx_ring_sem, K_FOREVER);
+
+		do {
+			gap = atomic_get(&rx_gap);
+			len = ring_buf_get_claim(&rx_ring, &data, UINT32_MAX);
+			if (gap) {
+				/* Bytes in front of the gap are still whole */
+				len = MIN(len, rx_gap_at - rx_get_total);
+			}
+
+			serial_radio_rx(data, len);
+
+			ring_buf_get_finish(&rx_ring, len);
+			rx_get_total += len;
+
+			if (gap && rx_get_total == rx_gap_at) {
+				serial_radio_rx_reset();
+				atomic_clear(&rx_gap);
+			}
+		} while (len || gap);
+	}
+}
+
+static void init_rx_ring(void)
+{
+#if defined(CONFIG_WPAN_SERIAL_RX_ISR_TIMING)
+	timing_init();
+	timing_start();
+#endif
+
+	k_thread_create(&rx_decode_thread_data, rx_decode_stack,
+			K_THREAD_STACK_SIZEOF(rx_decode_stack),
+			rx_decode_thread,
+			NULL, NULL, NULL, THREAD_PRIORITY, 0, K_NO_WAIT);
+}
+
+void serial_radio_irq_handler(const struct device *dev, void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+		if (uart_err_check(dev) & UART_ERROR_OVERRUN) {
+			atomic_inc(&serial_radio_stats.rx_overruns);
+		}
+
+		/* Handle RX */
+		if (uart_irq_rx_ready(dev)) {
+#if defined(CONFIG_WPAN_SERIAL_RX_ISR_TIMING)
+			timing_t t0 = timing_counter_get();
+			timing_t t1;
+
+			rx_ring_fill(dev);
+
+			t1 = timing_counter_get();
+			rx_isr_cycles += timing_cycles_get(&t0, &t1);
+#else
+			rx_ring_fill(dev);
+#endif
+		}
+
+		/* Handle TX */
+		if (uart_irq_tx_ready(dev)) {
+			uint8_t *data;
+			uint32_t len;
+			int wrote;
+
+			len = serial_radio_tx_claim(&data);
+			if (!len) {
+				uart_irq_tx_disable(dev);
+				continue;
+			}
+
+			wrote = uart_fifo_fill(dev, data, len);
+			serial_radio_tx_consumed(MAX(wrote, 0));
+		}
+	}
+}
+#endif
+
+/**
+ * Replies to the host's requests are never dropped and wait with
+ * K_FOREVER until tx_thread frees a message. The system workqueue must
+ * not wait on tx_thread, which may itself wait for the host, so work
+ * items use K_NO_WAIT and get NULL if none is free.
+ */
+static struct ctrl_msg *ctrl_msg_alloc(uint8_t *cfg, uint8_t *data,
+				       size_t len, k_timeout_t timeout)
+{
+	struct ctrl_msg *msg;
+
+	__ASSERT_NO_MSG(len + 3 <= CTRL_MSG_SIZE);
+
+	if (k_mem_slab_alloc(&ctrl_slab, (void **)&msg, timeout) < 0) {
+		atomic_inc(&tx_class_stats[TX_CLASS_CTRL].dropped);
+		return NULL;
+	}
+
+	LOG_DBG("queue ctrl %p len %u", msg, len);
+
+	/* Add configuration id */
+	memcpy(msg->data, cfg, 2);
+	memcpy(&msg->data[2], data, len);
+
+	/* simulate LQI */
+	msg->data[2 + len] = 0;
+	msg->len = 2 + len + 1;
+	msg->baud = 0;
+	msg->framing = LINK_FRAMING_KEEP;
+	msg->revert = false;
+
+	return msg;
+}
+
+static void ctrl_msg_queue(struct ctrl_msg *msg)
+{
+	msg->queued = k_cycle_get_32();
+	k_fifo_put(&tx_queue[TX_CLASS_CTRL], msg);
+}
+
+/* Allocate and send data to the host */
+static void send_data(uint8_t *cfg, uint8_t *data, size_t len)
+{
+	ctrl_msg_queue(ctrl_msg_alloc(cfg, data, len, K_FOREVER));
+}
+
+static void get_ieee_addr(void)
+{
+	uint8_t cfg[2] = { '!', 'M' };
+	uint8_t mac[8];
+
+	/* Send in BE */
+	sys_memcpy_swap(mac, mac_addr, sizeof(mac));
+
+	send_data(cfg, mac, sizeof(mac));
+}
+
+static void get_link_stats(void)
+{
+	uint8_t cfg[2] = { '!', 'D' };
+	uint8_t stats[LINK_STATS_LEN];
+	uint32_t isr_us = 0;
+
+#if defined(CONFIG_WPAN_SERIAL_RX_ISR_TIMING)
+	unsigned int key = irq_lock();
+	uint64_t cycles = rx_isr_cycles;
+
+	irq_unlock(key);
+	isr_us = timing_cycles_to_ns(cycles) / NSEC_PER_USEC;
+#endif
+
+	sys_put_be32(atomic_get(&serial_radio_stats.rx_bytes), &stats[0]);
+	sys_put_be32(atomic_get(&serial_radio_stats.rx_frames), &stats[4]);
+	sys_put_be32(atomic_get(&serial_radio_stats.rx_dropped_bytes) +
+		     slip_dec.dropped + cobs_dec.dropped, &stats[8]);
+	sys_put_be32(atomic_get(&serial_radio_stats.rx_overruns), &stats[12]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_frames), &stats[16]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_bytes), &stats[20]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_latency_count), &stats[24]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_latency_sum_us), &stats[28]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_latency_max_us), &stats[32]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_containers), &stats[36]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_aggregated), &stats[40]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_backlog), &stats[44]);
+	sys_put_be32(atomic_get(&serial_radio_stats.tx_backlog_max), &stats[48]);
+	sys_put_be32(atomic_get(&serial_radio_stats.rx_no_buf), &stats[52]);
+	sys_put_be32(atomic_get(&serial_radio_stats.rx_ring_max), &stats[56]);
+	sys_put_be32(atomic_get(&serial_radio_stats.rx_ring_overruns), &stats[60]);
+	sys_put_be32(isr_us, &stats[64]);
+	sys_put_be32(atomic_get(&serial_radio_stats.radio_filtered), &stats[68]);
+	sys_put_be32(cobs_dec.crc_errors, &stats[72]);
+
+	send_data(cfg, stats, sizeof(stats));
+}
+
+/* "!Q": per class depth, dropped, delay count, sum and max in us */
+static void get_queue_stats(void)
+{
+	uint8_t cfg[2] = { '!', 'Q' };
+	uint8_t stats[TX_CLASS_COUNT * 5 * sizeof(uint32_t)];
+	uint32_t depth[TX_CLASS_COUNT] = {
+		[TX_CLASS_CTRL] = k_mem_slab_num_used_get(&ctrl_slab) +
+				  atomic_get(&host_credits.queued),
+		[TX_CLASS_DATA] = atomic_get(&serial_radio_stats.tx_backlog),
+	};
+	uint8_t *p = stats;
+	int i;
+
+	for (i = 0; i < TX_CLASS_COUNT; i++) {
+		sys_put_be32(depth[i], &p[0]);
+		sys_put_be32(atomic_get(&tx_class_stats[i].dropped), &p[4]);
+		sys_put_be32(atomic_get(&tx_class_stats[i].delay_count), &p[8]);
+		sys_put_be32(atomic_get(&tx_class_stats[i].delay_sum_us), &p[12]);
+		sys_put_be32(atomic_get(&tx_class_stats[i].delay_max_us), &p[16]);
+		p += 5 * sizeof(uint32_t);
+	}
+
+	send_data(cfg, stats, sizeof(stats));
+}
+
+static void get_credits(void)
+{
+	LOG_INF("Credit based flow control enabled");
+
+	/* The host starts counting its messages from this request on */
+	atomic_clear(&host_credits.freed);
+	atomic_set(&host_credits.enabled, 1);
+	credit_update();
+}
+
+/* Status of "!U" replies */
+enum baud_status {
+	BAUD_OK = 0,
+	BAUD_UNSUPPORTED = 1,
+	BAUD_REVERTED = 2,
+};
+
+static uint32_t link_baud;
+/* Rate to fall back to while a switch waits for confirmation */
+static uint32_t link_baud_prev;
+/* Requested rate until the host has confirmed it at that rate */
+static atomic_t link_baud_pending;
+
+static void baud_fallback(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(baud_fallback_work, baud_fallback);
+
+static int link_set_baud(uint32_t baud)
+{
+	int ret;
+
+	ret = transport->set_baud(baud);
+	if (ret < 0) {
+		LOG_ERR("Failed to set %u baud: %d", baud, ret);
+		return ret;
+	}
+
+	LOG_INF("%s at %u baud", transport->name, baud);
+	link_baud = baud;
+
+	return 0;
+}
+
+/* "!U": rate (be32), status */
+static struct ctrl_msg *baud_reply_alloc(uint32_t baud, uint8_t status,
+					 k_timeout_t timeout)
+{
+	uint8_t cfg[2] = { '!', 'U' };
+	uint8_t reply[5];
+
+	sys_put_be32(baud, reply);
+	reply[4] = status;
+
+	return ctrl_msg_alloc(cfg, reply, sizeof(reply), timeout);
+}
+
+static void send_baud_reply(uint32_t baud, uint8_t status, bool apply)
+{
+	struct ctrl_msg *msg = baud_reply_alloc(baud, status, K_FOREVER);
+
+	/* Acknowledge at the old rate, tx_thread switches afterwards */
+	msg->baud = apply ? baud : 0;
+
+	ctrl_msg_queue(msg);
+}
+
+/* The host has not confirmed the new rate in time */
+static void baud_fallback(struct k_work *work)
+{
+	atomic_val_t baud = atomic_get(&link_baud_pending);
+	struct ctrl_msg *msg;
+
+	ARG_UNUSED(work);
+
+	if (!baud) {
+		return;
+	}
+
+	msg = baud_reply_alloc(link_baud_prev, BAUD_REVERTED, K_NO_WAIT);
+	if (!msg) {
+		k_work_schedule(&baud_fallback_work, K_MSEC(CTRL_RETRY_MS));
+		return;
+	}
+
+	/* Lost against a confirmation that came in meanwhile */
+	if (!atomic_cas(&link_baud_pending, baud, 0)) {
+		k_mem_slab_free(&ctrl_slab, msg);
+		return;
+	}
+
+	LOG_WRN("%u baud not confirmed, back to %u", (uint32_t)baud,
+		link_baud_prev);
+
+	/**
+	 * tx_thread switches back once the bytes in flight have left, and
+	 * sends the reply at the rate fallen back to
+	 */
+	msg->baud = link_baud_prev;
+	msg->revert = true;
+	ctrl_msg_queue(msg);
+}
+
+/**
+ * "?U" with a rate (be32). The reply is sent at the current rate before
+ * switching; the host then confirms by repeating the request at the new
+ * rate within CONFIG_WPAN_SERIAL_BAUD_CONFIRM_MS, or the line falls back.
+ */
+static void set_baud(struct net_buf *buf)
+{
+	uint32_t baud;
+	int i;
+
+	if (buf->len < sizeof(baud)) {
+		LOG_ERR("Missing baud rate");
+		return;
+	}
+
+	baud = net_buf_pull_be32(buf);
+
+	if (baud == link_baud) {
+		if (atomic_cas(&link_baud_pending, baud, 0)) {
+			k_work_cancel_delayable(&baud_fallback_work);
+			LOG_INF("%u baud confirmed", baud);
+		}
+
+		send_baud_reply(baud, BAUD_OK, false);
+		return;
+	}
+
+	for (i = 0; transport->set_baud && i < transport->num_bauds; i++) {
+		if (transport->bauds[i] == baud) {
+			break;
+		}
+	}
+
+	/* Only one switch at a time */
+	if (!transport->set_baud || i == transport->num_bauds ||
+	    !atomic_cas(&link_baud_pending, 0, baud)) {
+		LOG_ERR("Unsupported baud rate %u", baud);
+		send_baud_reply(baud, BAUD_UNSUPPORTED, false);
+		return;
+	}
+
+	send_baud_reply(baud, BAUD_OK, true);
+}
+
+/* Framing to fall back to while a switch waits for confirmation */
+static uint8_t link_framing_prev;
+/* A switch waits for the host to confirm it in the new framing */
+static atomic_t link_framing_pending;
+
+static void framing_fallback(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(framing_fallback_work, framing_fallback);
+
+/* "!V": framing, status as in "!U" */
+static struct ctrl_msg *framing_reply_alloc(uint8_t framing, uint8_t status,
+					    k_timeout_t timeout)
+{
+	uint8_t cfg[2] = { '!', 'V' };
+	uint8_t reply[2] = { framing, status };
+
+	return ctrl_msg_alloc(cfg, reply, sizeof(reply), timeout);
+}
+
+static void send_framing_reply(uint8_t framing, uint8_t status, bool apply)
+{
+	struct ctrl_msg *msg = framing_reply_alloc(framing, status, K_FOREVER);
+
+	/* Acknowledge in the old framing, tx_thread switches afterwards */
+	msg->framing = apply ? framing : LINK_FRAMING_KEEP;
+
+	ctrl_msg_queue(msg);
+}
+
+/* The host has not confirmed the new framing in time */
+static void framing_fallback(struct k_work *work)
+{
+	struct ctrl_msg *msg;
+
+	ARG_UNUSED(work);
+
+	if (!atomic_get(&link_framing_pending)) {
+		return;
+	}
+
+	msg = framing_reply_alloc(link_framing_prev, BAUD_REVERTED, K_NO_WAIT);
+	if (!msg) {
+		k_work_schedule(&framing_fallback_work, K_MSEC(CTRL_RETRY_MS));
+		return;
+	}
+
+	/* Lost against a confirmation that came in meanwhile */
+	if (!atomic_cas(&link_framing_pending, 1, 0)) {
+		k_mem_slab_free(&ctrl_slab, msg);
+		return;
+	}
+
+	LOG_WRN("Framing %u not confirmed, back to %u",
+		(uint8_t)atomic_get(&rx_framing_next), link_framing_prev);
+
+	atomic_set(&rx_framing_next, link_framing_prev);
+
+	/* tx_thread switches back and sends the reply in the old framing */
+	msg->framing = link_framing_prev;
+	msg->revert = true;
+	ctrl_msg_queue(msg);
+}
+
+/**
+ * "?V" with a framing (enum link_framing). Like "?U", the reply is sent
+ * in the current framing before switching, and the host confirms by
+ * repeating the request in the new framing within
+ * CONFIG_WPAN_SERIAL_BAUD_CONFIRM_MS, or the link falls back. Received
+ * bytes are decoded in the new framing as soon as the request has been
+ * processed.
+ */
+static void set_framing(struct net_buf *buf)
+{
+	uint8_t framing;
+
+	if (buf->len < 1) {
+		LOG_ERR("Missing framing");
+		return;
+	}
+
+	framing = net_buf_pull_u8(buf);
+
+	if (framing == atomic_get(&rx_framing_next)) {
+		if (atomic_cas(&link_framing_pending, 1, 0)) {
+			k_work_cancel_delayable(&framing_fallback_work);
+			LOG_INF("Framing %u confirmed", framing);
+		}
+
+		send_framing_reply(framing, BAUD_OK, false);
+		return;
+	}
+
+	/* Only one switch at a time */
+	if (framing >= LINK_FRAMING_COUNT ||
+	    !atomic_cas(&link_framing_pending, 0, 1)) {
+		LOG_ERR("Unsupported framing %u", framing);
+		send_framing_reply(framing, BAUD_UNSUPPORTED, false);
+		return;
+	}
+
+	link_framing_prev = atomic_get(&rx_framing_next);
+	atomic_set(&rx_framing_next, framing);
+	send_framing_reply(framing, BAUD_OK, true);
+
+	k_work_schedule(&framing_fallback_work,
+			K_MSEC(CONFIG_WPAN_SERIAL_BAUD_CONFIRM_MS));
+}
+
+static void ed_scan_done(const struct device *dev, int16_t max_ed)
+{
+	ARG_UNUSED(dev);
+
+	ed_scan_max = max_ed;
+	k_sem_give(&ed_scan_sem);
+}
+
+/**
+ * "?L": measure the energy on every channel for the number of ms given
+ * as be16, then return to the current channel. The reply carries the
+ * first channel, the channel count and the energy of each in dBm.
+ * Radio TX waits for the scan, host messages are processed after it.
+ */
+static void scan_energy(struct net_buf *buf)
+{
+	uint8_t cfg[2] = { '!', 'L' };
+	uint8_t reply[2 + ED_SCAN_CHANNELS] = {
+		ED_SCAN_FIRST_CHANNEL, ED_SCAN_CHANNELS
+	};
+	uint16_t duration = ED_SCAN_DEFAULT_MS;
+	int i;
+
+	if (buf->len >= 2 && sys_get_be16(buf->data)) {
+		duration = sys_get_be16(buf->data);
+	}
+
+	memset(&reply[2], ED_SCAN_NONE, ED_SCAN_CHANNELS);
+
+	if (!(radio_api->get_capabilities(ieee802154_dev) &
+	      IEEE802154_HW_ENERGY_SCAN) || !radio_api->ed_scan) {
+		LOG_WRN("Radio cannot scan for energy");
+		send_data(cfg, reply, sizeof(reply));
+		return;
+	}
+
+	k_mutex_lock(&radio_lock, K_FOREVER);
+
+	for (i = 0; i < ED_SCAN_CHANNELS; i++) {
+		uint8_t chan = ED_SCAN_FIRST_CHANNEL + i;
+
+		if (radio_api->set_channel(ieee802154_dev, chan) < 0) {
+			continue;
+		}
+
+		k_sem_reset(&ed_scan_sem);
+		if (radio_api->ed_scan(ieee802154_dev, duration,
+				       ed_scan_done) < 0 ||
+		    k_sem_take(&ed_scan_sem, K_MSEC(2 * duration + 10)) < 0) {
+			LOG_WRN("Energy scan of channel %u failed", chan);
+			continue;
+		}
+
+		reply[2 + i] = CLAMP(ed_scan_max, INT8_MIN, INT8_MAX - 1);
+	}
+
+	/* Unknown until set, in which case the last one scanned stays */
+	if (radio_channel) {
+		radio_api->set_channel(ieee802154_dev, radio_channel);
+	}
+
+	k_mutex_unlock(&radio_lock);
+
+	LOG_INF("Energy scan of %u ms per channel done", duration);
+
+	send_data(cfg, reply, sizeof(reply));
+}
+
+/* "!H": bucket count, then the buckets of each path (be32) */
+static void get_latency_hist(void)
+{
+	uint8_t cfg[2] = { '!', 'H' };
+	uint8_t hist[1 + TX_HIST_LEN] = { TX_HIST_BUCKETS };
+	uint8_t *p = &hist[1];
+	int path, i;
+
+	for (path = 0; path < TX_PATH_COUNT; path++) {
+		for (i = 0; i < TX_HIST_BUCKETS; i++) {
+			sys_put_be32(atomic_get(&tx_latency_hist[path][i]), p);
+			p += sizeof(uint32_t);
+		}
+	}
+
+	send_data(cfg, hist, sizeof(hist));
+}
+
+/**
+ * "!J" 'S': capabilities (ACK_FLAG_*), then the ack_stats counters
+ * (be32) in order
+ */
+static void get_ack_stats(void)
+{
+	uint8_t cfg[2] = { '!', 'J' };
+	uint8_t stats[2 + ACK_STATS_LEN] = { 'S' };
+	enum ieee802154_hw_caps caps;
+
+	caps = radio_api->get_capabilities(ieee802154_dev);
+	if (caps & IEEE802154_HW_RX_TX_ACK) {
+		stats[1] |= ACK_FLAG_RX_AUTO_ACK;
+	}
+	if (caps & IEEE802154_HW_TX_RX_ACK) {
+		stats[1] |= ACK_FLAG_TX_ACK_WAIT;
+	}
+
+	sys_put_be32(atomic_get(&ack_stats.rx_acked), &stats[2]);
+	sys_put_be32(atomic_get(&ack_stats.rx_pending), &stats[6]);
+	sys_put_be32(atomic_get(&ack_stats.rx_retries), &stats[10]);
+	sys_put_be32(atomic_get(&ack_stats.tx_ack_requested), &stats[14]);
+	sys_put_be32(atomic_get(&ack_stats.tx_acked), &stats[18]);
+	sys_put_be32(atomic_get(&ack_stats.tx_noack), &stats[22]);
+	sys_put_be32(atomic_get(&ack_stats.tx_retries), &stats[26]);
+	sys_put_be32(atomic_get(&ack_stats.tx_pending), &stats[30]);
+	sys_put_be32(atomic_get(&ack_stats.ack_wait_count), &stats[34]);
+	sys_put_be32(atomic_get(&ack_stats.ack_wait_sum_us), &stats[38]);
+	sys_put_be32(atomic_get(&ack_stats.ack_wait_max_us), &stats[42]);
+
+	send_data(cfg, stats, sizeof(stats));
+}
+
+static void process_request(struct net_buf *buf)
+{
+	uint8_t cmd;
+
+	if (buf->len < 1) {
+		LOG_ERR("Empty request");
+		return;
+	}
+
+	cmd = net_buf_pull_u8(buf);
+
+	switch (cmd) {
+	case 'M':
+		get_ieee_addr();
+		break;
+	case 'D':
+		get_link_stats();
+		break;
+	case 'C':
+		get_credits();
+		break;
+	case 'U':
+		set_baud(buf);
+		break;
+	case 'V':
+		set_framing(buf);
+		break;
+	case 'Q':
+		get_queue_stats();
+		break;
+	case 'L':
+		scan_energy(buf);
+		break;
+	case 'H':
+		get_latency_hist();
+		break;
+	case 'J':
+		get_ack_stats();
+		break;
+	default:
+		LOG_ERR("Not handled request %c", cmd);
+		break;
+	}
+}
+
+static void send_pkt_report(uint8_t seq, uint8_t status, uint8_t num_tx)
+{
+	uint8_t cfg[2] = { '!', 'R' };
+	uint8_t report[3];
+
+	report[0] = seq;
+	report[1] = status;
+	report[2] = num_tx;
+
+	send_data(cfg, report, sizeof(report));
+}
+
+static uint8_t radio_tx_status(int ret)
+{
+	switch (ret) {
+	case 0:
+		return MAC_TX_OK;
+	case -EBUSY:
+		/* CCA failed on every CSMA-CA backoff */
+		return MAC_TX_COLLISION;
+	case -ENOMSG:
+		return MAC_TX_NOACK;
+	case -ENETDOWN:
+		return MAC_TX_ERR_FATAL;
+	default:
+		return MAC_TX_ERR;
+	}
+}
+
+static void send_batch_report(struct radio_tx_batch *batch)
+{
+	uint8_t cfg[2] = { '!', 'B' };
+	uint8_t report[1 + sizeof(batch->report)];
+
+	report[0] = batch->count;
+	memcpy(&report[1], batch->report, 3 * batch->count);
+
+	send_data(cfg, report, 1 + 3 * batch->count);
+}
+
+static void radio_tx_complete(struct radio_tx_req *req, uint8_t status,
+			      uint8_t num_tx)
+{
+	struct radio_tx_batch *batch = req->batch;
+
+	if (!batch) {
+		/* Send packet data report */
+		send_pkt_report(req->seq, status, num_tx);
+		return;
+	}
+
+	batch->report[3 * req->idx] = req->seq;
+	batch->report[3 * req->idx + 1] = status;
+	batch->report[3 * req->idx + 2] = num_tx;
+
+	if (--batch->remaining == 0) {
+		send_batch_report(batch);
+		k_mem_slab_free(&radio_tx_batch_slab, batch);
+	}
+}
+
+/* Random backoff between attempts, as in unslotted CSMA-CA */
+static void radio_tx_backoff(uint8_t attempt)
+{
+	uint8_t be = MIN(MAC_MIN_BE + attempt - 1, MAC_MAX_BE);
+
+	k_sleep(K_USEC((sys_rand32_get() & BIT_MASK(be)) * UNIT_BACKOFF_US));
+}
+
+/**
+ * Transmit a host frame with retries. An acknowledgment is awaited by
+ * the radio driver whenever the frame has the AR bit set.
+ */
+static void radio_tx_process(struct radio_tx_req *req)
+{
+	struct net_buf *frame = &radio_tx_frame;
+	bool ack_request = sys_get_le16(req->psdu) & FRAME_FCF_ACK_REQUEST;
+	uint8_t attempts = 0;
+	uint8_t status;
+	int ret;
+
+	/* Only this thread transmits, so the frame can be sent in place */
+	net_buf_simple_init_with_data(&frame->b, req->psdu, req->len);
+
+	k_mutex_lock(&radio_lock, K_FOREVER);
+
+	do {
+		if (attempts) {
+			radio_tx_backoff(attempts);
+		}
+
+		attempts++;
+		if (ack_request) {
+			/* Kept odd, so that it never reads as none awaited */
+			ack_tx_start = k_cycle_get_32() | 1;
+		}
+
+		ret = radio_api->tx(ieee802154_dev, radio_tx_mode,
+				    radio_tx_pkt, frame);
+		status = radio_tx_status(ret);
+		ack_tx_start = 0;
+
+		if (ack_request && status != MAC_TX_COLLISION) {
+			atomic_inc(&ack_stats.tx_ack_requested);
+			if (status == MAC_TX_OK) {
+				atomic_inc(&ack_stats.tx_acked);
+			} else if (status == MAC_TX_NOACK) {
+				atomic_inc(&ack_stats.tx_noack);
+			}
+		}
+	} while ((status == MAC_TX_COLLISION || status == MAC_TX_NOACK) &&
+		 attempts < CONFIG_WPAN_SERIAL_TX_MAX_ATTEMPTS);
+
+	k_mutex_unlock(&radio_lock);
+
+	atomic_add(&ack_stats.tx_retries, attempts - 1);
+
+	if (ret) {
+		LOG_ERR("Error transmit data seq %u: %d after %u attempts",
+			req->seq, ret, attempts);
+	}
+
+	radio_tx_complete(req, status, attempts);
+}
+
+static void radio_tx_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	LOG_INF("Radio TX thread started");
+
+	while (true) {
+		struct radio_tx_req *req;
+
+		req = k_fifo_get(&radio_tx_queue, K_FOREVER);
+
+		radio_tx_process(req);
+
+		k_mem_slab_free(&radio_tx_slab, req);
+	}
+}
+
+/**
+ * Queue a frame for the radio TX thread, which reports it once it has
+ * completed. Waits if the window is exhausted.
+ */
+static void radio_tx_queue_frame(const uint8_t *data, uint8_t len,
+				 uint8_t seq, struct radio_tx_batch *batch,
+				 uint8_t idx)
+{
+	struct radio_tx_req *req;
+
+	k_mem_slab_alloc(&radio_tx_slab, (void **)&req, K_FOREVER);
+
+	memcpy(req->psdu, data, len);
+	req->len = len;
+	req->seq = seq;
+	req->batch = batch;
+	req->idx = idx;
+
+	k_fifo_put(&radio_tx_queue, req);
+}
+
+static void process_data(struct net_buf *buf)
+{
+	uint8_t seq, num_attr;
+	int i;
+
+	/* seq, num_attr and an attribute byte plus 16 bit value each */
+	if (buf->len < 2 || buf->len < 2 + 3 * buf->data[1]) {
+		LOG_ERR("Truncated send of %u bytes", buf->len);
+		if (buf->len) {
+			send_pkt_report(buf->data[0], MAC_TX_ERR_FATAL, 0);
+		}
+		return;
+	}
+
+	seq = net_buf_pull_u8(buf);
+	num_attr = net_buf_pull_u8(buf);
+
+	LOG_DBG("from SERIAL to RADIO: seq %u num_attr %u", seq, num_attr);
+
+	/**
+	 * There are some attributes sent over this protocol
+	 * discard them and return packet data report.
+	 */
+
+	for (i = 0; i < num_attr; i++) {
+		/* attr */
+		net_buf_pull_u8(buf);
+		/* value */
+		net_buf_pull_be16(buf);
+	}
+
+	if (!buf->len || buf->len > IEEE802154_MAX_PHY_PACKET_SIZE) {
+		LOG_ERR("Invalid frame length %u", buf->len);
+		send_pkt_report(seq, MAC_TX_ERR_FATAL, 0);
+		return;
+	}
+
+	radio_tx_queue_frame(buf->data, buf->len, seq, NULL, 0);
+}
+
+/**
+ * Report every frame of a malformed batch whose seq could be parsed as
+ * failed, so that the host releases them
+ */
+static void reject_batch(struct net_buf *buf)
+{
+	struct radio_tx_batch batch = { 0 };
+	size_t off = 1;
+
+	while (off < buf->len && batch.count < buf->data[0] &&
+	       batch.count < CONFIG_WPAN_SERIAL_TX_BATCH_MAX) {
+		batch.report[3 * batch.count] = buf->data[off];
+		batch.report[3 * batch.count + 1] = MAC_TX_ERR_FATAL;
+		batch.count++;
+
+		if (off + 1 >= buf->len) {
+			break;
+		}
+
+		off += 2 + buf->data[off + 1];
+	}
+
+	send_batch_report(&batch);
+}
+
+/**
+ * Batched send: "!B" count, then per frame seq, length and the frame.
+ * All frames are acknowledged with a single "!B" report.
+ */
+static void process_batch(struct net_buf *buf)
+{
+	struct radio_tx_batch *batch;
+	uint8_t count, i;
+	size_t off = 1;
+
+	if (!buf->len) {
+		LOG_ERR("Empty batch");
+		return;
+	}
+
+	count = buf->data[0];
+
+	/* Validate the whole batch before anything goes on air */
+	for (i = 0; i < count && off + 2 <= buf->len; i++) {
+		uint8_t len = buf->data[off + 1];
+
+		if (!len || len > IEEE802154_MAX_PHY_PACKET_SIZE) {
+			break;
+		}
+
+		off += 2 + len;
+	}
+
+	if (!count || count > CONFIG_WPAN_SERIAL_TX_BATCH_MAX ||
+	    i < count || off != buf->len) {
+		LOG_ERR("Malformed batch of %u frames, len %u", count, buf->len);
+		reject_batch(buf);
+		return;
+	}
+
+	LOG_DBG("from SERIAL to RADIO: batch of %u frames", count);
+
+	k_mem_slab_alloc(&radio_tx_batch_slab, (void **)&batch, K_FOREVER);
+	batch->count = count;
+	batch->remaining = count;
+
+	net_buf_pull_u8(buf);
+
+	for (i = 0; i < count; i++) {
+		uint8_t seq = net_buf_pull_u8(buf);
+		uint8_t len = net_buf_pull_u8(buf);
+
+		radio_tx_queue_frame(net_buf_pull_mem(buf, len), len, seq,
+				     batch, i);
+	}
+}
+
+static void set_channel(uint8_t chan)
+{
+	LOG_INF("Set channel %u", chan);
+
+	k_mutex_lock(&radio_lock, K_FOREVER);
+	if (radio_api->set_channel(ieee802154_dev, chan) == 0) {
+		radio_channel = chan;
+	}
+	k_mutex_unlock(&radio_lock);
+}
+
+static void set_cut_through(uint8_t mode)
+{
+	uint8_t cfg[2] = { '!', 'T' };
+	uint8_t reply[1] = { !!mode };
+
+	LOG_INF("Cut-through forwarding %s", mode ? "on" : "off");
+
+	atomic_set(&tx_cut_through, !!mode);
+
+	send_data(cfg, reply, sizeof(reply));
+}
+
+static void set_aggregation(uint8_t mode)
+{
+	uint8_t cfg[2] = { '!', 'A' };
+	uint8_t reply[2] = { !!mode, CONFIG_WPAN_SERIAL_AGG_MAX };
+
+	LOG_INF("Radio frame aggregation %s", mode ? "on" : "off");
+
+	atomic_set(&tx_aggregate, !!mode);
+
+	/* Lets the host tell whether the firmware supports containers */
+	send_data(cfg, reply, sizeof(reply));
+}
+
+/**
+ * "!E": the reply carries the mode, the fields the firmware fills in and
+ * the current radio time (be64 ns) to relate RX timestamps to.
+ */
+static void set_metadata(uint8_t mode)
+{
+	uint8_t cfg[2] = { '!', 'E' };
+	uint8_t reply[10] = { !!mode, META_FLAG_LQI | META_FLAG_RSSI };
+	net_time_t now = 0;
+
+#if defined(CONFIG_NET_PKT_TIMESTAMP)
+	reply[1] |= META_FLAG_TIMESTAMP;
+	if (radio_api->get_time) {
+		now = radio_api->get_time(ieee802154_dev);
+	}
+#endif
+	sys_put_be64(now, &reply[2]);
+
+	LOG_INF("Radio frame metadata %s", mode ? "on" : "off");
+
+	atomic_set(&tx_metadata, !!mode);
+
+	send_data(cfg, reply, sizeof(reply));
+}
+
+/* Clock of the capture timestamps, in ns */
+static net_time_t capture_now(void)
+{
+#if defined(CONFIG_NET_PKT_TIMESTAMP)
+	if (radio_api->get_time) {
+		return radio_api->get_time(ieee802154_dev);
+	}
+#endif
+	return k_ticks_to_ns_floor64(k_uptime_ticks());
+}
+
+static bool radio_config_bool(enum ieee802154_config_type type, bool on)
+{
+	struct ieee802154_config config = { 0 };
+	int ret;
+
+	if (type == IEEE802154_CONFIG_PROMISCUOUS) {
+		config.promiscuous = on;
+	} else {
+		config.rx_on_when_idle = on;
+	}
+
+	ret = radio_api->configure(ieee802154_dev, type, &config);
+	if (ret < 0) {
+		LOG_ERR("Failed to configure radio (%d): %d", type, ret);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * "!P": promiscuous reception, RX on when idle and capture framing, see
+ * PROMISC_FLAG_*. The reply carries the flags that are in effect and
+ * the current time of the capture clock (be64 ns), which the host needs
+ * to extend the 32-bit capture timestamps.
+ */
+static void set_promiscuous(uint8_t mode)
+{
+	uint8_t cfg[2] = { '!', 'P' };
+	uint8_t reply[9] = { 0 };
+	bool on;
+
+	on = mode & PROMISC_FLAG_PROMISCUOUS;
+	if ((radio_api->get_capabilities(ieee802154_dev) &
+	     IEEE802154_HW_PROMISC) &&
+	    radio_config_bool(IEEE802154_CONFIG_PROMISCUOUS, on) && on) {
+		reply[0] |= PROMISC_FLAG_PROMISCUOUS;
+	}
+
+	on = mode & PROMISC_FLAG_RX_ON_IDLE;
+	if (radio_config_bool(IEEE802154_CONFIG_RX_ON_WHEN_IDLE, on) && on) {
+		reply[0] |= PROMISC_FLAG_RX_ON_IDLE;
+	}
+
+	if (mode & PROMISC_FLAG_CAPTURE) {
+		reply[0] |= PROMISC_FLAG_CAPTURE;
+	}
+
+	LOG_INF("Promiscuous mode 0x%02x, in effect 0x%02x", mode, reply[0]);
+
+	atomic_set(&tx_capture, !!(mode & PROMISC_FLAG_CAPTURE));
+
+	sys_put_be64(capture_now(), &reply[1]);
+	send_data(cfg, reply, sizeof(reply));
+}
+
+/* Hand a filter to the radio, true if it filters in hardware now */
+static bool radio_filter_set(enum ieee802154_filter_type type, bool set,
+			     struct ieee802154_filter *filter)
+{
+	int ret;
+
+	if (!(radio_api->get_capabilities(ieee802154_dev) &
+	      IEEE802154_HW_FILTER)) {
+		return false;
+	}
+
+	ret = radio_api->filter(ieee802154_dev, set, type, filter);
+	if (ret < 0) {
+		LOG_WRN("Radio filter %d not %s: %d", type,
+			set ? "set" : "cleared", ret);
+		return false;
+	}
+
+	return set;
+}
+
+static uint8_t filter_add_src(struct net_buf *buf, bool deny)
+{
+	uint8_t mode;
+	size_t len;
+	int ret;
+
+	if (buf->len < 1) {
+		return FILTER_INVALID;
+	}
+
+	mode = net_buf_pull_u8(buf);
+	len = mode == FRAME_FILTER_ADDR_EXT ? 8 : 2;
+	if (buf->len < len) {
+		return FILTER_INVALID;
+	}
+
+	K_SPINLOCK(&rx_filter_lock) {
+		ret = frame_filter_add_src(&rx_filter, deny, mode,
+					   len == 8 ? sys_get_be64(buf->data) :
+						      sys_get_be16(buf->data));
+	}
+
+	return ret == -ENOMEM ? FILTER_FULL :
+	       ret < 0 ? FILTER_INVALID : FILTER_OK;
+}
+
+/**
+ * "!G": frame filter. The operation is followed by its argument:
+ *
+ *   P  PAN ID (be16), 0xffff accepts all PANs
+ *   S  own short address (be16), 0xffff unsets it
+ *   L  own extended address (be64), 0 unsets it and the radio falls
+ *      back to the MAC address of "?M"
+ *   T  accepted frame types, bit n for type n
+ *   A  allow a source: addressing mode (2 or 3), be16 or be64 address
+ *   D  deny a source, as A
+ *   C  accept all frames again
+ *
+ * The reply carries the operation, a status and whether the radio
+ * applies the PAN ID or address in hardware as well.
+ */
+static void set_filter(struct net_buf *buf)
+{
+	uint8_t cfg[2] = { '!', 'G' };
+	uint8_t reply[3] = { 0, FILTER_OK, 0 };
+	struct ieee802154_filter filter;
+	uint8_t op;
+
+	if (buf->len < 1) {
+		return;
+	}
+
+	op = net_buf_pull_u8(buf);
+	reply[0] = op;
+
+	switch (op) {
+	case 'P':
+	case 'S':
+		if (buf->len < 2) {
+			reply[1] = FILTER_INVALID;
+			break;
+		}
+
+		if (op == 'P') {
+			filter.pan_id = net_buf_pull_be16(buf);
+			K_SPINLOCK(&rx_filter_lock) {
+				frame_filter_set_pan_id(&rx_filter,
+							filter.pan_id);
+			}
+			reply[2] = radio_filter_set(
+				IEEE802154_FILTER_TYPE_PAN_ID,
+				filter.pan_id != FRAME_FILTER_BROADCAST,
+				&filter);
+		} else {
+			filter.short_addr = net_buf_pull_be16(buf);
+			K_SPINLOCK(&rx_filter_lock) {
+				frame_filter_set_short_addr(&rx_filter,
+							    filter.short_addr);
+			}
+			reply[2] = radio_filter_set(
+				IEEE802154_FILTER_TYPE_SHORT_ADDR,
+				filter.short_addr != FRAME_FILTER_BROADCAST,
+				&filter);
+		}
+		break;
+	case 'L': {
+		uint64_t addr;
+
+		if (buf->len < 8) {
+			reply[1] = FILTER_INVALID;
+			break;
+		}
+
+		addr = sys_get_be64(net_buf_pull_mem(buf, 8));
+		K_SPINLOCK(&rx_filter_lock) {
+			frame_filter_set_ext_addr(&rx_filter, addr);
+			/* The radio keeps acknowledging its MAC address */
+			ack_ext_addr = addr ? addr : sys_get_le64(mac_addr);
+		}
+
+		/* Radios take it in little endian, as on air */
+		sys_put_le64(ack_ext_addr, rx_filter_ext_addr);
+		filter.ieee_addr = rx_filter_ext_addr;
+		reply[2] = radio_filter_set(IEEE802154_FILTER_TYPE_IEEE_ADDR,
+					    true, &filter) && addr != 0;
+		break;
+	}
+	case 'T':
+		if (buf->len < 1) {
+			reply[1] = FILTER_INVALID;
+			break;
+		}
+
+		K_SPINLOCK(&rx_filter_lock) {
+			frame_filter_set_types(&rx_filter,
+					       net_buf_pull_u8(buf));
+		}
+		break;
+	case 'A':
+	case 'D':
+		reply[1] = filter_add_src(buf, op == 'D');
+		break;
+	case 'C':
+		K_SPINLOCK(&rx_filter_lock) {
+			frame_filter_clear(&rx_filter);
+			frame_filter_set_mac_addr(&rx_filter, ack_ext_addr);
+		}
+		break;
+	default:
+		reply[1] = FILTER_INVALID;
+	}
+
+	LOG_INF("Frame filter %c: status %u, hw %u", op, reply[1], reply[2]);
+
+	send_data(cfg, reply, sizeof(reply));
+}
+
+/**
+ * "!J": frame pending table of the radio's ACKs. The operation is
+ * followed by its argument:
+ *
+ *   A  0 never sets the frame pending bit, 1 sets it for sources in
+ *      the table
+ *   P  add a source: addressing mode (2 or 3), be16 or be64 address
+ *   R  remove a source, as P
+ *   C  remove all sources
+ *
+ * The reply carries the operation, a status as in "!G" and whether
+ * the radio applied it. The table lives in the radio only, radios
+ * without one keep answering with the frame pending bit unset.
+ */
+static void set_ack_pending(struct net_buf *buf)
+{
+	uint8_t cfg[2] = { '!', 'J' };
+	uint8_t reply[3] = { 0, FILTER_OK, 0 };
+	struct ieee802154_config config = { 0 };
+	uint8_t addr[8];
+	uint8_t op, mode;
+	int ret;
+
+	if (buf->len < 1) {
+		return;
+	}
+
+	op = net_buf_pull_u8(buf);
+	reply[0] = op;
+
+	switch (op) {
+	case 'A':
+		if (buf->len < 1) {
+			reply[1] = FILTER_INVALID;
+			break;
+		}
+
+		config.auto_ack_fpb.enabled = net_buf_pull_u8(buf);
+		config.auto_ack_fpb.mode = IEEE802154_FPB_ADDR_MATCH_THREAD;
+		ret = radio_api->configure(ieee802154_dev,
+					   IEEE802154_CONFIG_AUTO_ACK_FPB,
+					   &config);
+		reply[2] = ret == 0;
+		break;
+	case 'P':
+	case 'R':
+		mode = buf->len ? net_buf_pull_u8(buf) : 0;
+		if ((mode != FRAME_FILTER_ADDR_SHORT &&
+		     mode != FRAME_FILTER_ADDR_EXT) ||
+		    buf->len < (mode == FRAME_FILTER_ADDR_EXT ? 8 : 2)) {
+			reply[1] = FILTER_INVALID;
+			break;
+		}
+
+		/* Radios take it in little endian, as on air */
+		if (mode == FRAME_FILTER_ADDR_EXT) {
+			sys_put_le64(net_buf_pull_be64(buf), addr);
+		} else {
+			sys_put_le16(net_buf_pull_be16(buf), addr);
+		}
+
+		config.ack_fpb.addr = addr;
+		config.ack_fpb.extended = mode == FRAME_FILTER_ADDR_EXT;
+		config.ack_fpb.enabled = op == 'P';
+		ret = radio_api->configure(ieee802154_dev,
+					   IEEE802154_CONFIG_ACK_FPB, &config);
+		if (ret == -ENOMEM) {
+			reply[1] = FILTER_FULL;
+		}
+		reply[2] = ret == 0;
+		break;
+	case 'C':
+		/* Without an address, both tables are reset */
+		ret = radio_api->configure(ieee802154_dev,
+					   IEEE802154_CONFIG_ACK_FPB, &config);
+		if (ret == 0) {
+			config.ack_fpb.extended = true;
+			ret = radio_api->configure(ieee802154_dev,
+						   IEEE802154_CONFIG_ACK_FPB,
+						   &config);
+		}
+		reply[2] = ret == 0;
+		break;
+	default:
+		reply[1] = FILTER_INVALID;
+	}
+
+	LOG_INF("ACK pending %c: status %u, hw %u", op, reply[1], reply[2]);
+
+	send_data(cfg, reply, sizeof(reply));
+}
+
+/* The argument byte of a config message, false if it is missing */
+static bool config_arg(struct net_buf *buf, uint8_t cmd, uint8_t *arg)
+{
+	if (buf->len < 1) {
+		LOG_ERR("Missing argument of !%c", cmd);
+		return false;
+	}
+
+	*arg = net_buf_pull_u8(buf);
+	return true;
+}
+
+static void process_config(struct net_buf *buf)
+{
+	uint8_t cmd, arg;
+
+	if (buf->len < 1) {
+		LOG_ERR("Empty config");
+		return;
+	}
+
+	cmd = net_buf_pull_u8(buf);
+
+	LOG_DBG("Process config %c", cmd);
+
+	switch (cmd) {
+	case 'S':
+		process_data(buf);
+		break;
+	case 'B':
+		process_batch(buf);
+		break;
+	case 'C':
+		if (config_arg(buf, cmd, &arg)) {
+			set_channel(arg);
+		}
+		break;
+	case 'A':
+		if (config_arg(buf, cmd, &arg)) {
+			set_aggregation(arg);
+		}
+		break;
+	case 'E':
+		if (config_arg(buf, cmd, &arg)) {
+			set_metadata(arg);
+		}
+		break;
+	case 'P':
+		if (config_arg(buf, cmd, &arg)) {
+			set_promiscuous(arg);
+		}
+		break;
+	case 'G':
+		set_filter(buf);
+		break;
+	case 'T':
+		if (config_arg(buf, cmd, &arg)) {
+			set_cut_through(arg);
+		}
+		break;
+	case 'J':
+		set_ack_pending(buf);
+		break;
+	case 'N':
+		/* Link benchmark payload, counted by the decoder only */
+		break;
+	default:
+		LOG_ERR("Unhandled cmd %u", cmd);
+	}
+}
+
+static void rx_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	LOG_INF("RX thread started");
+
+	while (true) {
+		struct net_buf *buf;
+		uint8_t specifier;
+
+		buf = k_fifo_get(&rx_queue, K_FOREVER);
+
+		LOG_DBG("from SERIAL: rx_queue buf %p", buf);
+
+		LOG_HEXDUMP_DBG(buf->data, buf->len, "SLIP >");
+
+		if (buf->len < 1) {
+			LOG_ERR("Empty message");
+			net_buf_unref(buf);
+			continue;
+		}
+
+		specifier = net_buf_pull_u8(buf);
+		switch (specifier) {
+		case '?':
+			process_request(buf);
+			break;
+		case '!':
+			process_config(buf);
+			break;
+		default:
+			LOG_ERR("Unknown message specifier %c", specifier);
+			break;
+		}
+
+		/* Frames have been copied out, this returns the credit */
+		net_buf_unref(buf);
+	}
+}
+
+static void tx_enc_begin(void)
+{
+	if (tx_framing == LINK_FRAMING_COBS) {
+		cobs_encoder_begin(&tx_enc.cobs);
+	} else {
+		slip_encoder_begin(&tx_enc.slip);
+	}
+}
+
+static void tx_enc_next(const uint8_t *data, size_t len, bool last)
+{
+	if (tx_framing == LINK_FRAMING_COBS) {
+		cobs_encoder_next(&tx_enc.cobs, data, len, last);
+	} else {
+		slip_encoder_next(&tx_enc.slip, data, len, last);
+	}
+}
+
+static bool tx_enc_done(void)
+{
+	return tx_framing == LINK_FRAMING_COBS ?
+	       cobs_encoder_done(&tx_enc.cobs) :
+	       slip_encoder_done(&tx_enc.slip);
+}
+
+/* Encoded size of a frame of @p len bytes in the worst case */
+static size_t tx_enc_max(size_t len)
+{
+	/* SLIP: every byte escaped, plus SLIP_END */
+	return tx_framing == LINK_FRAMING_COBS ? COBS_ENCODED_MAX(len) :
+	       2 * len + 1;
+}
+
+/* Encode the current segment of tx_enc into tx_ring */
+static void tx_encode(bool last, uint32_t start, enum tx_path path)
+{
+	uint8_t *window;
+	uint32_t size;
+	size_t wrote;
+
+	while (!tx_enc_done()) {
+		size = ring_buf_put_claim(&tx_ring, &window, UINT32_MAX);
+		if (!size) {
+			if (k_sem_take(&tx_space_sem, K_MSEC(1000)) < 0) {
+				LOG_ERR("TX stalled");
+			}
+			continue;
+		}
+
+		wrote = tx_framing == LINK_FRAMING_COBS ?
+			cobs_encode(&tx_enc.cobs, window, size) :
+			slip_encode(&tx_enc.slip, window, size);
+		if (last && tx_enc_done()) {
+			tx_mark_push(tx_put_total + wrote, start, path);
+		}
+
+		ring_buf_put_finish(&tx_ring, wrote);
+		tx_put_total += wrote;
+		atomic_add(&serial_radio_stats.tx_bytes, wrote);
+
+		transport->tx_kick();
+	}
+}
+
+/* Encode a frame into tx_ring while the transport drains it */
+static void tx_write(const uint8_t *data, size_t len, uint32_t start,
+		     enum tx_path path)
+{
+	tx_enc_begin();
+	tx_enc_next(data, len, true);
+	tx_encode(true, start, path);
+
+	atomic_inc(&serial_radio_stats.tx_frames);
+}
+
+/* As tx_write(), with @p hdr in front of the frame but without a copy */
+static void tx_write_hdr(const uint8_t *hdr, size_t hdr_len,
+			 const uint8_t *data, size_t len, uint32_t start,
+			 enum tx_path path)
+{
+	tx_enc_begin();
+	tx_enc_next(hdr, hdr_len, false);
+	tx_encode(false, start, path);
+	tx_enc_next(data, len, true);
+	tx_encode(true, start, path);
+
+	atomic_inc(&serial_radio_stats.tx_frames);
+}
+
+/* Reception metadata of a radio frame, RADIO_META_LEN bytes */
+static void radio_meta_put(struct net_pkt *pkt, uint8_t *meta)
+{
+	int16_t rssi = net_pkt_ieee802154_rssi_dbm(pkt);
+
+	meta[0] = net_pkt_ieee802154_lqi(pkt);
+	/* IEEE802154_MAC_RSSI_DBM_UNDEFINED clamps to -128 */
+	meta[1] = (uint8_t)(int8_t)CLAMP(rssi, INT8_MIN, INT8_MAX);
+#if defined(CONFIG_NET_PKT_TIMESTAMP)
+	sys_put_be64(net_pkt_timestamp_ns(pkt), &meta[2]);
+#else
+	sys_put_be64(0, &meta[2]);
+#endif
+}
+
+/* Capture header of a radio frame, CAPTURE_INFO_LEN bytes */
+static void capture_info_put(struct net_pkt *pkt, uint8_t *info)
+{
+	int16_t rssi = net_pkt_ieee802154_rssi_dbm(pkt);
+	net_time_t ts;
+
+#if defined(CONFIG_NET_PKT_TIMESTAMP)
+	ts = net_pkt_timestamp_ns(pkt);
+#else
+	/* Time of forwarding instead of reception */
+	ts = capture_now();
+#endif
+
+	info[0] = radio_channel;
+	info[1] = net_pkt_ieee802154_lqi(pkt);
+	info[2] = (uint8_t)(int8_t)CLAMP(rssi, INT8_MIN, INT8_MAX);
+	sys_put_be32((uint32_t)(ts / NSEC_PER_USEC), &info[3]);
+}
+
+/**
+ * Cycle counter at the reception of a radio frame. The frame's RX
+ * timestamp is on the radio clock, so its age is taken from that clock.
+ */
+static uint32_t radio_rx_cycles(struct net_pkt *pkt)
+{
+	uint32_t now = k_cycle_get_32();
+
+#if defined(CONFIG_NET_PKT_TIMESTAMP)
+	if (radio_api->get_time && net_pkt_timestamp_ns(pkt)) {
+		net_time_t age = radio_api->get_time(ieee802154_dev) -
+				 net_pkt_timestamp_ns(pkt);
+
+		if (age > 0) {
+			now -= k_ns_to_cyc_floor32(age);
+		}
+	}
+#else
+	ARG_UNUSED(pkt);
+#endif
+
+	return now;
+}
+
+static bool tx_radio_frame_waiting(void)
+{
+	return !k_fifo_is_empty(&tx_queue[TX_CLASS_DATA]);
+}
+
+/**
+ * Take the next radio frame and the cycle counter at its reception,
+ * tx_thread is the only consumer
+ */
+static struct net_pkt *tx_radio_frame_get(uint32_t *rx)
+{
+	struct net_pkt *pkt = k_fifo_get(&tx_queue[TX_CLASS_DATA], K_NO_WAIT);
+	uint32_t queued;
+
+	if (!pkt) {
+		return NULL;
+	}
+
+	queued = tx_data_times[tx_data_tail].queued;
+	if (rx) {
+		*rx = tx_data_times[tx_data_tail].rx;
+	}
+	tx_data_tail = (tx_data_tail + 1) % ARRAY_SIZE(tx_data_times);
+
+	/* Its slot may be reused by the producer from here on */
+	atomic_dec(&serial_radio_stats.tx_backlog);
+	tx_delay_record(TX_CLASS_DATA, queued);
+
+	return pkt;
+}
+
+/**
+ * Next queued radio frame if it still fits into @p room bytes, with its
+ * length and @p info_len bytes of header
+ */
+static struct net_pkt *tx_next_radio_frame(size_t room, size_t info_len)
+{
+	struct net_pkt *pkt = k_fifo_peek_head(&tx_queue[TX_CLASS_DATA]);
+
+	/* The head stays until tx_thread takes it */
+	if (!pkt || net_pkt_get_len(pkt) - 2U + 1U + info_len > room) {
+		return NULL;
+	}
+
+	return tx_radio_frame_get(NULL);
+}
+
+/**
+ * Copy the queued radio frames into one "!F" container of count,
+ * length-prefixed frames, a "!Y" container with the metadata behind
+ * each length or a "!K" container with the capture header there. The
+ * frames are released before the container is encoded, so the radio
+ * driver gets its buffers back while the link is still busy.
+ */
+static void tx_write_container(struct net_pkt *pkt, uint32_t start)
+{
+	bool capture = atomic_get(&tx_capture);
+	bool meta = !capture && atomic_get(&tx_metadata);
+	size_t info_len = capture ? CAPTURE_INFO_LEN :
+			  meta ? RADIO_META_LEN : 0;
+	size_t off = 3;
+	uint8_t count = 0;
+	size_t len;
+
+	agg_buf[0] = '!';
+	agg_buf[1] = capture ? 'K' : meta ? 'Y' : 'F';
+
+	do {
+		/* remove FCS 2 bytes */
+		len = net_pkt_get_len(pkt) - 2U;
+
+		agg_buf[off++] = len;
+		if (capture) {
+			capture_info_put(pkt, &agg_buf[off]);
+		} else if (meta) {
+			radio_meta_put(pkt, &agg_buf[off]);
+		}
+		off += info_len;
+
+		net_pkt_cursor_init(pkt);
+		net_pkt_read(pkt, &agg_buf[off], len);
+		off += len;
+		count++;
+
+		net_pkt_unref(pkt);
+	} while (count < CONFIG_WPAN_SERIAL_AGG_MAX &&
+		 (pkt = tx_next_radio_frame(sizeof(agg_buf) - off, info_len)));
+
+	agg_buf[2] = count;
+
+	LOG_DBG("from RADIO to SERIAL: Send %u frames in %zu bytes", count, off);
+
+	atomic_inc(&serial_radio_stats.tx_containers);
+	atomic_add(&serial_radio_stats.tx_aggregated, count);
+
+	/* Latency is accounted for the oldest frame of the container */
+	tx_write(agg_buf, off, start, TX_PATH_QUEUED);
+}
+
+/* "!C": window, flags, messages released since "?C" (be16) */
+static void send_credits(void)
+{
+	uint8_t msg[6] = {
+		'!', 'C', CONFIG_WPAN_SERIAL_SLIP_RX_BUF_COUNT,
+		transport->hw_flow_control ? CREDIT_FLAG_RTS_CTS : 0,
+	};
+
+	/* Releases from now on need another update */
+	atomic_clear(&host_credits.queued);
+	sys_put_be16(atomic_get(&host_credits.freed), &msg[4]);
+
+	tx_write(msg, sizeof(msg), k_cycle_get_32(), TX_PATH_CTRL);
+}
+
+/**
+ * Switch the rate once everything queued so far has left the line. Unless
+ * it falls back, the host has to confirm the new rate.
+ */
+static void tx_switch_baud(uint32_t baud, bool confirm)
+{
+	uint32_t prev = link_baud;
+
+	while (tx_get_total != tx_put_total) {
+		k_sleep(K_MSEC(1));
+	}
+
+	/* The last character may still be in the shift register */
+	k_busy_wait(2 * 10 * USEC_PER_SEC / prev);
+
+	if (link_set_baud(baud) < 0) {
+		/* Still at the old rate, where the host will check */
+		atomic_clear(&link_baud_pending);
+		return;
+	}
+
+	/* A fallback is not confirmed */
+	if (!confirm) {
+		return;
+	}
+
+	link_baud_prev = prev;
+	k_work_schedule(&baud_fallback_work,
+			K_MSEC(CONFIG_WPAN_SERIAL_BAUD_CONFIRM_MS));
+}
+
+/* Apply the rate and framing a control message carries */
+static void tx_switch_link(uint32_t baud, uint8_t framing, bool confirm)
+{
+	if (framing != LINK_FRAMING_KEEP) {
+		tx_framing = framing;
+	}
+
+	if (baud) {
+		tx_switch_baud(baud, confirm);
+	}
+}
+
+/* A single radio frame, as "!X" with metadata once enabled */
+static void tx_write_radio_frame(struct net_pkt *pkt, uint32_t start,
+				 enum tx_path path)
+{
+	struct net_buf *buf = net_buf_frag_last(pkt->buffer);
+
+	LOG_DBG("from RADIO to SERIAL: Send pkt %p buf %p len %d", pkt, buf,
+		net_pkt_get_len(pkt));
+
+	LOG_HEXDUMP_DBG(buf->data, buf->len, "SLIP <");
+
+	/* remove FCS 2 bytes */
+	buf->len -= 2U;
+
+	/**
+	 * Encode into the TX ring; the previous frame may still be on the
+	 * wire
+	 */
+	if (atomic_get(&tx_metadata)) {
+		uint8_t hdr[2 + RADIO_META_LEN] = { '!', 'X' };
+
+		radio_meta_put(pkt, &hdr[2]);
+		tx_write_hdr(hdr, sizeof(hdr), buf->data, buf->len, start,
+			     path);
+	} else {
+		tx_write(buf->data, buf->len, start, path);
+	}
+
+	net_pkt_unref(pkt);
+}
+
+/**
+ * Forward a radio frame cut-through if the link is idle: nothing may be
+ * queued or being encoded, so that frames stay in order and control
+ * replies keep their priority, and the encoded frame has to fit into
+ * tx_ring, so that the radio RX thread never waits for the link.
+ * Captured frames always take the queue into a "!K" container.
+ */
+static bool tx_forward_cut_through(struct net_pkt *pkt, uint32_t rx)
+{
+	size_t len = net_pkt_get_len(pkt);
+
+	if (!atomic_get(&tx_cut_through) || atomic_get(&tx_capture) ||
+	    k_is_in_isr() || pkt->buffer->frags ||
+	    !k_fifo_is_empty(&tx_queue[TX_CLASS_CTRL]) ||
+	    !k_fifo_is_empty(&tx_queue[TX_CLASS_DATA])) {
+		return false;
+	}
+
+	if (k_mutex_lock(&tx_ring_lock, K_NO_WAIT) < 0) {
+		return false;
+	}
+
+	if (ring_buf_space_get(&tx_ring) < tx_enc_max(2 + RADIO_META_LEN + len)) {
+		k_mutex_unlock(&tx_ring_lock);
+		return false;
+	}
+
+	tx_write_radio_frame(pkt, rx, TX_PATH_CUT_THROUGH);
+
+	k_mutex_unlock(&tx_ring_lock);
+
+	return true;
+}
+
+/* Send the next queued message, with tx_ring_lock held */
+static void tx_dispatch(void)
+{
+	struct net_pkt *pkt;
+	uint32_t start;
+	void *item;
+
+	/* Control replies first, radio frames only once none waits */
+	item = k_fifo_get(&tx_queue[TX_CLASS_CTRL], K_NO_WAIT);
+	if (item == &credit_marker) {
+		tx_delay_record(TX_CLASS_CTRL, credit_marker.queued);
+		send_credits();
+		return;
+	}
+
+	if (item) {
+		struct ctrl_msg *msg = item;
+		uint32_t baud = msg->baud;
+		uint8_t framing = msg->framing;
+		bool revert = msg->revert;
+
+		tx_delay_record(TX_CLASS_CTRL, msg->queued);
+		if (revert) {
+			tx_switch_link(baud, framing, false);
+		}
+
+		tx_write(msg->data, msg->len, k_cycle_get_32(), TX_PATH_CTRL);
+		k_mem_slab_free(&ctrl_slab, msg);
+
+		if (!revert) {
+			tx_switch_link(baud, framing, true);
+		}
+		return;
+	}
+
+	pkt = tx_radio_frame_get(&start);
+	if (!pkt) {
+		return;
+	}
+
+	/**
+	 * Only coalesce while more frames are waiting; captured frames
+	 * always go into a container, even a single one
+	 */
+	if (atomic_get(&tx_capture) ||
+	    (atomic_get(&tx_aggregate) && tx_radio_frame_waiting())) {
+		tx_write_container(pkt, start);
+		return;
+	}
+
+	tx_write_radio_frame(pkt, start, TX_PATH_QUEUED);
+
+#if ANALYZE_UART_BOTTLENECK
+	uint32_t sent_count = atomic_inc(&packets_sent);
+	uint32_t recv_count = atomic_get(&packets_received);
+
+	/* Log every 10 packets */
+	if (sent_count % 10 == 0) {
+		LOG_INF("Stats: received=%u, sent=%u, lag=%d", recv_count,
+			sent_count, (int)(recv_count - sent_count));
+	}
+#endif
+}
+
+/**
+ * TX - transmit to SLIP interface
+ */
+static void tx_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	LOG_INF("TX thread started");
+
+	while (true) {
+		int i;
+
+		k_poll(tx_events, ARRAY_SIZE(tx_events), K_FOREVER);
+		for (i = 0; i < ARRAY_SIZE(tx_events); i++) {
+			tx_events[i].state = K_POLL_STATE_NOT_READY;
+		}
+
+		/**
+		 * Held from dequeue to the last byte in tx_ring, so a
+		 * cut-through frame cannot overtake the one taken here
+		 */
+		k_mutex_lock(&tx_ring_lock, K_FOREVER);
+		tx_dispatch();
+		k_mutex_unlock(&tx_ring_lock);
+	}
+}
+
+static void init_rx_queue(void)
+{
+	k_fifo_init(&rx_queue);
+
+	k_thread_create(&rx_thread_data, rx_stack,
+			K_THREAD_STACK_SIZEOF(rx_stack),
+			rx_thread,
+			NULL, NULL, NULL, THREAD_PRIORITY, 0, K_NO_WAIT);
+}
+
+static void init_tx_queue(void)
+{
+	int i;
+
+	for (i = 0; i < TX_CLASS_COUNT; i++) {
+		k_fifo_init(&tx_queue[i]);
+		k_poll_event_init(&tx_events[i], K_POLL_TYPE_FIFO_DATA_AVAILABLE,
+				  K_POLL_MODE_NOTIFY_ONLY, &tx_queue[i]);
+	}
+
+	k_mem_slab_init(&ctrl_slab, ctrl_msgs, sizeof(struct ctrl_msg),
+			ARRAY_SIZE(ctrl_msgs));
+
+	k_thread_create(&tx_thread_data, tx_stack,
+			K_THREAD_STACK_SIZEOF(tx_stack),
+			tx_thread,
+			NULL, NULL, NULL, THREAD_PRIORITY, 0, K_NO_WAIT);
+}
+
+static void init_radio_tx(void)
+{
+	enum ieee802154_hw_caps caps = radio_api->get_capabilities(ieee802154_dev);
+
+	if (IS_ENABLED(CONFIG_WPAN_SERIAL_TX_CSMA_CA)) {
+		if (caps & IEEE802154_HW_CSMA) {
+			radio_tx_mode = IEEE802154_TX_MODE_CSMA_CA;
+		} else {
+			/* Backoff is done by radio_tx_process() */
+			radio_tx_mode = IEEE802154_TX_MODE_CCA;
+		}
+	}
+
+	if (!(caps & IEEE802154_HW_TX_RX_ACK)) {
+		LOG_WRN("Radio does not wait for ACKs, NOACK is never reported");
+	}
+
+	LOG_INF("Radio TX mode %d, window %d", radio_tx_mode,
+		CONFIG_WPAN_SERIAL_TX_WINDOW);
+
+	radio_tx_pkt = net_pkt_alloc(K_FOREVER);
+
+	k_thread_create(&radio_tx_thread_data, radio_tx_stack,
+			K_THREAD_STACK_SIZEOF(radio_tx_stack),
+			radio_tx_thread,
+			NULL, NULL, NULL, THREAD_PRIORITY, 0, K_NO_WAIT);
+}
+
+#if defined(CONFIG_WPAN_SERIAL_ALLOC_STATS)
+#define ALLOC_ROUNDS 256
+
+/* Compare a reply net_pkt with the slab blocks that replaced it */
+static void analyze_alloc_latency(void)
+{
+	uint32_t pkt_cyc, ctrl_cyc, frame_cyc;
+	struct net_pkt *pkt;
+	void *block;
+	uint32_t t0;
+	int i;
+
+	/* Repeated, the system clock is too coarse for a single one */
+	t0 = k_cycle_get_32();
+	for (i = 0; i < ALLOC_ROUNDS; i++) {
+		pkt = net_pkt_alloc_with_buffer(NULL, 16, AF_UNSPEC, 0,
+						K_NO_WAIT);
+		net_pkt_unref(pkt);
+	}
+	pkt_cyc = k_cycle_get_32() - t0;
+
+	t0 = k_cycle_get_32();
+	for (i = 0; i < ALLOC_ROUNDS; i++) {
+		k_mem_slab_alloc(&ctrl_slab, &block, K_NO_WAIT);
+		k_mem_slab_free(&ctrl_slab, block);
+	}
+	ctrl_cyc = k_cycle_get_32() - t0;
+
+	t0 = k_cycle_get_32();
+	for (i = 0; i < ALLOC_ROUNDS; i++) {
+		k_mem_slab_alloc(&radio_tx_slab, &block, K_NO_WAIT);
+		k_mem_slab_free(&radio_tx_slab, block);
+	}
+	frame_cyc = k_cycle_get_32() - t0;
+
+	LOG_INF("net_pkt: %zu B + %u B buffer, alloc+free %u ns",
+		sizeof(struct net_pkt), CONFIG_NET_BUF_DATA_SIZE,
+		(uint32_t)(k_cyc_to_ns_ceil64(pkt_cyc) / ALLOC_ROUNDS));
+	LOG_INF("ctrl_msg: %zu B, alloc+free %u ns", sizeof(struct ctrl_msg),
+		(uint32_t)(k_cyc_to_ns_ceil64(ctrl_cyc) / ALLOC_ROUNDS));
+	LOG_INF("radio_tx_req: %zu B, alloc+free %u ns",
+		sizeof(struct radio_tx_req),
+		(uint32_t)(k_cyc_to_ns_ceil64(frame_cyc) / ALLOC_ROUNDS));
+}
+#endif
+
+/**
+ * FIXME choose correct OUI, or add support in L2
+ */
+static uint8_t *get_mac(const struct device *dev)
+{
+	mac_addr[7] = 0x00;
+	mac_addr[6] = 0x12;
+	mac_addr[5] = 0x4b;
+	mac_addr[4] = 0x00;
+
+	sys_rand_get(mac_addr, 4U);
+
+	mac_addr[0] = (mac_addr[0] & ~0x01) | 0x02;
+
+	return mac_addr;
+}
+
+static bool init_ieee802154(void)
+{
+	LOG_INF("Initialize ieee802.15.4");
+
+	if (!device_is_ready(ieee802154_dev)) {
+		LOG_ERR("IEEE 802.15.4 device not ready");
+		return false;
+	}
+
+	radio_api = (struct ieee802154_radio_api *)ieee802154_dev->api;
+
+	/**
+	 * Do actual initialization of the chip
+	 */
+	get_mac(ieee802154_dev);
+
+	/* Addresses and further criteria are set by the host with "!G" */
+	frame_filter_clear(&rx_filter);
+	ack_ext_addr = sys_get_le64(mac_addr);
+	frame_filter_set_mac_addr(&rx_filter, ack_ext_addr);
+
+	if (IEEE802154_HW_FILTER &
+	    radio_api->get_capabilities(ieee802154_dev)) {
+		struct ieee802154_filter filter;
+
+		/* The radio acknowledges frames to its address by itself */
+		memcpy(rx_filter_ext_addr, mac_addr, sizeof(mac_addr));
+		filter.ieee_addr = rx_filter_ext_addr;
+		radio_api->filter(ieee802154_dev, true,
+				  IEEE802154_FILTER_TYPE_IEEE_ADDR, &filter);
+
+#ifdef CONFIG_NET_CONFIG_SETTINGS
+		LOG_INF("Set panid %x", CONFIG_NET_CONFIG_IEEE802154_PAN_ID);
+
+		filter.pan_id = CONFIG_NET_CONFIG_IEEE802154_PAN_ID;
+
+		radio_api->filter(ieee802154_dev, true,
+				  IEEE802154_FILTER_TYPE_PAN_ID,
+				  &filter);
+#endif /* CONFIG_NET_CONFIG_SETTINGS */
+	}
+
+#ifdef CONFIG_NET_CONFIG_SETTINGS
+	LOG_INF("Set channel %u", CONFIG_NET_CONFIG_IEEE802154_CHANNEL);
+	radio_api->set_channel(ieee802154_dev,
+			       CONFIG_NET_CONFIG_IEEE802154_CHANNEL);
+	radio_channel = CONFIG_NET_CONFIG_IEEE802154_CHANNEL;
+#endif /* CONFIG_NET_CONFIG_SETTINGS */
+
+	/* Start ieee802154 */
+	radio_api->start(ieee802154_dev);
+
+	/* Promiscuous mode is switched by the host with "!P" */
+
+	return true;
+}
+
+/**
+ * Count a frame the radio has acknowledged. Retransmissions repeat the
+ * sequence number of the frame whose ACK the sender missed.
+ */
+static void ack_rx_account(struct net_pkt *pkt, uint16_t short_addr,
+			   uint64_t ext_addr)
+{
+	struct frame_mhr h;
+	int i;
+
+	if (!frame_mhr_parse(pkt->buffer->data, pkt->buffer->len, &h) ||
+	    !h.ack_request) {
+		return;
+	}
+
+	if (!(h.dst_mode == FRAME_FILTER_ADDR_SHORT && h.dst == short_addr) &&
+	    !(h.dst_mode == FRAME_FILTER_ADDR_EXT && h.dst == ext_addr)) {
+		return;
+	}
+
+	atomic_inc(&ack_stats.rx_acked);
+	if (net_pkt_ieee802154_ack_fpb(pkt)) {
+		atomic_inc(&ack_stats.rx_pending);
+	}
+
+	if (!h.has_seq || h.src_mode == FRAME_FILTER_ADDR_NONE) {
+		return;
+	}
+
+	/* Only called from the radio RX path, no other writer */
+	for (i = 0; i < ACK_RX_SOURCES; i++) {
+		if (ack_rx_last[i].mode == h.src_mode &&
+		    ack_rx_last[i].addr == h.src) {
+			break;
+		}
+	}
+
+	if (i == ACK_RX_SOURCES) {
+		i = ack_rx_next;
+		ack_rx_next = (ack_rx_next + 1) % ACK_RX_SOURCES;
+		ack_rx_last[i].mode = h.src_mode;
+		ack_rx_last[i].addr = h.src;
+	} else if (ack_rx_last[i].seq == h.seq) {
+		atomic_inc(&ack_stats.rx_retries);
+	}
+
+	ack_rx_last[i].seq = h.seq;
+}
+
+static void queue_radio_frame(struct net_pkt *pkt)
+{
+	uint32_t rx = radio_rx_cycles(pkt);
+	atomic_val_t backlog;
+	uint16_t short_addr;
+	uint64_t ext_addr;
+	bool pass;
+
+	K_SPINLOCK(&rx_filter_lock) {
+		pass = frame_filter_match(&rx_filter, pkt->buffer->data,
+					  pkt->buffer->len);
+		short_addr = rx_filter.short_addr;
+		ext_addr = ack_ext_addr;
+	}
+
+	ack_rx_account(pkt, short_addr, ext_addr);
+
+	if (!pass) {
+		atomic_inc(&serial_radio_stats.radio_filtered);
+		net_pkt_unref(pkt);
+		return;
+	}
+
+	if (tx_forward_cut_through(pkt, rx)) {
+		return;
+	}
+
+	backlog = atomic_get(&serial_radio_stats.tx_backlog);
+
+	/**
+	 * Tail drop: the frames already queued keep their place, and the
+	 * radio driver keeps buffers to receive into.
+	 */
+	if (backlog >= CONFIG_WPAN_SERIAL_TX_DATA_DEPTH) {
+		atomic_inc(&tx_class_stats[TX_CLASS_DATA].dropped);
+		net_pkt_unref(pkt);
+		return;
+	}
+
+	/* Only called from the radio RX path, no other writer */
+	tx_data_times[tx_data_head].queued = k_cycle_get_32();
+	tx_data_times[tx_data_head].rx = rx;
+	tx_data_head = (tx_data_head + 1) % ARRAY_SIZE(tx_data_times);
+
+	backlog = atomic_inc(&serial_radio_stats.tx_backlog) + 1;
+	if (backlog > atomic_get(&serial_radio_stats.tx_backlog_max)) {
+		atomic_set(&serial_radio_stats.tx_backlog_max, backlog);
+	}
+
+	k_fifo_put(&tx_queue[TX_CLASS_DATA], pkt);
+}
+
+#if ANALYZE_UART_BOTTLENECK
+int net_recv_data(struct net_if *iface, struct net_pkt *pkt)
+{
+	uint32_t recv_count = atomic_inc(&packets_received);
+
+	LOG_DBG("from RADIO: Received pkt %p, len %d [#%u]",
+	        pkt, net_pkt_get_len(pkt), recv_count);
+
+	queue_radio_frame(pkt);
+	return 0;
+}
+#else
+int net_recv_data(struct net_if *iface, struct net_pkt *pkt)
+{
+	LOG_DBG("from RADIO: Received pkt %p, len %d", pkt, net_pkt_get_len(pkt));
+
+	queue_radio_frame(pkt);
+
+	return 0;
+}
+#endif
+
+/**
+ * ACK of a host frame, called by the radio driver before its tx()
+ * returns. The driver owns and frees the packet.
+ */
+enum net_verdict ieee802154_handle_ack(struct net_if *iface, struct net_pkt *pkt)
+{
+	uint32_t start = ack_tx_start;
+	uint32_t us;
+
+	ARG_UNUSED(iface);
+
+	if (!start) {
+		return NET_DROP;
+	}
+
+	us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+	atomic_inc(&ack_stats.ack_wait_count);
+	atomic_add(&ack_stats.ack_wait_sum_us, us);
+	if (us > atomic_get(&ack_stats.ack_wait_max_us)) {
+		atomic_set(&ack_stats.ack_wait_max_us, us);
+	}
+
+	if (pkt->buffer && pkt->buffer->len &&
+	    (pkt->buffer->data[0] & FRAME_FCF_PENDING)) {
+		atomic_inc(&ack_stats.tx_pending);
+	}
+
+	return NET_OK;
+}
+
+int serial_radio_start(const struct serial_radio_transport *tp)
+{
+	int ret;
+
+	transport = tp;
+	link_baud = tp->baud;
+
+	LOG_INF("Starting serial-radio on %s", tp->name);
+
+	/* Initialize net_pkt */
+	net_pkt_init();
+
+	slip_decoder_init(&slip_dec, &slip_cb, &slip_done);
+	cobs_decoder_init(&cobs_dec, &slip_cb, &slip_done);
+
+	/* Initialize RX queue */
+	init_rx_queue();
+
+#if defined(CONFIG_UART_INTERRUPT_DRIVEN)
+	init_rx_ring();
+#endif
+
+	/* Initialize TX queue */
+	init_tx_queue();
+
+	/* Initialize ieee802154 device */
+	if (!init_ieee802154()) {
+		LOG_ERR("Unable to initialize ieee802154");
+		return -ENODEV;
+	}
+
+	init_radio_tx();
+
+#if defined(CONFIG_WPAN_SERIAL_ALLOC_STATS)
+	analyze_alloc_latency();
+#endif
+
+	ret = tp->init();
+	if (ret < 0) {
+		LOG_ERR("Failed to start %s: %d", tp->name, ret);
+		return ret;
+	}
+
+	LOG_INF("Serial-radio ready on %s", tp->name);
+
+	return 0;
+}
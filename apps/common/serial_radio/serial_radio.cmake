@@ -0,0 +1,31 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Serial-radio core and the transport selected in Kconfig, shared by
+# wpan_serial and wpan_serial_uart
+
+set(SERIAL_RADIO_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+target_include_directories(app PRIVATE ${SERIAL_RADIO_DIR})
+
+target_sources(app PRIVATE
+  ${SERIAL_RADIO_DIR}/slip.c
+  ${SERIAL_RADIO_DIR}/cobs.c
+  ${SERIAL_RADIO_DIR}/frame_filter.c
+  ${SERIAL_RADIO_DIR}/serial_radio.c
+)
+
+target_sources_ifdef(CONFIG_WPAN_SERIAL_UART_IRQ app PRIVATE
+  ${SERIAL_RADIO_DIR}/transport_uart.c)
+target_sources_ifdef(CONFIG_WPAN_SERIAL_UART_ASYNC app PRIVATE
+  ${SERIAL_RADIO_DIR}/transport_uart.c)
+target_sources_ifdef(CONFIG_WPAN_SERIAL_CDC_ACM app PRIVATE
+  ${SERIAL_RADIO_DIR}/transport_cdc_acm.c)
+target_sources_ifdef(CONFIG_WPAN_SERIAL_PTY app PRIVATE
+  ${SERIAL_RADIO_DIR}/transport_pty.c)
+
+if(CONFIG_WPAN_SERIAL_RADIO_SIM)
+  target_sources(app PRIVATE ${SERIAL_RADIO_DIR}/sim/radio_sim.c)
+  # Runs on the host side of native_sim, against the host C library
+  target_sources(native_simulator INTERFACE
+    ${SERIAL_RADIO_DIR}/sim/radio_sim_bottom.c)
+endif()
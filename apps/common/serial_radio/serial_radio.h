@@ -0,0 +1,125 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief 802.15.4 "serial-radio" core with pluggable transports
+ *
+ * The core implements the serial-radio protocol, the queues and threads
+ * between host and radio, and the SLIP or COBS pipeline. A transport
+ * only moves bytes: received chunks are passed to serial_radio_rx(), and
+ * encoded bytes are taken from the TX ring with serial_radio_tx_claim()
+ * and serial_radio_tx_consumed() whenever the core kicks it.
+ */
+
+#ifndef SERIAL_RADIO_H_
+#define SERIAL_RADIO_H_
+
+#include <zephyr/device.h>
+#include <zephyr/sys/atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct serial_radio_transport {
+	const char *name;
+	/** Bring up the link and start reception */
+	int (*init)(void);
+	/** The TX ring holds new bytes; called from the TX thread */
+	void (*tx_kick)(void);
+	/**
+	 * Change the line rate to one of @p bauds. NULL if the rate is
+	 * fixed, "?U" is then answered as unsupported.
+	 */
+	int (*set_baud)(uint32_t baud);
+	const uint32_t *bauds;
+	uint8_t num_bauds;
+	/** Line rate at start */
+	uint32_t baud;
+	/** RTS/CTS is enabled, reported to the host in "!C" */
+	bool hw_flow_control;
+};
+
+/** Serial link counters, reported to the host on a "?D" request */
+struct serial_radio_stats {
+	atomic_t rx_bytes;
+	atomic_t rx_frames;
+	atomic_t rx_dropped_bytes;
+	atomic_t rx_overruns;
+	/* Host messages without a free buffer, i.e. sent beyond the credits */
+	atomic_t rx_no_buf;
+	/* Highest fill of the interrupt byte ring, and times it overflowed */
+	atomic_t rx_ring_max;
+	atomic_t rx_ring_overruns;
+	atomic_t tx_frames;
+	atomic_t tx_bytes;
+	/**
+	 * Radio frame reception, or dequeue of a reply, to the last byte
+	 * handed to the transport
+	 */
+	atomic_t tx_latency_count;
+	atomic_t tx_latency_sum_us;
+	atomic_t tx_latency_max_us;
+	/* "!F" containers and the radio frames carried in them */
+	atomic_t tx_containers;
+	atomic_t tx_aggregated;
+	/* Radio frames waiting in tx_queue, and the highest count seen */
+	atomic_t tx_backlog;
+	atomic_t tx_backlog_max;
+	/* Radio frames rejected by the frame filter */
+	atomic_t radio_filtered;
+};
+
+extern struct serial_radio_stats serial_radio_stats;
+
+/* Transports, the one selected in Kconfig is built */
+extern const struct serial_radio_transport serial_radio_uart;
+extern const struct serial_radio_transport serial_radio_cdc_acm;
+extern const struct serial_radio_transport serial_radio_pty;
+
+/**
+ * @brief Start the serial-radio on @p transport
+ *
+ * Initializes the radio, starts the core threads and then the transport.
+ */
+int serial_radio_start(const struct serial_radio_transport *transport);
+
+/**
+ * @brief Decode a chunk of bytes received from the host
+ *
+ * Called from thread context, never concurrently. Transports on the
+ * interrupt-driven API use serial_radio_irq_handler() instead, which
+ * hands the bytes to a decoder thread.
+ */
+void serial_radio_rx(const uint8_t *data, size_t len);
+
+/** @brief Bytes were lost, drop the partially received message */
+void serial_radio_rx_reset(void);
+
+/**
+ * @brief Contiguous encoded bytes waiting for the transport
+ *
+ * Every claim is followed by serial_radio_tx_consumed(), with 0 if
+ * nothing could be sent.
+ */
+uint32_t serial_radio_tx_claim(uint8_t **data);
+
+/** @brief The transport has taken @p len claimed bytes */
+void serial_radio_tx_consumed(uint32_t len);
+
+/**
+ * @brief Interrupt handler for transports on the interrupt-driven UART API
+ *
+ * Copies received bytes into a byte ring that a decoder thread drains,
+ * and fills the FIFO from the TX ring. The transport enables TX
+ * interrupts in its tx_kick().
+ */
+void serial_radio_irq_handler(const struct device *dev, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_RADIO_H_ */
@@ -0,0 +1,578 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Simulated 802.15.4 radio for native_sim
+ *
+ * Frames are exchanged with the other native_sim processes (and host
+ * tools) attached to the same medium directory, given with --air. The
+ * medium is ideal: every frame on the same channel reaches every other
+ * process after its air time at 250 kbit/s. Outside promiscuous mode,
+ * frames are filtered by PAN ID and destination address, and those to
+ * the radio's own address with the AR bit set are acknowledged after
+ * the turnaround time, with the frame pending bit set for sources in
+ * the pending table. Transmissions with the AR bit set report NOACK
+ * unless an ACK arrives in time. An energy scan finds a channel busy if
+ * a frame was sent on it while scanning.
+ */
+
+#define DT_DRV_COMPAT serial_radio_sim_802154
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(radio_sim, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/ieee802154_radio.h>
+#include <zephyr/net/net_core.h>
+#include <zephyr/net/net_pkt.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#include <cmdline.h>
+#include <posix_native_task.h>
+
+#include "frame_filter.h"
+#include "radio_sim_bottom.h"
+
+/* Air time per byte and of the synchronization and PHY header */
+#define SIM_US_PER_BYTE 32
+#define SIM_SHR_PHR_LEN 6
+
+/* Link quality reported for every received frame */
+#define SIM_LQI      255
+#define SIM_RSSI_DBM (-40)
+
+/* Energy of a channel without frames */
+#define SIM_NOISE_DBM (-100)
+
+#define SIM_FIRST_CHANNEL 11
+#define SIM_LAST_CHANNEL  26
+
+/* Poll interval of the medium */
+#define SIM_RX_POLL_US 100
+
+/**
+ * RX to TX turnaround before an ACK, and how long a sender waits for
+ * it. The 864 us of macAckWaitDuration would be too tight with the
+ * medium polled and the processes scheduled by the host.
+ */
+#define SIM_TURNAROUND_US 192
+#define SIM_ACK_WAIT_US   2000
+
+/* Frame control field and sequence number */
+#define SIM_ACK_LEN 3
+
+#define SIM_PENDING_MAX 16
+
+struct radio_sim_pending {
+	uint64_t addr;
+	bool extended;
+};
+
+struct radio_sim_data {
+	uint8_t channel;
+	bool started;
+	bool promiscuous;
+	/* Uptime in ticks of the last frame on each channel */
+	int64_t last_frame[SIM_LAST_CHANNEL + 1];
+	/* Address filter, FRAME_FILTER_BROADCAST and 0 if not set */
+	uint16_t pan_id;
+	uint16_t short_addr;
+	uint64_t ext_addr;
+	/* Frame pending table of the ACKs sent */
+	bool fpb_enabled;
+	uint8_t num_pending;
+	struct radio_sim_pending pending[SIM_PENDING_MAX];
+	/* Sequence number of the awaited ACK, -1 if none */
+	int ack_seq;
+	bool ack_pending;
+	struct k_sem ack_sem;
+};
+
+static struct radio_sim_data radio_sim_data = {
+	.channel = 26,
+	.pan_id = FRAME_FILTER_BROADCAST,
+	.short_addr = FRAME_FILTER_BROADCAST,
+	.ack_seq = -1,
+};
+
+static char *air_dir = "/tmp/wpan-air";
+
+static K_THREAD_STACK_DEFINE(radio_sim_stack, 1024);
+static struct k_thread radio_sim_thread_data;
+
+static net_time_t radio_sim_now(void)
+{
+	return k_ticks_to_ns_floor64(k_uptime_ticks());
+}
+
+static bool radio_sim_to_us(const struct frame_mhr *h)
+{
+	struct radio_sim_data *data = &radio_sim_data;
+
+	if (h->dst_mode == FRAME_FILTER_ADDR_SHORT) {
+		return data->short_addr != FRAME_FILTER_BROADCAST &&
+		       h->dst == data->short_addr;
+	}
+
+	return h->dst_mode == FRAME_FILTER_ADDR_EXT && data->ext_addr != 0 &&
+	       h->dst == data->ext_addr;
+}
+
+static bool radio_sim_accept(const struct frame_mhr *h)
+{
+	struct radio_sim_data *data = &radio_sim_data;
+
+	if (data->promiscuous || h->dst_mode == FRAME_FILTER_ADDR_NONE) {
+		return true;
+	}
+
+	if (h->has_dst_pan && h->dst_pan != FRAME_FILTER_BROADCAST &&
+	    data->pan_id != FRAME_FILTER_BROADCAST &&
+	    h->dst_pan != data->pan_id) {
+		return false;
+	}
+
+	return (h->dst_mode == FRAME_FILTER_ADDR_SHORT &&
+		h->dst == FRAME_FILTER_BROADCAST) || radio_sim_to_us(h);
+}
+
+static bool radio_sim_is_pending(const struct frame_mhr *h)
+{
+	struct radio_sim_data *data = &radio_sim_data;
+
+	if (!data->fpb_enabled) {
+		return false;
+	}
+
+	for (int i = 0; i < data->num_pending; i++) {
+		if (data->pending[i].extended ==
+		    (h->src_mode == FRAME_FILTER_ADDR_EXT) &&
+		    data->pending[i].addr == h->src) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void radio_sim_send_ack(uint8_t seq, bool pending)
+{
+	uint8_t buf[1 + SIM_ACK_LEN + IEEE802154_FCS_LENGTH];
+
+	buf[0] = radio_sim_data.channel;
+	sys_put_le16(FRAME_TYPE_ACK | (pending ? FRAME_FCF_PENDING : 0),
+		     &buf[1]);
+	buf[3] = seq;
+	sys_put_le16(crc16_ccitt(0, &buf[1], SIM_ACK_LEN),
+		     &buf[1 + SIM_ACK_LEN]);
+
+	k_sleep(K_USEC(SIM_TURNAROUND_US +
+		       (SIM_SHR_PHR_LEN + sizeof(buf) - 1) * SIM_US_PER_BYTE));
+
+	radio_sim_air_send(buf, sizeof(buf));
+}
+
+static void radio_sim_rx(const uint8_t *psdu, int len)
+{
+	struct radio_sim_data *data = &radio_sim_data;
+	struct net_pkt *pkt;
+	struct frame_mhr h;
+	bool pending = false;
+
+	if (len < IEEE802154_FCS_LENGTH ||
+	    !frame_mhr_parse(psdu, len - IEEE802154_FCS_LENGTH, &h)) {
+		if (!data->promiscuous) {
+			return;
+		}
+	} else if (h.type == FRAME_TYPE_ACK) {
+		/* ACKs are consumed by the radio, as on hardware */
+		if (h.has_seq && h.seq == data->ack_seq) {
+			data->ack_pending = psdu[0] & FRAME_FCF_PENDING;
+			data->ack_seq = -1;
+			k_sem_give(&data->ack_sem);
+		}
+		return;
+	} else if (!radio_sim_accept(&h)) {
+		return;
+	} else if (h.ack_request && h.has_seq && radio_sim_to_us(&h)) {
+		pending = radio_sim_is_pending(&h);
+		radio_sim_send_ack(h.seq, pending);
+	}
+
+	pkt = net_pkt_rx_alloc_with_buffer(NULL, len, AF_UNSPEC, 0,
+					   K_NO_WAIT);
+	if (!pkt) {
+		LOG_WRN("No buffer, frame dropped");
+		return;
+	}
+
+	/* Frames are delivered with FCS, as the serial-radio expects */
+	if (net_pkt_write(pkt, psdu, len) < 0) {
+		net_pkt_unref(pkt);
+		return;
+	}
+
+	net_pkt_set_ieee802154_lqi(pkt, SIM_LQI);
+	net_pkt_set_ieee802154_rssi_dbm(pkt, SIM_RSSI_DBM);
+	net_pkt_set_ieee802154_ack_fpb(pkt, pending);
+#if defined(CONFIG_NET_PKT_TIMESTAMP)
+	net_pkt_set_timestamp_ns(pkt, radio_sim_now());
+#endif
+
+	if (net_recv_data(NULL, pkt) < 0) {
+		net_pkt_unref(pkt);
+	}
+}
+
+static void radio_sim_thread(void *p1, void *p2, void *p3)
+{
+	uint8_t buf[1 + IEEE802154_MAX_PHY_PACKET_SIZE];
+	int len;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (true) {
+		len = radio_sim_air_recv(buf, sizeof(buf));
+		if (len <= 0) {
+			k_sleep(K_USEC(SIM_RX_POLL_US));
+			continue;
+		}
+
+		/* First byte is the channel the frame was sent on */
+		if (len >= 2 && buf[0] >= SIM_FIRST_CHANNEL &&
+		    buf[0] <= SIM_LAST_CHANNEL) {
+			radio_sim_data.last_frame[buf[0]] = k_uptime_ticks();
+		}
+
+		if (!radio_sim_data.started || len < 2 ||
+		    buf[0] != radio_sim_data.channel) {
+			continue;
+		}
+
+		radio_sim_rx(&buf[1], len - 1);
+	}
+}
+
+static enum ieee802154_hw_caps radio_sim_get_capabilities(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	return IEEE802154_HW_FCS | IEEE802154_HW_CSMA | IEEE802154_HW_PROMISC |
+	       IEEE802154_HW_ENERGY_SCAN | IEEE802154_HW_FILTER |
+	       IEEE802154_HW_RX_TX_ACK | IEEE802154_HW_TX_RX_ACK;
+}
+
+static int radio_sim_cca(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	return 0;
+}
+
+static int radio_sim_set_channel(const struct device *dev, uint16_t channel)
+{
+	ARG_UNUSED(dev);
+
+	if (channel < SIM_FIRST_CHANNEL || channel > SIM_LAST_CHANNEL) {
+		return -EINVAL;
+	}
+
+	radio_sim_data.channel = channel;
+
+	return 0;
+}
+
+static int radio_sim_ed_scan(const struct device *dev, uint16_t duration,
+			     energy_scan_done_cb_t done_cb)
+{
+	uint8_t channel = radio_sim_data.channel;
+	int64_t start = k_uptime_ticks();
+
+	k_sleep(K_MSEC(duration));
+
+	done_cb(dev, radio_sim_data.last_frame[channel] >= start ?
+		     SIM_RSSI_DBM : SIM_NOISE_DBM);
+
+	return 0;
+}
+
+static int radio_sim_filter(const struct device *dev, bool set,
+			    enum ieee802154_filter_type type,
+			    const struct ieee802154_filter *filter)
+{
+	struct radio_sim_data *data = &radio_sim_data;
+
+	ARG_UNUSED(dev);
+
+	switch (type) {
+	case IEEE802154_FILTER_TYPE_PAN_ID:
+		data->pan_id = set ? filter->pan_id : FRAME_FILTER_BROADCAST;
+		break;
+	case IEEE802154_FILTER_TYPE_SHORT_ADDR:
+		data->short_addr = set ? filter->short_addr :
+					 FRAME_FILTER_BROADCAST;
+		break;
+	case IEEE802154_FILTER_TYPE_IEEE_ADDR:
+		/* Little endian, as on air */
+		data->ext_addr = set ? sys_get_le64(filter->ieee_addr) : 0;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+static int radio_sim_set_txpower(const struct device *dev, int16_t dbm)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(dbm);
+
+	return 0;
+}
+
+/* Hand the ACK of a transmitted frame to the upper layer */
+static void radio_sim_handle_ack(uint8_t seq, bool pending)
+{
+	uint8_t psdu[SIM_ACK_LEN];
+	struct net_pkt *pkt;
+
+	sys_put_le16(FRAME_TYPE_ACK | (pending ? FRAME_FCF_PENDING : 0), psdu);
+	psdu[2] = seq;
+
+	pkt = net_pkt_rx_alloc_with_buffer(NULL, sizeof(psdu), AF_UNSPEC, 0,
+					   K_NO_WAIT);
+	if (!pkt) {
+		return;
+	}
+
+	if (net_pkt_write(pkt, psdu, sizeof(psdu)) == 0) {
+		net_pkt_set_ieee802154_lqi(pkt, SIM_LQI);
+		net_pkt_set_ieee802154_rssi_dbm(pkt, SIM_RSSI_DBM);
+		net_pkt_cursor_init(pkt);
+		ieee802154_handle_ack(NULL, pkt);
+	}
+
+	net_pkt_unref(pkt);
+}
+
+static int radio_sim_tx(const struct device *dev, enum ieee802154_tx_mode mode,
+			struct net_pkt *pkt, struct net_buf *frag)
+{
+	struct radio_sim_data *data = &radio_sim_data;
+	uint8_t buf[1 + IEEE802154_MAX_PHY_PACKET_SIZE];
+	size_t len = frag->len;
+	struct frame_mhr h;
+	bool ack;
+
+	ARG_UNUSED(dev);
+	ARG_UNUSED(mode);
+	ARG_UNUSED(pkt);
+
+	if (len + IEEE802154_FCS_LENGTH > IEEE802154_MAX_PHY_PACKET_SIZE) {
+		return -EINVAL;
+	}
+
+	ack = frame_mhr_parse(frag->data, len, &h) && h.ack_request &&
+	      h.has_seq;
+	if (ack) {
+		/* Armed before sending, the ACK may be polled in right away */
+		k_sem_reset(&data->ack_sem);
+		data->ack_seq = h.seq;
+	}
+
+	buf[0] = radio_sim_data.channel;
+	memcpy(&buf[1], frag->data, len);
+	sys_put_le16(crc16_ccitt(0, frag->data, len), &buf[1 + len]);
+	len += IEEE802154_FCS_LENGTH;
+
+	/* The frame reaches the other nodes once it has been on air */
+	k_sleep(K_USEC((SIM_SHR_PHR_LEN + len) * SIM_US_PER_BYTE));
+
+	if (radio_sim_air_send(buf, 1 + len) < 0) {
+		data->ack_seq = -1;
+		return -EIO;
+	}
+
+	if (!ack) {
+		return 0;
+	}
+
+	if (k_sem_take(&data->ack_sem, K_USEC(SIM_ACK_WAIT_US)) < 0) {
+		data->ack_seq = -1;
+		return -ENOMSG;
+	}
+
+	radio_sim_handle_ack(h.seq, data->ack_pending);
+
+	return 0;
+}
+
+static int radio_sim_start(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	radio_sim_data.started = true;
+
+	return 0;
+}
+
+static int radio_sim_stop(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	radio_sim_data.started = false;
+
+	return 0;
+}
+
+/**
+ * Pending table update: add or remove an address, or without one,
+ * remove all short or all extended addresses
+ */
+static int radio_sim_ack_fpb(const struct ieee802154_config *config)
+{
+	struct radio_sim_data *data = &radio_sim_data;
+	const uint8_t *raw = config->ack_fpb.addr;
+	bool extended = config->ack_fpb.extended;
+	uint64_t addr = 0;
+	int i, j;
+
+	if (raw) {
+		addr = extended ? sys_get_le64(raw) : sys_get_le16(raw);
+	}
+
+	for (i = 0, j = 0; i < data->num_pending; i++) {
+		if (data->pending[i].extended == extended &&
+		    (!raw || data->pending[i].addr == addr)) {
+			continue;
+		}
+		data->pending[j++] = data->pending[i];
+	}
+	data->num_pending = j;
+
+	if (!config->ack_fpb.enabled || !raw) {
+		return 0;
+	}
+
+	if (data->num_pending == SIM_PENDING_MAX) {
+		return -ENOMEM;
+	}
+
+	data->pending[data->num_pending].addr = addr;
+	data->pending[data->num_pending].extended = extended;
+	data->num_pending++;
+
+	return 0;
+}
+
+static int radio_sim_configure(const struct device *dev,
+			       enum ieee802154_config_type type,
+			       const struct ieee802154_config *config)
+{
+	struct radio_sim_data *data = &radio_sim_data;
+
+	ARG_UNUSED(dev);
+
+	switch (type) {
+	case IEEE802154_CONFIG_PROMISCUOUS:
+		data->promiscuous = config->promiscuous;
+		break;
+	case IEEE802154_CONFIG_AUTO_ACK_FPB:
+		data->fpb_enabled = config->auto_ack_fpb.enabled;
+		break;
+	case IEEE802154_CONFIG_ACK_FPB:
+		return radio_sim_ack_fpb(config);
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int radio_sim_attr_get(const struct device *dev,
+			      enum ieee802154_attr attr,
+			      struct ieee802154_attr_value *value)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(attr);
+	ARG_UNUSED(value);
+
+	return -ENOENT;
+}
+
+static net_time_t radio_sim_get_time(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	return radio_sim_now();
+}
+
+static int radio_sim_init(const struct device *dev)
+{
+	int ret;
+
+	ARG_UNUSED(dev);
+
+	k_sem_init(&radio_sim_data.ack_sem, 0, 1);
+
+	ret = radio_sim_air_open(air_dir);
+	if (ret < 0) {
+		LOG_ERR("Cannot attach to medium %s: %d", air_dir, ret);
+		return ret;
+	}
+
+	LOG_INF("Attached to medium %s", air_dir);
+
+	k_thread_create(&radio_sim_thread_data, radio_sim_stack,
+			K_THREAD_STACK_SIZEOF(radio_sim_stack),
+			radio_sim_thread,
+			NULL, NULL, NULL, K_PRIO_PREEMPT(7), 0, K_NO_WAIT);
+
+	return 0;
+}
+
+static const struct ieee802154_radio_api radio_sim_api = {
+	.get_capabilities = radio_sim_get_capabilities,
+	.cca = radio_sim_cca,
+	.ed_scan = radio_sim_ed_scan,
+	.set_channel = radio_sim_set_channel,
+	.filter = radio_sim_filter,
+	.set_txpower = radio_sim_set_txpower,
+	.tx = radio_sim_tx,
+	.start = radio_sim_start,
+	.stop = radio_sim_stop,
+	.configure = radio_sim_configure,
+	.attr_get = radio_sim_attr_get,
+	.get_time = radio_sim_get_time,
+};
+
+/* Only raw mode is supported, the serial-radio has no network stack */
+DEVICE_DT_INST_DEFINE(0, radio_sim_init, NULL, &radio_sim_data, NULL,
+		      POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE,
+		      &radio_sim_api);
+
+static void radio_sim_add_options(void)
+{
+	static struct args_struct_t radio_sim_options[] = {
+		{
+			.option = "air",
+			.name = "dir",
+			.type = 's',
+			.dest = (void *)&air_dir,
+			.descript = "Directory of the simulated 802.15.4 medium, "
+				    "shared by all nodes on it (default "
+				    "/tmp/wpan-air)",
+		},
+		ARG_TABLE_ENDMARKER,
+	};
+
+	native_add_command_line_opts(radio_sim_options);
+}
+
+NATIVE_TASK(radio_sim_add_options, PRE_BOOT_1, 1);
@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Host side of the simulated 802.15.4 medium
+ *
+ * Unix datagram sockets need no network configuration, unlike multicast
+ * on the loopback interface, so the medium also works in CI containers.
+ * Sockets of processes that have died are removed by the next sender.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "radio_sim_bottom.h"
+
+static int air_fd = -1;
+static struct sockaddr_un air_addr;
+static char air_dir[sizeof(air_addr.sun_path) / 2];
+
+static void radio_sim_air_close(void)
+{
+	unlink(air_addr.sun_path);
+}
+
+int radio_sim_air_open(const char *dir)
+{
+	int fd;
+
+	if (strlen(dir) >= sizeof(air_dir)) {
+		return -ENAMETOOLONG;
+	}
+
+	strcpy(air_dir, dir);
+	mkdir(air_dir, 0777);
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	memset(&air_addr, 0, sizeof(air_addr));
+	air_addr.sun_family = AF_UNIX;
+	snprintf(air_addr.sun_path, sizeof(air_addr.sun_path), "%s/%d",
+		 air_dir, (int)getpid());
+	unlink(air_addr.sun_path);
+
+	if (bind(fd, (struct sockaddr *)&air_addr, sizeof(air_addr)) < 0) {
+		int err = errno;
+
+		close(fd);
+		return -err;
+	}
+
+	air_fd = fd;
+	atexit(radio_sim_air_close);
+
+	return 0;
+}
+
+int radio_sim_air_send(const uint8_t *data, int len)
+{
+	struct sockaddr_un peer = { .sun_family = AF_UNIX };
+	struct dirent *ent;
+	DIR *d;
+	int sent = 0;
+
+	d = opendir(air_dir);
+	if (!d) {
+		return -errno;
+	}
+
+	while ((ent = readdir(d))) {
+		if (ent->d_name[0] == '.') {
+			continue;
+		}
+
+		if (snprintf(peer.sun_path, sizeof(peer.sun_path), "%s/%s",
+			     air_dir, ent->d_name) >= (int)sizeof(peer.sun_path) ||
+		    !strcmp(peer.sun_path, air_addr.sun_path)) {
+			continue;
+		}
+
+		if (sendto(air_fd, data, len, 0, (struct sockaddr *)&peer,
+			   sizeof(peer)) == len) {
+			sent++;
+		} else if (errno == ECONNREFUSED) {
+			/* Nobody is bound to it anymore */
+			unlink(peer.sun_path);
+		}
+		/* A full peer queue loses the frame, as on air */
+	}
+
+	closedir(d);
+
+	return sent;
+}
+
+int radio_sim_air_recv(uint8_t *buf, int size)
+{
+	ssize_t len = recv(air_fd, buf, size, 0);
+
+	if (len < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -errno;
+	}
+
+	return len;
+}
@@ -0,0 +1,36 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Host side of the simulated 802.15.4 medium
+ *
+ * Compiled against the host C library, so only plain C types cross this
+ * interface. Every attached process binds a Unix datagram socket in the
+ * medium directory and sends each frame to all other sockets in it.
+ */
+
+#ifndef SERIAL_RADIO_SIM_BOTTOM_H_
+#define SERIAL_RADIO_SIM_BOTTOM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Attach to the medium in @p dir, returns 0 or a negative errno */
+int radio_sim_air_open(const char *dir);
+
+/** Send a datagram to all other attached processes */
+int radio_sim_air_send(const uint8_t *data, int len);
+
+/** Receive a datagram without blocking, returns 0 if none is waiting */
+int radio_sim_air_recv(uint8_t *buf, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_RADIO_SIM_BOTTOM_H_ */
@@ -0,0 +1,302 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "slip.h"
+
+/* Word-at-a-time scan for SLIP_END and SLIP_ESC */
+typedef unsigned long slip_word_t;
+
+#define ONES  ((slip_word_t)-1 / 0xff)
+#define HIGHS (ONES * 0x80)
+
+#define HAS_ZERO_BYTE(w) (((w) - ONES) & ~(w) & HIGHS)
+#define HAS_BYTE(w, b)   HAS_ZERO_BYTE((w) ^ (ONES * (b)))
+
+/* Length of the leading run of bytes that are neither SLIP_END nor SLIP_ESC */
+static size_t slip_scan(const uint8_t *p, const uint8_t *end)
+{
+	const uint8_t *start = p;
+	slip_word_t w;
+
+	while (end - p >= (ptrdiff_t)sizeof(w)) {
+		memcpy(&w, p, sizeof(w));
+		if (HAS_BYTE(w, SLIP_END) | HAS_BYTE(w, SLIP_ESC)) {
+			break;
+		}
+
+		p += sizeof(w);
+	}
+
+	while (p < end && *p != SLIP_END && *p != SLIP_ESC) {
+		p++;
+	}
+
+	return p - start;
+}
+
+static void slip_drop_frame(struct slip_decoder *dec)
+{
+	if (dec->buf) {
+		dec->cb->discard(dec->user_data);
+		dec->dropped += dec->len;
+		dec->buf = NULL;
+	}
+
+	dec->state = STATE_GARBAGE;
+}
+
+static int slip_alloc(struct slip_decoder *dec)
+{
+	dec->buf = dec->cb->alloc(dec->user_data, &dec->size);
+	dec->len = 0;
+	if (!dec->buf) {
+		dec->state = STATE_GARBAGE;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Copy and unescape frame content into the frame storage, up to the
+ * next SLIP_END or the end of input. Returns the first unprocessed byte.
+ */
+static const uint8_t *slip_copy(struct slip_decoder *dec, const uint8_t *p,
+				const uint8_t *end)
+{
+	uint8_t *out = dec->buf + dec->len;
+	uint8_t *out_end = dec->buf + dec->size;
+	size_t run;
+	uint8_t c;
+
+	while (p < end) {
+		c = *p;
+
+		if (c != SLIP_END && c != SLIP_ESC) {
+			run = slip_scan(p, end);
+			if (run > (size_t)(out_end - out)) {
+				goto overflow;
+			}
+
+			memcpy(out, p, run);
+			out += run;
+			p += run;
+			continue;
+		}
+
+		if (c == SLIP_END) {
+			break;
+		}
+
+		if (p + 1 == end) {
+			/* Escape sequence continues in the next chunk */
+			dec->state = STATE_ESC;
+			p++;
+			break;
+		}
+
+		c = p[1];
+		if (c == SLIP_ESC_END) {
+			c = SLIP_END;
+		} else if (c == SLIP_ESC_ESC) {
+			c = SLIP_ESC;
+		} else {
+			dec->len = out - dec->buf;
+			slip_drop_frame(dec);
+			dec->dropped += 2;
+			return p + 2;
+		}
+
+		if (out == out_end) {
+			goto overflow;
+		}
+
+		*out++ = c;
+		p += 2;
+	}
+
+	dec->len = out - dec->buf;
+
+	return p;
+
+overflow:
+	dec->len = out - dec->buf;
+	slip_drop_frame(dec);
+
+	return p;
+}
+
+void slip_decoder_init(struct slip_decoder *dec,
+		       const struct slip_decoder_cb *cb, void *user_data)
+{
+	memset(dec, 0, sizeof(*dec));
+
+	dec->cb = cb;
+	dec->user_data = user_data;
+	dec->state = STATE_OK;
+}
+
+void slip_decoder_reset(struct slip_decoder *dec)
+{
+	slip_drop_frame(dec);
+}
+
+size_t slip_decode(struct slip_decoder *dec, const uint8_t *data, size_t len)
+{
+	const uint8_t *p = data;
+	const uint8_t *end = data + len;
+	const uint8_t *q;
+	size_t frames = 0;
+	uint8_t c;
+
+	while (p < end) {
+		switch (dec->state) {
+		case STATE_GARBAGE:
+			q = memchr(p, SLIP_END, end - p);
+			if (!q) {
+				dec->dropped += end - p;
+				return frames;
+			}
+
+			dec->dropped += q - p;
+			dec->state = STATE_OK;
+			p = q + 1;
+			break;
+
+		case STATE_ESC:
+			c = *p++;
+			if (c == SLIP_ESC_END) {
+				c = SLIP_END;
+			} else if (c == SLIP_ESC_ESC) {
+				c = SLIP_ESC;
+			} else {
+				slip_drop_frame(dec);
+				dec->dropped += 2;
+				break;
+			}
+
+			dec->state = STATE_OK;
+			if (dec->len == dec->size) {
+				slip_drop_frame(dec);
+				break;
+			}
+
+			dec->buf[dec->len++] = c;
+			break;
+
+		case STATE_OK:
+			if (*p == SLIP_END) {
+				p++;
+
+				/* A lone SLIP_END only separates frames */
+				if (dec->buf) {
+					dec->cb->frame(dec->user_data, dec->len);
+					dec->buf = NULL;
+					frames++;
+				}
+				break;
+			}
+
+			if (!dec->buf && slip_alloc(dec) < 0) {
+				break;
+			}
+
+			p = slip_copy(dec, p, end);
+			break;
+		}
+	}
+
+	return frames;
+}
+
+void slip_encoder_start(struct slip_encoder *enc, const uint8_t *data,
+			size_t len)
+{
+	slip_encoder_begin(enc);
+	slip_encoder_next(enc, data, len, 1);
+}
+
+void slip_encoder_begin(struct slip_encoder *enc)
+{
+	enc->data = NULL;
+	enc->len = 0;
+	enc->pending = 0;
+	enc->end = 0;
+}
+
+void slip_encoder_next(struct slip_encoder *enc, const uint8_t *data,
+		       size_t len, int last)
+{
+	/* A pending escape of the previous segment is kept */
+	enc->data = data;
+	enc->len = len;
+	enc->end = last;
+}
+
+size_t slip_encode(struct slip_encoder *enc, uint8_t *dst, size_t size)
+{
+	const uint8_t *src = enc->data;
+	const uint8_t *src_end = enc->data + enc->len;
+	uint8_t *out = dst;
+	uint8_t *out_end = dst + size;
+	slip_word_t w;
+	uint8_t c;
+
+	if (enc->pending && out < out_end) {
+		*out++ = enc->pending;
+		enc->pending = 0;
+	}
+
+	while (src < src_end && out < out_end) {
+		c = *src;
+
+		if (c != SLIP_END && c != SLIP_ESC) {
+			/**
+			 * Copy a word at a time while it needs no escaping,
+			 * slip_scan() and memcpy() cost more than they save
+			 * on the short runs of a frame or a ring window
+			 */
+			if (src_end - src >= (ptrdiff_t)sizeof(w) &&
+			    out_end - out >= (ptrdiff_t)sizeof(w)) {
+				memcpy(&w, src, sizeof(w));
+				if (!(HAS_BYTE(w, SLIP_END) | HAS_BYTE(w, SLIP_ESC))) {
+					memcpy(out, &w, sizeof(w));
+					out += sizeof(w);
+					src += sizeof(w);
+					continue;
+				}
+			}
+
+			*out++ = c;
+			src++;
+			continue;
+		}
+
+		src++;
+		*out++ = SLIP_ESC;
+		c = (c == SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+		if (out == out_end) {
+			enc->pending = c;
+			break;
+		}
+
+		*out++ = c;
+	}
+
+	enc->len = src_end - src;
+	enc->data = src;
+
+	/**
+	 * This strange protocol does not require send START, only the
+	 * frame is terminated
+	 */
+	if (!enc->len && !enc->pending && enc->end && out < out_end) {
+		*out++ = SLIP_END;
+		enc->end = 0;
+	}
+
+	return out - dst;
+}
@@ -0,0 +1,134 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Chunk based SLIP decoder for the serial-radio protocol
+ *
+ * The decoder does not depend on Zephyr so that it can be compiled and
+ * benchmarked on a Linux host. Frame storage is provided by the caller
+ * through callbacks, which lets the firmware decode straight into
+ * net_buf tailroom.
+ */
+
+#ifndef SERIAL_RADIO_SLIP_H_
+#define SERIAL_RADIO_SLIP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+enum slip_state {
+	STATE_GARBAGE,
+	STATE_OK,
+	STATE_ESC,
+};
+
+struct slip_decoder_cb {
+	/**
+	 * Provide storage for a new frame. Return NULL if none is
+	 * available, the frame is then discarded up to the next SLIP_END.
+	 */
+	uint8_t *(*alloc)(void *user_data, size_t *size);
+	/** Frame of @p len bytes has been decoded into the storage */
+	void (*frame)(void *user_data, size_t len);
+	/** Storage handed out by alloc() is no longer used */
+	void (*discard)(void *user_data);
+};
+
+struct slip_decoder {
+	const struct slip_decoder_cb *cb;
+	void *user_data;
+
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+
+	uint8_t state;
+
+	/** Bytes discarded because of framing errors or missing storage */
+	uint32_t dropped;
+};
+
+/**
+ * @brief Streaming SLIP encoder
+ *
+ * Encodes a frame into as many output windows as needed, so that it can
+ * be written straight into a transmit ring without a worst-case staging
+ * buffer. An escape sequence may be split across two windows.
+ */
+struct slip_encoder {
+	const uint8_t *data;
+	size_t len;
+
+	/* Second byte of an escape sequence that did not fit */
+	uint8_t pending;
+	/* Terminating SLIP_END still has to be written */
+	uint8_t end;
+};
+
+void slip_decoder_init(struct slip_decoder *dec,
+		       const struct slip_decoder_cb *cb, void *user_data);
+
+/**
+ * @brief Drop any partial frame and wait for the next SLIP_END
+ *
+ * Used after input bytes have been lost, e.g. on a UART overrun.
+ */
+void slip_decoder_reset(struct slip_decoder *dec);
+
+/**
+ * @brief Decode a span of received bytes
+ *
+ * Runs of bytes that need no unescaping are copied with a single
+ * memcpy() into the frame storage.
+ *
+ * @return Number of frames completed within @p data
+ */
+size_t slip_decode(struct slip_decoder *dec, const uint8_t *data, size_t len);
+
+void slip_encoder_start(struct slip_encoder *enc, const uint8_t *data,
+			size_t len);
+
+/**
+ * @brief Begin a frame that is made of several segments
+ *
+ * Each segment, e.g. a header and the payload behind it, is passed with
+ * slip_encoder_next() once the previous one is done.
+ */
+void slip_encoder_begin(struct slip_encoder *enc);
+
+/**
+ * @brief Continue the frame with the next segment
+ *
+ * The frame is terminated after the segment with @p last set.
+ */
+void slip_encoder_next(struct slip_encoder *enc, const uint8_t *data,
+		       size_t len, int last);
+
+/**
+ * @brief Encode the next part of the frame into @p dst
+ *
+ * @return Number of bytes written, at most @p size
+ */
+size_t slip_encode(struct slip_encoder *enc, uint8_t *dst, size_t size);
+
+static inline int slip_encoder_done(const struct slip_encoder *enc)
+{
+	return !enc->len && !enc->pending && !enc->end;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIAL_RADIO_SLIP_H_ */
@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief USB CDC ACM transport of the serial-radio
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(serial_radio, LOG_LEVEL_INF);
+
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/usb/usb_device.h>
+
+#include "serial_radio.h"
+
+static const struct device *const uart_dev =
+	DEVICE_DT_GET_ONE(zephyr_cdc_acm_uart);
+
+static void cdc_acm_tx_kick(void)
+{
+	uart_irq_tx_enable(uart_dev);
+}
+
+static int cdc_acm_init(void)
+{
+	uint32_t baudrate, dtr = 0U;
+	int ret;
+
+	LOG_INF("Checking readiness of CDC ACM UART device %s...",
+		uart_dev->name);
+	if (!device_is_ready(uart_dev)) {
+		LOG_ERR("CDC ACM device not ready");
+		return -ENODEV;
+	}
+
+	LOG_INF("Trying to enable USB...");
+	ret = usb_enable(NULL);
+	if (ret != 0) {
+		LOG_ERR("Failed to enable USB");
+		return ret;
+	}
+
+	LOG_INF("Waiting for DTR..");
+
+	while (1) {
+		uart_line_ctrl_get(uart_dev, UART_LINE_CTRL_DTR, &dtr);
+		if (dtr) {
+			break;
+		} else {
+			/* Give CPU resources to low priority threads. */
+			k_sleep(K_MSEC(100));
+		}
+	}
+
+	LOG_INF("DTR set, continue");
+
+	ret = uart_line_ctrl_get(uart_dev, UART_LINE_CTRL_BAUD_RATE, &baudrate);
+	if (ret) {
+		LOG_WRN("Failed to get baudrate, ret code %d", ret);
+	} else {
+		LOG_INF("Baudrate detected: %d", baudrate);
+	}
+
+	uart_irq_callback_set(uart_dev, serial_radio_irq_handler);
+
+	/* Enable rx interrupts */
+	uart_irq_rx_enable(uart_dev);
+
+	return 0;
+}
+
+/* The line rate of USB does not depend on the host's setting */
+const struct serial_radio_transport serial_radio_cdc_acm = {
+	.name = "CDC ACM",
+	.init = cdc_acm_init,
+	.tx_kick = cdc_acm_tx_kick,
+};
@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Host pseudo terminal transport of the serial-radio
+ *
+ * On native_sim, uart0 is connected to a pseudo terminal of the Linux
+ * host (see the --uart_* options of native_sim). The driver only
+ * supports polling, so a thread of its own moves the bytes and sleeps
+ * while the line is idle.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(serial_radio, LOG_LEVEL_INF);
+
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+
+#include "serial_radio.h"
+
+#if defined(CONFIG_NET_TC_THREAD_COOPERATIVE)
+#define THREAD_PRIORITY K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1)
+#else
+#define THREAD_PRIORITY K_PRIO_PREEMPT(8)
+#endif
+
+/* Poll interval while nothing is received or queued */
+#define PTY_IDLE_US 200
+
+static const struct device *const uart_dev =
+	DEVICE_DT_GET(DT_NODELABEL(uart0));
+
+static K_THREAD_STACK_DEFINE(pty_stack, 1024);
+static struct k_thread pty_thread_data;
+static K_SEM_DEFINE(pty_tx_sem, 0, 1);
+
+static void pty_tx_kick(void)
+{
+	k_sem_give(&pty_tx_sem);
+}
+
+static size_t pty_read(void)
+{
+	uint8_t chunk[64];
+	size_t len = 0;
+
+	while (len < sizeof(chunk) && uart_poll_in(uart_dev, &chunk[len]) == 0) {
+		len++;
+	}
+
+	if (len) {
+		atomic_add(&serial_radio_stats.rx_bytes, len);
+		serial_radio_rx(chunk, len);
+	}
+
+	return len;
+}
+
+static size_t pty_write(void)
+{
+	uint8_t *data;
+	uint32_t len;
+	uint32_t i;
+
+	len = serial_radio_tx_claim(&data);
+	for (i = 0; i < len; i++) {
+		uart_poll_out(uart_dev, data[i]);
+	}
+
+	serial_radio_tx_consumed(len);
+
+	return len;
+}
+
+static void pty_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	LOG_INF("PTY thread started");
+
+	while (true) {
+		size_t moved = pty_read() + pty_write();
+
+		if (!moved) {
+			/* Woken early when tx_thread has queued bytes */
+			k_sem_take(&pty_tx_sem, K_USEC(PTY_IDLE_US));
+		}
+	}
+}
+
+static int pty_init(void)
+{
+	if (!device_is_ready(uart_dev)) {
+		LOG_ERR("PTY UART device not ready");
+		return -ENODEV;
+	}
+
+	k_thread_create(&pty_thread_data, pty_stack,
+			K_THREAD_STACK_SIZEOF(pty_stack),
+			pty_thread,
+			NULL, NULL, NULL, THREAD_PRIORITY, 0, K_NO_WAIT);
+
+	return 0;
+}
+
+/* A pseudo terminal has no line rate */
+const struct serial_radio_transport serial_radio_pty = {
+	.name = "PTY",
+	.init = pty_init,
+	.tx_kick = pty_tx_kick,
+};
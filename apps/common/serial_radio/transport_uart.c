@@ -0,0 +1,341 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief UART transport of the serial-radio
+ *
+ * Uses uart0, either through the interrupt-driven API or through the
+ * async (EasyDMA) API with CONFIG_WPAN_SERIAL_UART_ASYNC.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(serial_radio, LOG_LEVEL_INF);
+
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+
+#include "serial_radio.h"
+
+#if defined(CONFIG_NET_TC_THREAD_COOPERATIVE)
+#define THREAD_PRIORITY K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1)
+#else
+#define THREAD_PRIORITY K_PRIO_PREEMPT(8)
+#endif
+
+#define UART_NODE DT_NODELABEL(uart0)
+
+static const struct device *const uart_dev = DEVICE_DT_GET(UART_NODE);
+
+/* Rates accepted by "?U", all supported by the nRF UARTE */
+static const uint32_t uart_bauds[] = {
+	115200, 230400, 460800, 921600, 1000000,
+};
+
+#if DT_NODE_HAS_COMPAT(UART_NODE, nordic_nrf_uarte)
+static void print_uart_pins(void)
+{
+	/* Read the pins from the nRF UARTE peripheral registers directly */
+	NRF_UARTE_Type *uarte = (NRF_UARTE_Type *)DT_REG_ADDR(UART_NODE);
+	uint32_t txd_pin = uarte->PSEL.TXD;
+	uint32_t rxd_pin = uarte->PSEL.RXD;
+
+	LOG_INF("=== UART0 PIN CONFIGURATION ===");
+	LOG_INF("TXD: P%d.%d (register: 0x%08x)",
+		(txd_pin >> 5) & 0x1, txd_pin & 0x1F, txd_pin);
+	LOG_INF("RXD: P%d.%d (register: 0x%08x)",
+		(rxd_pin >> 5) & 0x1, rxd_pin & 0x1F, rxd_pin);
+#if DT_PROP(UART_NODE, hw_flow_control)
+	LOG_INF("RTS: P%d.%d, CTS: P%d.%d",
+		(uarte->PSEL.RTS >> 5) & 0x1, uarte->PSEL.RTS & 0x1F,
+		(uarte->PSEL.CTS >> 5) & 0x1, uarte->PSEL.CTS & 0x1F);
+#endif
+	LOG_INF("===============================");
+}
+#else
+static void print_uart_pins(void)
+{
+}
+#endif
+
+static int uart_set_baud(uint32_t baud)
+{
+	struct uart_config cfg;
+	int ret;
+
+	ret = uart_config_get(uart_dev, &cfg);
+	if (ret < 0) {
+		return ret;
+	}
+
+	cfg.baudrate = baud;
+
+	return uart_configure(uart_dev, &cfg);
+}
+
+#if defined(CONFIG_WPAN_SERIAL_UART_ASYNC)
+#define RX_BUF_COUNT CONFIG_WPAN_SERIAL_UART_RX_BUF_COUNT
+#define RX_BUF_SIZE  CONFIG_WPAN_SERIAL_UART_RX_BUF_SIZE
+
+/* Slice of a DMA buffer that is ready for SLIP decoding */
+struct rx_chunk {
+	uint8_t *data;
+	uint16_t len;
+	uint8_t idx;
+	/* Bytes were lost before this chunk, resynchronize on SLIP_END */
+	bool resync;
+};
+
+/**
+ * DMA buffers are reference counted: the driver holds one reference
+ * from UART_RX_BUF_REQUEST until UART_RX_BUF_RELEASED, and every chunk
+ * queued to the decoder thread holds another one. A buffer is only
+ * handed back to the driver once its count has dropped to zero.
+ */
+static uint8_t rx_bufs[RX_BUF_COUNT][RX_BUF_SIZE];
+static atomic_t rx_buf_refs[RX_BUF_COUNT];
+static uint8_t rx_buf_next;
+static bool rx_lost;
+static atomic_t rx_stalled;
+
+K_MSGQ_DEFINE(rx_chunk_msgq, sizeof(struct rx_chunk),
+	      CONFIG_WPAN_SERIAL_UART_RX_CHUNK_COUNT, 4);
+
+static K_THREAD_STACK_DEFINE(slip_stack, 1024);
+static struct k_thread slip_thread_data;
+
+static atomic_t tx_busy;
+
+/* Start a DMA transfer of the next contiguous part of the TX ring */
+static void tx_kick(void)
+{
+	uint8_t *data;
+	uint32_t len;
+
+	if (!atomic_cas(&tx_busy, 0, 1)) {
+		/* Picked up by the UART_TX_DONE of the running transfer */
+		return;
+	}
+
+	len = serial_radio_tx_claim(&data);
+	if (!len || uart_tx(uart_dev, data, len, SYS_FOREVER_US) < 0) {
+		serial_radio_tx_consumed(0);
+		atomic_clear(&tx_busy);
+	}
+}
+
+static int rx_buf_claim(uint8_t **buf)
+{
+	uint8_t idx = rx_buf_next;
+
+	if (!atomic_cas(&rx_buf_refs[idx], 0, 1)) {
+		/* Decoder has not finished with this buffer yet */
+		return -EBUSY;
+	}
+
+	rx_buf_next = (idx + 1) % RX_BUF_COUNT;
+	*buf = rx_bufs[idx];
+
+	return 0;
+}
+
+static void rx_buf_unref(const uint8_t *buf)
+{
+	atomic_dec(&rx_buf_refs[(buf - rx_bufs[0]) / RX_BUF_SIZE]);
+}
+
+static int rx_restart(void)
+{
+	uint8_t *buf;
+	int ret;
+
+	ret = rx_buf_claim(&buf);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = uart_rx_enable(uart_dev, buf, RX_BUF_SIZE,
+			     CONFIG_WPAN_SERIAL_UART_RX_TIMEOUT_US);
+	if (ret < 0) {
+		rx_buf_unref(buf);
+		return ret;
+	}
+
+	atomic_clear(&rx_stalled);
+
+	return 0;
+}
+
+static void rx_chunk_ready(struct uart_event_rx *rx)
+{
+	struct rx_chunk chunk = {
+		.data = rx->buf + rx->offset,
+		.len = rx->len,
+		.idx = (rx->buf - rx_bufs[0]) / RX_BUF_SIZE,
+		.resync = rx_lost,
+	};
+
+	atomic_add(&serial_radio_stats.rx_bytes, rx->len);
+	atomic_inc(&rx_buf_refs[chunk.idx]);
+
+	if (k_msgq_put(&rx_chunk_msgq, &chunk, K_NO_WAIT) < 0) {
+		atomic_dec(&rx_buf_refs[chunk.idx]);
+		atomic_add(&serial_radio_stats.rx_dropped_bytes, rx->len);
+		rx_lost = true;
+		return;
+	}
+
+	rx_lost = false;
+}
+
+static void uart_callback(const struct device *dev, struct uart_event *evt,
+			  void *user_data)
+{
+	uint8_t *buf;
+
+	ARG_UNUSED(user_data);
+
+	switch (evt->type) {
+	case UART_RX_RDY:
+		rx_chunk_ready(&evt->data.rx);
+		break;
+
+	case UART_RX_BUF_REQUEST:
+		if (rx_buf_claim(&buf) < 0) {
+			/**
+			 * Let the driver run into the end of the current
+			 * buffer; the decoder thread restarts reception
+			 * once it has released a buffer. Nothing is lost
+			 * until then, see UART_RX_DISABLED.
+			 */
+			atomic_inc(&serial_radio_stats.rx_overruns);
+			break;
+		}
+
+		uart_rx_buf_rsp(dev, buf, RX_BUF_SIZE);
+		break;
+
+	case UART_RX_BUF_RELEASED:
+		rx_buf_unref(evt->data.rx_buf.buf);
+		break;
+
+	case UART_RX_STOPPED:
+		LOG_ERR("RX stopped, reason %d", evt->data.rx_stop.reason);
+		atomic_inc(&serial_radio_stats.rx_overruns);
+		rx_lost = true;
+		break;
+
+	case UART_RX_DISABLED:
+		/* Bytes arriving until reception restarts are lost */
+		rx_lost = true;
+		if (rx_restart() < 0) {
+			atomic_set(&rx_stalled, 1);
+		}
+		break;
+
+	case UART_TX_DONE:
+	case UART_TX_ABORTED:
+		serial_radio_tx_consumed(evt->data.tx.len);
+		atomic_clear(&tx_busy);
+		tx_kick();
+		break;
+
+	default:
+		break;
+	}
+}
+
+/**
+ * Decode DMA chunks outside of interrupt context
+ */
+static void slip_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	LOG_INF("SLIP decoder thread started");
+
+	while (true) {
+		struct rx_chunk chunk;
+
+		k_msgq_get(&rx_chunk_msgq, &chunk, K_FOREVER);
+
+		if (chunk.resync) {
+			serial_radio_rx_reset();
+		}
+
+		serial_radio_rx(chunk.data, chunk.len);
+
+		atomic_dec(&rx_buf_refs[chunk.idx]);
+
+		if (atomic_get(&rx_stalled) && rx_restart() == 0) {
+			LOG_INF("RX restarted");
+		}
+	}
+}
+
+static int uart_start(void)
+{
+	int ret;
+
+	k_thread_create(&slip_thread_data, slip_stack,
+			K_THREAD_STACK_SIZEOF(slip_stack),
+			slip_thread,
+			NULL, NULL, NULL, THREAD_PRIORITY, 0, K_NO_WAIT);
+
+	ret = uart_callback_set(uart_dev, uart_callback, NULL);
+	if (ret < 0) {
+		LOG_ERR("Failed to set UART callback: %d", ret);
+		return ret;
+	}
+
+	/* Start DMA reception */
+	return rx_restart();
+}
+
+#else /* CONFIG_WPAN_SERIAL_UART_ASYNC */
+
+static void tx_kick(void)
+{
+	uart_irq_tx_enable(uart_dev);
+}
+
+static int uart_start(void)
+{
+	uart_irq_callback_set(uart_dev, serial_radio_irq_handler);
+
+	/* Enable rx interrupts */
+	uart_irq_rx_enable(uart_dev);
+
+	return 0;
+}
+
+#endif /* CONFIG_WPAN_SERIAL_UART_ASYNC */
+
+static int uart_init(void)
+{
+	LOG_INF("Checking readiness of UART device %s...",
+		uart_dev->name);
+	if (!device_is_ready(uart_dev)) {
+		LOG_ERR("UART device not ready");
+		return -ENODEV;
+	}
+
+	print_uart_pins();
+
+	return uart_start();
+}
+
+const struct serial_radio_transport serial_radio_uart = {
+	.name = "UART0",
+	.init = uart_init,
+	.tx_kick = tx_kick,
+	.set_baud = uart_set_baud,
+	.bauds = uart_bauds,
+	.num_bauds = ARRAY_SIZE(uart_bauds),
+	.baud = DT_PROP(UART_NODE, current_speed),
+	/* RTS/CTS is enabled by hwfc.overlay */
+	.hw_flow_control = DT_PROP(UART_NODE, hw_flow_control),
+};
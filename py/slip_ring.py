@@ -0,0 +1,217 @@
+"""
+slip_ring.py - Incremental SLIP receive buffer for the Python host tools
+
+Decodes SLIP as it is read, without growing and re-slicing a buffer per
+frame. The native implementation is the firmware's chunk based decoder
+(apps/common/serial_radio/slip.c), which the native bridge uses as well,
+built as a shared library with
+
+    make -C apps/common/serial_radio/bridge libslipring.so
+
+It reads straight into a preallocated buffer, decodes into one arena and
+hands out frames as memoryviews of that arena, without a copy per frame.
+A frame is only valid until the next read, so it must be copied, e.g.
+with bytes(), to be kept.
+
+Without the library, a pure Python decoder with the same interface is
+used, which finds frames with bytes.find() and returns each as bytes.
+Both take linear time however bursty the input is.
+"""
+
+import ctypes
+import os
+
+SLIP_END = 0o300
+SLIP_ESC = 0o333
+SLIP_ESC_END = 0o334
+SLIP_ESC_ESC = 0o335
+
+# Bytes read at once, and the largest frame, a "!Y" container
+CHUNK = 65536
+FRAME_MAX = 2048
+
+LIB_NAME = "libslipring.so"
+LIB_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..",
+                       "apps", "common", "serial_radio", "bridge")
+
+
+def _load_lib():
+    """The native decoder, from $SLIP_RING_LIB or the bridge's build"""
+    path = os.environ.get("SLIP_RING_LIB", os.path.join(LIB_DIR, LIB_NAME))
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    lib.slip_ring_new.restype = ctypes.c_void_p
+    lib.slip_ring_new.argtypes = [ctypes.c_size_t, ctypes.c_size_t]
+    lib.slip_ring_free.argtypes = [ctypes.c_void_p]
+    lib.slip_ring_read.restype = ctypes.c_ssize_t
+    lib.slip_ring_read.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.slip_ring_feed.restype = ctypes.c_size_t
+    lib.slip_ring_feed.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                   ctypes.c_size_t]
+    lib.slip_ring_dropped.restype = ctypes.c_uint32
+    lib.slip_ring_dropped.argtypes = [ctypes.c_void_p]
+    lib.slip_ring_arena.restype = ctypes.c_void_p
+    lib.slip_ring_arena.argtypes = [ctypes.c_void_p,
+                                    ctypes.POINTER(ctypes.c_size_t)]
+    lib.slip_ring_frames.restype = ctypes.c_void_p
+    lib.slip_ring_frames.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+_lib = _load_lib()
+
+
+class NativeSlipRing:
+    """SLIP receive buffer around the firmware's decoder, see slip_ring.h"""
+
+    native = True
+
+    def __init__(self, chunk=CHUNK, frame_max=FRAME_MAX):
+        if _lib is None:
+            raise OSError(f"{LIB_NAME} is not built")
+
+        self.chunk = chunk
+        self._ring = _lib.slip_ring_new(chunk, frame_max)
+        if not self._ring:
+            raise MemoryError("slip_ring_new")
+
+        size = ctypes.c_size_t()
+        arena = _lib.slip_ring_arena(self._ring, ctypes.byref(size))
+        self._arena = memoryview(
+            (ctypes.c_uint8 * size.value).from_address(arena)).cast("B")
+
+        # Offset and length of each frame, see struct slip_ring_frame
+        frames = _lib.slip_ring_frames(self._ring)
+        self._frames = memoryview(
+            (ctypes.c_uint32 * (2 * (chunk // 2 + 1))).from_address(frames)
+        ).cast("B").cast("I")
+
+    def __del__(self):
+        if getattr(self, "_ring", None):
+            _lib.slip_ring_free(self._ring)
+            self._ring = None
+
+    @property
+    def dropped(self):
+        """Bytes dropped for framing errors or frames that were too long"""
+        return _lib.slip_ring_dropped(self._ring)
+
+    def _views(self, count):
+        arena, frames = self._arena, self._frames
+        return [arena[frames[2 * i]:frames[2 * i] + frames[2 * i + 1]]
+                for i in range(count)]
+
+    def read(self, fd):
+        """Read once from fd, return the frames completed as memoryviews"""
+        n = _lib.slip_ring_read(self._ring, fd)
+        if n < 0:
+            raise OSError(-n, os.strerror(-n))
+        return self._views(n)
+
+    def feed(self, data):
+        """
+        Decode bytes that were read elsewhere, yield the frames completed
+        as memoryviews, each valid until the next one is taken
+        """
+        if isinstance(data, bytes):
+            base = ctypes.cast(ctypes.c_char_p(data), ctypes.c_void_p).value
+        else:
+            data = memoryview(data).cast("B")
+            if data.readonly:
+                data = bytearray(data)
+            base = ctypes.addressof(
+                (ctypes.c_char * len(data)).from_buffer(data))
+
+        for off in range(0, len(data), self.chunk):
+            n = _lib.slip_ring_feed(self._ring, base + off,
+                                    min(self.chunk, len(data) - off))
+            yield from self._views(n)
+
+
+class PySlipRing:
+    """Pure Python fallback of NativeSlipRing, frames are bytes"""
+
+    native = False
+
+    def __init__(self, chunk=CHUNK, frame_max=FRAME_MAX):
+        self.chunk = chunk
+        self.frame_max = frame_max
+        self.dropped = 0
+        self._buf = bytearray()
+        # Up to the next SLIP_END after a frame that was too long
+        self._garbage = False
+
+    def _decode(self, frame):
+        """Unescape a frame, None if it holds an invalid escape"""
+        if SLIP_ESC not in frame:
+            return bytes(frame)
+        if frame.count(SLIP_ESC) != (
+                frame.count(bytes([SLIP_ESC, SLIP_ESC_END])) +
+                frame.count(bytes([SLIP_ESC, SLIP_ESC_ESC]))):
+            return None
+        frame = frame.replace(bytes([SLIP_ESC, SLIP_ESC_END]),
+                              bytes([SLIP_END]))
+        return bytes(frame.replace(bytes([SLIP_ESC, SLIP_ESC_ESC]),
+                                   bytes([SLIP_ESC])))
+
+    def _frames(self, data):
+        buf = self._buf
+        buf += data
+        frames = []
+        start = 0
+
+        while True:
+            end = buf.find(SLIP_END, start)
+            if end < 0:
+                break
+
+            raw = buf[start:end]
+            start = end + 1
+            if self._garbage:
+                self._garbage = False
+                self.dropped += len(raw)
+                continue
+            if not raw:
+                continue
+
+            frame = self._decode(raw) if len(raw) <= 2 * self.frame_max \
+                else None
+            if frame is None or len(frame) > self.frame_max:
+                self.dropped += len(raw)
+                continue
+            frames.append(frame)
+
+        # Deleting from the front of a bytearray does not move the rest
+        del buf[:start]
+        if len(buf) > 2 * self.frame_max:
+            self.dropped += len(buf)
+            del buf[:]
+            self._garbage = True
+
+        return frames
+
+    def read(self, fd):
+        """Read once from fd, return the frames completed"""
+        try:
+            data = os.read(fd, self.chunk)
+        except (BlockingIOError, InterruptedError):
+            return []
+        if not data:
+            raise OSError(32, os.strerror(32))
+        return self._frames(data)
+
+    def feed(self, data):
+        """Decode bytes that were read elsewhere, yield the frames completed"""
+        data = memoryview(data).cast("B")
+        for off in range(0, len(data), self.chunk):
+            yield from self._frames(data[off:off + self.chunk])
+
+
+def slip_ring(chunk=CHUNK, frame_max=FRAME_MAX, native=None):
+    """The native receive buffer if it is built, else the Python one"""
+    if native or (native is None and _lib is not None):
+        return NativeSlipRing(chunk, frame_max)
+    return PySlipRing(chunk, frame_max)
@@ -3,32 +3,55 @@
 Complete bridge between wpan_serial (802.15.4) and Linux TUN interface.
 Handles full 6LoWPAN compression/decompression.
 
-TODO: This is deprecated and not fully implemented! Use the modified contiki
-      native border router (for example, this working commit: https://github.com/lassezuengel/contiki/tree/e17887cb35d942d8e4a30ffbbf116db618d3e1fd)
-      instead!
+TODO: This is deprecated and not fully implemented! Use the native bridge in
+      apps/common/serial_radio/bridge, or the modified contiki native border
+      router (for example, this working commit: https://github.com/lassezuengel/contiki/tree/e17887cb35d942d8e4a30ffbbf116db618d3e1fd)
+      instead! The options match the native bridge's, so both can be run
+      under its load test.
 """
 
+import argparse
+
 import serial
 import struct
 import fcntl
 import os
 import sys
 import select
-import ipaddress
-from scapy.all import *
-from scapy.layers.dot15d4 import *
-from scapy.layers.sixlowpan import *
-
-# Monkey-patch a bug in Scapy's dot15d4 layer. The util_srcpanid_present
-# function incorrectly checks pkt.underlayer for fields that are present in pkt
-# itself, causing an AttributeError.
-import scapy.layers.dot15d4 as dot15d4_module
-def _fixed_util_srcpanid_present(pkt):
-    if (pkt.getfieldval("fcf_srcaddrmode") != 0) and \
-       (pkt.getfieldval("fcf_panidcompress") == 0):
-        return True
-    return False
-dot15d4_module.util_srcpanid_present = _fixed_util_srcpanid_present
+import socket
+import time
+from collections import deque
+
+from slip_ring import slip_ring
+
+# Scapy is only needed to decompress 6LoWPAN IPHC, frames with an
+# uncompressed IPv6 header are handled without it
+try:
+    from scapy.all import IPv6
+    from scapy.layers.dot15d4 import Dot15d4
+    from scapy.layers.sixlowpan import LoWPAN_IPHC
+
+    # Monkey-patch a bug in Scapy's dot15d4 layer. The util_srcpanid_present
+    # function incorrectly checks pkt.underlayer for fields that are present in pkt
+    # itself, causing an AttributeError.
+    import scapy.layers.dot15d4 as dot15d4_module
+    def _fixed_util_srcpanid_present(pkt):
+        if (pkt.getfieldval("fcf_srcaddrmode") != 0) and \
+           (pkt.getfieldval("fcf_panidcompress") == 0):
+            return True
+        return False
+    dot15d4_module.util_srcpanid_present = _fixed_util_srcpanid_present
+except ImportError:
+    Dot15d4 = None
+
+# Frames per "!B" batch, must not exceed CONFIG_WPAN_SERIAL_TX_BATCH_MAX
+BATCH_MAX = 8
+# Bytes per "!B" batch before SLIP encoding, must not exceed
+# CONFIG_WPAN_SERIAL_SLIP_RX_BUF_SIZE or the radio drops the whole message
+BATCH_BYTES_MAX = 512
+
+# Largest message from the serial-radio, a "!Y" container
+SERIAL_MSG_MAX = 2048
 
 # SLIP constants
 SLIP_END = 0o300
@@ -36,12 +59,81 @@ SLIP_ESC = 0o333
 SLIP_ESC_END = 0o334
 SLIP_ESC_ESC = 0o335
 
+# Radio frame metadata of "!X" frames and "!Y" containers
+META_LEN = 10
+
+# 6LoWPAN dispatch of an uncompressed IPv6 header
+DISPATCH_IPV6 = 0x41
+
+# Energy detection scan: ms per channel, and the level of unscanned channels
+ED_SCAN_MS = 50
+ED_NONE = 127
+
+# Neighbor table as in the native bridge: learned entries age out after
+# NEIGHBOR_TIMEOUT_S, unknown addresses are solicited NEIGHBOR_SOLICIT_MAX
+# times, NEIGHBOR_RETRANS_S apart, holding at most NEIGHBOR_HOLD_MAX packets
+NEIGHBOR_TIMEOUT_S = 600
+NEIGHBOR_SOLICIT_MAX = 3
+NEIGHBOR_RETRANS_S = 1.0
+NEIGHBOR_HOLD_MAX = 4
+
+# Destination of multicast packets, short broadcast address (big-endian)
+BROADCAST = b'\xff\xff'
+
+def parse_mhr(frame):
+    """Header length, source addressing mode and source address of a 2003
+    or 2006 data frame without security, or None"""
+    if len(frame) < 3:
+        return None
+    fcf = frame[0] | frame[1] << 8
+    # Data frame, no security, no IEs, version 2003 or 2006
+    if fcf & 0x7 != 1 or fcf & 0x0208 or fcf >> 12 & 0x3 > 1:
+        return None
+    dst_mode = fcf >> 10 & 0x3
+    src_mode = fcf >> 14 & 0x3
+    if dst_mode == 1 or src_mode == 1:
+        return None
+
+    off = 3
+    if dst_mode:
+        off += 2 + (8 if dst_mode == 3 else 2)
+    if src_mode and not (fcf & 0x40 and dst_mode):
+        off += 2
+    src_len = 8 if src_mode == 3 else 2 if src_mode else 0
+    if len(frame) < off + src_len:
+        return None
+    src = int.from_bytes(frame[off:off + src_len], 'little')
+    return off + src_len, src_mode, src
+
+def icmpv6_checksum(src, dst, msg):
+    """Checksum of an ICMPv6 message over the IPv6 pseudo-header"""
+    data = src + dst + struct.pack('>I3xB', len(msg), 58) + msg
+    if len(data) & 1:
+        data += b'\0'
+    total = sum(struct.unpack(f'>{len(data) // 2}H', data))
+    while total >> 16:
+        total = (total & 0xffff) + (total >> 16)
+    return ~total & 0xffff
+
+def addr_str(ip6):
+    """Text form of a 16-byte IPv6 address"""
+    return socket.inet_ntop(socket.AF_INET6, ip6)
+
+def addr_bytes(text):
+    """16-byte form of a textual IPv6 address"""
+    return socket.inet_pton(socket.AF_INET6, text)
+
 class WPANBridge:
-    def __init__(self, serial_port='/dev/ttyACM2', tun_prefix='48:1516:2342::', pan_id=0xabcd):
+    def __init__(self, serial_port='/dev/ttyACM2', tun_prefix='48:1516:2342::', pan_id=0xabcd,
+                 channel=None, tun_name='tun0'):
         self.serial_port = serial_port
+        self.tun_name = tun_name
         self.tun_prefix = tun_prefix
         self.pan_id = pan_id
-        self.slip_buffer = b''
+        # None keeps the radio's channel, 'auto' picks the quietest one
+        self.channel = channel
+        # Frames are decoded as they are read, see slip_ring.py
+        self.slip_rx = slip_ring(frame_max=SERIAL_MSG_MAX)
         self.seq = 0
 
         # Open serial
@@ -50,7 +142,7 @@ class WPANBridge:
 
         # Create TUN
         self.tun = self.create_tun()
-        print(f"Created tun0 with prefix {tun_prefix}/64")
+        print(f"Created {tun_name} with prefix {tun_prefix}/64")
 
         # Radio MAC address (will be learned from ?M request)
         self.radio_mac = None
@@ -59,6 +151,23 @@ class WPANBridge:
         # Short address (derived from MAC)
         self.radio_short_addr = None
 
+        # Credit based flow control, unknown until the "!C" reply
+        self.credit_window = None
+        self.credits_freed = 0
+        self.credits_sent = 0
+        self.credit_backlog = deque()
+
+        # Destinations of the frames in flight, whose ACKs from the radio
+        # carry the frame pending bit ("!J"), by seq and frame count
+        self.inflight = {}
+        self.pending_dst = {}
+
+        # MAC address (big-endian, 2 or 8 bytes) and expiry by IPv6 address,
+        # learned from the source addresses of received frames
+        self.neighbors = {}
+        # Packets to addresses being solicited: [probes, next probe, packets]
+        self.unresolved = {}
+
     def create_tun(self):
         """Create and configure TUN interface"""
         TUNSETIFF = 0x400454ca
@@ -66,34 +175,19 @@ class WPANBridge:
         IFF_NO_PI = 0x1000
 
         tun = open('/dev/net/tun', 'r+b', buffering=0)
-        ifr = struct.pack('16sH', b'tun0', IFF_TUN | IFF_NO_PI)
+        ifr = struct.pack('16sH', self.tun_name.encode(), IFF_TUN | IFF_NO_PI)
         fcntl.ioctl(tun, TUNSETIFF, ifr)
 
+        # Non-blocking, so that all queued packets can be drained at once
+        flags = fcntl.fcntl(tun, fcntl.F_GETFL)
+        fcntl.fcntl(tun, fcntl.F_SETFL, flags | os.O_NONBLOCK)
+
         # Configure interface
-        os.system('ip link set tun0 up')
-        os.system(f'ip -6 addr add {self.tun_prefix}1/64 dev tun0')
+        os.system(f'ip link set {self.tun_name} up')
+        os.system(f'ip -6 addr add {self.tun_prefix}1/64 dev {self.tun_name}')
 
         return tun
 
-    def decode_slip(self, data):
-        """Decode SLIP-encoded data"""
-        result = []
-        i = 0
-        while i < len(data):
-            if data[i] == SLIP_ESC:
-                i += 1
-                if i < len(data):
-                    if data[i] == SLIP_ESC_END:
-                        result.append(SLIP_END)
-                    elif data[i] == SLIP_ESC_ESC:
-                        result.append(SLIP_ESC)
-            elif data[i] == SLIP_END:
-                break
-            else:
-                result.append(data[i])
-            i += 1
-        return bytes(result)
-
     def encode_slip(self, data):
         """Encode data with SLIP"""
         result = []
@@ -108,7 +202,7 @@ class WPANBridge:
         return bytes(result)
 
     def handle_radio_packet(self, decoded):
-        """Handle packet received from radio"""
+        """Handle packet received from radio, valid until the next read"""
         if len(decoded) < 2:
             return
 
@@ -122,7 +216,7 @@ class WPANBridge:
             if cmd == 'M':
                 # MAC address report (in big-endian)
                 if len(payload) >= 8:
-                    self.radio_mac_be = payload[:8]
+                    self.radio_mac_be = bytes(payload[:8])
                     # Convert to little-endian for internal use
                     self.radio_mac = bytes(reversed(self.radio_mac_be))
 
@@ -136,17 +230,114 @@ class WPANBridge:
                 # Packet report (seq, status, num_tx)
                 if len(payload) >= 3:
                     seq, status, num_tx = payload[0], payload[1], payload[2]
-                    if status == 0:
-                        print(f"  TX success: seq={seq}")
-                    else:
-                        print(f"  TX error: seq={seq} status={status}")
+                    self.print_report(seq, status, num_tx)
+
+            elif cmd == 'B':
+                # Batch report (count, then seq, status, num_tx per frame)
+                count = payload[0] if payload else 0
+                for i in range(min(count, (len(payload) - 1) // 3)):
+                    seq, status, num_tx = payload[1 + 3 * i:4 + 3 * i]
+                    self.print_report(seq, status, num_tx)
+
+            elif cmd == 'C':
+                # Credits (window, flags, messages released as be16)
+                if len(payload) >= 4:
+                    self.credit_window = payload[0]
+                    self.credits_freed = struct.unpack('>H', payload[2:4])[0]
+                    self.flush_credit_backlog()
+
+            elif cmd == 'A':
+                # Aggregation reply (mode, max frames per container)
+                if len(payload) >= 2:
+                    print(f"Radio frame aggregation: mode={payload[0]} max={payload[1]}")
+
+            elif cmd == 'E':
+                # Metadata reply (mode, fields, radio time as be64 ns)
+                if len(payload) >= 10:
+                    print(f"Radio frame metadata: mode={payload[0]} fields=0x{payload[1]:02x}")
+
+            elif cmd == 'J':
+                # Pending table reply (op, status, applied by the radio)
+                if len(payload) >= 3 and payload[0] == ord('A'):
+                    print(f"Radio frame pending bit: status={payload[1]} hw={payload[2]}")
+
+            elif cmd == 'L':
+                # Energy scan (first channel, count, dBm per channel)
+                if len(payload) >= 2:
+                    self.select_channel(payload)
+
+            elif cmd == 'X':
+                # Frame with metadata (LQI, RSSI, RX timestamp)
+                if len(payload) >= META_LEN:
+                    self.handle_radio_frame(payload[META_LEN:],
+                                            self.radio_meta(payload))
+
+            elif cmd in ('F', 'Y'):
+                # Container (count, then length, "!Y" metadata and frame per frame)
+                off = 1
+                for _ in range(payload[0] if payload else 0):
+                    length = payload[off]
+                    off += 1
+                    meta = None
+                    if cmd == 'Y':
+                        meta = self.radio_meta(payload[off:])
+                        off += META_LEN
+                    self.handle_radio_frame(payload[off:off + length], meta)
+                    off += length
 
             return
 
         # Otherwise it's a data packet - should be 802.15.4 frame
+        self.handle_radio_frame(decoded)
+
+    def select_channel(self, payload):
+        """Switch to the channel with the least energy of a "!L" scan"""
+        first, count = payload[0], payload[1]
+        levels = struct.unpack(f'{count}b', payload[2:2 + count])
+        energy = {first + i: level for i, level in enumerate(levels)
+                  if level != ED_NONE}
+        if not energy:
+            print("Radio cannot scan for energy, keeping its channel")
+            return
+
+        print("Channel energy: " + " ".join(f"{c}:{l}" for c, l in sorted(energy.items())))
+
+        # Ties go to the highest channel, 26 overlaps the fewest Wi-Fi channels
+        self.channel = min(sorted(energy, reverse=True), key=energy.get)
+        self.send_message(b'!C' + bytes([self.channel]))
+        print(f"-> Switching to channel {self.channel} ({energy[self.channel]} dBm)")
+
+    def radio_meta(self, data):
+        """LQI, RSSI in dBm and radio RX timestamp in ns"""
+        return struct.unpack('>BbQ', data[:META_LEN])
+
+    def handle_radio_frame(self, decoded, meta=None):
+        """Handle an 802.15.4 frame received by the radio"""
+        if meta:
+            lqi, rssi, timestamp = meta
+            print(f"  Link: lqi={lqi} rssi={rssi} dBm rx_time={timestamp} ns")
+
+        # The radio passes frames on without their FCS
+        mhr = parse_mhr(decoded)
+        if mhr and len(decoded) > mhr[0] and decoded[mhr[0]] == DISPATCH_IPV6:
+            hdr_len, src_mode, src_addr = mhr
+            ipv6_bytes = bytes(decoded[hdr_len + 1:])
+            if len(ipv6_bytes) < 40:
+                print(f"  Truncated IPv6 packet, len={len(ipv6_bytes)}")
+                return
+            self.tun.write(ipv6_bytes)
+            self.learn(src_mode, src_addr, ipv6_bytes)
+            print(f"<- Radio: {addr_str(ipv6_bytes[8:24])} -> "
+                  f"{addr_str(ipv6_bytes[24:40])} (uncompressed)")
+            return
+
+        if Dot15d4 is None:
+            print("  Frame needs Scapy to be decoded, dropped")
+            return
+
         try:
             # Parse as 802.15.4 frame
-            frame = Dot15d4FCS(decoded)
+            frame = Dot15d4(bytes(decoded))
 
             # Check if it contains 6LoWPAN data
             if frame.haslayer(LoWPAN_IPHC):
@@ -156,19 +347,14 @@ class WPANBridge:
                 # Write to TUN
                 ipv6_bytes = bytes(ipv6_pkt)
                 self.tun.write(ipv6_bytes)
+                if mhr:
+                    self.learn(mhr[1], mhr[2], ipv6_bytes)
 
                 src = ipv6_pkt.src
                 dst = ipv6_pkt.dst
                 proto = ipv6_pkt.nh if hasattr(ipv6_pkt, 'nh') else '?'
                 print(f"<- Radio: {src} -> {dst} proto={proto} len={len(ipv6_bytes)}")
 
-            elif frame.haslayer(IPv6):
-                # Uncompressed IPv6 (rare, but possible)
-                ipv6_pkt = frame[IPv6]
-                ipv6_bytes = bytes(ipv6_pkt)
-                self.tun.write(ipv6_bytes)
-                print(f"<- Radio: {ipv6_pkt.src} -> {ipv6_pkt.dst} (uncompressed)")
-
             else:
                 print("  Unknown frame type received from radio")
 
@@ -177,41 +363,106 @@ class WPANBridge:
             # Print hex dump for debugging
             print(f"  Raw: {decoded[:40].hex()}")
 
-    def mac_from_ipv6_bytes(self, dst_bytes):
-        """Extract MAC address from IPv6 address bytes (16 bytes)"""
-
-        # Extract last 8 bytes (interface identifier)
-        iid = dst_bytes[8:]
-
-        # Reverse EUI-64: flip bit 7 of first byte and remove ff:fe in middle
-        mac = bytearray()
-        mac.append(iid[0] ^ 0x02)  # Flip universal/local bit
-        mac.append(iid[1])
-        mac.append(iid[2])
-        # Skip iid[3:5] (should be 0xff, 0xfe)
-        mac.append(iid[5])
-        mac.append(iid[6])
-        mac.append(iid[7])
-
-        return bytes(mac)
-
-    def mac_from_ipv6(self, ipv6_addr):
-        """Extract MAC address from IPv6 address string"""
-        addr_obj = ipaddress.IPv6Address(ipv6_addr)
-        return self.mac_from_ipv6_bytes(addr_obj.packed)
-
-    def send_to_radio_raw(self, ipv6_bytes, dest_mac):
-        """Send raw IPv6 bytes to radio via wpan_serial protocol"""
-
-        print(f"Sending to radio: len={len(ipv6_bytes)}")
+    def print_report(self, seq, status, num_tx):
+        """Print a packet report; status is a Contiki MAC_TX_* code"""
+        self.release_pending(seq)
+        if status == 0:
+            print(f"  TX success: seq={seq} num_tx={num_tx}")
+        else:
+            print(f"  TX error: seq={seq} status={status} num_tx={num_tx}")
+
+    def learn(self, mode, addr, ipv6_bytes):
+        """Map the source address of a received packet to its sender's MAC"""
+        src = ipv6_bytes[8:24]
+        # Unspecified and multicast sources say nothing about the sender
+        if mode not in (2, 3) or src[0] == 0xff or not any(src):
+            return
 
+        mac = addr.to_bytes(2 if mode == 2 else 8, 'big')
+        if src not in self.neighbors:
+            print(f"  Learned {addr_str(src)} at {mac.hex(':')}")
+        self.neighbors[src] = (mac, time.monotonic() + NEIGHBOR_TIMEOUT_S)
+
+        # Send what was held while the address was solicited
+        entry = self.unresolved.pop(src, None)
+        if entry:
+            self.send_packets([(p, mac) for p in entry[2]])
+
+    def resolve(self, dst):
+        """MAC address of an IPv6 destination, or None if it is not known"""
+        if dst[0] == 0xff:
+            return BROADCAST
+
+        entry = self.neighbors.get(dst)
+        if entry is None:
+            return None
+        if entry[1] <= time.monotonic():
+            del self.neighbors[dst]
+            return None
+        return entry[0]
+
+    def hold(self, ipv6_bytes, dst):
+        """Hold a packet to an unknown address, and solicit the address"""
+        entry = self.unresolved.get(dst)
+        if entry is None:
+            entry = self.unresolved[dst] = [0, 0, []]
+            self.solicit(dst, entry)
+        if len(entry[2]) < NEIGHBOR_HOLD_MAX:
+            entry[2].append(ipv6_bytes)
+        else:
+            print(f"  Dropped packet to unresolved {addr_str(dst)}")
+
+    def solicit(self, dst, entry):
+        """Broadcast a neighbor solicitation for dst"""
+        entry[0] += 1
+        entry[1] = time.monotonic() + NEIGHBOR_RETRANS_S
+
+        # Link-local addresses are solicited from the radio's own
+        if dst[:2] == b'\xfe\x80':
+            src = b'\xfe\x80' + bytes(6) + bytes([self.radio_mac_be[0] ^ 0x02]) + \
+                  self.radio_mac_be[1:]
+        else:
+            src = addr_bytes(self.tun_prefix + '1')
+        snm = b'\xff\x02' + bytes(9) + b'\x01\xff' + dst[13:]
+        # Source link-layer address option of RFC 4944, padded to 16 bytes
+        sllao = b'\x01\x02' + self.radio_mac_be + bytes(6)
+
+        # Type 135, code 0, checksum, reserved, target, option
+        icmp = bytearray(b'\x87\x00\x00\x00' + bytes(4) + dst + sllao)
+        struct.pack_into('>H', icmp, 2, icmpv6_checksum(src, snm, icmp))
+        # Version 6, payload length, next header ICMPv6, hop limit 255
+        ns = struct.pack('>IHBB', 6 << 28, len(icmp), 58, 255) + src + snm + icmp
+        print(f"-> Radio: who has {addr_str(dst)}?")
+        self.send_to_radio_raw(ns, BROADCAST)
+
+    def expire_unresolved(self):
+        """Solicit again, or drop the packets to addresses that never answered"""
+        now = time.monotonic()
+        for dst, entry in list(self.unresolved.items()):
+            if entry[1] > now:
+                continue
+            if entry[0] < NEIGHBOR_SOLICIT_MAX:
+                self.solicit(dst, entry)
+                continue
+            print(f"  No answer from {addr_str(dst)}, dropped {len(entry[2])} packets")
+            del self.unresolved[dst]
+
+    def build_frame(self, ipv6_bytes, dest_mac):
+        """Build an 802.15.4 frame carrying raw IPv6 bytes"""
         # Build 802.15.4 frame manually as bytes to avoid Scapy issues
         frame_bytes = bytearray()
 
         # Frame Control Field (2 bytes)
-        # FCF: Data(1), NoSec(0), NoPend(0), NoAck(0), PanCompress(1),
-        # DestAddrExt(3), Ver(1=2006), SrcAddrExt(3)
-        fcf = 0xDC41  # Data frame, PAN ID compress, extended addressing
+        # FCF: Data(1), NoSec(0), NoPend(0), AckReq(1), PanCompress(1),
+        # DestAddrExt(3) or DestAddrShort(2), Ver(1=2006), SrcAddrExt(3)
+        # The radio awaits the ACK and retransmits without one, broadcasts
+        # are not acknowledged
+        if dest_mac == BROADCAST:
+            fcf = 0xD841
+        elif len(dest_mac) == 2:
+            fcf = 0xD861
+        else:
+            fcf = 0xDC61
         frame_bytes.extend(struct.pack('<H', fcf))
 
         # Sequence number (1 byte)
@@ -220,7 +471,7 @@ class WPANBridge:
         # Destination PAN ID (2 bytes)
         frame_bytes.extend(struct.pack('<H', self.pan_id))
 
-        # Destination address (8 bytes, little-endian)
+        # Destination address (2 or 8 bytes, little-endian)
         frame_bytes.extend(reversed(dest_mac))
 
         # Source address (8 bytes, little-endian)
@@ -234,6 +485,16 @@ class WPANBridge:
 
         print(f" Built 802.15.4 frame; len={len(frame_bytes)}")
 
+        return bytes(frame_bytes)
+
+    def send_to_radio_raw(self, ipv6_bytes, dest_mac):
+        """Send raw IPv6 bytes to radio via wpan_serial protocol"""
+
+        print(f"Sending to radio: len={len(ipv6_bytes)}")
+
+        frame_bytes = self.build_frame(ipv6_bytes, dest_mac)
+        self.track_pending(self.seq, dest_mac)
+
         # Build wpan_serial packet: !S + seq + num_attrs + [attrs] + frame
         packet = bytearray()
         packet.append(ord('!'))
@@ -243,28 +504,121 @@ class WPANBridge:
         packet.extend(frame_bytes)
 
         # Encode and send via SLIP
-        slip_data = self.encode_slip(bytes(packet))
-        self.ser.write(slip_data)
+        self.send_message(bytes(packet))
 
         print(f"-> Radio: seq={self.seq} len={len(frame_bytes)} dest={dest_mac.hex(':')}")
         self.seq = (self.seq + 1) % 256
 
+    def send_batch_to_radio(self, packets):
+        """Send several (ipv6_bytes, dest_mac) in one "!B" SLIP message"""
+
+        # Build wpan_serial packet: !B + count + [seq + len + frame]*
+        packet = bytearray(b'!B')
+        packet.append(len(packets))
+
+        for ipv6_bytes, dest_mac in packets:
+            frame_bytes = self.build_frame(ipv6_bytes, dest_mac)
+            self.track_pending(self.seq, dest_mac)
+            packet.append(self.seq)
+            packet.append(len(frame_bytes))
+            packet.extend(frame_bytes)
+            self.seq = (self.seq + 1) % 256
+
+        self.send_message(bytes(packet))
+
+        print(f"-> Radio: batch of {len(packets)} frames")
+
+    def track_pending(self, seq, dest_mac):
+        """Set the frame pending bit for dest_mac until its frame is reported"""
+        # A report for a reused seq is lost, release its destination
+        self.release_pending(seq)
+        if dest_mac == BROADCAST:
+            return
+        self.inflight[seq] = dest_mac
+        count = self.pending_dst.get(dest_mac, 0)
+        if not count:
+            self.send_message(b'!JP' + self.addr_mode(dest_mac) + dest_mac)
+        self.pending_dst[dest_mac] = count + 1
+
+    def release_pending(self, seq):
+        """Drop the destination of a reported frame from the pending table"""
+        dest_mac = self.inflight.pop(seq, None)
+        if dest_mac is None:
+            return
+        self.pending_dst[dest_mac] -= 1
+        if not self.pending_dst[dest_mac]:
+            del self.pending_dst[dest_mac]
+            self.send_message(b'!JR' + self.addr_mode(dest_mac) + dest_mac)
+
+    def addr_mode(self, mac):
+        """Addressing mode of a MAC address for "!J": 2 short, 3 extended"""
+        return b'\x02' if len(mac) == 2 else b'\x03'
+
+    def request_ack_pending(self):
+        """Let the radio's ACKs tell polling nodes that frames are coming"""
+        self.send_message(b'!JA\x01')
+        print("-> Requesting frame pending bit...")
+
     def request_mac(self):
         """Request MAC address from radio"""
-        packet = b'?M'
-        slip_data = self.encode_slip(packet)
-        self.ser.write(slip_data)
+        self.send_message(b'?M')
         print("-> Requesting MAC address...")
 
+    def send_message(self, packet):
+        """Send a message, or hold it back while no credit is left"""
+        self.credit_backlog.append(packet)
+        self.flush_credit_backlog()
+
+    def flush_credit_backlog(self):
+        """Send held back messages as far as the credits allow"""
+        while self.credit_backlog:
+            if self.credit_window is not None and \
+               (self.credits_sent - self.credits_freed) & 0xffff >= self.credit_window:
+                print(f"  Out of credits, holding {len(self.credit_backlog)} messages")
+                return
+
+            self.ser.write(self.encode_slip(self.credit_backlog.popleft()))
+            self.credits_sent = (self.credits_sent + 1) & 0xffff
+
+    def request_credits(self):
+        """Enable credit based flow control"""
+        # The firmware counts released messages from this request on
+        self.ser.write(self.encode_slip(b'?C'))
+        self.credits_sent = 1
+        print("-> Requesting credits...")
+
+    def request_aggregation(self):
+        """Let the radio coalesce frames into "!F" containers when backlogged"""
+        self.send_message(b'!A\x01')
+        print("-> Requesting radio frame aggregation...")
+
+    def request_metadata(self):
+        """Let the radio pass LQI, RSSI and RX timestamps with each frame"""
+        self.send_message(b'!E\x01')
+        print("-> Requesting radio frame metadata...")
+
+    def request_channel(self):
+        """Set the configured channel, or scan for the quietest one"""
+        if self.channel == 'auto':
+            self.send_message(b'?L' + struct.pack('>H', ED_SCAN_MS))
+            print("-> Scanning channels...")
+        elif self.channel is not None:
+            self.send_message(b'!C' + bytes([self.channel]))
+            print(f"-> Setting channel {self.channel}")
+
     def run(self):
         """Main loop"""
         print("\n=== WPAN Bridge Running! ===\n")
 
-        # Request MAC address
+        # Request credits, then the MAC address and the channel
+        self.request_credits()
         self.request_mac()
+        self.request_channel()
+        self.request_aggregation()
+        self.request_metadata()
+        self.request_ack_pending()
 
         # Wait a bit for MAC to be received
-        import time
         time.sleep(0.5)
 
         if not self.radio_mac:
@@ -277,52 +631,103 @@ class WPANBridge:
             # Handle serial data (from radio)
             if self.ser in readable:
                 print("Reading from serial...")
-                data = self.ser.read(4096)
-                if data:
-                    self.slip_buffer += data
-
-                    # Process complete SLIP packets
-                    while SLIP_END in self.slip_buffer:
-                        end_idx = self.slip_buffer.index(SLIP_END)
-                        slip_packet = self.slip_buffer[:end_idx+1]
-                        self.slip_buffer = self.slip_buffer[end_idx+1:]
-
-                        decoded = self.decode_slip(slip_packet)
-                        if decoded:
-                            self.handle_radio_packet(decoded)
+                for decoded in self.slip_rx.read(self.ser.fileno()):
+                    self.handle_radio_packet(decoded)
 
             # Handle TUN data (from Linux)
             if self.tun in readable:
                 print("Reading from TUN...")
+                pending = self.read_tun_packets()
+
+                if not self.radio_mac:
+                    if pending:
+                        print("  Skipping: Radio MAC not known yet")
+                else:
+                    self.send_packets(self.resolve_packets(pending))
+
+            if self.unresolved:
+                self.expire_unresolved()
+
+    def send_packets(self, packets):
+        """Send (ipv6_bytes, dest_mac) alone or in batches"""
+        batch = []
+        size = 3
+        for ipv6_bytes, dest_mac in packets:
+            # Seq, length and the frame as built by build_frame()
+            entry = 2 + 14 + len(dest_mac) + len(ipv6_bytes)
+            if batch and (len(batch) == BATCH_MAX or size + entry > BATCH_BYTES_MAX):
+                self.send_batch(batch)
+                batch = []
+                size = 3
+            batch.append((ipv6_bytes, dest_mac))
+            size += entry
+        if batch:
+            self.send_batch(batch)
+
+    def send_batch(self, packets):
+        """Send one frame as "!S", several as one "!B" batch"""
+        if len(packets) == 1:
+            self.send_to_radio_raw(*packets[0])
+        else:
+            self.send_batch_to_radio(packets)
+
+    def resolve_packets(self, packets):
+        """Address packets to known neighbors, hold the others"""
+        resolved = []
+        for ipv6_bytes in packets:
+            dst = ipv6_bytes[24:40]
+            dest_mac = self.resolve(dst)
+            if dest_mac is None:
+                self.hold(ipv6_bytes, dst)
+            else:
+                resolved.append((ipv6_bytes, dest_mac))
+        return resolved
+
+    def read_tun_packets(self):
+        """Drain the TUN device, return a list of IPv6 packets"""
+        pending = []
+
+        while True:
+            try:
                 ipv6_data = self.tun.read(1500)
-                if ipv6_data:
-                    try:
-                        ipv6_pkt = IPv6(ipv6_data)
+            except BlockingIOError:
+                break
 
-                        # Determine destination MAC from IPv6 address
-                        dest_mac = self.mac_from_ipv6(ipv6_pkt.dst)
+            if not ipv6_data:
+                break
+
+            if len(ipv6_data) < 40 or ipv6_data[0] >> 4 != 6:
+                print(f"TUN error: not an IPv6 packet, len={len(ipv6_data)}")
+                continue
 
-                        print(f"-> TUN: {ipv6_pkt.src} -> {ipv6_pkt.dst} len={len(ipv6_pkt)}")
+            print(f"-> TUN: {addr_str(ipv6_data[8:24])} -> "
+                  f"{addr_str(ipv6_data[24:40])} len={len(ipv6_data)}")
 
-                        if self.radio_mac:
-                            # self.send_to_radio(ipv6_pkt, dest_mac)
-                            self.send_to_radio_raw(ipv6_data, dest_mac)
-                        else:
-                            print("  Skipping: Radio MAC not known yet")
+            pending.append(ipv6_data)
 
-                    except Exception as e:
-                        print(f"TUN error: {e}")
+        return pending
 
 def main():
+    parser = argparse.ArgumentParser(description="Bridge a wpan_serial radio to a TUN interface")
+    parser.add_argument("-d", "--device", "--port", dest="port", default="/dev/ttyACM2", help="serial port of the radio")
+    parser.add_argument("-i", "--tun", default="tun0", help="TUN interface to create")
+    parser.add_argument("-p", "--prefix", default="48:1516:2342::", help="/64 prefix of the network")
+    parser.add_argument("-P", "--pan", type=lambda v: int(v, 0), default=0xabcd, help="PAN ID")
+    # 'auto' for the quietest channel, nodes must be built for it
+    parser.add_argument("-c", "--channel", help="channel, or 'auto' (default: keep the radio's)")
+    args = parser.parse_args()
+
     if os.geteuid() != 0:
         print("Error: Must run as root (for TUN interface)")
         sys.exit(1)
 
     try:
         bridge = WPANBridge(
-            serial_port='/dev/ttyACM2',
-            tun_prefix='48:1516:2342::',
-            pan_id=0xabcd
+            serial_port=args.port,
+            tun_prefix=args.prefix,
+            pan_id=args.pan,
+            channel=args.channel if args.channel in (None, 'auto') else int(args.channel),
+            tun_name=args.tun
         )
         bridge.run()
     except KeyboardInterrupt:
@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+"""
+wpan-capture.py - Capture 802.15.4 traffic through a serial-radio
+
+Switches the serial-radio into promiscuous capture mode with "!P" and
+writes every received frame to a pcapng file as it arrives. The frames
+come in "!K" containers whose compact header carries the channel, LQI,
+RSSI and a 32-bit RX timestamp in us, which is extended with the clock
+value of the "!P" reply and converted to host wall-clock time.
+
+By default the link type is IEEE 802.15.4 TAP (283), so Wireshark shows
+channel, LQI and RSSI of every frame; --plain writes bare frames without
+FCS (230) for tools that do not know TAP. Write to stdout for a live view:
+
+    ./wpan-capture.py /dev/ttyACM0 --channel 26 -w - | wireshark -k -i -
+
+The frame filter of the serial-radio narrows the capture down before
+frames take up the serial link, e.g. to one PAN and two senders:
+
+    ./wpan-capture.py /dev/ttyACM0 --pan 0xabcd --allow 0x0001 \
+        --allow 00:12:4b:00:01:02:03:04 -w pan.pcapng
+
+A frame that arrives while the link is idle comes in a container of its
+own; while the link is backlogged, the firmware packs all waiting frames
+into one container, which is what keeps up with a busy channel.
+"""
+
+import argparse
+import signal
+import struct
+import sys
+import time
+
+import serial
+
+# SLIP constants
+SLIP_END = 0o300
+SLIP_ESC = 0o333
+SLIP_ESC_END = 0o334
+SLIP_ESC_ESC = 0o335
+
+# "!P" flags
+PROMISC_FLAG_PROMISCUOUS = 1
+PROMISC_FLAG_RX_ON_IDLE = 2
+PROMISC_FLAG_CAPTURE = 4
+
+# "!G" frame filter: addressing modes and reply status
+ADDR_MODE_SHORT = 2
+ADDR_MODE_EXT = 3
+FILTER_STATUS = {0: "ok", 1: "invalid", 2: "list full"}
+
+# "!K" capture header behind each length: channel, LQI, RSSI, be32 us
+CAPTURE_INFO = struct.Struct('>BBbI')
+
+# pcapng link types
+LINKTYPE_IEEE802_15_4_NOFCS = 230
+LINKTYPE_IEEE802_15_4_TAP = 283
+
+# IEEE 802.15.4 TAP TLVs
+TAP_FCS_TYPE = 0
+TAP_RSS = 1
+TAP_CHANNEL = 3
+TAP_LQI = 10
+
+RSSI_UNKNOWN = -128
+
+
+def encode_slip(data):
+    """Encode data with SLIP"""
+    data = data.replace(bytes([SLIP_ESC]), bytes([SLIP_ESC, SLIP_ESC_ESC]))
+    data = data.replace(bytes([SLIP_END]), bytes([SLIP_ESC, SLIP_ESC_END]))
+    return data + bytes([SLIP_END])
+
+
+def decode_slip(data):
+    """Decode a single SLIP frame without its trailing SLIP_END"""
+    data = data.replace(bytes([SLIP_ESC, SLIP_ESC_END]), bytes([SLIP_END]))
+    return data.replace(bytes([SLIP_ESC, SLIP_ESC_ESC]), bytes([SLIP_ESC]))
+
+
+def pad4(data):
+    return data + bytes(-len(data) % 4)
+
+
+def pcapng_block(block_type, body):
+    length = 12 + len(body)
+    return struct.pack('<II', block_type, length) + body + \
+        struct.pack('<I', length)
+
+
+def tap_tlv(tlv_type, value):
+    return pad4(struct.pack('<HH', tlv_type, len(value)) + value)
+
+
+class PcapngWriter:
+    """Section header, one interface and an enhanced packet per frame"""
+
+    def __init__(self, out, tap):
+        self.out = out
+        self.tap = tap
+        linktype = (LINKTYPE_IEEE802_15_4_TAP if tap
+                    else LINKTYPE_IEEE802_15_4_NOFCS)
+
+        shb = struct.pack('<IHHq', 0x1A2B3C4D, 1, 0, -1)
+        # if_tsresol 6: timestamps in us
+        idb = struct.pack('<HHI', linktype, 0, 256) + \
+            pad4(struct.pack('<HHB', 9, 1, 6)) + struct.pack('<HH', 0, 0)
+        out.write(pcapng_block(0x0A0D0D0A, shb))
+        out.write(pcapng_block(1, idb))
+
+    def frame(self, ts_us, frame, channel, lqi, rssi):
+        if self.tap:
+            tlvs = tap_tlv(TAP_FCS_TYPE, bytes([0]))
+            if rssi != RSSI_UNKNOWN:
+                tlvs += tap_tlv(TAP_RSS, struct.pack('<f', rssi))
+            tlvs += tap_tlv(TAP_CHANNEL, struct.pack('<HB', channel, 0))
+            tlvs += tap_tlv(TAP_LQI, bytes([lqi]))
+            frame = struct.pack('<BBH', 0, 0, 4 + len(tlvs)) + tlvs + frame
+
+        epb = struct.pack('<IIIII', 0, ts_us >> 32, ts_us & 0xffffffff,
+                          len(frame), len(frame)) + pad4(frame)
+        self.out.write(pcapng_block(6, epb))
+
+
+class Clock:
+    """Extends the 32-bit capture timestamps to host wall-clock time"""
+
+    def __init__(self, capture_now_ns):
+        self.last = capture_now_ns // 1000
+        self.offset = time.time_ns() // 1000 - self.last
+
+    def wall_us(self, ts32):
+        diff = (ts32 - self.last) & 0xffffffff
+        if diff >= 1 << 31:
+            # Received before the last one, e.g. queued before "!P"
+            diff -= 1 << 32
+        self.last += diff
+        return self.last + self.offset
+
+
+def transact(ser, request, reply, min_len, timeout=2.0):
+    """Send a request, return the payload of its reply and what follows"""
+    ser.write(encode_slip(request))
+
+    buf = b''
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        buf += ser.read(256)
+        while bytes([SLIP_END]) in buf:
+            frame, buf = buf.split(bytes([SLIP_END]), 1)
+            frame = decode_slip(frame)
+            if frame[:2] == reply and len(frame) >= 2 + min_len:
+                return frame[2:], buf
+
+    raise TimeoutError(f"No '{reply.decode()}' reply from serial-radio")
+
+
+def parse_addr(text):
+    """Source address for "!G": short (0x1234) or extended (00:12:...)"""
+    if ':' in text or len(text) == 16:
+        addr = bytes.fromhex(text.replace(':', ''))
+        if len(addr) != 8:
+            raise argparse.ArgumentTypeError(f"bad address {text}")
+        return bytes([ADDR_MODE_EXT]) + addr
+    return bytes([ADDR_MODE_SHORT]) + struct.pack('>H', int(text, 16))
+
+
+def set_filter(ser, op, arg=b''):
+    """Apply one "!G" filter operation"""
+    reply, _ = transact(ser, b'!G' + op + arg, b'!G', 3)
+    if reply[1]:
+        raise ValueError(f"filter {op.decode()} {arg.hex()}: "
+                         f"{FILTER_STATUS.get(reply[1], reply[1])}")
+
+
+def capture_frames(frame):
+    """(frame, channel, lqi, rssi, ts32) of a "!K" container"""
+    frames = []
+    off = 3
+    for _ in range(frame[2]):
+        length = frame[off]
+        channel, lqi, rssi, ts32 = CAPTURE_INFO.unpack_from(frame, off + 1)
+        off += 1 + CAPTURE_INFO.size
+        frames.append((frame[off:off + length], channel, lqi, rssi, ts32))
+        off += length
+    return frames
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Capture 802.15.4 frames to pcapng through a serial-radio")
+    parser.add_argument("port", help="Serial port of the serial-radio")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--rtscts", action="store_true",
+                        help="Enable RTS/CTS hardware flow control")
+    parser.add_argument("--channel", type=int,
+                        help="Switch to this channel before capturing")
+    parser.add_argument("-w", "--write", default="-",
+                        help="pcapng file, - for stdout (default)")
+    parser.add_argument("--plain", action="store_true",
+                        help="Write bare frames instead of the TAP link type")
+    parser.add_argument("--pan", type=lambda s: int(s, 16),
+                        help="Capture frames of this PAN ID (hex) only")
+    parser.add_argument("--allow", type=parse_addr, action="append",
+                        default=[], metavar="ADDR",
+                        help="Capture frames from this source only, "
+                             "may be repeated")
+    parser.add_argument("--deny", type=parse_addr, action="append",
+                        default=[], metavar="ADDR",
+                        help="Drop frames from this source, may be repeated")
+    parser.add_argument("--duration", type=float, default=0.0,
+                        help="Stop after this many seconds (default: never)")
+    args = parser.parse_args()
+
+    ser = serial.Serial(args.port, args.baud, timeout=0.1,
+                        rtscts=args.rtscts)
+    ser.reset_input_buffer()
+
+    if args.channel is not None:
+        ser.write(encode_slip(b'!C' + bytes([args.channel])))
+
+    set_filter(ser, b'C')
+    if args.pan is not None:
+        set_filter(ser, b'P', struct.pack('>H', args.pan))
+    for addr in args.allow:
+        set_filter(ser, b'A', addr)
+    for addr in args.deny:
+        set_filter(ser, b'D', addr)
+
+    mode = (PROMISC_FLAG_PROMISCUOUS | PROMISC_FLAG_RX_ON_IDLE |
+            PROMISC_FLAG_CAPTURE)
+    reply, buf = transact(ser, b'!P' + bytes([mode]), b'!P', 9)
+    if not reply[0] & PROMISC_FLAG_PROMISCUOUS:
+        print("Radio does not support promiscuous mode, capturing frames "
+              "addressed to it only", file=sys.stderr)
+    clock = Clock(struct.unpack('>Q', reply[1:9])[0])
+
+    out = sys.stdout.buffer if args.write == '-' else open(args.write, 'wb')
+    writer = PcapngWriter(out, not args.plain)
+
+    running = True
+
+    def stop(signum, frame):
+        nonlocal running
+        running = False
+
+    signal.signal(signal.SIGINT, stop)
+    signal.signal(signal.SIGTERM, stop)
+
+    frames = 0
+    skipped = 0
+    start = time.monotonic()
+    try:
+        while running and (not args.duration or
+                           time.monotonic() - start < args.duration):
+            buf += ser.read(max(1, ser.in_waiting))
+            *slip_frames, buf = buf.split(bytes([SLIP_END]))
+            for frame in slip_frames:
+                frame = decode_slip(frame)
+                if frame[:2] != b'!K' or len(frame) < 3:
+                    # Frames queued before the switch, or replies
+                    if frame[:1] not in (b'!', b'?'):
+                        skipped += 1
+                    continue
+                for radio_frame, channel, lqi, rssi, ts32 in \
+                        capture_frames(frame):
+                    writer.frame(clock.wall_us(ts32), radio_frame,
+                                 channel, lqi, rssi)
+                    frames += 1
+            if slip_frames:
+                out.flush()
+    except BrokenPipeError:
+        # The reader, e.g. Wireshark, has gone away
+        pass
+
+    elapsed = time.monotonic() - start
+
+    # Back to normal reception, then ask how many frames were dropped
+    ser.write(encode_slip(b'!P' + bytes([PROMISC_FLAG_RX_ON_IDLE])))
+    ser.write(encode_slip(b'!GC'))
+    try:
+        queues, _ = transact(ser, b'?Q', b'!Q', 40)
+        dropped = struct.unpack('>I', queues[24:28])[0]
+    except TimeoutError:
+        dropped = None
+
+    print(f"{frames} frames in {elapsed:.1f} s "
+          f"({frames / max(elapsed, 1e-3):.1f} frames/s), "
+          f"{skipped} before capture started, "
+          f"{'unknown' if dropped is None else dropped} dropped by firmware "
+          f"since boot", file=sys.stderr)
+
+    if out is not sys.stdout.buffer:
+        out.close()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""
+wpan-scan.py - Find the least congested 802.15.4 channel with a serial-radio
+
+Runs energy detection scans ("?L") over channels 11-26 and prints the
+energy of every channel in dBm, the highest seen over all rounds, so
+that bursty neighbors are not missed. The quietest channel is printed
+last, and with --set the serial-radio is switched to it:
+
+    ./wpan-scan.py /dev/ttyACM0 --rounds 10 --set
+
+Nodes have their channel built in (CONFIG_NET_CONFIG_IEEE802154_CHANNEL),
+so they need to be rebuilt for the channel picked.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+import serial
+
+# SLIP constants
+SLIP_END = 0o300
+SLIP_ESC = 0o333
+SLIP_ESC_END = 0o334
+SLIP_ESC_ESC = 0o335
+
+# Energy of channels the radio could not scan
+ED_NONE = 127
+
+
+def encode_slip(data):
+    """Encode data with SLIP"""
+    data = data.replace(bytes([SLIP_ESC]), bytes([SLIP_ESC, SLIP_ESC_ESC]))
+    data = data.replace(bytes([SLIP_END]), bytes([SLIP_ESC, SLIP_ESC_END]))
+    return data + bytes([SLIP_END])
+
+
+def decode_slip(data):
+    """Decode a single SLIP frame without its trailing SLIP_END"""
+    data = data.replace(bytes([SLIP_ESC, SLIP_ESC_END]), bytes([SLIP_END]))
+    return data.replace(bytes([SLIP_ESC, SLIP_ESC_ESC]), bytes([SLIP_ESC]))
+
+
+def scan(ser, duration_ms):
+    """One scan round, {channel: dBm} of the channels that were scanned"""
+    ser.write(encode_slip(b'?L' + struct.pack('>H', duration_ms)))
+
+    buf = b''
+    deadline = time.monotonic() + 16 * duration_ms / 1000 + 2.0
+    while time.monotonic() < deadline:
+        buf += ser.read(256)
+        while bytes([SLIP_END]) in buf:
+            frame, buf = buf.split(bytes([SLIP_END]), 1)
+            frame = decode_slip(frame)
+            if frame[:2] != b'!L' or len(frame) < 4:
+                continue
+            first, count = frame[2], frame[3]
+            levels = struct.unpack(f'{count}b', frame[4:4 + count])
+            return {first + i: level for i, level in enumerate(levels)
+                    if level != ED_NONE}
+
+    raise TimeoutError("No '!L' reply from serial-radio")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Energy detection scan with a serial-radio")
+    parser.add_argument("port", help="Serial port of the serial-radio")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--duration", type=int, default=50,
+                        help="Scan time per channel and round in ms "
+                             "(default: 50)")
+    parser.add_argument("--rounds", type=int, default=4,
+                        help="Scan rounds (default: 4)")
+    parser.add_argument("--set", action="store_true",
+                        help="Switch the serial-radio to the quietest channel")
+    args = parser.parse_args()
+
+    ser = serial.Serial(args.port, args.baud, timeout=0.1)
+    ser.reset_input_buffer()
+
+    energy = {}
+    for _ in range(args.rounds):
+        for channel, level in scan(ser, args.duration).items():
+            energy[channel] = max(level, energy.get(channel, level))
+
+    if not energy:
+        print("Radio cannot scan for energy", file=sys.stderr)
+        return 1
+
+    for channel in sorted(energy):
+        level = energy[channel]
+        print(f"  {channel:2d} {level:5d} dBm {'#' * max(0, level + 100)}")
+
+    # Ties go to the highest channel, 26 overlaps the fewest Wi-Fi channels
+    quietest = min(sorted(energy, reverse=True), key=energy.get)
+    print(f"quietest channel: {quietest}")
+
+    if args.set:
+        ser.write(encode_slip(b'!C' + bytes([quietest])))
+        ser.flush()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,608 @@
+#!/usr/bin/env python3
+"""
+wpan-serial-bench.py - Serial link throughput benchmark for wpan_serial_uart
+
+Streams SLIP encoded "!N" sink frames to the serial-radio as fast as the
+UART accepts them and reads the firmware link counters ("?D") before and
+after the run. The sink frames are decoded and counted by the firmware but
+never reach the radio, so the result reflects the UART receive path only.
+
+With --credits the frames are paced by the firmware's "!C" credits, and
+--rtscts enables hardware flow control on the port; under saturation no
+frame should then be lost, and the frame rate is the goodput ceiling.
+
+With --stress the input rate is raised step by step up to the line rate,
+which shows the highest rate the serial-radio sustains without loss, the
+fill of its interrupt byte ring and, with CONFIG_WPAN_SERIAL_RX_ISR_TIMING,
+the interrupt time per received byte.
+
+With --switch-baud the UART rate is negotiated with "?U" first, and the
+result is compared with the frame rate the 250 kbit/s radio could carry.
+
+With --framing cobs the link is switched to COBS framing with a CRC-16
+("?V") before the run. Comparing the frame rate of both framings, with
+and without --escapes, shows the goodput each leaves of the line rate.
+
+Run it once against an IRQ build and once against a build with
+overlay-async.conf to compare both receive paths, e.g.:
+
+    ./wpan-serial-bench.py /dev/ttyACM0 --label irq
+    ./wpan-serial-bench.py /dev/ttyACM0 --label dma
+
+With --direction tx the script only listens: it counts the frames the
+serial-radio forwards from the radio (generate traffic with another node)
+and reports the radio-to-UART latency measured by the firmware. Add
+--aggregate to let the firmware coalesce backlogged frames into "!F"
+containers, and compare the frame rate against a run without it.
+--metadata has every frame carry its LQI, RSSI and radio RX timestamp,
+from which the script reports the link quality and the RX-to-host delay.
+The time frames and control replies waited in their TX priority class
+("?Q") is reported as well.
+"""
+
+import argparse
+import binascii
+import os
+import struct
+import sys
+import time
+
+import serial
+
+# SLIP constants
+SLIP_END = 0o300
+SLIP_ESC = 0o333
+SLIP_ESC_END = 0o334
+SLIP_ESC_ESC = 0o335
+
+# Link framings of "?V"; COBS frames end with a CRC-16 and a 0x00
+FRAMING_SLIP = 0
+FRAMING_COBS = 1
+FRAMINGS = {"slip": FRAMING_SLIP, "cobs": FRAMING_COBS}
+COBS_DELIM = 0
+COBS_BLOCK_MAX = 254
+
+# Framing in use on the link, changed by switch_framing()
+framing = FRAMING_SLIP
+
+# 802.15.4 O-QPSK: 32 us per byte, PHY header of 6 bytes, FCS of 2 bytes
+RADIO_US_PER_BYTE = 32
+RADIO_OVERHEAD = 6 + 2
+
+# "!E" frame metadata: LQI, RSSI, RX timestamp (be64 ns)
+META_LEN = 10
+META_FLAG_TIMESTAMP = 4
+
+STATS_FIELDS = ("rx_bytes", "rx_frames", "rx_dropped_bytes",
+                "rx_overruns", "tx_frames", "tx_bytes",
+                "tx_latency_count", "tx_latency_sum_us", "tx_latency_max_us",
+                "tx_containers", "tx_aggregated", "tx_backlog",
+                "tx_backlog_max", "rx_no_buf", "rx_ring_max",
+                "rx_ring_overruns", "rx_isr_us", "radio_filtered",
+                "rx_crc_errors")
+
+# "?Q" counters of each TX priority class
+QUEUE_CLASSES = ("ctrl", "data")
+QUEUE_FIELDS = ("depth", "dropped", "delay_count", "delay_sum_us",
+                "delay_max_us")
+
+
+def encode_slip(data):
+    """Encode data with SLIP"""
+    data = data.replace(bytes([SLIP_ESC]), bytes([SLIP_ESC, SLIP_ESC_ESC]))
+    data = data.replace(bytes([SLIP_END]), bytes([SLIP_ESC, SLIP_ESC_END]))
+    return data + bytes([SLIP_END])
+
+
+def decode_slip(data):
+    """Decode a single SLIP frame without its trailing SLIP_END"""
+    data = data.replace(bytes([SLIP_ESC, SLIP_ESC_END]), bytes([SLIP_END]))
+    return data.replace(bytes([SLIP_ESC, SLIP_ESC_ESC]), bytes([SLIP_ESC]))
+
+
+def encode_cobs(data):
+    """Encode data and its CRC-16 with COBS"""
+    data += struct.pack('>H', binascii.crc_hqx(data, 0xffff))
+    out = bytearray()
+    for block in data.split(bytes([COBS_DELIM])):
+        while len(block) >= COBS_BLOCK_MAX:
+            out += bytes([COBS_BLOCK_MAX + 1]) + block[:COBS_BLOCK_MAX]
+            block = block[COBS_BLOCK_MAX:]
+        out += bytes([len(block) + 1]) + block
+    return bytes(out) + bytes([COBS_DELIM])
+
+
+def decode_cobs(data):
+    """Decode a single COBS frame without its delimiter
+
+    Returns None if the frame is truncated or its CRC does not match.
+    """
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        block = data[i + 1:i + code]
+        if len(block) < code - 1:
+            return None
+        out += block
+        i += code
+        if code <= COBS_BLOCK_MAX and i < len(data):
+            out.append(0)
+    if len(out) < 2 or binascii.crc_hqx(bytes(out), 0xffff):
+        return None
+    return bytes(out[:-2])
+
+
+def encode_frame(data):
+    """Encode data in the framing of the link"""
+    if framing == FRAMING_COBS:
+        return encode_cobs(data)
+    return encode_slip(data)
+
+
+def split_frames(buf):
+    """Split received bytes into decoded frames and the incomplete rest
+
+    Empty and corrupted frames are left out.
+    """
+    if framing == FRAMING_COBS:
+        delim, decode = COBS_DELIM, decode_cobs
+    else:
+        delim, decode = SLIP_END, decode_slip
+    *frames, rest = buf.split(bytes([delim]))
+    return [f for f in map(decode, frames) if f], rest
+
+
+def transact(ser, request, reply, min_len, timeout=2.0):
+    """Send a request and return the payload of its reply"""
+    ser.reset_input_buffer()
+    ser.write(encode_frame(request))
+
+    buf = b''
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        buf += ser.read(256)
+        frames, buf = split_frames(buf)
+        for frame in frames:
+            if frame[:2] == reply and len(frame) >= 2 + min_len:
+                return frame[2:]
+
+    raise TimeoutError(f"No '{reply.decode()}' reply from serial-radio")
+
+
+def read_stats(ser):
+    """Request and parse the firmware link counters"""
+    size = 4 * len(STATS_FIELDS)
+    values = struct.unpack(f'>{len(STATS_FIELDS)}I',
+                           transact(ser, b'?D', b'!D', size)[:size])
+    return dict(zip(STATS_FIELDS, values))
+
+
+def read_queue_stats(ser):
+    """Request and parse the counters of the TX priority classes"""
+    n = len(QUEUE_FIELDS)
+    size = 4 * n * len(QUEUE_CLASSES)
+    values = struct.unpack(f'>{n * len(QUEUE_CLASSES)}I',
+                           transact(ser, b'?Q', b'!Q', size)[:size])
+    return {cls: dict(zip(QUEUE_FIELDS, values[i * n:(i + 1) * n]))
+            for i, cls in enumerate(QUEUE_CLASSES)}
+
+
+def switch_baud(ser, baud, confirm_timeout=0.8):
+    """Negotiate a new UART rate with "?U", return True once confirmed"""
+    old = ser.baudrate
+    request = b'?U' + struct.pack('>I', baud)
+
+    reply = transact(ser, request, b'!U', 5)
+    if reply[4] != 0:
+        print(f"{baud} baud not supported by the serial-radio")
+        return False
+
+    # The serial-radio switches once its reply has left, follow it
+    ser.baudrate = baud
+    time.sleep(0.01)
+
+    deadline = time.monotonic() + confirm_timeout
+    while time.monotonic() < deadline:
+        try:
+            reply = transact(ser, request, b'!U', 5, timeout=0.1)
+        except TimeoutError:
+            continue
+        if struct.unpack('>I', reply[:4])[0] == baud and reply[4] == 0:
+            return True
+
+    # Not confirmed, the serial-radio falls back on its own
+    print(f"{baud} baud not confirmed, back to {old}")
+    ser.baudrate = old
+    transact(ser, b'?U' + struct.pack('>I', old), b'!U', 5)
+    return False
+
+
+def link_delimiter():
+    """Delimiter the decoder of the link framing resynchronizes on"""
+    return bytes([COBS_DELIM if framing == FRAMING_COBS else SLIP_END])
+
+
+def switch_framing(ser, mode, confirm_timeout=0.8):
+    """Negotiate the link framing with "?V", return True once confirmed"""
+    global framing
+    old = framing
+    request = b'?V' + bytes([mode])
+
+    reply = transact(ser, request, b'!V', 2)
+    if reply[1] != 0:
+        print(f"Framing {mode} not supported by the serial-radio")
+        return False
+
+    # The reply came in the old framing, everything after it is in the
+    # new one, whose decoder waits for a delimiter first
+    framing = mode
+    ser.write(link_delimiter())
+
+    deadline = time.monotonic() + confirm_timeout
+    while time.monotonic() < deadline:
+        try:
+            reply = transact(ser, request, b'!V', 2, timeout=0.1)
+        except TimeoutError:
+            continue
+        if reply[0] == mode and reply[1] == 0:
+            return True
+
+    # Not confirmed, the serial-radio falls back on its own
+    print(f"Framing {mode} not confirmed, back to {old}")
+    framing = old
+    time.sleep(0.5)
+    ser.write(link_delimiter())
+    return False
+
+
+def set_aggregation(ser, enable):
+    """Switch "!F" containers on or off, return the frames per container"""
+    reply = transact(ser, b'!A' + bytes([enable]), b'!A', 2)
+    return reply[1]
+
+
+def set_metadata(ser, enable):
+    """Switch frame metadata on or off
+
+    Returns the supported fields and the offset from the radio clock to
+    time.monotonic_ns(); the offset includes the delay of the reply.
+    """
+    reply = transact(ser, b'!E' + bytes([enable]), b'!E', 10)
+    radio_now = struct.unpack('>Q', reply[2:10])[0]
+    return reply[1], time.monotonic_ns() - radio_now
+
+
+class Credits:
+    """Host side of the "!C" credit based flow control"""
+
+    def __init__(self, ser):
+        self.ser = ser
+        self.buf = b''
+        self.window = 0
+        self.rtscts = False
+        self.freed = 0
+        # Messages sent since and including the "?C" request
+        self.sent = 1
+        ser.write(encode_frame(b'?C'))
+
+        deadline = time.monotonic() + 2.0
+        while not self.window:
+            if time.monotonic() > deadline:
+                raise TimeoutError("No '!C' reply from serial-radio")
+            self.poll(block=True)
+
+    def poll(self, block=False):
+        """Process "!C" updates received so far"""
+        if block:
+            data = self.ser.read(max(1, self.ser.in_waiting))
+        else:
+            data = self.ser.read(self.ser.in_waiting)
+        self.buf += data
+
+        frames, self.buf = split_frames(self.buf)
+        for frame in frames:
+            if frame[:2] == b'!C' and len(frame) >= 6:
+                self.window = frame[2]
+                self.rtscts = bool(frame[3] & 1)
+                self.freed = struct.unpack('>H', frame[4:6])[0]
+
+    def outstanding(self):
+        return (self.sent - self.freed) & 0xffff
+
+    def send(self, msg):
+        """Write an encoded message, waiting for a credit first"""
+        self.poll()
+        while self.outstanding() >= self.window:
+            self.poll(block=True)
+        self.ser.write(msg)
+        self.sent += 1
+
+
+def radio_meta(data):
+    """LQI, RSSI in dBm and radio RX timestamp in ns of "!E" metadata"""
+    return struct.unpack('>BbQ', data[:META_LEN])
+
+
+def radio_frames(frame):
+    """Split a message from the serial-radio into (frame, metadata)"""
+    if frame[:2] in (b'!F', b'!Y') and len(frame) >= 3:
+        frames = []
+        off = 3
+        for _ in range(frame[2]):
+            length = frame[off]
+            off += 1
+            info = None
+            if frame[1] == ord('Y'):
+                info = radio_meta(frame[off:])
+                off += META_LEN
+            frames.append((frame[off:off + length], info))
+            off += length
+        return frames
+
+    if frame[:2] == b'!X' and len(frame) >= 2 + META_LEN:
+        return [(frame[2 + META_LEN:], radio_meta(frame[2:]))]
+
+    if frame[:1] in (b'!', b'?'):
+        return []
+
+    return [(frame, None)]
+
+
+def make_frame(size, escapes):
+    """Build a sink frame; with escapes every payload byte needs SLIP escaping"""
+    if escapes:
+        payload = bytes([SLIP_END, SLIP_ESC]) * (size // 2 + 1)
+    else:
+        payload = os.urandom(size)
+    return encode_frame(b'!N' + payload[:size])
+
+
+def stats_delta(before, after):
+    return {k: (after[k] - before[k]) & 0xffffffff for k in STATS_FIELDS}
+
+
+def stream_frames(ser, frame, duration, credits=False, rate=0.0):
+    """Send sink frames for duration s, at rate bytes/s if given
+
+    Returns the frames sent, the elapsed time, the counter deltas and the
+    number of frames the firmware received.
+    """
+    before = read_stats(ser)
+    credits = Credits(ser) if credits else None
+    interval = len(frame) / rate if rate else 0.0
+
+    sent = 0
+    start = time.monotonic()
+    due = start
+    while time.monotonic() - start < duration:
+        if interval:
+            delay = due - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            due += interval
+        if credits:
+            credits.send(frame)
+        else:
+            ser.write(frame)
+        sent += 1
+    ser.flush()
+    elapsed = time.monotonic() - start
+
+    # Let the decoder drain whatever is still queued
+    time.sleep(0.5)
+    delta = stats_delta(before, read_stats(ser))
+
+    # The '?D' and '?C' requests are counted as well
+    received = delta["rx_frames"] - 1 - (1 if credits else 0)
+
+    return sent, elapsed, delta, received
+
+
+def isr_ns_per_byte(delta):
+    """Interrupt time per received byte, None without RX_ISR_TIMING"""
+    if not delta["rx_isr_us"] or not delta["rx_bytes"]:
+        return None
+    return delta["rx_isr_us"] * 1000 / delta["rx_bytes"]
+
+
+def bench_rx(ser, args):
+    """Host to serial-radio: stream sink frames into the UART"""
+    frame = make_frame(args.size, args.escapes)
+
+    sent, elapsed, delta, received = stream_frames(ser, frame, args.duration,
+                                                   args.credits)
+
+    print(f"{args.label or args.port}: {len(frame)} B/frame on the wire, "
+          f"{elapsed:.1f} s")
+    print(f"  sent       {sent} frames ({sent / elapsed:.1f} frames/s)")
+    print(f"  received   {received} frames ({received / elapsed:.1f} frames/s)")
+    print(f"  lost       {sent - received} frames")
+    print(f"  dropped    {delta['rx_dropped_bytes']} bytes, "
+          f"{delta['rx_overruns']} overruns, "
+          f"{delta['rx_no_buf']} without buffer, "
+          f"{delta['rx_crc_errors']} CRC errors")
+    if credits:
+        print(f"  credits    window {credits.window}, "
+              f"RTS/CTS {'on' if credits.rtscts else 'off'} in firmware")
+    print(f"  line rate  {delta['rx_bytes'] * 10 / elapsed / 1000:.1f} kbit/s "
+          f"at {ser.baudrate} baud")
+    # Not a counter either, the high watermark covers the whole uptime
+    print(f"  RX ring    max {read_stats(ser)['rx_ring_max']} bytes, "
+          f"{delta['rx_ring_overruns']} overflows")
+    ns = isr_ns_per_byte(delta)
+    if ns:
+        print(f"  RX ISR     {ns:.0f} ns/byte")
+
+    # Frames of this size the radio could send back to back
+    radio_fps = 1e6 / ((args.size + RADIO_OVERHEAD) * RADIO_US_PER_BYTE)
+    bottleneck = "UART" if received / elapsed < radio_fps else "radio"
+    print(f"  radio max  {radio_fps:.1f} frames/s, bottleneck: {bottleneck}")
+
+
+def bench_stress(ser, args):
+    """Host to serial-radio: raise the input rate until bytes are lost"""
+    frame = make_frame(args.size, args.escapes)
+    line_rate = ser.baudrate / 10
+    sustained = 0
+
+    print(f"{args.label or args.port}: {len(frame)} B/frame on the wire, "
+          f"{args.stress} steps of {args.duration:.1f} s at {ser.baudrate} baud")
+    print("  offered     received      lost  ring max  overflows  ISR ns/B")
+    for step in range(1, args.stress + 1):
+        rate = line_rate * step / args.stress
+        sent, elapsed, delta, received = stream_frames(
+            ser, frame, args.duration, rate=rate)
+        ring_max = read_stats(ser)["rx_ring_max"]
+        ns = isr_ns_per_byte(delta)
+        lost = sent - received
+        print(f"  {rate * 8 / 1000:6.1f} kbit/s "
+              f"{received / elapsed:7.1f} fps {lost:6} {ring_max:9} "
+              f"{delta['rx_ring_overruns']:10} "
+              f"{f'{ns:9.0f}' if ns else '        -'}")
+        if not lost and not delta["rx_ring_overruns"] and \
+                not delta["rx_overruns"]:
+            sustained = rate
+
+    if sustained:
+        print(f"  sustained  {sustained * 8 / 1000:.1f} kbit/s without loss")
+    else:
+        print("  sustained  none of the steps without loss")
+
+
+def bench_tx(ser, args):
+    """Serial-radio to host: count forwarded radio frames"""
+    agg_max = set_aggregation(ser, args.aggregate)
+    meta_flags, clock_offset = set_metadata(ser, args.metadata)
+    lqis = []
+    rssis = []
+    delays = []
+    before = read_stats(ser)
+    queues_before = read_queue_stats(ser)
+
+    frames = 0
+    lost = 0
+    dsn = None
+    nbytes = 0
+    buf = b''
+    start = time.monotonic()
+    while time.monotonic() - start < args.duration:
+        data = ser.read(4096)
+        nbytes += len(data)
+        buf += data
+        messages, buf = split_frames(buf)
+        for frame in messages:
+            now = time.monotonic_ns()
+            for radio_frame, info in radio_frames(frame):
+                frames += 1
+                if info:
+                    lqi, rssi, timestamp = info
+                    lqis.append(lqi)
+                    if rssi != -128:
+                        rssis.append(rssi)
+                    if meta_flags & META_FLAG_TIMESTAMP:
+                        delays.append(now - clock_offset - timestamp)
+                if len(radio_frame) < 3:
+                    continue
+                # Sequence number gaps of a single sender are lost frames
+                if dsn is not None:
+                    lost += (radio_frame[2] - dsn - 1) & 0xff
+                dsn = radio_frame[2]
+    elapsed = time.monotonic() - start
+
+    after = read_stats(ser)
+    delta = stats_delta(before, after)
+    count = delta["tx_latency_count"]
+    queues = read_queue_stats(ser)
+
+    print(f"{args.label or args.port}: {elapsed:.1f} s")
+    print(f"  received   {frames} frames ({frames / elapsed:.1f} frames/s)")
+    print(f"  line rate  {nbytes * 10 / elapsed / 1000:.1f} kbit/s")
+    print(f"  lost       {lost} frames (sequence number gaps)")
+    print(f"  forwarded  {delta['tx_frames']} messages by firmware counters")
+    if args.aggregate:
+        containers = delta["tx_containers"]
+        print(f"  containers {containers}, {delta['tx_aggregated']} frames "
+              f"(up to {agg_max} per container)")
+    # Not a counter either, the high watermark covers the whole uptime
+    print(f"  backlog    max {after['tx_backlog_max']} frames")
+    if count:
+        # The maximum is not a counter, it covers the whole uptime
+        print(f"  latency    avg {delta['tx_latency_sum_us'] / count:.0f} us, "
+              f"max {after['tx_latency_max_us']} us")
+    for cls in QUEUE_CLASSES:
+        q = {k: (queues[cls][k] - queues_before[cls][k]) & 0xffffffff
+             for k in ("dropped", "delay_count", "delay_sum_us")}
+        if q["delay_count"]:
+            # The maximum covers the whole uptime, like the latency's
+            print(f"  queue {cls:4} avg {q['delay_sum_us'] / q['delay_count']:.0f} us, "
+                  f"max {queues[cls]['delay_max_us']} us, "
+                  f"{q['dropped']} dropped")
+    if lqis:
+        print(f"  LQI        avg {sum(lqis) / len(lqis):.0f}, "
+              f"min {min(lqis)}")
+    if rssis:
+        print(f"  RSSI       avg {sum(rssis) / len(rssis):.0f} dBm, "
+              f"min {min(rssis)} dBm")
+    if delays:
+        # Relative to the "!E" reply, whose own delay is not known
+        base = min(delays)
+        avg = (sum(delays) / len(delays) - base) / 1000
+        print(f"  RX delay   avg {avg:.0f} us, "
+              f"max {(max(delays) - base) / 1000:.0f} us above the minimum")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure serial-radio UART throughput")
+    parser.add_argument("port", help="Serial port of the serial-radio")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--size", type=int, default=127,
+                        help="Payload bytes per frame (default: 127)")
+    parser.add_argument("--switch-baud", type=int, default=0,
+                        help="Negotiate this UART rate before the run")
+    parser.add_argument("--framing", choices=FRAMINGS, default="slip",
+                        help="Switch the link to this framing before the run")
+    parser.add_argument("--duration", type=float, default=10.0,
+                        help="Benchmark duration in seconds")
+    parser.add_argument("--escapes", action="store_true",
+                        help="Use worst-case payloads that are fully escaped")
+    parser.add_argument("--direction", choices=("rx", "tx"), default="rx",
+                        help="rx: host to serial-radio, tx: radio to host")
+    parser.add_argument("--aggregate", action="store_true",
+                        help="tx: coalesce backlogged frames into containers")
+    parser.add_argument("--metadata", action="store_true",
+                        help="tx: report LQI, RSSI and RX timestamps")
+    parser.add_argument("--stress", type=int, default=0, metavar="STEPS",
+                        help="rx: raise the input rate to the line rate in "
+                             "this many steps of --duration each")
+    parser.add_argument("--credits", action="store_true",
+                        help="rx: pace frames by the firmware's credits")
+    parser.add_argument("--rtscts", action="store_true",
+                        help="Enable RTS/CTS hardware flow control")
+    parser.add_argument("--label", default="",
+                        help="Label printed with the result, e.g. irq or dma")
+    args = parser.parse_args()
+
+    ser = serial.Serial(args.port, args.baud, timeout=0.1,
+                        rtscts=args.rtscts)
+
+    if args.switch_baud and not switch_baud(ser, args.switch_baud):
+        return 1
+
+    if FRAMINGS[args.framing] != framing and \
+            not switch_framing(ser, FRAMINGS[args.framing]):
+        return 1
+
+    if args.direction == "rx" and args.stress:
+        bench_stress(ser, args)
+    elif args.direction == "rx":
+        bench_rx(ser, args)
+    else:
+        bench_tx(ser, args)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
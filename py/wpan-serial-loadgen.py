@@ -0,0 +1,451 @@
+#!/usr/bin/env python3
+"""
+wpan-serial-loadgen.py - Load generator for serial-radios on native_sim
+
+Sends "!S" data frames to a serial-radio at a fixed rate and receives
+them back from the simulated 802.15.4 medium, either directly by
+attaching to the medium directory (--air) or through a second
+serial-radio (--rx). Every frame carries a counter and the host time it
+was sent at, from which the script reports the frame rate, the p50/p99
+host-to-air-to-host latency and the frames that never arrived.
+
+Start one native_sim build per node, all with the same --air directory,
+and pass the pseudo terminals they print, e.g.:
+
+    ./zephyr.exe --air=/tmp/wpan-air
+    ./wpan-serial-loadgen.py --tx /dev/pts/3 --rate 200 --duration 10
+
+The simulated medium is ideal and the radio transmits back to back, so
+the results reflect the serial-radio and its host link only.
+
+With --rx, the receiving serial-radio's histogram of its radio-to-UART
+latency ("?H") is printed as well, per forwarding path. Compare runs
+with and without --cut-through to see what the queue and the TX thread
+cost:
+
+    ./wpan-serial-loadgen.py --tx /dev/pts/3 --rx /dev/pts/4 --cut-through
+
+With --ack (and --rx), frames are addressed to the receiving radio with
+the AR bit set instead of broadcast. The receiving radio acknowledges
+them itself, the sending one awaits the ACKs and retransmits, and the
+ACK counters of both ("?J") are printed.
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+import serial
+
+# SLIP constants
+SLIP_END = 0o300
+SLIP_ESC = 0o333
+SLIP_ESC_END = 0o334
+SLIP_ESC_ESC = 0o335
+
+# "!E" frame metadata: LQI, RSSI, RX timestamp (be64 ns)
+META_LEN = 10
+
+# Broadcast data frame, PAN ID compression, short addresses
+FRAME_FCF = bytes([0x41, 0x88])
+FRAME_PAN = 0xabcd
+FRAME_SRC = 0x0001
+FRAME_HDR_LEN = 9
+FCS_LEN = 2
+
+# With --ack: AR bit set, to this short address of the receiving radio
+FRAME_FCF_AR = bytes([0x61, 0x88])
+FRAME_DST = 0x0002
+
+# "!J" 'S' ACK counters, in order
+ACK_FIELDS = ("rx_acked", "rx_pending", "rx_retries", "tx_ack_requested",
+              "tx_acked", "tx_noack", "tx_retries", "tx_pending",
+              "ack_wait_count", "ack_wait_sum_us", "ack_wait_max_us")
+
+# "!H" latency histogram: paths, upper bound of bucket 0 in us
+HIST_PATHS = ("queued", "cut-through")
+HIST_BASE_US = 128
+
+# Payload: magic, be32 counter, be64 host time in ns
+LOAD_MAGIC = b'LG'
+LOAD_LEN = len(LOAD_MAGIC) + 4 + 8
+
+
+def encode_slip(data):
+    """Encode data with SLIP"""
+    data = data.replace(bytes([SLIP_ESC]), bytes([SLIP_ESC, SLIP_ESC_ESC]))
+    data = data.replace(bytes([SLIP_END]), bytes([SLIP_ESC, SLIP_ESC_END]))
+    return data + bytes([SLIP_END])
+
+
+def decode_slip(data):
+    """Decode a single SLIP frame without its trailing SLIP_END"""
+    data = data.replace(bytes([SLIP_ESC, SLIP_ESC_END]), bytes([SLIP_END]))
+    return data.replace(bytes([SLIP_ESC, SLIP_ESC_ESC]), bytes([SLIP_ESC]))
+
+
+def radio_frames(frame):
+    """Radio frames carried by a SLIP frame from the serial-radio"""
+    if frame[:2] in (b'!F', b'!Y') and len(frame) >= 3:
+        frames = []
+        off = 3
+        for _ in range(frame[2]):
+            length = frame[off]
+            off += 1
+            if frame[1] == ord('Y'):
+                off += META_LEN
+            frames.append(frame[off:off + length])
+            off += length
+        return frames
+
+    if frame[:2] == b'!X':
+        return [frame[2 + META_LEN:]]
+
+    if frame[:1] in (b'!', b'?'):
+        return []
+
+    return [frame]
+
+
+def make_frame(seq, counter, size, ack=False):
+    """802.15.4 broadcast frame of size bytes without FCS"""
+    fcf, dst = (FRAME_FCF_AR, FRAME_DST) if ack else (FRAME_FCF, 0xffff)
+    hdr = fcf + bytes([seq]) + struct.pack('<HHH', FRAME_PAN, dst, FRAME_SRC)
+    payload = LOAD_MAGIC + struct.pack('>IQ', counter, time.monotonic_ns())
+    return hdr + payload + bytes(size - FRAME_HDR_LEN - LOAD_LEN)
+
+
+def ack_stats_reply(frame):
+    """Counters of a "!J" 'S' reply, or None"""
+    size = 4 * len(ACK_FIELDS)
+    if frame[:3] != b'!JS' or len(frame) < 4 + size:
+        return None
+    return dict(zip(ACK_FIELDS,
+                    struct.unpack(f'>{len(ACK_FIELDS)}I', frame[4:4 + size])))
+
+
+def parse_frame(frame):
+    """Counter and send time of a load frame, or None"""
+    payload = frame[FRAME_HDR_LEN:FRAME_HDR_LEN + LOAD_LEN]
+    if len(payload) < LOAD_LEN or payload[:2] != LOAD_MAGIC:
+        return None
+    return struct.unpack('>IQ', payload[2:])
+
+
+class Receiver(threading.Thread):
+    """Collects the load frames coming back, with their latency"""
+
+    def __init__(self):
+        super().__init__(daemon=True)
+        self.lock = threading.Lock()
+        self.latencies = {}
+        self.duplicates = 0
+        self.running = True
+
+    def frame(self, frame, now):
+        info = parse_frame(frame)
+        if not info:
+            return
+        counter, sent = info
+        with self.lock:
+            if counter in self.latencies:
+                self.duplicates += 1
+            else:
+                self.latencies[counter] = now - sent
+
+
+class AirReceiver(Receiver):
+    """Attached to the simulated medium like another native_sim node"""
+
+    def __init__(self, air_dir, channel):
+        super().__init__()
+        self.channel = channel
+        self.path = os.path.join(air_dir, f"loadgen-{os.getpid()}")
+        os.makedirs(air_dir, exist_ok=True)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self.sock.bind(self.path)
+        self.sock.settimeout(0.1)
+
+    def run(self):
+        try:
+            while self.running:
+                try:
+                    data = self.sock.recv(256)
+                except socket.timeout:
+                    continue
+                # Channel, then the PSDU with its FCS
+                if len(data) > 1 + FCS_LEN and data[0] == self.channel:
+                    self.frame(data[1:-FCS_LEN], time.monotonic_ns())
+        finally:
+            self.sock.close()
+            os.unlink(self.path)
+
+
+class SerialReceiver(Receiver):
+    """Frames forwarded by a second serial-radio"""
+
+    def __init__(self, ser):
+        super().__init__()
+        self.ser = ser
+        self.hist = None
+        self.hist_event = threading.Event()
+        self.ack_stats = None
+        self.ack_event = threading.Event()
+
+    def run(self):
+        buf = b''
+        while self.running:
+            buf += self.ser.read(max(1, self.ser.in_waiting))
+            *frames, buf = buf.split(bytes([SLIP_END]))
+            now = time.monotonic_ns()
+            for frame in frames:
+                frame = decode_slip(frame)
+                if frame[:2] == b'!H' and len(frame) >= 3:
+                    self.hist_reply(frame[2:])
+                    continue
+                if frame[:2] == b'!J':
+                    self.ack_stats = ack_stats_reply(frame)
+                    self.ack_event.set()
+                    continue
+                for radio_frame in radio_frames(frame):
+                    self.frame(radio_frame, now)
+
+    def hist_reply(self, payload):
+        n = payload[0]
+        values = struct.unpack(f'>{n * len(HIST_PATHS)}I',
+                               payload[1:1 + 4 * n * len(HIST_PATHS)])
+        self.hist = [values[i * n:(i + 1) * n]
+                     for i in range(len(HIST_PATHS))]
+        self.hist_event.set()
+
+    def read_hist(self, timeout=2.0):
+        """Latency histogram of the serial-radio, None without a reply"""
+        self.hist_event.clear()
+        self.ser.write(encode_slip(b'?H'))
+        if not self.hist_event.wait(timeout):
+            return None
+        return self.hist
+
+    def read_ack_stats(self, timeout=2.0):
+        """ACK counters of the serial-radio, None without a reply"""
+        self.ack_event.clear()
+        self.ser.write(encode_slip(b'?J'))
+        if not self.ack_event.wait(timeout):
+            return None
+        return self.ack_stats
+
+
+class Sender:
+    """Sends "!S" frames and keeps track of "!R" reports and "!C" credits"""
+
+    def __init__(self, ser, credits):
+        self.ser = ser
+        self.buf = b''
+        self.reports = 0
+        self.failed = {}
+        self.window = 0
+        self.freed = 0
+        self.sent = 0
+        self.ack_stats = None
+        if credits:
+            self.sent = 1
+            ser.write(encode_slip(b'?C'))
+            deadline = time.monotonic() + 2.0
+            while not self.window:
+                if time.monotonic() > deadline:
+                    raise TimeoutError("No '!C' reply from serial-radio")
+                self.poll(block=True)
+
+    def poll(self, block=False):
+        """Process replies received so far"""
+        if block:
+            data = self.ser.read(max(1, self.ser.in_waiting))
+        else:
+            data = self.ser.read(self.ser.in_waiting)
+        self.buf += data
+
+        *frames, self.buf = self.buf.split(bytes([SLIP_END]))
+        for frame in frames:
+            frame = decode_slip(frame)
+            if frame[:2] == b'!R' and len(frame) >= 5:
+                self.reports += 1
+                if frame[3] != 0:
+                    self.failed[frame[3]] = self.failed.get(frame[3], 0) + 1
+            elif frame[:2] == b'!C' and len(frame) >= 6:
+                self.window = frame[2]
+                self.freed = struct.unpack('>H', frame[4:6])[0]
+            elif frame[:3] == b'!JS':
+                self.ack_stats = ack_stats_reply(frame)
+
+    def read_ack_stats(self, timeout=2.0):
+        """ACK counters of the serial-radio, None without a reply"""
+        self.ack_stats = None
+        self.ser.write(encode_slip(b'?J'))
+        self.sent += 1
+        deadline = time.monotonic() + timeout
+        while self.ack_stats is None and time.monotonic() < deadline:
+            self.poll(block=True)
+        return self.ack_stats
+
+    def send(self, frame, seq):
+        """Send a frame, waiting for a credit first if enabled"""
+        self.poll()
+        if self.window:
+            while (self.sent - self.freed) & 0xffff >= self.window:
+                self.poll(block=True)
+        self.ser.write(encode_slip(b'!S' + bytes([seq, 0]) + frame))
+        self.sent += 1
+
+
+def percentile(values, p):
+    return values[int(p * (len(values) - 1))]
+
+
+def print_hist(before, after):
+    """Frames per latency bucket and path forwarded during the run"""
+    for path, old, new in zip(HIST_PATHS, before, after):
+        counts = [b - a for a, b in zip(old, new)]
+        if not sum(counts):
+            continue
+        print(f"  firmware   {path}, radio to UART:")
+        for i, count in enumerate(counts):
+            if not count:
+                continue
+            if i == len(counts) - 1:
+                bound = f">= {HIST_BASE_US << (i - 1)} us"
+            else:
+                bound = f"<  {HIST_BASE_US << i} us"
+            print(f"    {bound:>12} {count:8d}")
+
+
+def print_ack_stats(tx, rx):
+    """ACK counters of both serial-radios, as (before, after) pairs"""
+    wait_max = tx[1]["ack_wait_max_us"]
+    tx = {k: (tx[1][k] - tx[0][k]) & 0xffffffff for k in ACK_FIELDS}
+    rx = {k: (rx[1][k] - rx[0][k]) & 0xffffffff for k in ACK_FIELDS}
+    wait = tx["ack_wait_sum_us"] / max(1, tx["ack_wait_count"])
+    print(f"  acks sent  {rx['rx_acked']}, {rx['rx_retries']} for "
+          f"retransmissions")
+    print(f"  acks rcvd  {tx['tx_acked']} of {tx['tx_ack_requested']} "
+          f"attempts, {tx['tx_noack']} missed, {tx['tx_retries']} retries")
+    print(f"  ack wait   avg {wait:.0f} us, max {wait_max} us since boot")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Load a serial-radio on native_sim with radio frames")
+    parser.add_argument("--tx", required=True,
+                        help="Pseudo terminal of the sending serial-radio")
+    parser.add_argument("--rx",
+                        help="Pseudo terminal of a receiving serial-radio "
+                             "(default: attach to the medium)")
+    parser.add_argument("--air", default="/tmp/wpan-air",
+                        help="Directory of the simulated medium")
+    parser.add_argument("--channel", type=int, default=26,
+                        help="Radio channel (default: 26)")
+    parser.add_argument("--rate", type=float, default=100.0,
+                        help="Frames per second, 0 for back to back")
+    parser.add_argument("--size", type=int, default=64,
+                        help=f"Frame bytes without FCS ({FRAME_HDR_LEN + LOAD_LEN}"
+                             f"-{127 - FCS_LEN}, default: 64)")
+    parser.add_argument("--duration", type=float, default=10.0,
+                        help="Duration in seconds")
+    parser.add_argument("--credits", action="store_true",
+                        help="Pace frames by the firmware's credits")
+    parser.add_argument("--cut-through", action="store_true",
+                        help="Let the receiving serial-radio forward "
+                             "frames cut-through (with --rx)")
+    parser.add_argument("--ack", action="store_true",
+                        help="Address frames to the receiving serial-radio "
+                             "with ACK request (with --rx)")
+    parser.add_argument("--label", default="",
+                        help="Label printed with the result")
+    args = parser.parse_args()
+
+    if not FRAME_HDR_LEN + LOAD_LEN <= args.size <= 127 - FCS_LEN:
+        parser.error("frame size out of range")
+    if args.ack and not args.rx:
+        parser.error("--ack needs --rx")
+
+    tx = serial.Serial(args.tx, 115200, timeout=0.1)
+    channel = bytes([args.channel])
+    tx.write(encode_slip(b'!C' + channel))
+
+    if args.rx:
+        rx = serial.Serial(args.rx, 115200, timeout=0.1)
+        rx.write(encode_slip(b'!C' + channel))
+        rx.write(encode_slip(b'!T' + bytes([args.cut_through])))
+        if args.ack:
+            rx.write(encode_slip(b'!GS' + struct.pack('>H', FRAME_DST)))
+        receiver = SerialReceiver(rx)
+    else:
+        receiver = AirReceiver(args.air, args.channel)
+    receiver.start()
+
+    hist = receiver.read_hist() if args.rx else None
+
+    sender = Sender(tx, args.credits)
+    if args.ack:
+        acks = ([sender.read_ack_stats()], [receiver.read_ack_stats()])
+    interval = 1.0 / args.rate if args.rate else 0.0
+
+    sent = 0
+    start = time.monotonic()
+    due = start
+    while time.monotonic() - start < args.duration:
+        if interval:
+            delay = due - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            due += interval
+        sender.send(make_frame(sent & 0xff, sent, args.size, args.ack),
+                    sent & 0xff)
+        sent += 1
+    tx.flush()
+    elapsed = time.monotonic() - start
+
+    # Let the frames still in flight arrive
+    deadline = time.monotonic() + 1.0
+    while time.monotonic() < deadline:
+        sender.poll(block=True)
+    if hist:
+        hist = (hist, receiver.read_hist())
+    if args.ack:
+        acks[0].append(sender.read_ack_stats())
+        acks[1].append(receiver.read_ack_stats())
+    receiver.running = False
+    receiver.join()
+
+    with receiver.lock:
+        latencies = sorted(receiver.latencies.values())
+    received = len(latencies)
+
+    print(f"{args.label or args.tx}: {args.size} B/frame, {elapsed:.1f} s, "
+          f"rate {'max' if not args.rate else f'{args.rate:g}/s'}")
+    print(f"  sent       {sent} frames ({sent / elapsed:.1f} frames/s)")
+    print(f"  received   {received} frames ({received / elapsed:.1f} frames/s)")
+    print(f"  dropped    {sent - received} frames")
+    if receiver.duplicates:
+        print(f"  duplicates {receiver.duplicates} frames")
+    failed = sum(sender.failed.values())
+    print(f"  reports    {sender.reports}, {failed} failed"
+          + "".join(f", status {s}: {n}"
+                    for s, n in sorted(sender.failed.items())))
+    if latencies:
+        print(f"  latency    p50 {percentile(latencies, 0.5) / 1000:.0f} us, "
+              f"p99 {percentile(latencies, 0.99) / 1000:.0f} us, "
+              f"max {latencies[-1] / 1000:.0f} us")
+    if hist and hist[1]:
+        print_hist(*hist)
+    if args.ack and None not in acks[0] + acks[1]:
+        print_ack_stats(*acks)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
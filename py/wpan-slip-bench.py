@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+"""
+wpan-slip-bench.py - SLIP receive throughput of the Python host tools
+
+Feeds a recorded serial capture, the raw SLIP bytes the serial-radio sent
+to the host, through the bridge's receive path and reports MB/s:
+
+  legacy   the loop py/wpan-bridge.py used: the buffer grows with +=, is
+           sliced after every frame and each frame is decoded byte by byte
+           into a list, which takes quadratic time in the burst size
+  python   slip_ring.PySlipRing, frames found with bytes.find()
+  native   slip_ring.NativeSlipRing, the firmware's decoder from
+           libslipring.so, frames as memoryviews of its arena
+  read     the same, reading the capture with read(2) straight into it
+
+Every decoder must yield the same frames. Without a capture, one of
+"!X" frames with metadata and "!R" reports is generated, with as many
+escapes as random frame contents have, and --record keeps it:
+
+    make -C apps/common/serial_radio/bridge libslipring.so
+    ./wpan-slip-bench.py --record /tmp/radio.slip
+    ./wpan-slip-bench.py /tmp/radio.slip --chunk 4096 --chunk 262144
+
+The legacy loop only gets the first --legacy-mb of the capture, as it
+would take minutes for large bursts otherwise.
+"""
+
+import argparse
+import os
+import random
+import sys
+import tempfile
+import time
+import zlib
+
+import slip_ring
+from slip_ring import SLIP_END, SLIP_ESC, SLIP_ESC_END, SLIP_ESC_ESC
+
+# "!X" frame metadata: LQI, RSSI, RX timestamp (be64 ns)
+META_LEN = 10
+PSDU_MAX = 127
+
+
+def encode_slip(data):
+    data = data.replace(bytes([SLIP_ESC]), bytes([SLIP_ESC, SLIP_ESC_ESC]))
+    data = data.replace(bytes([SLIP_END]), bytes([SLIP_ESC, SLIP_ESC_END]))
+    return data + bytes([SLIP_END])
+
+
+def generate(size):
+    """Radio frames and TX reports as the serial-radio sends them"""
+    rng = random.Random(1)
+    out = bytearray()
+    seq = 0
+
+    while len(out) < size:
+        if rng.random() < 0.2:
+            msg = b"!R" + bytes([seq, 0, rng.randint(1, 4)])
+            seq = (seq + 1) & 0xff
+        else:
+            meta = bytes([rng.randint(0, 255), rng.randint(0, 255)]) + \
+                rng.randbytes(8)
+            msg = b"!X" + meta + rng.randbytes(rng.randint(5, PSDU_MAX))
+        out += encode_slip(msg)
+
+    return bytes(out)
+
+
+def legacy_decode_slip(data):
+    """decode_slip() of the old py/wpan-bridge.py"""
+    result = []
+    i = 0
+    while i < len(data):
+        if data[i] == SLIP_ESC:
+            i += 1
+            if i < len(data):
+                if data[i] == SLIP_ESC_END:
+                    result.append(SLIP_END)
+                elif data[i] == SLIP_ESC_ESC:
+                    result.append(SLIP_ESC)
+        elif data[i] == SLIP_END:
+            break
+        else:
+            result.append(data[i])
+        i += 1
+    return bytes(result)
+
+
+def legacy(capture, chunk, consume):
+    """The serial loop of the old py/wpan-bridge.py"""
+    slip_buffer = b''
+    for off in range(0, len(capture), chunk):
+        slip_buffer += capture[off:off + chunk]
+        while SLIP_END in slip_buffer:
+            end_idx = slip_buffer.index(SLIP_END)
+            slip_packet = slip_buffer[:end_idx + 1]
+            slip_buffer = slip_buffer[end_idx + 1:]
+            decoded = legacy_decode_slip(slip_packet)
+            if decoded:
+                consume(decoded)
+
+
+def ring(capture, chunk, consume, native):
+    for frame in slip_ring.slip_ring(chunk, native=native).feed(capture):
+        consume(frame)
+
+
+def ring_read(path, chunk, consume):
+    rx = slip_ring.slip_ring(chunk, native=True)
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        while True:
+            for frame in rx.read(fd):
+                consume(frame)
+    except BrokenPipeError:
+        pass
+    finally:
+        os.close(fd)
+
+
+class Counter:
+    def __init__(self, digest):
+        self.frames = 0
+        self.bytes = 0
+        self.crc = 0
+        self.digest = digest
+
+    def __call__(self, frame):
+        self.frames += 1
+        self.bytes += len(frame)
+        if self.digest:
+            self.crc = zlib.crc32(frame, self.crc)
+
+
+def measure(run, size, reference):
+    """Check the frames once, then time the best of three runs"""
+    check = Counter(True)
+    run(check)
+    if reference and (check.frames, check.crc) != reference[:2]:
+        print(f"  wrong frames: {check.frames} instead of {reference[0]}")
+        sys.exit(1)
+
+    best = None
+    for _ in range(3):
+        count = Counter(False)
+        start = time.perf_counter()
+        run(count)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+
+    return check, size / best / 1e6, count.frames / best
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="SLIP receive throughput of the Python host tools")
+    parser.add_argument("capture", nargs="?",
+                        help="raw SLIP bytes from the serial-radio "
+                             "(default: generated)")
+    parser.add_argument("--size", type=float, default=8.0, metavar="MB",
+                        help="size of a generated capture (8 MB)")
+    parser.add_argument("--record", metavar="PATH",
+                        help="save the generated capture")
+    parser.add_argument("--chunk", type=int, action="append",
+                        help="bytes per read, repeatable "
+                             "(4096 and 262144)")
+    parser.add_argument("--legacy-mb", type=float, default=1.0,
+                        help="capture the legacy loop decodes (1 MB)")
+    args = parser.parse_args()
+
+    chunks = args.chunk or [4096, 262144]
+    path = args.capture or args.record
+
+    if args.capture:
+        with open(args.capture, "rb") as f:
+            capture = f.read()
+    else:
+        capture = generate(int(args.size * 1e6))
+        if args.record:
+            with open(args.record, "wb") as f:
+                f.write(capture)
+
+    tmp = None
+    if not path:
+        tmp = tempfile.NamedTemporaryFile(suffix=".slip")
+        tmp.write(capture)
+        tmp.flush()
+        path = tmp.name
+
+    size = len(capture)
+    legacy_capture = capture[:int(args.legacy_mb * 1e6)]
+    # Up to the last frame, so the legacy loop yields whole frames only
+    legacy_capture = legacy_capture[:legacy_capture.rfind(SLIP_END) + 1]
+
+    reference = Counter(True)
+    ring(capture, chunks[0], reference, False)
+    reference = (reference.frames, reference.crc)
+    legacy_reference = Counter(True)
+    ring(legacy_capture, chunks[0], legacy_reference, False)
+    legacy_reference = (legacy_reference.frames, legacy_reference.crc)
+
+    print(f"Capture: {size / 1e6:.1f} MB, {reference[0]} frames, "
+          f"native decoder {'built' if slip_ring._lib else 'not built'}")
+    print(f"{'decoder':<8} {'chunk':>8} {'MB':>6} {'MB/s':>9} "
+          f"{'frames/s':>11}")
+
+    for chunk in chunks:
+        runs = [
+            ("legacy", len(legacy_capture), legacy_reference,
+             lambda c: legacy(legacy_capture, chunk, c)),
+            ("python", size, reference,
+             lambda c: ring(capture, chunk, c, False)),
+        ]
+        if slip_ring._lib:
+            runs += [
+                ("native", size, reference,
+                 lambda c: ring(capture, chunk, c, True)),
+                ("read", size, reference,
+                 lambda c: ring_read(path, chunk, c)),
+            ]
+
+        for name, run_size, ref, run in runs:
+            _, mbps, fps = measure(run, run_size, ref)
+            print(f"{name:<8} {chunk:>8} {run_size / 1e6:>6.1f} "
+                  f"{mbps:>9.1f} {fps:>11.0f}")
+
+    if tmp:
+        tmp.close()
+
+
+if __name__ == "__main__":
+    main()